@@ -21,12 +21,11 @@
 #include <click/args.hh>
 #include <click/error.hh>
 #include <click/packet_anno.hh>
-#include <click/integers.hh>	// for first_bit_set
 #include <click/router.hh>
 CLICK_DECLS
 
 AggregateCounter::AggregateCounter()
-    : _root(0), _free(0), _call_nnz_h(0), _call_count_h(0)
+    : _shards(0), _nshards(0), _call_nnz_h(0), _call_count_h(0)
 {
 }
 
@@ -34,22 +33,6 @@ AggregateCounter::~AggregateCounter()
 {
 }
 
-AggregateCounter::Node *
-AggregateCounter::new_node_block()
-{
-    assert(!_free);
-    int block_size = 1024;
-    Node *block = new Node[block_size];
-    if (!block)
-	return 0;
-    _blocks.push_back(block);
-    for (int i = 1; i < block_size - 1; i++)
-	block[i].child[0] = &block[i+1];
-    block[block_size - 1].child[0] = 0;
-    _free = &block[1];
-    return &block[0];
-}
-
 int
 AggregateCounter::configure(Vector<String> &conf, ErrorHandler *errh)
 {
@@ -121,6 +104,14 @@ AggregateCounter::initialize(ErrorHandler *errh)
     if (_call_count_h && _call_count_h->initialize_write(this, errh) < 0)
 	return -1;
 
+    _nshards = click_max_cpu_ids();
+    if (!(_shards = new Shard[_nshards]))
+	return errh->error("out of memory!");
+    for (int i = 0; i < _nshards; ++i) {
+	if (!(_shards[i].entries = new Entry[INITIAL_CAPACITY]))
+	    return errh->error("out of memory!");
+	_shards[i].mask = INITIAL_CAPACITY - 1;
+    }
     if (clear(errh) < 0)
 	return -1;
 
@@ -132,84 +123,54 @@ AggregateCounter::initialize(ErrorHandler *errh)
 void
 AggregateCounter::cleanup(CleanupStage)
 {
-    for (int i = 0; i < _blocks.size(); i++)
-	delete[] _blocks[i];
-    _blocks.clear();
+    for (int i = 0; i < _nshards; i++)
+	delete[] _shards[i].entries;
+    delete[] _shards;
+    _shards = 0;
+    _nshards = 0;
     delete _call_nnz_h;
     delete _call_count_h;
     _call_nnz_h = _call_count_h = 0;
 }
 
-AggregateCounter::Node *
-AggregateCounter::make_peer(uint32_t a, Node *n, bool frozen)
+bool
+AggregateCounter::grow(Shard &s)
 {
-    /*
-     * become a peer
-     * algo: create two nodes, the two peers.  leave orig node as
-     * the parent of the two new ones.
-     */
-
-    if (frozen)
-	return 0;
-
-    Node *down[2];
-    if (!(down[0] = new_node()))
-	return 0;
-    if (!(down[1] = new_node())) {
-	free_node(down[0]);
-	return 0;
-    }
-
-    // swivel is first bit 'a' and 'old->input' differ
-    int swivel = ffs_msb(a ^ n->aggregate);
-    // bitvalue is the value of that bit of 'a'
-    int bitvalue = (a >> (32 - swivel)) & 1;
-    // mask masks off all bits before swivel
-    uint32_t mask = (swivel == 1 ? 0 : (0xFFFFFFFFU << (33 - swivel)));
-
-    down[bitvalue]->aggregate = a;
-    down[bitvalue]->count = 0;
-    down[bitvalue]->child[0] = down[bitvalue]->child[1] = 0;
-
-    *down[1 - bitvalue] = *n;	/* copy orig node down one level */
-
-    n->aggregate = (down[0]->aggregate & mask);
-    if (down[0]->aggregate == n->aggregate) {
-	n->count = down[0]->count;
-	down[0]->count = 0;
-    } else
-	n->count = 0;
-    n->child[0] = down[0];	/* point to children */
-    n->child[1] = down[1];
-
-    return (n->aggregate == a ? n : down[bitvalue]);
+    uint32_t ncap = (s.mask + 1) * 2;
+    Entry *n = new Entry[ncap];
+    if (!n)
+	return false;
+    memset(n, 0, sizeof(Entry) * ncap);
+    for (uint32_t i = 0; i <= s.mask; ++i)
+	if (s.entries[i].count) {
+	    uint32_t j = hash(s.entries[i].aggregate) & (ncap - 1);
+	    while (n[j].count)
+		j = (j + 1) & (ncap - 1);
+	    n[j] = s.entries[i];
+	}
+    delete[] s.entries;
+    s.entries = n;
+    s.mask = ncap - 1;
+    s.last = 0;
+    return true;
 }
 
-AggregateCounter::Node *
-AggregateCounter::find_node(uint32_t a, bool frozen)
+/*
+ * Return an empty slot for aggregate a, which is not in s, keeping the load
+ * factor at most 1/2.  The caller must hold s.lock and store a nonzero count
+ * in the slot.
+ */
+AggregateCounter::Entry *
+AggregateCounter::insert_entry(Shard &s, uint32_t a)
 {
-    // straight outta tcpdpriv
-    Node *n = _root;
-    while (n) {
-	if (n->aggregate == a)
-	    return (n->count || !frozen ? n : 0);
-	if (!n->child[0])
-	    n = make_peer(a, n, frozen);
-	else {
-	    // swivel is the first bit in which the two children differ
-	    int swivel = ffs_msb(n->child[0]->aggregate ^ n->child[1]->aggregate);
-	    if (ffs_msb(a ^ n->aggregate) < swivel) // input differs earlier
-		n = make_peer(a, n, frozen);
-	    else if (a & (1 << (32 - swivel)))
-		n = n->child[1];
-	    else
-		n = n->child[0];
-	}
-    }
-
-    if (!frozen)
+    if (s.num_nonzero >= (s.mask + 1) / 2 && !grow(s)) {
 	click_chatter("AggregateCounter: out of memory!");
-    return 0;
+	return 0;
+    }
+    Entry *e = find_entry(s, a);
+    e->aggregate = a;
+    s.num_nonzero++;
+    return e;
 }
 
 inline bool
@@ -220,10 +181,6 @@ AggregateCounter::update(Packet *p, bool frozen)
 
     // AGGREGATE_ANNO is already in host byte order!
     uint32_t agg = AGGREGATE_ANNO(p);
-    Node *n = find_node(agg, frozen);
-    if (!n)
-	return false;
-
     uint32_t amount;
     if (!_bytes)
 	amount = 1 + (_use_packet_count ? EXTRA_PACKETS_ANNO(p) : 0);
@@ -233,20 +190,39 @@ AggregateCounter::update(Packet *p, bool frozen)
 	    amount -= p->network_header_offset();
     }
 
-    // update _num_nonzero; possibly call handler
-    if (amount && !n->count) {
-	if (_num_nonzero >= _call_nnz) {
+    // handlers clear and merge shards, so hold the lock while updating
+    Shard &s = _shards[click_current_cpu_id()];
+    s.lock.acquire();
+    Entry *e = find_entry(s, agg);
+    if (!e->count && frozen) {
+	s.lock.release();
+	return false;
+    } else if (!amount) {
+	s.lock.release();
+	return true;
+    }
+
+    // update num_nonzero; possibly call handler
+    if (!e->count) {
+	if (s.num_nonzero >= _call_nnz) {
+	    s.lock.release();
 	    _call_nnz = (uint32_t)(-1);
 	    _call_nnz_h->call_write();
 	    // handler may have changed our state; reupdate
 	    return update(p, frozen || _frozen);
 	}
-	_num_nonzero++;
+	if (!(e = insert_entry(s, agg))) {
+	    s.lock.release();
+	    return false;
+	}
     }
 
-    n->count += amount;
-    _count += amount;
-    if (_count >= _call_count) {
+    e->count += amount;
+    s.last = e;
+    s.count += amount;
+    uint64_t count = s.count;
+    s.lock.release();
+    if (count >= _call_count) {
 	_call_count = (uint64_t)(-1);
 	_call_count_h->call_write();
     }
@@ -272,105 +248,105 @@ AggregateCounter::pull(int port)
 
 // CLEAR, REAGGREGATE
 
-void
-AggregateCounter::clear_node(Node *n)
+int
+AggregateCounter::clear(ErrorHandler *)
 {
-    if (n->child[0]) {
-	clear_node(n->child[0]);
-	clear_node(n->child[1]);
+    for (int i = 0; i < _nshards; ++i) {
+	Shard &s = _shards[i];
+	s.lock.acquire();
+	memset(s.entries, 0, sizeof(Entry) * (s.mask + 1));
+	s.num_nonzero = 0;
+	s.count = 0;
+	s.last = 0;
+	s.lock.release();
     }
-    free_node(n);
+    return 0;
 }
 
-int
-AggregateCounter::clear(ErrorHandler *errh)
+uint32_t
+AggregateCounter::num_nonzero() const
 {
-    if (_root)
-	clear_node(_root);
+    if (_nshards == 1)
+	return _shards[0].num_nonzero;
+    // an aggregate seen by several threads has an entry in each shard
+    Vector<Entry> entries;
+    merge(entries);
+    return entries.size();
+}
 
-    if (!(_root = new_node())) {
-	if (errh)
-	    errh->error("out of memory!");
-	return -1;
+uint64_t
+AggregateCounter::total_count() const
+{
+    uint64_t count = 0;
+    for (int i = 0; i < _nshards; ++i) {
+	Shard &s = _shards[i];
+	s.lock.acquire();
+	count += s.count;
+	s.lock.release();
     }
-    _root->aggregate = 0;
-    _root->count = 0;
-    _root->child[0] = _root->child[1] = 0;
-    _num_nonzero = 0;
-    _count = 0;
-    return 0;
+    return count;
 }
 
+static int
+entry_compar(const void *a, const void *b, void *)
+{
+    uint32_t aa = *static_cast<const uint32_t *>(a);
+    uint32_t ba = *static_cast<const uint32_t *>(b);
+    return aa < ba ? -1 : aa != ba;
+}
 
+/*
+ * Collect the nonzero counts from every shard into entries, sorted by
+ * aggregate, adding together counts for the same aggregate.
+ */
 void
-AggregateCounter::reaggregate_node(Node *n)
+AggregateCounter::merge(Vector<Entry> &entries) const
 {
-    Node *l = n->child[0], *r = n->child[1];
-    uint32_t count = n->count;
-    free_node(n);
-
-    if ((n = find_node(count, false))) {
-	if (!n->count)
-	    _num_nonzero++;
-	n->count++;
-	_count++;
+    entries.clear();
+    for (int i = 0; i < _nshards; ++i) {
+	Shard &s = _shards[i];
+	s.lock.acquire();
+	for (uint32_t j = 0; j <= s.mask; ++j)
+	    if (s.entries[j].count)
+		entries.push_back(s.entries[j]);
+	s.lock.release();
     }
-
-    if (l) {
-	reaggregate_node(l);
-	reaggregate_node(r);
+    if (entries.empty())
+	return;
+    click_qsort(entries.begin(), entries.size(), sizeof(Entry), entry_compar);
+    if (_nshards > 1) {
+	Entry *out = entries.begin();
+	for (Entry *e = entries.begin() + 1; e != entries.end(); ++e)
+	    if (e->aggregate == out->aggregate)
+		out->count += e->count;
+	    else
+		*++out = *e;
+	entries.resize(out + 1 - entries.begin());
     }
 }
 
 void
 AggregateCounter::reaggregate_counts()
 {
-    Node *old_root = _root;
-    _root = 0;
+    Vector<Entry> old;
+    merge(old);
     clear();
-    reaggregate_node(old_root);
-}
-
-
-// HANDLERS
-
-static void
-write_batch(FILE *f, AggregateCounter::WriteFormat format,
-	    uint32_t *buffer, int pos, double count, ErrorHandler *)
-{
-    if (format == AggregateCounter::WR_BINARY)
-	ignore_result(fwrite(buffer, sizeof(uint32_t), pos, f));
-    else if (format == AggregateCounter::WR_TEXT_IP)
-	for (int i = 0; i < pos; i += 2)
-	    fprintf(f, "%d.%d.%d.%d %u\n", (buffer[i] >> 24) & 255, (buffer[i] >> 16) & 255, (buffer[i] >> 8) & 255, buffer[i] & 255, buffer[i+1]);
-    else if (format == AggregateCounter::WR_TEXT_PDF)
-	for (int i = 0; i < pos; i += 2)
-	    fprintf(f, "%u %.12g\n", buffer[i], buffer[i+1] / count);
-    else if (format == AggregateCounter::WR_TEXT)
-	for (int i = 0; i < pos; i += 2)
-	    fprintf(f, "%u %u\n", buffer[i], buffer[i+1]);
-}
 
-void
-AggregateCounter::write_nodes(Node *n, FILE *f, WriteFormat format,
-			      uint32_t *buffer, int &pos, int len,
-			      ErrorHandler *errh) const
-{
-    if (n->count > 0) {
-	buffer[pos++] = n->aggregate;
-	buffer[pos++] = n->count;
-	if (pos == len) {
-	    write_batch(f, format, buffer, pos, _count, errh);
-	    pos = 0;
+    Shard &s = _shards[0];
+    s.lock.acquire();
+    for (Entry *o = old.begin(); o != old.end(); ++o) {
+	Entry *e = find_entry(s, o->count);
+	if (e->count || (e = insert_entry(s, o->count))) {
+	    e->count++;
+	    s.count++;
 	}
     }
-
-    if (n->child[0])
-	write_nodes(n->child[0], f, format, buffer, pos, len, errh);
-    if (n->child[1])
-	write_nodes(n->child[1], f, format, buffer, pos, len, errh);
+    s.lock.release();
 }
 
+
+// HANDLERS
+
 int
 AggregateCounter::write_file(String where, WriteFormat format,
 			     ErrorHandler *errh) const
@@ -383,11 +359,14 @@ AggregateCounter::write_file(String where, WriteFormat format,
     if (!f)
 	return errh->error("%s: %s", where.c_str(), strerror(errno));
 
+    Vector<Entry> entries;
+    merge(entries);
+
     fprintf(f, "!IPAggregate 1.0\n");
     ignore_result(fwrite(_output_banner.data(), 1, _output_banner.length(), f));
     if (_output_banner.length() && _output_banner.back() != '\n')
 	fputc('\n', f);
-    fprintf(f, "!num_nonzero %u\n", _num_nonzero);
+    fprintf(f, "!num_nonzero %d\n", entries.size());
     if (format == WR_BINARY) {
 #if CLICK_BYTE_ORDER == CLICK_BIG_ENDIAN
 	fprintf(f, "!packed_be\n");
@@ -399,11 +378,19 @@ AggregateCounter::write_file(String where, WriteFormat format,
     } else if (format == WR_TEXT_IP)
 	fprintf(f, "!ip\n");
 
-    uint32_t buf[1024];
-    int pos = 0;
-    write_nodes(_root, f, format, buf, pos, 1024, errh);
-    if (pos)
-	write_batch(f, format, buf, pos, _count, errh);
+    // Entries are already the packed binary records.
+    if (format == WR_BINARY)
+	ignore_result(fwrite(entries.begin(), sizeof(Entry), entries.size(), f));
+    else if (format == WR_TEXT_IP)
+	for (Entry *e = entries.begin(); e != entries.end(); ++e)
+	    fprintf(f, "%d.%d.%d.%d %u\n", (e->aggregate >> 24) & 255, (e->aggregate >> 16) & 255, (e->aggregate >> 8) & 255, e->aggregate & 255, e->count);
+    else if (format == WR_TEXT_PDF) {
+	double count = total_count();
+	for (Entry *e = entries.begin(); e != entries.end(); ++e)
+	    fprintf(f, "%u %.12g\n", e->aggregate, e->count / count);
+    } else
+	for (Entry *e = entries.begin(); e != entries.end(); ++e)
+	    fprintf(f, "%u %u\n", e->aggregate, e->count);
 
     bool had_err = ferror(f);
     if (f != stdout)
@@ -448,9 +435,9 @@ AggregateCounter::read_handler(Element *e, void *thunk)
 	else
 	    return String(ac->_call_count) + " " + ac->_call_count_h->unparse();
       case AC_COUNT:
-	return String(ac->_count);
+	return String(ac->total_count());
       case AC_NAGG:
-	return String(ac->_num_nonzero);
+	return String(ac->num_nonzero());
       default:
 	return "<error>";
     }
@@ -1,6 +1,7 @@
 #ifndef CLICK_AGGCOUNTER_HH
 #define CLICK_AGGCOUNTER_HH
 #include <click/element.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 class HandlerCall;
 
@@ -161,13 +162,20 @@ Returns or sets the COUNT_CALL setting.
 
 =h nagg read-only
 
-Returns the number of aggregates that have been seen so far.
+Returns the number of aggregates that have been seen so far.  On a
+multithreaded router, this merges the threads' tables, so it costs as much as
+C<write_text_file>.
 
 =n
 
 The aggregate identifier is stored in host byte order. Thus, the aggregate ID
 corresponding to IP address 128.0.0.0 is 2147483648.
 
+Counts are kept in a hash table of 8-byte entries, so each distinct aggregate
+costs about 16 bytes.  On a multithreaded router, each thread counts into its
+own table, and the handlers merge the tables.  In that case the AGGREGATE and
+COUNT keywords apply to each thread's table separately.
+
 Only available in user-level processes.
 
 =e
@@ -206,7 +214,7 @@ class AggregateCounter : public Element { public:
     void push(int, Packet *);
     Packet *pull(int);
 
-    bool empty() const			{ return _num_nonzero == 0; }
+    bool empty() const			{ return num_nonzero() == 0; }
     int clear(ErrorHandler * = 0);
     enum WriteFormat { WR_TEXT = 0, WR_BINARY = 1, WR_TEXT_IP = 2, WR_TEXT_PDF = 3 };
     int write_file(String, WriteFormat, ErrorHandler *) const;
@@ -214,12 +222,30 @@ class AggregateCounter : public Element { public:
 
   private:
 
-    struct Node {
+    struct Entry {
 	uint32_t aggregate;
-	uint32_t count;
-	Node *child[2];
+	uint32_t count;			// 0 means the slot is empty
+    };
+
+    // One per thread: an open-addressed table with linear probing.  Only
+    // the owning thread inserts, but handlers clear and read every shard, so
+    // the owning thread holds the lock while it updates, and handlers hold
+    // it while they touch the entries.
+    struct Shard {
+	Entry *entries;
+	uint32_t mask;			// capacity - 1
+	uint32_t num_nonzero;
+	uint64_t count;
+	Entry *last;			// most recently updated entry
+	SimpleSpinlock lock;
+
+	Shard()
+	    : entries(0), mask(0), num_nonzero(0), count(0), last(0) {
+	}
     };
 
+    enum { INITIAL_CAPACITY = 1024 };
+
     bool _bytes : 1;
     bool _ip_bytes : 1;
     bool _use_packet_count : 1;
@@ -227,11 +253,8 @@ class AggregateCounter : public Element { public:
     bool _frozen;
     bool _active;
 
-    Node *_root;
-    Node *_free;
-    Vector<Node *> _blocks;
-    uint32_t _num_nonzero;
-    uint64_t _count;
+    Shard *_shards;
+    int _nshards;
 
     uint32_t _call_nnz;
     HandlerCall *_call_nnz_h;
@@ -240,38 +263,33 @@ class AggregateCounter : public Element { public:
 
     String _output_banner;
 
-    Node *new_node();
-    Node *new_node_block();
-    void free_node(Node *);
+    static inline uint32_t hash(uint32_t a) {
+	a *= 0x9E3779B1U;
+	return a ^ (a >> 16);
+    }
+    static inline Entry *find_entry(const Shard &s, uint32_t a);
+    bool grow(Shard &s);
+    Entry *insert_entry(Shard &s, uint32_t a);
 
-    Node *make_peer(uint32_t, Node *, bool frozen);
-    Node *find_node(uint32_t, bool frozen = false);
-    void reaggregate_node(Node *);
-    void clear_node(Node *);
+    uint32_t num_nonzero() const;
+    uint64_t total_count() const;
+    void merge(Vector<Entry> &entries) const;
 
-    void write_nodes(Node *, FILE *, WriteFormat, uint32_t *, int &, int, ErrorHandler *) const;
     static int write_file_handler(const String &, Element *, void *, ErrorHandler *);
     static String read_handler(Element *, void *) CLICK_COLD;
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
 
 };
 
-inline AggregateCounter::Node *
-AggregateCounter::new_node()
-{
-    if (_free) {
-	Node *n = _free;
-	_free = n->child[0];
-	return n;
-    } else
-	return new_node_block();
-}
-
-inline void
-AggregateCounter::free_node(Node *n)
+inline AggregateCounter::Entry *
+AggregateCounter::find_entry(const Shard &s, uint32_t a)
 {
-    n->child[0] = _free;
-    _free = n;
+    if (s.last && s.last->aggregate == a && s.last->count)
+	return s.last;
+    uint32_t i = hash(a) & s.mask;
+    while (s.entries[i].count && s.entries[i].aggregate != a)
+	i = (i + 1) & s.mask;
+    return &s.entries[i];
 }
 
 CLICK_ENDDECLS
@@ -0,0 +1,189 @@
+/*
+ * aggdistinct.{cc,hh} -- estimate the number of distinct aggregates
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "aggdistinct.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <click/integers.hh>	// for ffs_msb
+#include <math.h>
+CLICK_DECLS
+
+AggregateDistinct::AggregateDistinct()
+    : _sketches(0), _nsketches(0)
+{
+}
+
+AggregateDistinct::~AggregateDistinct()
+{
+}
+
+int
+AggregateDistinct::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _precision = 12;
+    if (Args(conf, this, errh)
+	.read("PRECISION", _precision)
+	.complete() < 0)
+	return -1;
+    if (_precision < 4 || _precision > 18)
+	return errh->error("PRECISION must be between 4 and 18");
+    return 0;
+}
+
+int
+AggregateDistinct::initialize(ErrorHandler *errh)
+{
+    _nsketches = click_max_cpu_ids();
+    if (!(_sketches = new Sketch[_nsketches]))
+	return errh->error("out of memory!");
+    for (int i = 0; i < _nsketches; ++i)
+	if (!(_sketches[i].reg = new uint8_t[1 << _precision]))
+	    return errh->error("out of memory!");
+    clear();
+    return 0;
+}
+
+void
+AggregateDistinct::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _nsketches; ++i)
+	delete[] _sketches[i].reg;
+    delete[] _sketches;
+    _sketches = 0;
+    _nsketches = 0;
+}
+
+void
+AggregateDistinct::clear()
+{
+    for (int i = 0; i < _nsketches; ++i) {
+	Sketch &s = _sketches[i];
+	s.lock.acquire();
+	memset(s.reg, 0, 1 << _precision);
+	s.count = 0;
+	s.lock.release();
+    }
+}
+
+Packet *
+AggregateDistinct::simple_action(Packet *p)
+{
+    // finalizer from MurmurHash3: spreads the 32-bit aggregate over 64 bits
+    uint64_t h = AGGREGATE_ANNO(p);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+
+    // The top bits pick a register; the rest give the rank of the first 1
+    // bit.
+    uint32_t index = h >> (64 - _precision);
+    uint64_t rest = h << _precision;
+    uint8_t rank = rest ? ffs_msb(rest) : 65 - _precision;
+
+    Sketch &s = _sketches[click_current_cpu_id()];
+    s.lock.acquire();
+    if (s.reg[index] < rank)
+	s.reg[index] = rank;
+    s.count++;
+    s.lock.release();
+    return p;
+}
+
+double
+AggregateDistinct::estimate() const
+{
+    uint32_t m = 1 << _precision;
+    Vector<uint8_t> reg(m, 0);
+    for (int i = 0; i < _nsketches; ++i) {
+	Sketch &s = _sketches[i];
+	s.lock.acquire();
+	for (uint32_t j = 0; j < m; ++j)
+	    if (s.reg[j] > reg[j])
+		reg[j] = s.reg[j];
+	s.lock.release();
+    }
+
+    double sum = 0;
+    uint32_t zeros = 0;
+    for (uint32_t j = 0; j < m; ++j) {
+	sum += ldexp(1.0, -reg[j]);
+	zeros += (reg[j] == 0);
+    }
+
+    double alpha;
+    if (m == 16)
+	alpha = 0.673;
+    else if (m == 32)
+	alpha = 0.697;
+    else if (m == 64)
+	alpha = 0.709;
+    else
+	alpha = 0.7213 / (1 + 1.079 / m);
+    double e = alpha * m * m / sum;
+    // small-range correction: linear counting
+    if (e <= 2.5 * m && zeros)
+	e = m * log((double) m / zeros);
+    return e;
+}
+
+String
+AggregateDistinct::read_handler(Element *e, void *thunk)
+{
+    AggregateDistinct *ad = static_cast<AggregateDistinct *>(e);
+    switch ((intptr_t) thunk) {
+    case H_DISTINCT:
+	return String((uint64_t) (ad->estimate() + 0.5));
+    case H_COUNT: {
+	uint64_t count = 0;
+	for (int i = 0; i < ad->_nsketches; ++i) {
+	    Sketch &s = ad->_sketches[i];
+	    s.lock.acquire();
+	    count += s.count;
+	    s.lock.release();
+	}
+	return String(count);
+    }
+    default:
+	return String();
+    }
+}
+
+int
+AggregateDistinct::write_handler(const String &, Element *e, void *thunk, ErrorHandler *)
+{
+    AggregateDistinct *ad = static_cast<AggregateDistinct *>(e);
+    switch ((intptr_t) thunk) {
+    case H_CLEAR:
+	ad->clear();
+	return 0;
+    default:
+	return -1;
+    }
+}
+
+void
+AggregateDistinct::add_handlers()
+{
+    add_read_handler("distinct", read_handler, H_DISTINCT);
+    add_read_handler("count", read_handler, H_COUNT);
+    add_write_handler("clear", write_handler, H_CLEAR, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel int64)
+EXPORT_ELEMENT(AggregateDistinct)
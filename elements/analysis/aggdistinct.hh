@@ -0,0 +1,112 @@
+#ifndef CLICK_AGGDISTINCT_HH
+#define CLICK_AGGDISTINCT_HH
+#include <click/element.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+
+/*
+=c
+
+AggregateDistinct([I<KEYWORDS>])
+
+=s aggregates
+
+estimates the number of distinct aggregates in fixed memory
+
+=d
+
+AggregateDistinct estimates how many distinct aggregate annotation values it
+has seen, using a HyperLogLog sketch of 2^PRECISION one-byte registers.  The
+estimate's standard error is about 1.04/sqrt(2^PRECISION): 1.6% at the
+default precision, which takes 4 kilobytes.  Packets pass through unchanged.
+
+Each thread updates its own registers.  Each set of registers has a lock,
+which its thread takes for every packet; only handlers contend for it.
+Handlers lock each thread's registers in turn and merge them by taking their
+maximum, which yields the same estimate as a single sketch that saw every
+packet.  AggregateDistinct is thus safe to use from several threads, and its
+handlers may run while packets are arriving.
+
+To count distinct sources, for example, precede AggregateDistinct with
+AggregateIP(ip src).
+
+Keyword arguments are:
+
+=over 8
+
+=item PRECISION
+
+Unsigned between 4 and 18.  The number of index bits.  Default is 12.
+
+=back
+
+=h distinct read-only
+
+Returns the estimated number of distinct aggregates.
+
+=h count read-only
+
+Returns the number of packets seen.
+
+=h clear write-only
+
+Resets the sketch.
+
+=n
+
+Only available in user-level processes.
+
+=e
+
+This configuration prints the number of distinct sources sending to a
+victim each second.
+
+  ... -> IPClassifier(dst host 10.0.0.1)
+      -> AggregateIP(ip src)
+      -> ad :: AggregateDistinct
+      -> ...;
+  Script(TYPE ACTIVE, wait 1s, print ad.distinct, write ad.clear, loop);
+
+=a
+
+AggregateHeavyHitters, AggregateCounter, AggregateIP */
+
+class AggregateDistinct : public Element { public:
+
+    AggregateDistinct() CLICK_COLD;
+    ~AggregateDistinct() CLICK_COLD;
+
+    const char *class_name() const	{ return "AggregateDistinct"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    Packet *simple_action(Packet *);
+
+  private:
+
+    // One per thread.  The owning thread and handlers both take the lock.
+    struct Sketch {
+	uint8_t *reg;
+	uint64_t count;
+	SimpleSpinlock lock;
+    };
+
+    Sketch *_sketches;
+    int _nsketches;
+    int _precision;
+
+    void clear();
+    double estimate() const;
+
+    enum { H_DISTINCT, H_COUNT, H_CLEAR };
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,405 @@
+/*
+ * aggheavyhitters.{cc,hh} -- find large aggregates with fixed-size sketches
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "aggheavyhitters.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <click/straccum.hh>
+#include <click/ipaddress.hh>
+CLICK_DECLS
+
+AggregateHeavyHitters::AggregateHeavyHitters()
+    : _sketches(0), _nsketches(0)
+{
+}
+
+AggregateHeavyHitters::~AggregateHeavyHitters()
+{
+}
+
+int
+AggregateHeavyHitters::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    bool bytes = false;
+    bool ip_bytes = false;
+    bool packet_count = true;
+    bool extra_length = true;
+    _k = 256;
+    _width = 4096;
+    _depth = 4;
+    _threshold = (uint64_t) -1;
+
+    if (Args(conf, this, errh)
+	.read("K", _k)
+	.read("WIDTH", _width)
+	.read("DEPTH", _depth)
+	.read("THRESHOLD", _threshold)
+	.read("BYTES", bytes)
+	.read("IP_BYTES", ip_bytes)
+	.read("MULTIPACKET", packet_count)
+	.read("EXTRA_LENGTH", extra_length)
+	.complete() < 0)
+	return -1;
+
+    if (_k == 0 || _k > 0x1000000)
+	return errh->error("K out of range");
+    if (_width == 0 || _width > 0x1000000)
+	return errh->error("WIDTH out of range");
+    if (_depth < 1 || _depth > MAX_DEPTH)
+	return errh->error("DEPTH must be between 1 and %d", MAX_DEPTH);
+    while (_width & (_width - 1))
+	_width = (_width | (_width - 1)) + 1;
+
+    _bytes = bytes;
+    _ip_bytes = ip_bytes;
+    _use_packet_count = packet_count;
+    _use_extra_length = extra_length;
+    return 0;
+}
+
+int
+AggregateHeavyHitters::initialize(ErrorHandler *errh)
+{
+    _nsketches = click_max_cpu_ids();
+    if (!(_sketches = new Sketch[_nsketches]))
+	return errh->error("out of memory!");
+    for (int i = 0; i < _nsketches; ++i) {
+	Sketch &s = _sketches[i];
+	s.cm = new uint64_t[_depth * _width];
+	s.counters = new Counter[_k];
+	s.heap = new Counter *[_k];
+	if (!s.cm || !s.counters || !s.heap)
+	    return errh->error("out of memory!");
+	s.map.rehash(_k);
+    }
+    clear();
+    return 0;
+}
+
+void
+AggregateHeavyHitters::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _nsketches; ++i) {
+	_sketches[i].map.clear();
+	delete[] _sketches[i].cm;
+	delete[] _sketches[i].counters;
+	delete[] _sketches[i].heap;
+    }
+    delete[] _sketches;
+    _sketches = 0;
+    _nsketches = 0;
+}
+
+void
+AggregateHeavyHitters::clear()
+{
+    for (int i = 0; i < _nsketches; ++i) {
+	Sketch &s = _sketches[i];
+	s.lock.acquire();
+	memset(s.cm, 0, sizeof(uint64_t) * _depth * _width);
+	s.map.clear();
+	s.ncounters = 0;
+	s.total = 0;
+	s.lock.release();
+    }
+}
+
+inline uint32_t
+AggregateHeavyHitters::hash(uint32_t agg, int row)
+{
+    // A different odd multiplier per row; the high bits of the product are
+    // well mixed.
+    static const uint64_t mult[MAX_DEPTH] = {
+	0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+	0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL,
+	0xFF51AFD7ED558CCDULL, 0xC4CEB9FE1A85EC53ULL,
+	0x94D049BB133111EBULL, 0xBF58476D1CE4E5B9ULL
+    };
+    uint64_t x = (agg + (uint64_t) row) * mult[row];
+    x ^= x >> 29;
+    return x >> 32;
+}
+
+inline uint64_t
+AggregateHeavyHitters::amount(const Packet *p) const
+{
+    if (!_bytes)
+	return 1 + (_use_packet_count ? EXTRA_PACKETS_ANNO(p) : 0);
+    uint64_t a = p->length() + (_use_extra_length ? EXTRA_LENGTH_ANNO(p) : 0);
+    if (_ip_bytes && p->has_network_header())
+	a -= p->network_header_offset();
+    return a;
+}
+
+void
+AggregateHeavyHitters::heap_down(Sketch &s, uint32_t i)
+{
+    Counter *c = s.heap[i];
+    while (1) {
+	uint32_t child = 2 * i + 1;
+	if (child >= s.ncounters)
+	    break;
+	if (child + 1 < s.ncounters
+	    && s.heap[child + 1]->count < s.heap[child]->count)
+	    ++child;
+	if (s.heap[child]->count >= c->count)
+	    break;
+	s.heap[i] = s.heap[child];
+	s.heap[i]->heap_index = i;
+	i = child;
+    }
+    s.heap[i] = c;
+    c->heap_index = i;
+}
+
+inline bool
+AggregateHeavyHitters::update(Packet *p)
+{
+    // AGGREGATE_ANNO is already in host byte order!
+    uint32_t agg = AGGREGATE_ANNO(p);
+    uint64_t a = amount(p);
+    Sketch &s = _sketches[click_current_cpu_id()];
+    s.lock.acquire();
+    s.total += a;
+
+    // Count-Min: add to one counter per row
+    uint64_t est = (uint64_t) -1;
+    for (int r = 0; r < _depth; ++r) {
+	uint64_t &c = s.cm[r * _width + (hash(agg, r) & (_width - 1))];
+	c += a;
+	if (c < est)
+	    est = c;
+    }
+
+    // Space-Saving: counts only grow, so counters only move down the heap
+    if (Counter *c = s.map.get(agg)) {
+	c->count += a;
+	heap_down(s, c->heap_index);
+    } else if (s.ncounters < _k) {
+	c = &s.counters[s.ncounters];
+	c->agg = agg;
+	c->count = a;
+	s.map.set(c);
+	uint32_t i = s.ncounters++;
+	while (i > 0 && s.heap[(i - 1) / 2]->count > a) {
+	    s.heap[i] = s.heap[(i - 1) / 2];
+	    s.heap[i]->heap_index = i;
+	    i = (i - 1) / 2;
+	}
+	s.heap[i] = c;
+	c->heap_index = i;
+    } else {
+	// replace the smallest counter, inheriting its count as error
+	c = s.heap[0];
+	s.map.erase(c->agg);
+	c->agg = agg;
+	c->count += a;
+	s.map.set(c);
+	heap_down(s, 0);
+    }
+
+    s.lock.release();
+    return est >= _threshold;
+}
+
+void
+AggregateHeavyHitters::push(int, Packet *p)
+{
+    if (update(p) && noutputs() == 2)
+	output(1).push(p);
+    else
+	output(0).push(p);
+}
+
+Packet *
+AggregateHeavyHitters::pull(int)
+{
+    Packet *p = input(0).pull();
+    if (p && update(p) && noutputs() == 2) {
+	output(1).push(p);
+	p = 0;
+    }
+    return p;
+}
+
+uint64_t
+AggregateHeavyHitters::estimate(uint32_t agg) const
+{
+    uint32_t col[MAX_DEPTH];
+    uint64_t row[MAX_DEPTH], ss = 0;
+    for (int r = 0; r < _depth; ++r) {
+	col[r] = r * _width + (hash(agg, r) & (_width - 1));
+	row[r] = 0;
+    }
+    for (int i = 0; i < _nsketches; ++i) {
+	Sketch &s = _sketches[i];
+	s.lock.acquire();
+	for (int r = 0; r < _depth; ++r)
+	    row[r] += s.cm[col[r]];
+	// An aggregate missing from a full summary has count at most the
+	// summary's minimum.
+	if (Counter *c = s.map.get(agg))
+	    ss += c->count;
+	else if (s.ncounters == _k)
+	    ss += s.heap[0]->count;
+	s.lock.release();
+    }
+    uint64_t cm = (uint64_t) -1;
+    for (int r = 0; r < _depth; ++r)
+	if (row[r] < cm)
+	    cm = row[r];
+    return ss < cm ? ss : cm;
+}
+
+namespace {
+struct TopEntry {
+    uint32_t agg;
+    uint64_t count;
+};
+
+int
+topentry_agg_compar(const void *a, const void *b, void *)
+{
+    uint32_t aa = static_cast<const TopEntry *>(a)->agg;
+    uint32_t ba = static_cast<const TopEntry *>(b)->agg;
+    return aa < ba ? -1 : aa != ba;
+}
+
+int
+topentry_count_compar(const void *a, const void *b, void *)
+{
+    const TopEntry *ta = static_cast<const TopEntry *>(a);
+    const TopEntry *tb = static_cast<const TopEntry *>(b);
+    if (ta->count != tb->count)
+	return ta->count > tb->count ? -1 : 1;
+    return topentry_agg_compar(a, b, 0);
+}
+}
+
+void
+AggregateHeavyHitters::topk(Vector<uint32_t> &aggs, Vector<uint64_t> &counts, uint32_t n) const
+{
+    Vector<TopEntry> v;
+    for (int i = 0; i < _nsketches; ++i) {
+	Sketch &s = _sketches[i];
+	s.lock.acquire();
+	for (uint32_t j = 0; j < s.ncounters; ++j) {
+	    TopEntry e = { s.counters[j].agg, 0 };
+	    v.push_back(e);
+	}
+	s.lock.release();
+    }
+    if (v.empty())
+	return;
+
+    // remove duplicate candidates, then rank by merged estimate
+    click_qsort(v.begin(), v.size(), sizeof(TopEntry), topentry_agg_compar);
+    TopEntry *out = v.begin();
+    for (TopEntry *e = v.begin(); e != v.end(); ++e)
+	if (e == v.begin() || e->agg != out[-1].agg) {
+	    out->agg = e->agg;
+	    out->count = estimate(e->agg);
+	    ++out;
+	}
+    v.resize(out - v.begin());
+    click_qsort(v.begin(), v.size(), sizeof(TopEntry), topentry_count_compar);
+
+    for (int i = 0; i < v.size() && (uint32_t) i < n; ++i) {
+	aggs.push_back(v[i].agg);
+	counts.push_back(v[i].count);
+    }
+}
+
+int
+AggregateHeavyHitters::read_handler(int, String &s, Element *e, const Handler *h, ErrorHandler *errh)
+{
+    AggregateHeavyHitters *hh = static_cast<AggregateHeavyHitters *>(e);
+    intptr_t what = reinterpret_cast<intptr_t>(h->read_user_data());
+    switch (what) {
+    case H_TOPK:
+    case H_TOPK_IP: {
+	uint32_t n = hh->_k;
+	if (s && !IntArg().parse(cp_uncomment(s), n))
+	    return errh->error("expected count");
+	Vector<uint32_t> aggs;
+	Vector<uint64_t> counts;
+	hh->topk(aggs, counts, n);
+	StringAccum sa;
+	for (int i = 0; i < aggs.size(); ++i) {
+	    if (what == H_TOPK_IP)
+		sa << IPAddress(htonl(aggs[i]));
+	    else
+		sa << aggs[i];
+	    sa << ' ' << counts[i] << '\n';
+	}
+	s = sa.take_string();
+	return 0;
+    }
+    case H_ESTIMATE: {
+	String arg = cp_uncomment(s);
+	uint32_t agg;
+	IPAddress a;
+	if (IntArg().parse(arg, agg))
+	    /* ok */;
+	else if (IPAddressArg().parse(arg, a, hh))
+	    agg = ntohl(a.addr());
+	else
+	    return errh->error("expected aggregate ID or IP address");
+	s = String(hh->estimate(agg));
+	return 0;
+    }
+    case H_COUNT: {
+	uint64_t total = 0;
+	for (int i = 0; i < hh->_nsketches; ++i) {
+	    Sketch &sk = hh->_sketches[i];
+	    sk.lock.acquire();
+	    total += sk.total;
+	    sk.lock.release();
+	}
+	s = String(total);
+	return 0;
+    }
+    default:
+	return -1;
+    }
+}
+
+int
+AggregateHeavyHitters::write_handler(const String &, Element *e, void *thunk, ErrorHandler *)
+{
+    AggregateHeavyHitters *hh = static_cast<AggregateHeavyHitters *>(e);
+    switch ((intptr_t) thunk) {
+    case H_CLEAR:
+	hh->clear();
+	return 0;
+    default:
+	return -1;
+    }
+}
+
+void
+AggregateHeavyHitters::add_handlers()
+{
+    set_handler("topk", Handler::f_read | Handler::f_read_param, read_handler, H_TOPK);
+    set_handler("topk_ip", Handler::f_read | Handler::f_read_param, read_handler, H_TOPK_IP);
+    set_handler("estimate", Handler::f_read | Handler::f_read_param, read_handler, H_ESTIMATE);
+    set_handler("count", Handler::f_read, read_handler, H_COUNT);
+    add_write_handler("clear", write_handler, H_CLEAR, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel int64)
+EXPORT_ELEMENT(AggregateHeavyHitters)
@@ -0,0 +1,215 @@
+#ifndef CLICK_AGGHEAVYHITTERS_HH
+#define CLICK_AGGHEAVYHITTERS_HH
+#include <click/element.hh>
+#include <click/hashcontainer.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+
+/*
+=c
+
+AggregateHeavyHitters([I<KEYWORDS>])
+
+=s aggregates
+
+finds the largest aggregates in fixed memory
+
+=d
+
+AggregateHeavyHitters estimates how many packets or bytes it has seen for each
+aggregate annotation value, and tracks the largest aggregates, using a fixed
+amount of memory however many aggregates it sees.  Read its C<topk> handler to
+get the largest aggregates.
+
+Two sketches are kept.  A Count-Min sketch, a DEPTH by WIDTH array of
+counters, gives an estimate for any aggregate.  The estimate is never too
+low, and with high probability it is too high by at most 2.72/WIDTH times the
+total count.  A Space-Saving summary of K counters tracks the candidates for
+the largest aggregates.  Any aggregate whose count exceeds 1/K of the total is
+guaranteed to be among the candidates.  Reported counts are the smaller of
+the two sketches' estimates.
+
+Each thread updates its own copy of the sketches.  Each copy has a lock,
+which its thread takes for every packet; only handlers contend for it.
+Handlers lock each copy in turn and merge them: Count-Min counters are summed,
+and the Space-Saving candidates are combined.  AggregateHeavyHitters is thus
+safe to use from several threads, and its handlers may run while packets are
+arriving.
+
+AggregateHeavyHitters may have one or two outputs.  If it has two, then
+packets whose aggregate's estimated count has reached THRESHOLD are emitted on
+the second output, and other packets on the first.  This check uses only the
+current thread's sketch.  Write the C<clear> handler periodically to measure
+rates rather than totals.
+
+Keyword arguments are:
+
+=over 8
+
+=item K
+
+Unsigned.  The number of Space-Saving counters per thread.  Default is 256.
+
+=item WIDTH
+
+Unsigned.  The number of counters per Count-Min row, rounded up to a power of
+two.  Default is 4096.
+
+=item DEPTH
+
+Unsigned.  The number of Count-Min rows, between 1 and 8.  Default is 4.
+
+=item THRESHOLD
+
+Unsigned.  The estimated count at which packets are emitted on the second
+output.  Default is never.
+
+=item BYTES
+
+Boolean. If true, then count bytes, not packets. Default is false.
+
+=item IP_BYTES
+
+Boolean. If true, then do not count bytes from the link header. Default is
+false.
+
+=item MULTIPACKET
+
+Boolean. If true, and BYTES is false, then use packets' packet count
+annotations to add to the number of packets seen. Default is true.
+
+=item EXTRA_LENGTH
+
+Boolean. If true, and BYTES is true, then include packets' extra length
+annotations in the byte counts. Default is true.
+
+=back
+
+=h topk read-only
+
+Returns the largest aggregates, one per line, largest first.  Each line
+contains the aggregate ID in decimal, a space, then the estimated count.
+Takes an optional parameter, the maximum number of lines; the default is K.
+
+=h topk_ip read-only
+
+Like C<topk>, but aggregate IDs are printed as IP addresses.
+
+=h estimate read-only
+
+Takes an aggregate ID, or an IP address, as a parameter.  Returns the
+estimated count for that aggregate.
+
+=h count read-only
+
+Returns the total count.
+
+=h clear write-only
+
+Resets all counts to zero.
+
+=n
+
+The aggregate identifier is stored in host byte order. Thus, the aggregate ID
+corresponding to IP address 128.0.0.0 is 2147483648.
+
+Memory use is about 8*DEPTH*WIDTH + 40*K bytes per thread.
+
+Only available in user-level processes.
+
+=e
+
+This configuration counts packets per destination /24 and sends packets to
+prefixes that have received 100000 packets in the current second to output
+1.
+
+  ... -> AggregateIP(ip dst/24)
+      -> hh :: AggregateHeavyHitters(THRESHOLD 100000)
+      -> ...;
+  hh[1] -> suspects :: Queue -> ...;
+  Script(TYPE ACTIVE, wait 1s, print hh.topk_ip, write hh.clear, loop);
+
+=a
+
+AggregateCounter, AggregateDistinct, AggregateIP */
+
+class AggregateHeavyHitters : public Element { public:
+
+    AggregateHeavyHitters() CLICK_COLD;
+    ~AggregateHeavyHitters() CLICK_COLD;
+
+    const char *class_name() const	{ return "AggregateHeavyHitters"; }
+    const char *port_count() const	{ return "1/1-2"; }
+    const char *processing() const	{ return PROCESSING_A_AH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+    Packet *pull(int);
+
+  private:
+
+    enum { MAX_DEPTH = 8 };
+
+    struct Counter {
+	typedef uint32_t key_type;
+	typedef uint32_t key_const_reference;
+
+	uint32_t agg;
+	uint32_t heap_index;
+	uint64_t count;
+	Counter *_hashnext;
+
+	key_const_reference hashkey() const {
+	    return agg;
+	}
+    };
+
+    // One per thread.  The Space-Saving counters form a min-heap on count.
+    // The owning thread and handlers both take the lock.
+    struct Sketch {
+	uint64_t *cm;		// DEPTH rows of WIDTH counters
+	Counter *counters;
+	Counter **heap;
+	uint32_t ncounters;
+	HashContainer<Counter> map;
+	uint64_t total;
+	SimpleSpinlock lock;
+
+	Sketch()
+	    : cm(0), counters(0), heap(0), ncounters(0), total(0) {
+	}
+    };
+
+    Sketch *_sketches;
+    int _nsketches;
+
+    uint32_t _k;
+    uint32_t _width;
+    int _depth;
+    uint64_t _threshold;
+    bool _bytes : 1;
+    bool _ip_bytes : 1;
+    bool _use_packet_count : 1;
+    bool _use_extra_length : 1;
+
+    static inline uint32_t hash(uint32_t agg, int row);
+    inline uint64_t amount(const Packet *p) const;
+    void heap_down(Sketch &s, uint32_t i);
+    inline bool update(Packet *p);
+    void clear();
+
+    uint64_t estimate(uint32_t agg) const;
+    void topk(Vector<uint32_t> &aggs, Vector<uint64_t> &counts, uint32_t n) const;
+
+    enum { H_TOPK, H_TOPK_IP, H_ESTIMATE, H_COUNT, H_CLEAR };
+    static int read_handler(int, String &, Element *, const Handler *, ErrorHandler *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
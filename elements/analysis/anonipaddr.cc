@@ -18,6 +18,7 @@
 
 #include <click/config.h>
 #include "anonipaddr.hh"
+#include "cryptopan.hh"
 #include <click/standard/scheduleinfo.hh>
 #include <click/args.hh>
 #include <click/error.hh>
@@ -26,6 +27,7 @@
 #include <clicknet/icmp.h>
 #include <click/llrpc.h>
 #include <click/integers.hh>	// for first_bit_set
+#include <click/ipaddress.hh>
 #ifdef CLICK_USERLEVEL
 # include <unistd.h>
 # include <time.h>
@@ -33,7 +35,7 @@
 CLICK_DECLS
 
 AnonymizeIPAddr::AnonymizeIPAddr()
-    : _root(0), _free(0)
+    : _root(0), _free(0), _cryptopan(0), _caches(0), _have_key(false)
 {
 }
 
@@ -63,14 +65,28 @@ rand32()
     return click_random(0, 0xFFFFFFFFU);
 }
 
+static inline int
+hexval(char c)
+{
+    if (c >= '0' && c <= '9')
+	return c - '0';
+    else if (c >= 'A' && c <= 'F')
+	return c - 'A' + 10;
+    else if (c >= 'a' && c <= 'f')
+	return c - 'a' + 10;
+    else
+	return -1;
+}
+
 int
 AnonymizeIPAddr::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     _preserve_class = 0;
-    String preserve_8;
+    String preserve_8, key;
     bool seed_ignored;
 
     if (Args(conf, this, errh)
+	.read("KEY", key)
 	.read("CLASS", _preserve_class)
 	.read("PRESERVE_8", AnyArg(), preserve_8)
 	.read("SEED", seed_ignored)
@@ -95,12 +111,36 @@ AnonymizeIPAddr::configure(Vector<String> &conf, ErrorHandler *errh)
 		return errh->error("PRESERVE_8 expects integer between 0 and 255");
     }
 
+    // check key
+    if (key) {
+	if (key.length() != 2 * CryptoPAn::KEY_SIZE)
+	    return errh->error("KEY must have %d hexadecimal digits", 2 * CryptoPAn::KEY_SIZE);
+	for (int i = 0; i < key.length(); i++) {
+	    int d = hexval(key[i]);
+	    if (d < 0)
+		return errh->error("KEY must have %d hexadecimal digits", 2 * CryptoPAn::KEY_SIZE);
+	    _key[i / 2] = (i % 2 ? _key[i / 2] | d : d << 4);
+	}
+	_have_key = true;
+    }
+
     return 0;
 }
 
 int
 AnonymizeIPAddr::initialize(ErrorHandler *errh)
 {
+    if (_have_key) {
+	int ncaches = click_max_cpu_ids();
+	if (!(_cryptopan = new CryptoPAn)
+	    || !_cryptopan->set_key(_key)
+	    || !(_caches = new CacheSet[ncaches * CACHE_SETS]))
+	    return errh->error("out of memory!");
+	memset(_caches, 0, sizeof(CacheSet) * ncaches * CACHE_SETS);
+	memset(_key, 0, sizeof(_key));
+	return 0;
+    }
+
     if (!(_root = new_node()))
 	return errh->error("out of memory!");
     _root->input = 1;		// use 1 instead of 0 b/c 0.0.0.0 is special
@@ -144,6 +184,10 @@ AnonymizeIPAddr::cleanup(CleanupStage)
     for (int i = 0; i < _blocks.size(); i++)
 	delete[] _blocks[i];
     _blocks.clear();
+    delete _cryptopan;
+    delete[] _caches;
+    _cryptopan = 0;
+    _caches = 0;
 }
 
 uint32_t
@@ -227,13 +271,84 @@ AnonymizeIPAddr::find_node(uint32_t a)
     return 0;
 }
 
+/*
+ * Return the bits of a that Crypto-PAn must copy to the output to respect
+ * CLASS and PRESERVE_8.  Whether bit i is preserved depends only on the bits
+ * before it, so the mapping stays prefix-preserving.
+ */
+uint32_t
+AnonymizeIPAddr::preserve_mask(uint32_t a) const
+{
+    int npreserve = 0;
+    if (_preserve_class > 0) {
+	int ones = ffs_msb(~a);
+	ones = (ones ? ones - 1 : 32);
+	npreserve = (ones < _preserve_class ? ones + 1 : _preserve_class);
+    }
+    for (int i = 0; i < _preserve_8.size(); i++) {
+	int same = ffs_msb((a >> 24) ^ _preserve_8[i]);
+	same = (same ? same - 25 : 8);
+	if (same + 1 > npreserve)
+	    npreserve = (same < 8 ? same + 1 : 8);
+    }
+    return (npreserve ? ~(0xFFFFFFFFU >> npreserve) : 0);
+}
+
+/*
+ * Anonymize n (at most 2) addresses in network byte order, in place.
+ */
+void
+AnonymizeIPAddr::anonymize_addrs(uint32_t *a, int n)
+{
+    if (!_cryptopan) {
+	for (int i = 0; i < n; i++)
+	    if (Node *node = find_node(ntohl(a[i])))
+		a[i] = htonl(node->output);
+	    else
+		a[i] = 0;
+	return;
+    }
+
+    assert(n <= 2);
+    CacheSet *cache = _caches + click_current_cpu_id() * CACHE_SETS;
+    uint32_t miss[2];
+    int miss_index[2], nmiss = 0;
+    for (int i = 0; i < n; i++) {
+	uint32_t x = ntohl(a[i]);
+	CacheSet &set = cache[(x * 0x9E3779B1U) >> 21];
+	if (set.input[0] == x && set.valid[0]) {
+	    a[i] = htonl(set.output[0]);
+	    set.lru = 1;
+	} else if (set.input[1] == x && set.valid[1]) {
+	    a[i] = htonl(set.output[1]);
+	    set.lru = 0;
+	} else {
+	    miss[nmiss] = x;
+	    miss_index[nmiss++] = i;
+	}
+    }
+    if (!nmiss)
+	return;
+
+    uint32_t pad[2];
+    _cryptopan->pads(miss, pad, nmiss);
+    for (int j = 0; j < nmiss; j++) {
+	uint32_t x = miss[j];
+	uint32_t y = x ^ (pad[j] & ~preserve_mask(x));
+	CacheSet &set = cache[(x * 0x9E3779B1U) >> 21];
+	set.input[set.lru] = x;
+	set.output[set.lru] = y;
+	set.valid[set.lru] = true;
+	set.lru ^= 1;
+	a[miss_index[j]] = htonl(y);
+    }
+}
+
 inline uint32_t
 AnonymizeIPAddr::anonymize_addr(uint32_t a)
 {
-    if (Node *n = find_node(ntohl(a)))
-	return htonl(n->output);
-    else
-	return 0;
+    anonymize_addrs(&a, 1);
+    return a;
 }
 
 void
@@ -258,8 +373,10 @@ AnonymizeIPAddr::handle_icmp(WritablePacket *q)
 	uint32_t icmp_sum = (~icmph->icmp_cksum & 0xFFFF)
 	    + (~src & 0xFFFF) + (~src >> 16) + (~dst & 0xFFFF) + (~dst >> 16);
 
-	embedded_iph->ip_src.s_addr = src = anonymize_addr(src);
-	embedded_iph->ip_dst.s_addr = dst = anonymize_addr(dst);
+	uint32_t addrs[2] = { src, dst };
+	anonymize_addrs(addrs, 2);
+	embedded_iph->ip_src.s_addr = src = addrs[0];
+	embedded_iph->ip_dst.s_addr = dst = addrs[1];
 
 	icmp_sum += (src & 0xFFFF) + (src >> 16) + (dst & 0xFFFF) + (dst >> 16);
 	icmp_sum = (icmp_sum & 0xFFFF) + (icmp_sum >> 16);
@@ -285,8 +402,10 @@ AnonymizeIPAddr::simple_action(Packet *p)
 	uint32_t sum = (~iph->ip_sum & 0xFFFF)
 	    + (~src & 0xFFFF) + (~src >> 16) + (~dst & 0xFFFF) + (~dst >> 16);
 
-	iph->ip_src.s_addr = src = anonymize_addr(src);
-	iph->ip_dst.s_addr = dst = anonymize_addr(dst);
+	uint32_t addrs[2] = { src, dst };
+	anonymize_addrs(addrs, 2);
+	iph->ip_src.s_addr = src = addrs[0];
+	iph->ip_dst.s_addr = dst = addrs[1];
 
 	sum += (src & 0xFFFF) + (src >> 16) + (dst & 0xFFFF) + (dst >> 16);
 	sum = (sum & 0xFFFF) + (sum >> 16);
@@ -314,5 +433,23 @@ AnonymizeIPAddr::llrpc(unsigned command, void *data)
 	return Element::llrpc(command, data);
 }
 
+int
+AnonymizeIPAddr::map_handler(int, String &s, Element *e, const Handler *, ErrorHandler *errh)
+{
+    AnonymizeIPAddr *a = static_cast<AnonymizeIPAddr *>(e);
+    IPAddress addr;
+    if (!IPAddressArg().parse(cp_uncomment(s), addr, a))
+	return errh->error("expected IP address");
+    s = IPAddress(a->anonymize_addr(addr.addr())).unparse();
+    return 0;
+}
+
+void
+AnonymizeIPAddr::add_handlers()
+{
+    set_handler("map", Handler::f_read | Handler::f_read_param, map_handler);
+}
+
 CLICK_ENDDECLS
+ELEMENT_REQUIRES(CryptoPAn)
 EXPORT_ELEMENT(AnonymizeIPAddr)
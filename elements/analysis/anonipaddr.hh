@@ -3,11 +3,12 @@
 #define CLICK_ANONIPADDR_HH
 #include <click/element.hh>
 CLICK_DECLS
+class CryptoPAn;
 
 /*
 =c
 
-AnonymizeIPAddr
+AnonymizeIPAddr([I<keywords> KEY, CLASS, PRESERVE_8])
 
 =s ip
 
@@ -22,8 +23,9 @@ p-bit prefix, then the corresponding output addresses also share the same
 p-bit prefix. AnonymizeIPAddr was based on Greg Minshall's tcpdpriv(1); see
 L<http://ita.ee.lbl.gov/html/contrib/tcpdpriv.html|http://ita.ee.lbl.gov/html/contrib/tcpdpriv.html>.
 
-The special IP addresses 0.0.0.0 and 255.255.255.255 are always mapped to
-themselves, independent of any other mapping.
+Without KEY, the special IP addresses 0.0.0.0 and 255.255.255.255 are always
+mapped to themselves, independent of any other mapping.  With KEY, they are
+anonymized like any other address.
 
 AnonymizeIPAddr also incrementally updates the IP header checksum, so the new
 header is correct iff the old header was correct.
@@ -32,10 +34,29 @@ AnonymizeIPAddr only manipulates the IP header pointed to by the IP header
 annotation. This differs from tcpdpriv, which also anonymizes addresses on
 encapsulated IP headers for protocol 4 (ipip).
 
+If KEY is given, AnonymizeIPAddr uses the Crypto-PAn algorithm instead of
+tcpdpriv's.  Crypto-PAn computes each output bit from an AES encryption of
+the preceding input bits, so the mapping depends only on KEY: it is the same
+across runs, machines, and threads, and anonymizing shards of a trace in
+parallel gives the same result as anonymizing the whole trace.  No state
+grows with the number of addresses.  Each thread keeps a small cache of
+recent results, and on x86 CPUs with AES-NI, AnonymizeIPAddr uses those
+instructions.  AnonymizeIPAddr's Crypto-PAn output matches other Crypto-PAn
+implementations given the same key, except where CLASS or PRESERVE_8 apply.
+
+Without KEY, AnonymizeIPAddr builds its mapping from random numbers as
+addresses arrive, so the mapping differs from run to run and its memory use
+grows with the number of addresses seen.
+
 Keyword arguments are:
 
 =over 8
 
+=item KEY
+
+String of 64 hexadecimal digits, the 32-byte Crypto-PAn key.  Default is
+to use tcpdpriv's algorithm.
+
 =item CLASS
 
 Integer. Preserve some "class" information from input IP addresses. If CLASS
@@ -81,12 +102,24 @@ very concerned about leaking your network topology, I would not
 recommend giving out trace information privatized with the I<-A50>
 option.  I wouldn't expect this to be the case for most organizations."
 
+=h map read-only
+
+Takes an IP address as a parameter.  Returns the corresponding anonymized
+address.
+
 =h CLICK_LLRPC_MAP_IPADDRESS llrpc
 
 Argument is a pointer to an IP address. An IP address is read from that
 location; the corresponding anonymized IP address is then stored into that
 location.
 
+=e
+
+  FromDump(in.pcap, STOP true)
+    -> CheckIPHeader(14)
+    -> AnonymizeIPAddr(KEY 1522178d33a4cf80130a5b1649907d10d8988f837979652762574c2d2a842202)
+    -> ToDump(out.pcap);
+
 =a
 
 tcpdpriv(1) */
@@ -103,6 +136,8 @@ class AnonymizeIPAddr : public Element { public:
     int initialize(ErrorHandler *) CLICK_COLD;
     void cleanup(CleanupStage) CLICK_COLD;
 
+    void add_handlers() CLICK_COLD;
+
     Packet *simple_action(Packet *);
 
     int llrpc(unsigned, void *);
@@ -123,6 +158,19 @@ class AnonymizeIPAddr : public Element { public:
     int _preserve_class;
     Vector<uint32_t> _preserve_8;
 
+    // Crypto-PAn state, used if KEY was given
+    enum { CACHE_SETS = 2048 };
+    struct CacheSet {			// two-way
+	uint32_t input[2];
+	uint32_t output[2];
+	bool valid[2];
+	uint8_t lru;			// the way to replace next
+    };
+    CryptoPAn *_cryptopan;
+    CacheSet *_caches;			// CACHE_SETS per thread
+    unsigned char _key[32];
+    bool _have_key;
+
     Node *new_node();
     Node *new_node_block();
     void free_node(Node *);
@@ -131,6 +179,10 @@ class AnonymizeIPAddr : public Element { public:
     Node *make_peer(uint32_t, Node *);
     Node *find_node(uint32_t);
     inline uint32_t anonymize_addr(uint32_t);
+    uint32_t preserve_mask(uint32_t) const;
+    void anonymize_addrs(uint32_t *, int);
+
+    static int map_handler(int, String &, Element *, const Handler *, ErrorHandler *);
 
     void handle_icmp(WritablePacket *);
 
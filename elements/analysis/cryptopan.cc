@@ -0,0 +1,223 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * cryptopan.{cc,hh} -- Crypto-PAn prefix-preserving address anonymization
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "cryptopan.hh"
+#if CLICK_USERLEVEL && (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+# define CRYPTOPAN_AESNI 1
+# include <wmmintrin.h>
+#endif
+CLICK_DECLS
+
+static const unsigned char sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static inline unsigned char
+xtime(unsigned char x)
+{
+    return (x << 1) ^ ((x & 0x80) ? 0x1b : 0);
+}
+
+static void
+aes128_expand_key(const unsigned char *key, unsigned char *rk)
+{
+    memcpy(rk, key, 16);
+    unsigned char rcon = 1;
+    for (int i = 16; i < 176; i += 4) {
+	unsigned char t[4] = { rk[i - 4], rk[i - 3], rk[i - 2], rk[i - 1] };
+	if (i % 16 == 0) {
+	    unsigned char t0 = t[0];
+	    t[0] = sbox[t[1]] ^ rcon;
+	    t[1] = sbox[t[2]];
+	    t[2] = sbox[t[3]];
+	    t[3] = sbox[t0];
+	    rcon = xtime(rcon);
+	}
+	for (int j = 0; j < 4; ++j)
+	    rk[i + j] = rk[i - 16 + j] ^ t[j];
+    }
+}
+
+static void
+aes128_encrypt(const unsigned char *in, unsigned char *out, const unsigned char *rk)
+{
+    unsigned char s[16], t[16];
+    for (int i = 0; i < 16; ++i)
+	s[i] = in[i] ^ rk[i];
+    for (int round = 1; round <= 10; ++round) {
+	// SubBytes and ShiftRows; the state is column-major
+	for (int c = 0; c < 4; ++c)
+	    for (int r = 0; r < 4; ++r)
+		t[4 * c + r] = sbox[s[4 * ((c + r) & 3) + r]];
+	// MixColumns, except in the last round
+	if (round < 10)
+	    for (int c = 0; c < 4; ++c) {
+		unsigned char *col = t + 4 * c;
+		unsigned char a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+		unsigned char all = a0 ^ a1 ^ a2 ^ a3;
+		col[0] ^= all ^ xtime(a0 ^ a1);
+		col[1] ^= all ^ xtime(a1 ^ a2);
+		col[2] ^= all ^ xtime(a2 ^ a3);
+		col[3] ^= all ^ xtime(a3 ^ a0);
+	    }
+	for (int i = 0; i < 16; ++i)
+	    s[i] = t[i] ^ rk[16 * round + i];
+    }
+    memcpy(out, s, 16);
+}
+
+#if CRYPTOPAN_AESNI
+static __attribute__((target("aes,sse2"))) void
+aesni_encrypt_blocks(const unsigned char *in, unsigned char *out, int n,
+		     const unsigned char *rk)
+{
+    __m128i k[11];
+    for (int r = 0; r < 11; ++r)
+	k[r] = _mm_loadu_si128((const __m128i *) (rk + 16 * r));
+    // eight independent blocks keep the AES unit's pipeline full
+    for (; n >= 8; n -= 8, in += 128, out += 128) {
+	__m128i b[8];
+	for (int j = 0; j < 8; ++j)
+	    b[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 16 * j)), k[0]);
+	for (int r = 1; r < 10; ++r)
+	    for (int j = 0; j < 8; ++j)
+		b[j] = _mm_aesenc_si128(b[j], k[r]);
+	for (int j = 0; j < 8; ++j)
+	    _mm_storeu_si128((__m128i *) (out + 16 * j), _mm_aesenclast_si128(b[j], k[10]));
+    }
+    for (; n > 0; --n, in += 16, out += 16) {
+	__m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in), k[0]);
+	for (int r = 1; r < 10; ++r)
+	    b = _mm_aesenc_si128(b, k[r]);
+	_mm_storeu_si128((__m128i *) out, _mm_aesenclast_si128(b, k[10]));
+    }
+}
+#endif
+
+bool
+CryptoPAn::have_aesni()
+{
+#if CRYPTOPAN_AESNI
+    static int have = -1;
+    if (have < 0)
+	have = __builtin_cpu_supports("aes") ? 1 : 0;
+    return have;
+#else
+    return false;
+#endif
+}
+
+CryptoPAn::CryptoPAn()
+    : _pad32(0), _high(0)
+{
+    memset(_rk, 0, sizeof(_rk));
+    memset(_block, 0, sizeof(_block));
+}
+
+CryptoPAn::~CryptoPAn()
+{
+    delete[] _high;
+}
+
+void
+CryptoPAn::encrypt_blocks(const unsigned char *in, unsigned char *out, int n) const
+{
+#if CRYPTOPAN_AESNI
+    if (have_aesni()) {
+	aesni_encrypt_blocks(in, out, n, _rk);
+	return;
+    }
+#endif
+    for (; n > 0; --n, in += 16, out += 16)
+	aes128_encrypt(in, out, _rk);
+}
+
+bool
+CryptoPAn::set_key(const unsigned char *key)
+{
+    aes128_expand_key(key, _rk);
+    encrypt_blocks(key + 16, _block, 1);
+    _pad32 = (_block[0] << 24) | (_block[1] << 16) | (_block[2] << 8) | _block[3];
+    if (!_high && !(_high = new atomic_uint32_t[65536]))
+	return false;
+    for (int i = 0; i < 65536; ++i)
+	_high[i] = 0;
+    return true;
+}
+
+void
+CryptoPAn::pads(const uint32_t *a, uint32_t *pad, int n) const
+{
+    // Bit i of the pad is the first bit of the encryption of a block whose
+    // first i bits come from the address and whose other bits come from the
+    // encrypted pad.  Blocks for up to two addresses are encrypted together.
+    unsigned char in[64 * 16], out[64 * 16];
+    while (n > 0) {
+	int m = (n < 2 ? n : 2);
+	int from[2], nb = 0;
+	uint32_t high[2];
+	for (int j = 0; j < m; ++j) {
+	    high[j] = _high[a[j] >> 16].value();
+	    from[j] = (high[j] ? 16 : 0);
+	    for (int pos = from[j]; pos < 32; ++pos, ++nb) {
+		uint32_t x = _pad32;
+		if (pos)
+		    x = ((a[j] >> (32 - pos)) << (32 - pos)) | ((_pad32 << pos) >> pos);
+		unsigned char *b = in + 16 * nb;
+		b[0] = x >> 24;
+		b[1] = x >> 16;
+		b[2] = x >> 8;
+		b[3] = x;
+		memcpy(b + 4, _block + 4, 12);
+	    }
+	}
+
+	encrypt_blocks(in, out, nb);
+
+	nb = 0;
+	for (int j = 0; j < m; ++j) {
+	    uint32_t p = 0;
+	    if (from[j])
+		p = high[j] << 16;
+	    for (int pos = from[j]; pos < 32; ++pos, ++nb)
+		p |= (uint32_t) (out[16 * nb] >> 7) << (31 - pos);
+	    if (!from[j])
+		_high[a[j] >> 16] = 0x10000 | (p >> 16);
+	    pad[j] = p;
+	}
+	a += m;
+	pad += m;
+	n -= m;
+    }
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(CryptoPAn)
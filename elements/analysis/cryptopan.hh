@@ -0,0 +1,56 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_CRYPTOPAN_HH
+#define CLICK_CRYPTOPAN_HH
+#include <click/glue.hh>
+#include <click/atomic.hh>
+CLICK_DECLS
+
+/*
+ * CryptoPAn implements the Crypto-PAn prefix-preserving IPv4 address
+ * anonymization of Xu, Fan, Ammar, and Moon, which derives bit i of the
+ * output from an AES-128 encryption of the input's first i bits.  The
+ * mapping depends only on the 32-byte key: the first 16 bytes are the AES
+ * key, the rest a pad.
+ *
+ * On x86 CPUs with AES-NI, the 32 independent encryptions per address are
+ * pipelined with those instructions.  The one-time pad for each /16 prefix
+ * is computed once and remembered, so addresses in a known /16 cost 16
+ * encryptions.  Threads may call pads() concurrently: each remembered entry
+ * is a single word, read and written atomically, and every thread computes
+ * the same value for it.
+ */
+class CryptoPAn { public:
+
+    enum { KEY_SIZE = 32 };
+
+    CryptoPAn();
+    ~CryptoPAn();
+
+    bool set_key(const unsigned char *key);
+
+    /* Return the one-time pad for addresses a[0..n-1], in host byte order:
+       bit i of the anonymized address is bit i of a[i] XOR bit i of the
+       pad. */
+    void pads(const uint32_t *a, uint32_t *pad, int n) const;
+
+    inline uint32_t anonymize(uint32_t a) const {
+	uint32_t pad;
+	pads(&a, &pad, 1);
+	return a ^ pad;
+    }
+
+    static bool have_aesni();
+
+  private:
+
+    unsigned char _rk[16 * 11];		// AES-128 round keys
+    unsigned char _block[16];		// encrypted pad, as Crypto-PAn uses it
+    uint32_t _pad32;
+    atomic_uint32_t *_high;		// 0x10000 | pad bits for each /16, or 0
+
+    void encrypt_blocks(const unsigned char *in, unsigned char *out, int n) const;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -49,7 +49,8 @@ CLICK_DECLS
 #define GET1(p)		((p)[0])
 
 FromIPSummaryDump::FromIPSummaryDump()
-    : _work_packet(0), _task(this), _timer(this)
+    : _work_packet(0), _task(this), _timer(this),
+      _block_count(0), _block_pos(0), _skipped_blocks(0)
 {
     _ff.set_landmark_pattern("%f:%l");
 }
@@ -71,6 +72,7 @@ int
 FromIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     bool stop = false, active = true, zero = true, checksum = false, multipacket = false, timing = false, allow_nonexistent = false;
+    bool have_start, have_end, have_addr;
     uint8_t default_proto = IP_PROTO_TCP;
     _sampling_prob = (1 << SAMPLING_SHIFT);
     String default_contents, default_flowid, data;
@@ -92,6 +94,9 @@ FromIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("FIELDS", AnyArg(), default_contents)
 	.read("FLOWID", AnyArg(), default_flowid)
 	.read("ALLOW_NONEXISTENT", allow_nonexistent)
+	.read("START", _start).read_status(have_start)
+	.read("END", _end).read_status(have_end)
+	.read("ADDR", IPPrefixArg(true), _addr, _addr_mask).read_status(have_addr)
         .read("DATA", data)
 	.complete() < 0)
 	return -1;
@@ -110,7 +115,10 @@ FromIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     _allow_nonexistent = allow_nonexistent;
     _have_timing = false;
     _multipacket = multipacket;
-    _have_flowid = _have_aggregate = _binary = false;
+    _have_flowid = _have_aggregate = _binary = _columnar = false;
+    _have_start = have_start;
+    _have_end = have_end;
+    _have_addr = have_addr;
     if (default_contents)
 	bang_data(default_contents, errh);
     if (default_flowid)
@@ -130,13 +138,26 @@ FromIPSummaryDump::read_binary(String &result, ErrorHandler *errh)
     assert(_binary);
 
     uint8_t record_storage[4];
-    const uint8_t *record = _ff.get_unaligned(4, record_storage, errh);
-    if (!record)
-	return 0;
-    int record_length = GET4(record) & 0x7FFFFFFFU;
-    if (record_length < 4)
-	return _ff.error(errh, "binary record too short");
-    bool textual = (record[0] & 0x80 ? true : false);
+    const uint8_t *record;
+    int record_length;
+    bool textual;
+    while (1) {
+	record = _ff.get_unaligned(4, record_storage, errh);
+	if (!record)
+	    return 0;
+	record_length = GET4(record) & 0x7FFFFFFFU;
+	if (record_length < 4)
+	    return _ff.error(errh, "binary record too short");
+	textual = (record[0] & 0x80 ? true : false);
+	if (textual || !_columnar)
+	    break;
+	// columnar blocks are decoded into _block, or skipped
+	int r = read_block(record_length, errh);
+	if (r < 0)
+	    return 0;
+	else if (r > 0)
+	    return 1;
+    }
     result = _ff.get_string(record_length - 4, errh);
     if (!result)
 	return 0;
@@ -151,6 +172,130 @@ FromIPSummaryDump::read_binary(String &result, ErrorHandler *errh)
     return (textual ? 2 : 1);
 }
 
+int
+FromIPSummaryDump::read_block(uint32_t record_length, ErrorHandler *errh)
+{
+    using namespace IPSummaryDump;
+    uint32_t header_length = COLUMN_BLOCK_HEADER_SIZE + _fields.size() * COLUMN_DIRENT_SIZE;
+    if (record_length < 4 + header_length)
+	return _ff.error(errh, "columnar block too short");
+    uint32_t data_length = record_length - 4 - header_length;
+    _ff.set_lineno(_ff.lineno() + 1);
+
+    // copy the header, since reading the data may refill _ff's buffer
+    String header = _ff.get_string(header_length, errh);
+    if (!header)
+	return -1;
+    header = String(header.data(), header.length());
+    const uint8_t *h = reinterpret_cast<const uint8_t *>(header.data());
+    uint32_t count = column_value(h, 4);
+    if (column_value(h + 4, 4) != (uint64_t) _fields.size())
+	return _ff.error(errh, "columnar block does not match '!data'");
+    // every value takes at least one byte of data
+    if (count > COLUMN_BLOCK_MAX || count > data_length)
+	return _ff.error(errh, "bad columnar block");
+    const uint8_t *dir = h + COLUMN_BLOCK_HEADER_SIZE;
+
+    if ((_have_start || _have_end || _have_addr) && !check_block(dir)) {
+	_ff.shift_pos(data_length);
+	_skipped_blocks++;
+	return 0;
+    }
+
+    String data = _ff.get_string(data_length, errh);
+    if (!data && data_length)
+	return -1;
+    const uint8_t *s = reinterpret_cast<const uint8_t *>(data.data());
+    const uint8_t *end = s + data_length;
+
+    uint64_t total = 0;
+    for (int i = 0; i < _fields.size(); i++) {
+	int width = dir[i * COLUMN_DIRENT_SIZE + 5];
+	if (_fields[i] != &null_reader && width != column_width(_fields[i]->type))
+	    return _ff.error(errh, "columnar field '%s' has unexpected width", _fields[i]->name);
+	total += (uint64_t) count * width;
+    }
+    if (total > 0x7FFFFFFF)
+	return _ff.error(errh, "bad columnar block");
+    _block.clear();
+    uint8_t *out = reinterpret_cast<uint8_t *>(_block.extend(total));
+    if (!out && total)
+	return _ff.error(errh, strerror(ENOMEM));
+
+    _block_columns.clear();
+    for (int i = 0; i < _fields.size(); i++) {
+	const uint8_t *dirent = dir + i * COLUMN_DIRENT_SIZE;
+	uint32_t length = column_value(dirent, 4);
+	int width = dirent[5];
+	if (length > (uint32_t) (end - s)
+	    || !column_decode(s, s + length, dirent[4], count, width, out))
+	    return _ff.error(errh, "bad columnar block");
+	_block_columns.push_back(out);
+	out += (size_t) count * width;
+	s += length;
+    }
+    _block_count = count;
+    _block_pos = 0;
+    return 1;
+}
+
+static uint64_t
+time_key(const char *name, const Timestamp &ts)
+{
+    if (strcmp(name, "timestamp") == 0)
+	return ((uint64_t) (uint32_t) ts.sec() << 32) | (uint32_t) ts.usec();
+    else if (strcmp(name, "ntimestamp") == 0)
+	return ((uint64_t) (uint32_t) ts.sec() << 32) | (uint32_t) ts.nsec();
+    else if (strcmp(name, "ts_usec1") == 0)
+	return (uint64_t) ts.sec() * 1000000 + ts.usec();
+    else
+	return (uint32_t) ts.sec();
+}
+
+bool
+FromIPSummaryDump::check_block(const uint8_t *dir) const
+{
+    using namespace IPSummaryDump;
+    bool addr_indexed = false, addr_match = false;
+    uint32_t addr_lo = ntohl(_addr.addr() & _addr_mask.addr());
+    uint32_t addr_hi = addr_lo | ~ntohl(_addr_mask.addr());
+
+    for (int i = 0; i < _fields.size(); i++, dir += COLUMN_DIRENT_SIZE) {
+	const char *name = _fields[i]->name;
+	uint64_t min = column_value(dir + 8, 8), max = column_value(dir + 16, 8);
+	if (strcmp(name, "timestamp") == 0 || strcmp(name, "ntimestamp") == 0
+	    || strcmp(name, "ts_usec1") == 0 || strcmp(name, "ts_sec") == 0) {
+	    // keys are monotonic in time, so these comparisons are safe
+	    // even for fields coarser than the packets' timestamps
+	    if (_have_start && max < time_key(name, _start))
+		return false;
+	    if (_have_end && min > time_key(name, _end))
+		return false;
+	} else if (_have_addr && (strcmp(name, "ip_src") == 0 || strcmp(name, "ip_dst") == 0)) {
+	    addr_indexed = true;
+	    if (max >= addr_lo && min <= addr_hi)
+		addr_match = true;
+	}
+    }
+    return !addr_indexed || addr_match;
+}
+
+bool
+FromIPSummaryDump::check_filter(const Packet *p) const
+{
+    if (_have_start && p->timestamp_anno() < _start)
+	return false;
+    if (_have_end && p->timestamp_anno() >= _end)
+	return false;
+    if (_have_addr) {
+	const click_ip *iph = p->has_network_header() ? p->ip_header() : 0;
+	if (!iph || (!IPAddress(iph->ip_src).matches_prefix(_addr, _addr_mask)
+		     && !IPAddress(iph->ip_dst).matches_prefix(_addr, _addr_mask)))
+	    return false;
+    }
+    return true;
+}
+
 int
 FromIPSummaryDump::initialize(ErrorHandler *errh)
 {
@@ -325,6 +470,18 @@ FromIPSummaryDump::bang_binary(const String &line, ErrorHandler *errh)
     _ff.set_lineno(1);
 }
 
+void
+FromIPSummaryDump::bang_columnar(const String &line, ErrorHandler *errh)
+{
+    Vector<String> words;
+    cp_spacevec(line, words);
+    if (words.size() != 1)
+	_ff.error(errh, "bad !columnar specification");
+    _binary = _columnar = true;
+    _ff.set_landmark_pattern("%f:block %l");
+    _ff.set_lineno(0);
+}
+
 static void
 set_checksums(WritablePacket *q, click_ip *iph)
 {
@@ -354,18 +511,34 @@ set_checksums(WritablePacket *q, click_ip *iph)
 
 Packet *
 FromIPSummaryDump::read_packet(ErrorHandler *errh)
+{
+    while (1) {
+	Packet *p = parse_packet(errh);
+	if (!p || (!_have_start && !_have_end && !_have_addr) || check_filter(p))
+	    return p;
+	p->kill();
+    }
+}
+
+Packet *
+FromIPSummaryDump::parse_packet(ErrorHandler *errh)
 {
     // read non-packet lines
     bool binary;
     String line;
-    const char *data;
-    const char *end;
+    const char *data = 0;
+    const char *end = 0;
 
     while (1) {
-	if ((binary = _binary)) {
+	if (_block_pos < _block_count) {
+	    binary = true;
+	    break;
+	} else if ((binary = _binary)) {
 	    int result = read_binary(line, errh);
 	    if (result <= 0)
 		goto eof;
+	    else if (_block_pos < _block_count)
+		continue;
 	    else
 		binary = (result == 1);
 	} else if (_ff.read_line(line, errh, true) <= 0) {
@@ -395,6 +568,8 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
 		bang_aggregate(line, errh);
 	    else if (data + 8 <= end && memcmp(data, "!binary", 7) == 0 && isspace((unsigned char) data[7]))
 		bang_binary(line, errh);
+	    else if (data + 10 <= end && memcmp(data, "!columnar", 9) == 0 && isspace((unsigned char) data[9]))
+		bang_columnar(line, errh);
 	    else if (data + 10 <= end && memcmp(data, "!contents", 9) == 0 && isspace((unsigned char) data[9]))
 		bang_data(line, errh);
 	}
@@ -415,7 +590,29 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
     int nfields = 0;
 
     // new code goes here
-    if (_binary) {
+    if (_block_pos < _block_count) {
+	Vector<const unsigned char *> args;
+	for (int i = 0; i < _fields.size(); i++) {
+	    int width = IPSummaryDump::column_width(_fields[i]->type);
+	    args.push_back(_block_columns[i] + _block_pos * width);
+	}
+	++_block_pos;
+	end = _block.end();
+
+	for (int *fip = _field_order.begin();
+	     fip != _field_order.end() && d.p;
+	     ++fip) {
+	    const IPSummaryDump::FieldReader *f = _fields[*fip];
+	    if (!f->inject)
+		continue;
+	    d.clear_values();
+	    if (f->inb(d, args[*fip], (const uint8_t *) end, f)) {
+		f->inject(d, f);
+		nfields++;
+	    }
+	}
+
+    } else if (_binary) {
 	Vector<const unsigned char *> args;
 	int nbytes;
 	for (const IPSummaryDump::FieldReader * const *fp = _fields.begin(); fp != _fields.end(); ++fp) {
@@ -749,7 +946,7 @@ FromIPSummaryDump::pull(int)
 }
 
 
-enum { H_SAMPLING_PROB, H_ACTIVE, H_ENCAP, H_STOP };
+enum { H_SAMPLING_PROB, H_ACTIVE, H_ENCAP, H_STOP, H_SKIPPED_BLOCKS };
 
 String
 FromIPSummaryDump::read_handler(Element *e, void *thunk)
@@ -762,6 +959,8 @@ FromIPSummaryDump::read_handler(Element *e, void *thunk)
 	return BoolArg::unparse(fd->_active);
       case H_ENCAP:
 	return "IP";
+      case H_SKIPPED_BLOCKS:
+	return String(fd->_skipped_blocks);
       default:
 	return "<error>";
     }
@@ -801,6 +1000,7 @@ FromIPSummaryDump::add_handlers()
     add_read_handler("active", read_handler, H_ACTIVE, Handler::f_checkbox);
     add_write_handler("active", write_handler, H_ACTIVE);
     add_read_handler("encap", read_handler, H_ENCAP);
+    add_read_handler("skipped_blocks", read_handler, H_SKIPPED_BLOCKS);
     add_write_handler("stop", write_handler, H_STOP, Handler::f_button);
     _ff.add_handlers(this);
     if (output_is_push(0))
@@ -13,7 +13,7 @@ CLICK_DECLS
 /*
 =c
 
-FromIPSummaryDump(FILENAME [, I<keywords> STOP, TIMING, ACTIVE, ZERO, CHECKSUM, PROTO, MULTIPACKET, SAMPLE, FIELDS, FLOWID, DATA])
+FromIPSummaryDump(FILENAME [, I<keywords> STOP, TIMING, ACTIVE, ZERO, CHECKSUM, PROTO, MULTIPACKET, SAMPLE, FIELDS, FLOWID, START, END, ADDR, DATA])
 
 =s traces
 
@@ -100,6 +100,21 @@ destination address, destination port, and, optionally, protocol). Defines the
 IP addresses and ports used by default. Any flow information in the input file
 will override this setting.
 
+=item START
+
+Timestamp. If set, FromIPSummaryDump skips packets with timestamps before
+START.
+
+=item END
+
+Timestamp. If set, FromIPSummaryDump skips packets with timestamps at or
+after END.
+
+=item ADDR
+
+IP prefix. If set, FromIPSummaryDump skips packets whose IP source and
+destination addresses are both outside ADDR.
+
 =item ALLOW_NONEXISTENT
 
 Boolean.  If true, allow nonexistent and empty files: FromIPSummaryDump will
@@ -126,6 +141,13 @@ extra header length annotations are set correctly.
 FromIPSummaryDump is a notifier signal, active when the element is active and
 the dump contains more packets.
 
+START, END, and ADDR work for any dump, but they are fastest on columnar
+dumps written by ToIPSummaryDump's COLUMNAR option.  Each columnar block
+records the range of every field's values, so FromIPSummaryDump skips blocks
+that cannot contain matching packets without decoding them.  Time ranges use
+the dump's 'C<timestamp>', 'C<ntimestamp>', 'C<ts_usec1>', or 'C<ts_sec>'
+field; address ranges use 'C<ip_src>' and 'C<ip_dst>'.
+
 =h sampling_prob read-only
 
 Returns the sampling probability (see the SAMPLE keyword argument).
@@ -147,6 +169,10 @@ length cannot be determined.
 
 Returns FromIPSummaryDump's position in the file, in bytes.
 
+=h skipped_blocks read-only
+
+Returns the number of columnar blocks skipped because of START, END, or ADDR.
+
 =h stop write-only
 
 When written, sets 'active' to false and stops the driver.
@@ -198,6 +224,10 @@ class FromIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
     bool _timing : 1;
     bool _have_timing : 1;
     bool _allow_nonexistent : 1;
+    bool _columnar : 1;
+    bool _have_start : 1;
+    bool _have_end : 1;
+    bool _have_addr : 1;
     Packet *_work_packet;
     uint32_t _multipacket_length;
     Timestamp _multipacket_timestamp_delta;
@@ -211,7 +241,22 @@ class FromIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
     int _minor_version;
     IPFlowID _given_flowid;
 
+    Timestamp _start;
+    Timestamp _end;
+    IPAddress _addr;
+    IPAddress _addr_mask;
+
+    // current columnar block
+    StringAccum _block;
+    Vector<const uint8_t *> _block_columns;
+    uint32_t _block_count;
+    uint32_t _block_pos;
+    uint32_t _skipped_blocks;
+
     int read_binary(String &, ErrorHandler *);
+    int read_block(uint32_t record_length, ErrorHandler *);
+    bool check_block(const uint8_t *dir) const;
+    bool check_filter(const Packet *p) const;
 
     static int sort_fields_compare(const void *, const void *, void *);
     void bang_data(const String &, ErrorHandler *);
@@ -219,9 +264,11 @@ class FromIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
     void bang_flowid(const String &, ErrorHandler *);
     void bang_aggregate(const String &, ErrorHandler *);
     void bang_binary(const String &, ErrorHandler *);
+    void bang_columnar(const String &, ErrorHandler *);
     void check_defaults();
     bool check_timing(Packet *p);
     Packet *read_packet(ErrorHandler *);
+    Packet *parse_packet(ErrorHandler *);
     Packet *handle_multipacket(Packet *);
 
     static String read_handler(Element *, void *) CLICK_COLD;
@@ -0,0 +1,479 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * ipfixexport.{cc,hh} -- export flow records as IPFIX or NetFlow v9
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "ipfixexport.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+CLICK_DECLS
+
+namespace {
+
+enum { F_SRC, F_DST, F_SPORT, F_DPORT, F_PROTO, F_TCP_FLAGS, F_TOS,
+       F_OCTETS, F_PACKETS, F_START, F_END, F_END_REASON };
+
+struct FieldSpec {
+    uint16_t id;
+    uint16_t length;
+    int what;
+};
+
+// IANA IPFIX information elements
+const FieldSpec ipfix_fields[] = {
+    { 8, 4, F_SRC },		// sourceIPv4Address
+    { 12, 4, F_DST },		// destinationIPv4Address
+    { 7, 2, F_SPORT },		// sourceTransportPort
+    { 11, 2, F_DPORT },		// destinationTransportPort
+    { 4, 1, F_PROTO },		// protocolIdentifier
+    { 6, 2, F_TCP_FLAGS },	// tcpControlBits
+    { 5, 1, F_TOS },		// ipClassOfService
+    { 1, 8, F_OCTETS },		// octetDeltaCount
+    { 2, 8, F_PACKETS },	// packetDeltaCount
+    { 152, 8, F_START },	// flowStartMilliseconds
+    { 153, 8, F_END },		// flowEndMilliseconds
+    { 136, 1, F_END_REASON }	// flowEndReason
+};
+
+// NetFlow v9 field types
+const FieldSpec v9_fields[] = {
+    { 8, 4, F_SRC },		// IPV4_SRC_ADDR
+    { 12, 4, F_DST },		// IPV4_DST_ADDR
+    { 7, 2, F_SPORT },		// L4_SRC_PORT
+    { 11, 2, F_DPORT },		// L4_DST_PORT
+    { 4, 1, F_PROTO },		// PROTOCOL
+    { 6, 1, F_TCP_FLAGS },	// TCP_FLAGS
+    { 5, 1, F_TOS },		// SRC_TOS
+    { 1, 8, F_OCTETS },		// IN_BYTES
+    { 2, 8, F_PACKETS },	// IN_PKTS
+    { 22, 4, F_START },		// FIRST_SWITCHED
+    { 21, 4, F_END }		// LAST_SWITCHED
+};
+
+enum { TEMPLATE_ID = 256,
+       IPFIX_HEADER_SIZE = 16, V9_HEADER_SIZE = 20,
+       IPFIX_TEMPLATE_SET = 2, V9_TEMPLATE_SET = 0 };
+
+inline uint8_t *
+put(uint8_t *s, uint64_t v, int len)
+{
+    for (int i = len - 1; i >= 0; --i, v >>= 8)
+	s[i] = v;
+    return s + len;
+}
+
+}
+
+IPFIXExport::IPFIXExport()
+    : _nflows(0), _agg_notifier(0), _expire_timer(this), _msg(0),
+      _timer(this), _nrecords(0), _nmessages(0), _nnoagg(0)
+{
+}
+
+IPFIXExport::~IPFIXExport()
+{
+}
+
+int
+IPFIXExport::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Element *e = 0;
+    _version = 10;
+    _domain = 0;
+    _active_timeout = Timestamp(1800);
+    _inactive_timeout = Timestamp(15);
+    _max_flows = 1048576;
+    _mtu = 1400;
+    _template_interval = Timestamp(60);
+    _flush_interval = Timestamp(1);
+
+    if (Args(conf, this, errh)
+	.read("NOTIFIER", e)
+	.read("VERSION", _version)
+	.read("DOMAIN", _domain)
+	.read("ACTIVE_TIMEOUT", _active_timeout)
+	.read("INACTIVE_TIMEOUT", _inactive_timeout)
+	.read("MAX_FLOWS", _max_flows)
+	.read("MTU", _mtu)
+	.read("TEMPLATE_INTERVAL", _template_interval)
+	.read("FLUSH_INTERVAL", _flush_interval)
+	.complete() < 0)
+	return -1;
+
+    if (_version != 9 && _version != 10)
+	return errh->error("VERSION must be 9 or 10");
+    if (_mtu < 256 || _mtu > 65535)
+	return errh->error("MTU out of range");
+    if (e && !(_agg_notifier = (AggregateNotifier *)e->cast("AggregateNotifier")))
+	return errh->error("%s is not an AggregateNotifier", e->name().c_str());
+    return 0;
+}
+
+int
+IPFIXExport::initialize(ErrorHandler *)
+{
+    if (_agg_notifier)
+	_agg_notifier->add_listener(this);
+    _timer.initialize(this);
+    _expire_timer.initialize(this);
+    return 0;
+}
+
+void
+IPFIXExport::cleanup(CleanupStage stage)
+{
+    if (_nnoagg > 0 && _nrecords == 0 && _nflows == 0)
+	click_chatter("%p{element}: saw no packets with aggregate annotations", this);
+    if (stage == CLEANUP_ROUTER_INITIALIZED) {
+	while (Flow *f = _active_list.front())
+	    export_flow(f, END_FORCED);
+	finish_message();
+    }
+    while (Flow *f = _idle_list.front())
+	delete_flow(f);
+    if (_msg)
+	_msg->kill();
+    _msg = 0;
+}
+
+IPFIXExport::Flow *
+IPFIXExport::new_flow(uint32_t key, const Packet *p)
+{
+    if (_max_flows && _nflows >= _max_flows)
+	export_flow(_idle_list.front(), END_RESOURCES);
+
+    void *x = _allocator.allocate();
+    if (!x)
+	return 0;
+    Flow *f = new(x) Flow;
+    const click_ip *iph = p->ip_header();
+    f->_key = key;
+    f->_flowid = IPFlowID(p);
+    f->_proto = iph->ip_p;
+    f->_tos = iph->ip_tos;
+    f->_tcp_flags = 0;
+    f->_octets = f->_packets = 0;
+    f->_first = _now;
+    _map.set(f);
+    _map.balance();
+    _idle_list.push_back(f);
+    _active_list.push_back(f);
+    _nflows++;
+    if (!_expire_timer.scheduled()) {
+	_tick_now = _now;
+	_tick_wall = Timestamp::now_steady();
+	_expire_timer.schedule_after_sec(1);
+    }
+    return f;
+}
+
+void
+IPFIXExport::delete_flow(Flow *f)
+{
+    _map.erase(f->_key);
+    _idle_list.erase(f);
+    _active_list.erase(f);
+    f->~Flow();
+    _allocator.deallocate(f);
+    _nflows--;
+}
+
+inline uint8_t *
+IPFIXExport::reserve(uint32_t len)
+{
+    uint8_t *x = _msg->data() + _msg_len;
+    _msg_len += len;
+    return x;
+}
+
+bool
+IPFIXExport::start_message()
+{
+    _msg = Packet::make(Packet::default_headroom, 0, _mtu, 0);
+    if (!_msg)
+	return false;
+    _msg_len = (_version == 10 ? IPFIX_HEADER_SIZE : V9_HEADER_SIZE);
+    _msg_records = _msg_template_records = 0;
+    _msg_set = 0;
+    if (!_next_template || _now >= _next_template) {
+	add_template();
+	_next_template = _now + _template_interval;
+    }
+    if (_flush_interval)
+	_timer.schedule_after(_flush_interval);
+    return true;
+}
+
+void
+IPFIXExport::add_template()
+{
+    const FieldSpec *fields = (_version == 10 ? ipfix_fields : v9_fields);
+    int nfields = (_version == 10 ? sizeof(ipfix_fields) : sizeof(v9_fields)) / sizeof(FieldSpec);
+    uint32_t len = 8 + nfields * 4;
+    uint8_t *x = reserve(len);
+    x = put(x, _version == 10 ? IPFIX_TEMPLATE_SET : V9_TEMPLATE_SET, 2);
+    x = put(x, len, 2);
+    x = put(x, TEMPLATE_ID, 2);
+    x = put(x, nfields, 2);
+    for (int i = 0; i < nfields; ++i) {
+	x = put(x, fields[i].id, 2);
+	x = put(x, fields[i].length, 2);
+    }
+    _msg_template_records++;
+}
+
+void
+IPFIXExport::finish_message()
+{
+    if (!_msg)
+	return;
+    _timer.unschedule();
+    WritablePacket *q = _msg;
+    _msg = 0;
+
+    if (_msg_set)
+	put(q->data() + _msg_set + 2, _msg_len - _msg_set, 2);
+    q->take(_mtu - _msg_len);
+
+    uint32_t export_sec = _now.sec();
+    uint8_t *x = q->data();
+    x = put(x, _version, 2);
+    if (_version == 10) {
+	x = put(x, _msg_len, 2);
+	x = put(x, export_sec, 4);
+	x = put(x, _nrecords - _msg_records, 4);
+    } else {
+	x = put(x, _msg_records + _msg_template_records, 2);
+	x = put(x, (_now - _boot).msecval(), 4);
+	x = put(x, export_sec, 4);
+	x = put(x, _nmessages, 4);
+    }
+    put(x, _domain, 4);
+
+    _nmessages++;
+    q->timestamp_anno() = _now;
+    output(0).push(q);
+}
+
+void
+IPFIXExport::export_flow(Flow *f, int reason)
+{
+    if (f->_packets) {
+	const FieldSpec *fields = (_version == 10 ? ipfix_fields : v9_fields);
+	int nfields = (_version == 10 ? sizeof(ipfix_fields) : sizeof(v9_fields)) / sizeof(FieldSpec);
+	uint32_t len = 0;
+	for (int i = 0; i < nfields; ++i)
+	    len += fields[i].length;
+
+	if (_msg && _msg_len + len + (_msg_set ? 0 : 4) > _mtu)
+	    finish_message();
+	if (!_msg && !start_message())
+	    goto done;
+	if (!_msg_set) {
+	    if (_msg_len + len + 4 > _mtu) {
+		// template took the room
+		finish_message();
+		if (!start_message())
+		    goto done;
+	    }
+	    _msg_set = _msg_len;
+	    uint8_t *x = reserve(4);
+	    put(x, TEMPLATE_ID, 2);
+	}
+
+	uint8_t *x = reserve(len);
+	for (int i = 0; i < nfields; ++i) {
+	    uint64_t v;
+	    switch (fields[i].what) {
+	    case F_SRC:
+		v = ntohl(f->_flowid.saddr().addr());
+		break;
+	    case F_DST:
+		v = ntohl(f->_flowid.daddr().addr());
+		break;
+	    case F_SPORT:
+		v = ntohs(f->_flowid.sport());
+		break;
+	    case F_DPORT:
+		v = ntohs(f->_flowid.dport());
+		break;
+	    case F_PROTO:
+		v = f->_proto;
+		break;
+	    case F_TCP_FLAGS:
+		v = f->_tcp_flags;
+		break;
+	    case F_TOS:
+		v = f->_tos;
+		break;
+	    case F_OCTETS:
+		v = f->_octets;
+		break;
+	    case F_PACKETS:
+		v = f->_packets;
+		break;
+	    case F_START:
+		v = (_version == 10 ? f->_first.msecval() : (f->_first - _boot).msecval());
+		break;
+	    case F_END:
+		v = (_version == 10 ? f->_last.msecval() : (f->_last - _boot).msecval());
+		break;
+	    case F_END_REASON:
+		v = reason;
+		break;
+	    default:
+		v = 0;
+		break;
+	    }
+	    x = put(x, v, fields[i].length);
+	}
+	_msg_records++;
+	_nrecords++;
+    }
+
+  done:
+    delete_flow(f);
+}
+
+void
+IPFIXExport::expire()
+{
+    Timestamp idle_limit = _now - _inactive_timeout;
+    while (Flow *f = _idle_list.front()) {
+	if (f->_last >= idle_limit)
+	    break;
+	export_flow(f, END_IDLE);
+    }
+    Timestamp active_limit = _now - _active_timeout;
+    while (Flow *f = _active_list.front()) {
+	if (f->_first > active_limit)
+	    break;
+	export_flow(f, END_ACTIVE);
+    }
+}
+
+void
+IPFIXExport::push(int, Packet *p)
+{
+    Timestamp ts = p->timestamp_anno();
+    if (!ts)
+	ts = Timestamp::now();
+    if (ts > _now)
+	_now = ts;
+    if (!_boot)
+	_boot = _now;
+    expire();
+
+    uint32_t agg = AGGREGATE_ANNO(p);
+    const click_ip *iph = (p->has_network_header() ? p->ip_header() : 0);
+    if (agg && agg < 0x80000000U && iph && PAINT_ANNO(p) < 2) {
+	uint32_t key = (agg << 1) | PAINT_ANNO(p);
+	Flow *f = _map.get(key);
+	if (!f)
+	    f = new_flow(key, p);
+	else {
+	    _idle_list.erase(f);
+	    _idle_list.push_back(f);
+	}
+	if (f) {
+	    f->_octets += ntohs(iph->ip_len);
+	    f->_packets++;
+	    f->_last = _now;
+	    if (iph->ip_p == IP_PROTO_TCP && IP_FIRSTFRAG(iph)
+		&& p->transport_length() >= 14)
+		f->_tcp_flags |= p->tcp_header()->th_flags;
+	}
+    } else
+	_nnoagg++;
+
+    checked_output_push(1, p);
+}
+
+void
+IPFIXExport::aggregate_notify(uint32_t agg, AggregateEvent event, const Packet *)
+{
+    if (event == DELETE_AGG && agg < 0x80000000U)
+	for (int dir = 0; dir < 2; ++dir)
+	    if (Flow *f = _map.get((agg << 1) | dir)) {
+		int reason = (f->_tcp_flags & (TH_FIN | TH_RST) ? END_FLOW : END_IDLE);
+		export_flow(f, reason);
+	    }
+}
+
+void
+IPFIXExport::run_timer(Timer *t)
+{
+    if (t == &_expire_timer) {
+	// If no packet has advanced the clock since the last tick, advance it
+	// by the elapsed wall time.
+	Timestamp wall = Timestamp::now_steady();
+	if (_now == _tick_now)
+	    _now += wall - _tick_wall;
+	_tick_now = _now;
+	_tick_wall = wall;
+	expire();
+	if (_nflows)
+	    _expire_timer.reschedule_after_sec(1);
+    } else
+	finish_message();
+}
+
+enum { H_FLOWS, H_RECORDS, H_MESSAGES, H_FLUSH };
+
+String
+IPFIXExport::read_handler(Element *e, void *thunk)
+{
+    IPFIXExport *ie = static_cast<IPFIXExport *>(e);
+    switch ((intptr_t) thunk) {
+    case H_FLOWS:
+	return String(ie->_nflows);
+    case H_RECORDS:
+	return String(ie->_nrecords);
+    case H_MESSAGES:
+	return String(ie->_nmessages);
+    default:
+	return String();
+    }
+}
+
+int
+IPFIXExport::write_handler(const String &, Element *e, void *thunk, ErrorHandler *)
+{
+    IPFIXExport *ie = static_cast<IPFIXExport *>(e);
+    switch ((intptr_t) thunk) {
+    case H_FLUSH:
+	while (Flow *f = ie->_active_list.front())
+	    ie->export_flow(f, END_FORCED);
+	ie->finish_message();
+	return 0;
+    default:
+	return -1;
+    }
+}
+
+void
+IPFIXExport::add_handlers()
+{
+    add_read_handler("flows", read_handler, H_FLOWS);
+    add_read_handler("records", read_handler, H_RECORDS);
+    add_read_handler("messages", read_handler, H_MESSAGES);
+    add_write_handler("flush", write_handler, H_FLUSH, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(AggregateNotifier)
+EXPORT_ELEMENT(IPFIXExport)
@@ -0,0 +1,243 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IPFIXEXPORT_HH
+#define CLICK_IPFIXEXPORT_HH
+#include <click/element.hh>
+#include <click/ipflowid.hh>
+#include <click/hashcontainer.hh>
+#include <click/hashallocator.hh>
+#include <click/list.hh>
+#include <click/timer.hh>
+#include "aggregatenotifier.hh"
+CLICK_DECLS
+
+/*
+=c
+
+IPFIXExport([I<keywords> NOTIFIER, VERSION, DOMAIN, ACTIVE_TIMEOUT, INACTIVE_TIMEOUT, MAX_FLOWS, MTU, TEMPLATE_INTERVAL, FLUSH_INTERVAL])
+
+=s ipmeasure
+
+exports flow records in IPFIX or NetFlow v9 format
+
+=d
+
+IPFIXExport keeps a flow record for every flow seen on its input, and
+exports finished records as IPFIX (RFC 7011) or NetFlow version 9 (RFC 3954)
+messages on output 0.  Each message is a UDP payload, so output 0 is usually
+connected to a Socket element that sends to the collector, as in the example
+below.  Input packets are emitted unchanged on output 1, or dropped if there
+is no output 1.
+
+Flows are identified by aggregate annotation, so IPFIXExport normally follows
+an AggregateIPFlows element.  Packets with paint annotation 0 and 1 are
+counted in separate, unidirectional flow records, as IPFIX and NetFlow
+expect.  Packets without an aggregate annotation, without an IP header, or
+with paint annotation greater than 1 (ICMP errors) are not counted.
+
+A flow record is exported when its flow has been idle for INACTIVE_TIMEOUT,
+when it has been open for ACTIVE_TIMEOUT, or when the NOTIFIER element
+reports that the flow is over.  The next packet on an exported flow starts a
+new record.  Like AggregateIPFlows, IPFIXExport measures time by packet
+timestamps.  While no packets arrive, its clock advances with the wall clock,
+so idle flows are still exported.  Flows still open when the router stops
+are exported with end reason "forced end".
+
+Records are packed into messages of at most MTU bytes.  A message is sent
+when it is full, or FLUSH_INTERVAL after its first record was added.  Every
+TEMPLATE_INTERVAL, the next message starts with the template describing the
+records.  Each record contains the source and destination addresses and
+ports, the IP protocol, the union of TCP flags, the IP TOS byte, the number
+of IP octets and packets, and the times of the first and last packets.  IPFIX
+records also contain a flow end reason.
+
+Keyword arguments are:
+
+=over 8
+
+=item NOTIFIER
+
+The name of an AggregateNotifier element, such as AggregateIPFlows.  When the
+notifier deletes an aggregate, IPFIXExport exports its records.
+
+=item VERSION
+
+Either 10, for IPFIX, or 9, for NetFlow version 9.  Default is 10.
+
+=item DOMAIN
+
+Integer.  The observation domain ID (IPFIX) or source ID (NetFlow v9) placed
+in message headers.  Default is 0.
+
+=item ACTIVE_TIMEOUT
+
+Time in seconds.  Long-lived flows are exported at least this often.
+Default is 30 minutes.
+
+=item INACTIVE_TIMEOUT
+
+Time in seconds.  Flows with no packets for this long are exported.  Default
+is 15 seconds.
+
+=item MAX_FLOWS
+
+Integer.  The maximum number of flow records kept.  When the cache is full,
+the least recently active record is exported early.  0 means no limit.
+Default is 1048576.
+
+=item MTU
+
+Integer.  The maximum message length in bytes.  Default is 1400.
+
+=item TEMPLATE_INTERVAL
+
+Time in seconds.  Default is 60.
+
+=item FLUSH_INTERVAL
+
+Time in seconds.  Default is 1.
+
+=back
+
+IPFIXExport is not thread-safe.  On a multithreaded router, use one
+IPFIXExport (and one AggregateIPFlows) per thread, with different DOMAINs.
+
+=h flows read-only
+
+Returns the number of open flow records.
+
+=h records read-only
+
+Returns the number of flow records exported.
+
+=h messages read-only
+
+Returns the number of messages emitted.
+
+=h flush write-only
+
+Exports every open flow record, then emits any partial message.  Useful at
+the end of a trace:
+
+   DriverManager(wait, write af.clear, write ipfix.flush)
+
+=e
+
+   FromDevice(eth0)
+     -> Strip(14) -> CheckIPHeader
+     -> af :: AggregateIPFlows
+     -> ipfix :: IPFIXExport(NOTIFIER af, DOMAIN 1)
+     -> Socket(UDP, 10.0.0.2, 4739, CLIENT true);
+
+=a
+
+AggregateIPFlows, ToIPFlowDumps, Socket */
+
+class IPFIXExport : public Element, public AggregateListener { public:
+
+    IPFIXExport() CLICK_COLD;
+    ~IPFIXExport() CLICK_COLD;
+
+    const char *class_name() const	{ return "IPFIXExport"; }
+    const char *port_count() const	{ return "1/1-2"; }
+    const char *processing() const	{ return PUSH; }
+    // clean up before downstream elements, which receive the last records
+    int configure_phase() const		{ return CONFIGURE_PHASE_DEFAULT + 200; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+    void run_timer(Timer *);
+
+    void aggregate_notify(uint32_t, AggregateEvent, const Packet *);
+
+  private:
+
+    struct Flow {
+	typedef uint32_t key_type;
+	typedef uint32_t key_const_reference;
+
+	uint32_t _key;		// aggregate << 1 | direction
+	Flow *_hashnext;
+	List_member<Flow> _idle_link;
+	List_member<Flow> _active_link;
+
+	IPFlowID _flowid;
+	uint8_t _proto;
+	uint8_t _tos;
+	uint8_t _tcp_flags;
+	uint64_t _octets;
+	uint64_t _packets;
+	Timestamp _first;
+	Timestamp _last;
+
+	key_const_reference hashkey() const {
+	    return _key;
+	}
+    };
+
+    typedef HashContainer<Flow> Map;
+    typedef List<Flow, &Flow::_idle_link> IdleList;
+    typedef List<Flow, &Flow::_active_link> ActiveList;
+
+    Map _map;
+    IdleList _idle_list;	// least recently active first
+    ActiveList _active_list;	// oldest first
+    SizedHashAllocator<sizeof(Flow)> _allocator;
+    uint32_t _nflows;
+
+    AggregateNotifier *_agg_notifier;
+    int _version;
+    uint32_t _domain;
+    Timestamp _active_timeout;
+    Timestamp _inactive_timeout;
+    uint32_t _max_flows;
+    uint32_t _mtu;
+    Timestamp _template_interval;
+    Timestamp _flush_interval;
+
+    Timestamp _now;		// latest packet timestamp
+    Timestamp _boot;		// first packet timestamp, for NetFlow v9
+    Timestamp _next_template;
+
+    // expiry without packets: _now and the wall clock at the last tick
+    Timer _expire_timer;
+    Timestamp _tick_now;
+    Timestamp _tick_wall;
+
+    // message under construction
+    WritablePacket *_msg;
+    uint32_t _msg_len;
+    uint32_t _msg_records;	// data records in _msg
+    uint32_t _msg_set;		// offset of data set header, or 0
+    uint32_t _msg_template_records;
+    Timer _timer;
+
+    uint64_t _nrecords;
+    uint32_t _nmessages;
+    uint32_t _nnoagg;
+
+    enum {
+	END_IDLE = 1, END_ACTIVE = 2, END_FLOW = 3, END_FORCED = 4,
+	END_RESOURCES = 5
+    };
+
+    Flow *new_flow(uint32_t key, const Packet *p);
+    void delete_flow(Flow *f);
+    void export_flow(Flow *f, int reason);
+    void expire();
+
+    bool start_message();
+    void add_template();
+    void finish_message();
+    inline uint8_t *reserve(uint32_t len);
+
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
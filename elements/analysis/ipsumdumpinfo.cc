@@ -343,6 +343,105 @@ const uint8_t *inb(PacketOdesc& d, const uint8_t *s, const uint8_t *end, const F
 }
 
 
+int column_width(int type)
+{
+    switch (type) {
+    case B_0:
+	return 0;
+    case B_1:
+	return 1;
+    case B_2:
+	return 2;
+    case B_4:
+    case B_4NET:
+	return 4;
+    case B_6PTR:
+	return 6;
+    case B_8:
+	return 8;
+    case B_16:
+	return 16;
+    default:
+	return -1;
+    }
+}
+
+static inline bool column_numeric(int width)
+{
+    return width == 1 || width == 2 || width == 4 || width == 8;
+}
+
+void column_encode(StringAccum &sa, const uint8_t *data, int n, int width, int &encoding)
+{
+    int start = sa.length(), rawlen = n * width;
+    if (column_numeric(width)) {
+	// Store the differences between successive values as zigzag
+	// varints, so slowly changing columns take about a byte per value.
+	int shift = 64 - 8 * width;
+	uint64_t prev = 0;
+	const uint8_t *s = data;
+	for (int i = 0; i < n && sa.length() - start < rawlen; ++i, s += width) {
+	    uint64_t v = column_value(s, width);
+	    int64_t delta = (int64_t) ((v - prev) << shift) >> shift;
+	    uint64_t z = ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63);
+	    for (; z >= 0x80; z >>= 7)
+		sa.append((char) (z | 0x80));
+	    sa.append((char) z);
+	    prev = v;
+	}
+	if (sa.length() - start < rawlen) {
+	    encoding = COLUMN_DELTA;
+	    return;
+	}
+	sa.set_length(start);
+    }
+    sa.append(data, rawlen);
+    encoding = COLUMN_RAW;
+}
+
+bool column_decode(const uint8_t *s, const uint8_t *end, int encoding, uint32_t n, int width, uint8_t *out)
+{
+    if (encoding == COLUMN_RAW) {
+	size_t len = (size_t) n * width;
+	if ((size_t) (end - s) != len)
+	    return false;
+	memcpy(out, s, len);
+	return true;
+    } else if (encoding == COLUMN_DELTA && column_numeric(width)) {
+	uint64_t v = 0;
+	for (uint32_t i = 0; i < n; ++i, out += width) {
+	    uint64_t z = 0;
+	    for (int shift = 0; ; shift += 7) {
+		if (s == end || shift > 63)
+		    return false;
+		z |= (uint64_t) (*s & 0x7F) << shift;
+		if (!(*s++ & 0x80))
+		    break;
+	    }
+	    v += (z >> 1) ^ -(z & 1);
+	    column_store(out, width, v);
+	}
+	return s == end;
+    } else
+	return false;
+}
+
+void column_range(const uint8_t *data, int n, int width, uint64_t &min, uint64_t &max)
+{
+    min = max = 0;
+    if (!column_numeric(width) || n == 0)
+	return;
+    min = max = column_value(data, width);
+    for (int i = 1; i < n; ++i) {
+	data += width;
+	uint64_t v = column_value(data, width);
+	if (v < min)
+	    min = v;
+	else if (v > max)
+	    max = v;
+    }
+}
+
 
 void ip_prepare(PacketDesc &d, const FieldWriter *)
 {
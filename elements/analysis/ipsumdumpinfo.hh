@@ -174,6 +174,19 @@ void outb(const PacketDesc&, bool ok, const FieldWriter *);
 bool num_ina(PacketOdesc&, const String &, const FieldReader *);
 const uint8_t *inb(PacketOdesc&, const uint8_t*, const uint8_t*, const FieldReader *);
 
+// Columnar blocks store each field's values together; see ToIPSummaryDump.
+enum { COLUMN_RAW = 0,
+       COLUMN_DELTA = 1,
+       COLUMN_BLOCK_HEADER_SIZE = 8,
+       COLUMN_DIRENT_SIZE = 24,
+       COLUMN_BLOCK_MAX = 1048576 };	// records per block
+int column_width(int type);
+void column_encode(StringAccum &sa, const uint8_t *data, int n, int width, int &encoding);
+bool column_decode(const uint8_t *s, const uint8_t *end, int encoding, uint32_t n, int width, uint8_t *out);
+void column_range(const uint8_t *data, int n, int width, uint64_t &min, uint64_t &max);
+inline uint64_t column_value(const uint8_t *s, int width);
+inline void column_store(uint8_t *s, int width, uint64_t v);
+
 enum { MISSING_IP = 0,
        MISSING_ETHERNET = 260 };
 inline bool field_missing(const PacketDesc &d, int proto, int l);
@@ -251,6 +264,20 @@ inline bool field_missing(const PacketDesc &d, int proto, int l)
     return (d.bad_sa ? hard_field_missing(d, proto, l) : false);
 }
 
+inline uint64_t column_value(const uint8_t *s, int width)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < width; ++i)
+        v = (v << 8) | s[i];
+    return v;
+}
+
+inline void column_store(uint8_t *s, int width, uint64_t v)
+{
+    for (int i = width - 1; i >= 0; --i, v >>= 8)
+        s[i] = v;
+}
+
 }
 
 class IPSummaryDumpInfo { public:
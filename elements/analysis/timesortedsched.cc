@@ -27,10 +27,12 @@
 CLICK_DECLS
 
 TimeSortedSched::TimeSortedSched()
-    : _pkt(0), _npkt(0), _input(0), _nready(0),
+    : _pkt(0), _npkt(0), _input(0), _iheap(0), _niheap(0),
+      _parked(0), _nparked(0), _parked_pos(0), _starved(0), _nstarved(0),
       _notifier(Notifier::SEARCH_CONTINUE_WAKE), _buffer(1),
       _well_ordered(true)
 {
+    _woken = 0;
 }
 
 TimeSortedSched::~TimeSortedSched()
@@ -54,10 +56,13 @@ TimeSortedSched::configure(Vector<String> &conf, ErrorHandler *errh)
     if (Args(conf, this, errh)
 	.read("STOP", _stop)
 	.read("BUFFER", _buffer)
+	.read("WINDOW", _window).read_status(_windowed)
 	.complete() < 0)
 	return -1;
     if (_buffer <= 0)
 	return errh->error("BUFFER must be at least 1");
+    if (_windowed && _window < Timestamp())
+	return errh->error("WINDOW must not be negative");
     return 0;
 }
 
@@ -66,14 +71,16 @@ TimeSortedSched::initialize(ErrorHandler *errh)
 {
     _pkt = new packet_s[ninputs() * _buffer];
     _input = new input_s[ninputs()];
-    if (!_pkt || !_input)
+    _iheap = new int[ninputs()];
+    _parked = new int[ninputs()];
+    _starved = new int[ninputs()];
+    if (!_pkt || !_input || !_iheap || !_parked || !_starved)
 	return errh->error("out of memory!");
     for (int i = 0; i < ninputs(); i++) {
-	_input[i].signal = Notifier::upstream_empty_signal(this, i, &_notifier);
+	_input[i].signal = Notifier::upstream_empty_signal(this, i, wake_callback, this);
 	_input[i].space = _buffer;
-	_input[i].ready = i;
+	add_ready(i);
     }
-    _nready = ninputs();
     return 0;
 }
 
@@ -84,32 +91,110 @@ TimeSortedSched::cleanup(CleanupStage)
 	_pkt[i].p->kill();
     delete[] _pkt;
     delete[] _input;
+    delete[] _iheap;
+    delete[] _parked;
+    delete[] _starved;
+}
+
+void
+TimeSortedSched::wake_callback(void *user_data, Notifier *)
+{
+    TimeSortedSched *tss = static_cast<TimeSortedSched *>(user_data);
+    tss->_woken = 1;
+    tss->_notifier.wake();
+}
+
+inline void
+TimeSortedSched::add_ready(int i)
+{
+    _input[i].state = S_READY;
+    _iheap[_niheap] = i;
+    ++_niheap;
+    push_heap(_iheap, _iheap + _niheap, input_less(_input), input_place(_input));
+}
+
+inline void
+TimeSortedSched::remove_top(int state)
+{
+    int i = _iheap[0];
+    _input[i].state = state;
+    pop_heap(_iheap, _iheap + _niheap, input_less(_input), input_place(_input));
+    --_niheap;
+    if (state == S_PARKED)
+	_parked[_nparked++] = i;
+    else if (state == S_STARVED)
+	_starved[_nstarved++] = i;
+}
+
+inline void
+TimeSortedSched::unpark(int k)
+{
+    int i = _parked[k];
+    _parked[k] = _parked[_nparked - 1];
+    --_nparked;
+    add_ready(i);
+}
+
+void
+TimeSortedSched::check_parked()
+{
+    if (_woken.value() || _npkt == 0) {
+	// Something upstream may have new packets: check every input.
+	_woken = 0;
+	for (int k = _nparked - 1; k >= 0; --k)
+	    if (_input[_parked[k]].signal)
+		unpark(k);
+    } else {
+	// In case a wakeup raced with parking, also retry one parked input
+	// per pull.
+	int k = _parked_pos++ % _nparked;
+	if (_input[_parked[k]].signal)
+	    unpark(k);
+    }
 }
 
 Packet*
 TimeSortedSched::pull(int)
 {
-    bool signals_on = false;
-    // first maybe fill in buffer
-    for (int rpos = _nready - 1; rpos >= 0; --rpos) {
-	int i = _input[rpos].ready;
-	input_s &is = _input[i];
-	if (is.signal) {
-	    signals_on = true;
-	    while ((_pkt[_npkt].p = input(i).pull())) {
-		_pkt[_npkt].input = i;
-		++_npkt;
-		push_heap(_pkt, _pkt + _npkt, heap_less());
-		--is.space;
-		if (!is.space) {
-		    _input[rpos].ready = _input[_nready - 1].ready;
-		    --_nready;
-		    break;
-		}
-	    }
+    // An input whose signal stayed on while it was empty will not wake us,
+    // so pull it again.
+    while (_nstarved)
+	add_ready(_starved[--_nstarved]);
+    if (_nparked)
+	check_parked();
+
+    // First maybe fill in buffers.  The input heap's top is the input whose
+    // latest packet is earliest; it is the one that might hold a packet
+    // earlier than anything buffered.
+    while (_niheap > 0) {
+	input_s &is = _input[_iheap[0]];
+	if (_windowed && _npkt > 0
+	    && is.newest > _pkt[0].p->timestamp_anno() + _window)
+	    break;
+	if (!is.signal) {
+	    remove_top(S_PARKED);
+	    continue;
+	}
+	Packet *p = input(_iheap[0]).pull();
+	if (!p) {
+	    remove_top(is.signal ? S_STARVED : S_PARKED);
+	    continue;
 	}
+	_pkt[_npkt].p = p;
+	_pkt[_npkt].input = _iheap[0];
+	++_npkt;
+	push_heap(_pkt, _pkt + _npkt, heap_less());
+	if (p->timestamp_anno() > is.newest)
+	    is.newest = p->timestamp_anno();
+	--is.space;
+	if (!is.space)
+	    remove_top(S_FULL);
+	else
+	    change_heap(_iheap, _iheap + _niheap, _iheap, input_less(_input), input_place(_input));
     }
 
+    bool signals_on = _niheap > 0 || _nstarved > 0;
+
     // then maybe emit a packet
     _notifier.set_active(_npkt > 0 || signals_on);
     if (_npkt > 0) {
@@ -119,12 +204,10 @@ TimeSortedSched::pull(int)
 		_well_ordered = false;
 	    _last_emission = p->timestamp_anno();
 	}
-	input_s &is = _input[_pkt[0].input];
-	++is.space;
-	if (is.space == 1) {
-	    _input[_nready].ready = _pkt[0].input;
-	    ++_nready;
-	}
+	int i = _pkt[0].input;
+	++_input[i].space;
+	if (_input[i].state == S_FULL)
+	    add_ready(i);
 	pop_heap(_pkt, _pkt + _npkt, heap_less());
 	--_npkt;
 	return p;
@@ -3,12 +3,13 @@
 #define CLICK_TIMESORTEDSCHED_HH
 #include <click/element.hh>
 #include <click/notifier.hh>
+#include <click/atomic.hh>
 CLICK_DECLS
 
 /*
 =c
 
-TimeSortedSched(I<keywords> STOP, BUFFER)
+TimeSortedSched(I<keywords> STOP, BUFFER, WINDOW)
 
 =s timestamps
 
@@ -31,6 +32,15 @@ TimeSortedSched emitted some packets out of order.  (But see BUFFER, below.)
 TimeSortedSched listens for notification from its inputs to avoid useless
 pulls, and provides notification for its output.
 
+TimeSortedSched scales to thousands of inputs.  It keeps the inputs that may
+need pulling in a heap ordered by the timestamp of each input's latest packet,
+so a pull usually touches only the inputs that can affect the next emitted
+packet.  An input that comes up empty while its upstream notifier is active
+is pulled again on the next pull.  One that comes up empty with its notifier
+inactive is set aside, and checked again when any upstream notifier wakes up,
+when TimeSortedSched has no packets left, and otherwise one per pull, in
+turn.  Memory use is bounded by BUFFER packets per input.
+
 Keyword arguments are:
 
 =over 8
@@ -47,6 +57,15 @@ Integer. Up to BUFFER packets per input are buffered within
 TimeSortedSched. Default BUFFER is 1. Higher BUFFER values let TimeSortedSched
 cope with minor reordering in its input streams.
 
+=item WINDOW
+
+Timestamp. If set, TimeSortedSched pulls from an input only as far as
+necessary: it emits a packet once every input has buffered a packet at least
+WINDOW later, has a full buffer, or is empty.  Each input may then deliver
+packets up to WINDOW out of order, and TimeSortedSched will still emit them in
+order, provided BUFFER is large enough to hold a window's worth of packets.
+By default, every input's buffer is filled before each emission.
+
 =back
 
 =n
@@ -66,6 +85,9 @@ stream, and stops the driver when all the files are exhausted.
   // ...
   tss -> ...;
 
+FromDumps performs the same merge over tcpdump files, including a glob
+pattern such as C<link*.pcap>, with a reader thread per file.
+
 =h well_ordered r
 
 Returns a Boolean string. If "false", then TimeSortedSched's output was not
@@ -74,7 +96,7 @@ streams was not so sorted.
 
 =a
 
-FromDump
+FromDump, FromDumps
 */
 
 class TimeSortedSched : public Element { public:
@@ -108,22 +130,60 @@ class TimeSortedSched : public Element { public:
     };
     struct input_s {
 	NotifierSignal signal;
+	Timestamp newest;	// latest timestamp pulled
 	int space;
-	int ready;
+	int state;
+	int heap_index;
+    };
+    enum { S_READY, S_FULL, S_PARKED, S_STARVED };
+
+    // The input heap holds the S_READY inputs, earliest newest first.
+    struct input_less {
+	input_s *input;
+	input_less(input_s *input_)
+	    : input(input_) {
+	}
+	inline bool operator()(int a, int b) {
+	    return input[a].newest < input[b].newest;
+	}
+    };
+    struct input_place {
+	input_s *input;
+	input_place(input_s *input_)
+	    : input(input_) {
+	}
+	inline void operator()(int *begin, int *it) {
+	    input[*it].heap_index = it - begin;
+	}
     };
 
     packet_s *_pkt;
     int _npkt;
 
     input_s *_input;
-    int _nready;
+    int *_iheap;
+    int _niheap;
+    int *_parked;		// inputs that came up empty with signal off
+    int _nparked;
+    unsigned _parked_pos;	// next parked input to retry
+    int *_starved;		// inputs that came up empty with signal on
+    int _nstarved;
+    atomic_uint32_t _woken;	// an upstream notifier woke since last check
 
     Notifier _notifier;
     int _buffer;
+    Timestamp _window;
     Timestamp _last_emission;
+    bool _windowed;
     bool _stop;
     bool _well_ordered;
 
+    inline void add_ready(int i);
+    inline void remove_top(int state);
+    inline void unpark(int k);
+    void check_parked();
+    static void wake_callback(void *, Notifier *);
+
 };
 
 CLICK_ENDDECLS
@@ -31,12 +31,13 @@
 CLICK_DECLS
 
 ToIPSummaryDump::ToIPSummaryDump()
-    : _f(0), _task(this)
+    : _f(0), _task(this), _columns(0)
 {
 }
 
 ToIPSummaryDump::~ToIPSummaryDump()
 {
+    delete[] _columns;
 }
 
 int
@@ -48,8 +49,10 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     bool careful_trunc = true;
     bool multipacket = false;
     bool binary = false;
+    bool columnar = false;
     bool header = true;
     bool extra_length = true;
+    _block_size = 4096;
 
     if (Args(conf, this, errh)
 	.read_mp("FILENAME", FilenameArg(), _filename)
@@ -64,8 +67,12 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("CAREFUL_TRUNC", careful_trunc)
 	.read("EXTRA_LENGTH", extra_length)
 	.read("BINARY", binary)
+	.read("COLUMNAR", columnar)
+	.read("BLOCK_SIZE", _block_size)
 	.complete() < 0)
 	return -1;
+    if (columnar && (_block_size == 0 || _block_size > IPSummaryDump::COLUMN_BLOCK_MAX))
+	return errh->error("BLOCK_SIZE out of range");
 
     Vector<String> v;
     cp_spacevec(save, v);
@@ -94,6 +101,9 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	if ((s < 0 || !f->outb) && binary)
 	    errh->error("cannot use field %s with BINARY", word.c_str());
 	_binary_size += s;
+	_widths.push_back(IPSummaryDump::column_width(f->type));
+	if ((_widths.back() < 0 || !f->outb) && columnar)
+	    errh->error("cannot use field %s with COLUMNAR", word.c_str());
 
 	// remove _multipacket if packet count specified
 	if (strcmp(f->name, "count") == 0)
@@ -106,7 +116,8 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     _bad_packets = bad_packets;
     _careful_trunc = careful_trunc;
     _multipacket = multipacket;
-    _binary = binary;
+    _binary = binary || columnar;
+    _columnar = columnar;
     _header = header;
     _extra_length = extra_length;
 
@@ -162,8 +173,14 @@ ToIPSummaryDump::initialize(ErrorHandler *errh)
     sa << '\n';
 
     // binary marker
-    if (_binary)
+    if (_columnar)
+	sa << "!columnar\n";
+    else if (_binary)
 	sa << "!binary\n";
+    if (_columnar) {
+	_columns = new StringAccum[_fields.size()];
+	_block_count = 0;
+    }
 
     // print output
     if (_header)
@@ -175,6 +192,8 @@ ToIPSummaryDump::initialize(ErrorHandler *errh)
 void
 ToIPSummaryDump::cleanup(CleanupStage)
 {
+    if (_f && _columnar)
+	write_block();
     if (_f && _f != stdout)
 	fclose(_f);
     _f = 0;
@@ -252,12 +271,60 @@ ToIPSummaryDump::write_packet(Packet* p, int multipacket)
 
 	if (_bad_packets && _bad_sa)
 	    write_line(_bad_sa.take_string());
-	ignore_result(fwrite(_sa.data(), 1, _sa.length(), _f));
+	if (_columnar)
+	    add_row(reinterpret_cast<const unsigned char *>(_sa.data()) + 4);
+	else
+	    ignore_result(fwrite(_sa.data(), 1, _sa.length(), _f));
 
 	_output_count++;
     }
 }
 
+void
+ToIPSummaryDump::add_row(const unsigned char *data)
+{
+    for (int i = 0; i < _fields.size(); i++) {
+	_columns[i].append(data, _widths[i]);
+	data += _widths[i];
+    }
+    if (++_block_count == _block_size)
+	write_block();
+}
+
+void
+ToIPSummaryDump::write_block()
+{
+    if (!_block_count)
+	return;
+
+    using namespace IPSummaryDump;
+    int dirsize = _fields.size() * COLUMN_DIRENT_SIZE;
+    StringAccum sa;
+    char *c = sa.extend(4 + COLUMN_BLOCK_HEADER_SIZE + dirsize);
+    memset(c, 0, 4 + COLUMN_BLOCK_HEADER_SIZE + dirsize);
+    column_store((uint8_t *) c + 4, 4, _block_count);
+    column_store((uint8_t *) c + 8, 4, _fields.size());
+
+    for (int i = 0; i < _fields.size(); i++) {
+	const uint8_t *data = reinterpret_cast<const uint8_t *>(_columns[i].data());
+	int pos = sa.length(), encoding;
+	uint64_t min, max;
+	column_encode(sa, data, _block_count, _widths[i], encoding);
+	column_range(data, _block_count, _widths[i], min, max);
+	uint8_t *dirent = reinterpret_cast<uint8_t *>(sa.data()) + 4 + COLUMN_BLOCK_HEADER_SIZE + i * COLUMN_DIRENT_SIZE;
+	column_store(dirent, 4, sa.length() - pos);
+	dirent[4] = encoding;
+	dirent[5] = _widths[i];
+	column_store(dirent + 8, 8, min);
+	column_store(dirent + 16, 8, max);
+	_columns[i].clear();
+    }
+
+    column_store(reinterpret_cast<uint8_t *>(sa.data()), 4, sa.length());
+    ignore_result(fwrite(sa.data(), 1, sa.length(), _f));
+    _block_count = 0;
+}
+
 void
 ToIPSummaryDump::push(int, Packet *p)
 {
@@ -288,6 +355,8 @@ ToIPSummaryDump::write_line(const String& s)
 {
     if (s.length()) {
 	assert(s.back() == '\n');
+	if (_columnar)
+	    write_block();
 	if (_binary) {
 	    uint32_t marker = htonl(s.length() | 0x80000000U);
 	    ignore_result(fwrite(&marker, 4, 1, _f));
@@ -301,6 +370,8 @@ ToIPSummaryDump::add_note(const String &s)
 {
     if (s.length()) {
 	int extra = 1 + (s.back() == '\n' ? 0 : 1);
+	if (_columnar)
+	    write_block();
 	if (_binary) {
 	    uint32_t marker = htonl((s.length() + extra) | 0x80000000U);
 	    ignore_result(fwrite(&marker, 4, 1, _f));
@@ -316,6 +387,8 @@ int
 ToIPSummaryDump::flush_handler(const String &, Element *e, void *, ErrorHandler *)
 {
     ToIPSummaryDump *tod = (ToIPSummaryDump *) e;
+    if (tod->_f && tod->_columnar)
+	tod->write_block();
     if (tod->_f)
 	fflush(tod->_f);
     return 0;
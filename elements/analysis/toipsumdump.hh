@@ -23,7 +23,8 @@ Writes summary information about incoming packets to FILENAME in a simple
 ASCII format---each line corresponds to a packet.  The FIELDS keyword
 argument determines what information is written.  Writes to standard output if
 FILENAME is a single dash `C<->'.  The BINARY keyword argument writes a packed
-binary format to save space.
+binary format to save space; COLUMNAR writes a block-oriented columnar format
+for offline analysis.
 
 ToIPSummaryDump uses packets' extra-length and extra-packet-count annotations.
 
@@ -137,6 +138,17 @@ of the dump. Ignored if HEADER is false.
 Boolean. If true, then output packet records in a binary format (explained
 below). Defaults to false.
 
+=item COLUMNAR
+
+Boolean. If true, then output packet records in a columnar binary format
+(explained below), which is smaller than BINARY and lets FromIPSummaryDump
+skip blocks of records by time or address.  Variable-length fields, such as
+'C<ip_opt>', are not allowed.  Defaults to false.
+
+=item BLOCK_SIZE
+
+Integer. The number of packet records per COLUMNAR block.  Defaults to 4096.
+
 =item MULTIPACKET
 
 Boolean. If true, and the FIELDS option doesn't contain 'C<count>', then
@@ -338,6 +350,34 @@ The data stored in a metadata record is just an ASCII string, ending with
 newline, same as in a regular ASCII IPSummaryDump file. 'C<!bad>' records, for
 example, are stored this way.
 
+=head1 COLUMNAR FORMAT
+
+Columnar IPSummaryDump files begin with ASCII lines, ending with
+'C<!columnar>'.  After that come records framed as in the binary format.
+Metadata records are the same as in the binary format, but each regular
+record holds a block of up to BLOCK_SIZE packets, stored one field at a time:
+
+   +---------------+---------------+---------------+------------...
+   |0| block length|  packet count |  field count  |  directory
+   +---------------+---------------+---------------+------------...
+
+The directory contains one 24-byte entry per field, in 'C<!data>' order:
+
+   +---------------+-------+-------+-------+---------------+---------------+
+   | column length |  enc  | width |   0   |    minimum    |    maximum    |
+   +---------------+-------+-------+-------+---------------+---------------+
+    <---4 bytes---> <-1--> <--1--> <--2-->  <---8 bytes---> <---8 bytes--->
+
+The column data follows the directory, one column per field.  A column
+contains packet count values, each width bytes long when decoded, in the
+binary format's representation.  If enc is 0, the column is stored as is.  If
+enc is 1, each value is stored as the difference from the previous value
+(the first value's predecessor is 0), computed modulo 2^(8*width), taken as
+a signed number, zigzag-encoded, and written as a little-endian base-128
+varint.  Minimum and maximum are the smallest and largest values in the
+column, read as big-endian numbers; they are set only for 1-, 2-, 4-, and
+8-byte fields.
+
 =h flush write-only
 
 Flush all internal buffers to disk.
@@ -383,6 +423,7 @@ class ToIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
     bool _binary : 1;
     bool _header : 1;
     bool _extra_length : 1;
+    bool _columnar : 1;
     int32_t _binary_size;
     uint32_t _output_count;
     Task _task;
@@ -391,10 +432,17 @@ class ToIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
     StringAccum _sa;
     StringAccum _bad_sa;
 
+    uint32_t _block_size;
+    uint32_t _block_count;
+    Vector<int> _widths;
+    StringAccum *_columns;
+
     String _banner;
 
     bool summary(Packet* p, StringAccum& sa, StringAccum* bad_sa) const;
     void write_packet(Packet* p, int multipacket);
+    void add_row(const unsigned char *data);
+    void write_block();
     static int flush_handler(const String &, Element *, void *, ErrorHandler *);
 
 };
@@ -32,7 +32,7 @@
 CLICK_DECLS
 
 ARPQuerier::ARPQuerier()
-    : _arpt(0), _my_arpt(false), _zero_warned(false)
+    : _arpt(0), _caches(0), _my_arpt(false), _zero_warned(false)
 {
 }
 
@@ -185,12 +185,15 @@ ARPQuerier::initialize(ErrorHandler *)
     _arp_queries = 0;
     _drops = 0;
     _arp_responses = 0;
+    // Slots start with IP address 0.0.0.0, which is never cached.
+    _caches = new NextHopCache[click_max_cpu_ids()];
     return 0;
 }
 
 void
 ARPQuerier::cleanup(CleanupStage stage)
 {
+    delete[] _caches;
     if (_my_arpt) {
 	_arpt->cleanup(stage);
 	delete _arpt;
@@ -253,6 +256,37 @@ ARPQuerier::send_query_for(const Packet *p, bool ether_dhost_valid)
     output(noutputs() - 1).push(q);
 }
 
+/*
+ * Look up dst_ip as ARPTable::lookup() does, consulting this thread's next-hop
+ * cache first.  A cached result is used only while the table's generation is
+ * unchanged and the entry would neither expire nor need a poll.
+ */
+inline int
+ARPQuerier::lookup(IPAddress dst_ip, EtherAddress *dst_eth)
+{
+    uint32_t h = dst_ip.addr();
+    h ^= h >> 16;
+    h ^= h >> 8;
+    NextHop &n = _caches[click_current_cpu_id()].e[h & (cache_size - 1)];
+    click_jiffies_t now = click_jiffies();
+    uint32_t generation = _arpt->generation();
+    if (n.ip == dst_ip && dst_ip && n.generation == generation
+	&& click_jiffies_less(now, n.valid_until_j)) {
+	*dst_eth = n.eth;
+	return 0;
+    }
+
+    click_jiffies_t valid_until_j;
+    int r = _arpt->lookup(dst_ip, dst_eth, _poll_timeout_j, &valid_until_j);
+    if (r == 0 && dst_ip && click_jiffies_less(now, valid_until_j)) {
+	n.ip = dst_ip;
+	n.eth = *dst_eth;
+	n.generation = generation;
+	n.valid_until_j = valid_until_j;
+    }
+    return r;
+}
+
 /*
  * If the packet's IP address is in the table, add an ethernet header
  * and push it out.
@@ -285,9 +319,9 @@ ARPQuerier::handle_ip(Packet *p, bool response)
     EtherAddress *dst_eth = reinterpret_cast<EtherAddress *>(q->ether_header()->ether_dhost);
     int r;
 
-    // Easy case: requires only read lock
+    // Easy case: requires at most a read lock
   retry_read_lock:
-    r = _arpt->lookup(dst_ip, dst_eth, _poll_timeout_j);
+    r = lookup(dst_ip, dst_eth);
     if (r >= 0) {
 	assert(!dst_eth->is_broadcast());
 	if (r > 0)
@@ -116,6 +116,12 @@ annotations set from the corresponding input packets.
 
 ARPQuerier will send at most 10 queries a second for any IP address.
 
+Each thread running ARPQuerier keeps a small private cache of recently used
+next hops, so packets to a busy next hop usually avoid the ARP table
+altogether.  Cached results are dropped whenever the table removes an entry or
+changes an entry's Ethernet address, and a cached result is never used past
+the time its entry would expire or need polling.
+
 =h ipaddr rw
 
 Returns or sets the ARPQuerier's source IP address.
@@ -195,7 +201,19 @@ class ARPQuerier : public Element { public:
 
   private:
 
+    enum { cache_size = 8 };	// power of two
+    struct NextHop {
+	IPAddress ip;
+	EtherAddress eth;
+	uint32_t generation;
+	click_jiffies_t valid_until_j;
+    };
+    struct NextHopCache {
+	NextHop e[cache_size];
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
     ARPTable *_arpt;
+    NextHopCache *_caches;	// one per thread
     EtherAddress _my_en;
     IPAddress _my_ip;
     IPAddress _my_bcast_ip;
@@ -212,6 +230,7 @@ class ARPQuerier : public Element { public:
 
     void send_query_for(const Packet *p, bool ether_dhost_valid);
 
+    inline int lookup(IPAddress dst_ip, EtherAddress *dst_eth);
     void handle_ip(Packet *p, bool response);
     void handle_response(Packet *p);
 
@@ -33,7 +33,7 @@ CLICK_DECLS
 ARPTable::ARPTable()
     : _entry_capacity(0), _packet_capacity(2048), _entry_packet_capacity(0), _capacity_slim_factor(2), _expire_timer(this)
 {
-    _entry_count = _packet_count = _drops = 0;
+    _entry_count = _packet_count = _drops = _generation = 0;
 }
 
 ARPTable::~ARPTable()
@@ -83,6 +83,7 @@ ARPTable::clear()
     }
     _entry_count = _packet_count = 0;
     _age.__clear();
+    ++_generation;
 }
 
 void
@@ -105,6 +106,7 @@ ARPTable::take_state(Element *e, ErrorHandler *errh)
 
     arpt->_entry_count = 0;
     arpt->_packet_count = 0;
+    ++_generation;
 }
 
 void
@@ -128,6 +130,7 @@ ARPTable::slim(click_jiffies_t now)
 
 	_alloc.deallocate(ae);
 	--_entry_count;
+	++_generation;
     }
 
     // Delete packets to make space.
@@ -196,6 +199,8 @@ ARPTable::insert(IPAddress ip, const EtherAddress &eth, Packet **head)
     if (!ae)
 	return -ENOMEM;
 
+    if (ae->_known && ae->_eth != eth)
+	++_generation;
     ae->_eth = eth;
     ae->_known = !eth.is_broadcast();
 
@@ -283,6 +288,17 @@ ARPTable::append_query(IPAddress ip, Packet *p)
     return r;
 }
 
+void
+ARPTable::lookup(int n, const IPAddress *ip, EtherAddress *eth, int *result,
+		 uint32_t poll_timeout_j)
+{
+    _lock.acquire_read();
+    click_jiffies_t now = click_jiffies();
+    for (int i = 0; i < n; ++i)
+	result[i] = lookup_locked(ip[i], &eth[i], poll_timeout_j, now, 0);
+    _lock.release_read();
+}
+
 IPAddress
 ARPTable::reverse_lookup(const EtherAddress &eth)
 {
@@ -57,6 +57,13 @@ service attack.
 Time value.  The amount of time after which an ARP entry will expire.  Default
 is 5 minutes.  Zero means ARP entries never expire.
 
+=n
+
+Lookups take only a read lock.  ARPTable also keeps a generation number that
+changes whenever an entry is removed or its Ethernet address changes, so that
+callers, such as ARPQuerier, may cache lookup results privately and check that
+they are still current without touching the table.
+
 =h table r
 
 Return a table of the ARP entries.  The returned string has four
@@ -106,8 +113,11 @@ class ARPTable : public Element { public:
     void add_handlers() CLICK_COLD;
     void cleanup(CleanupStage) CLICK_COLD;
 
-    int lookup(IPAddress ip, EtherAddress *eth, uint32_t poll_timeout_j);
+    int lookup(IPAddress ip, EtherAddress *eth, uint32_t poll_timeout_j,
+	       click_jiffies_t *valid_until_j = 0);
     EtherAddress lookup(IPAddress ip);
+    void lookup(int n, const IPAddress *ip, EtherAddress *eth, int *result,
+		uint32_t poll_timeout_j);
     IPAddress reverse_lookup(const EtherAddress &eth);
     int insert(IPAddress ip, const EtherAddress &en, Packet **head = 0);
     int append_query(IPAddress ip, Packet *p);
@@ -157,6 +167,9 @@ class ARPTable : public Element { public:
     uint32_t length() const {
 	return _packet_count;
     }
+    uint32_t generation() const {
+	return _generation;
+    }
 
     void run_timer(Timer *);
 
@@ -222,32 +235,54 @@ class ARPTable : public Element { public:
     uint32_t _capacity_slim_factor;
     uint32_t _timeout_j;
     atomic_uint32_t _drops;
+    atomic_uint32_t _generation;
     SizedHashAllocator<sizeof(ARPEntry)> _alloc;
     Timer _expire_timer;
 
     ARPEntry *ensure(IPAddress ip, click_jiffies_t now);
     void slim(click_jiffies_t now);
+    inline int lookup_locked(IPAddress ip, EtherAddress *eth,
+			     uint32_t poll_timeout_j, click_jiffies_t now,
+			     click_jiffies_t *valid_until_j);
 
 };
 
 inline int
-ARPTable::lookup(IPAddress ip, EtherAddress *eth, uint32_t poll_timeout_j)
+ARPTable::lookup_locked(IPAddress ip, EtherAddress *eth,
+			uint32_t poll_timeout_j, click_jiffies_t now,
+			click_jiffies_t *valid_until_j)
 {
-    _lock.acquire_read();
-    int r = -1;
-    if (Table::iterator it = _table.find(ip)) {
-	click_jiffies_t now = click_jiffies();
+    if (Table::iterator it = _table.find(ip))
 	if (it->known(now, _timeout_j)) {
 	    *eth = it->_eth;
 	    if (poll_timeout_j
 		&& !click_jiffies_less(now, it->_live_at_j + poll_timeout_j)
 		&& it->allow_poll(now)) {
 		it->mark_poll(now);
-		r = 1;
-	    } else
-		r = 0;
+		return 1;
+	    }
+	    if (valid_until_j) {
+		// The result stands until the entry expires or needs a poll.
+		click_jiffies_t until_j = now + CLICK_HZ;
+		if (_timeout_j
+		    && click_jiffies_less(it->_live_at_j + _timeout_j, until_j))
+		    until_j = it->_live_at_j + _timeout_j;
+		if (poll_timeout_j
+		    && click_jiffies_less(it->_live_at_j + poll_timeout_j, until_j))
+		    until_j = it->_live_at_j + poll_timeout_j;
+		*valid_until_j = until_j;
+	    }
+	    return 0;
 	}
-    }
+    return -1;
+}
+
+inline int
+ARPTable::lookup(IPAddress ip, EtherAddress *eth, uint32_t poll_timeout_j,
+		 click_jiffies_t *valid_until_j)
+{
+    _lock.acquire_read();
+    int r = lookup_locked(ip, eth, poll_timeout_j, click_jiffies(), valid_until_j);
     _lock.release_read();
     return r;
 }
@@ -23,10 +23,12 @@
 #include <click/args.hh>
 #include <click/straccum.hh>
 #include <click/error.hh>
+#include <click/packet_anno.hh>
 CLICK_DECLS
 
 EtherSwitch::EtherSwitch()
-    : _table(AddrInfo(-1, Timestamp())), _timeout(300)
+    : _table(AddrInfo(-1, Timestamp())), _timeout(300), _vlan(false),
+      _expire_timer(this)
 {
 }
 
@@ -40,9 +42,34 @@ EtherSwitch::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     return Args(conf, this, errh)
 	.read("TIMEOUT", SecondsArg(), _timeout)
+	.read("VLAN", _vlan)
 	.complete();
 }
 
+int
+EtherSwitch::initialize(ErrorHandler *)
+{
+    _expire_timer.initialize(this);
+    _expire_timer.schedule_after_sec(_timeout / 4 + 1);
+    return 0;
+}
+
+void
+EtherSwitch::run_timer(Timer *)
+{
+    if (_timeout != 0) {
+	_lock.acquire_write();
+	Timestamp limit = _now - Timestamp(_timeout, 0);
+	for (Table::iterator it = _table.begin(); it.live(); )
+	    if (it.value().stamp < limit)
+		it = _table.erase(it);
+	    else
+		++it;
+	_lock.release_write();
+    }
+    _expire_timer.reschedule_after_sec(_timeout / 4 + 1);
+}
+
 void
 EtherSwitch::broadcast(int source, Packet *p)
 {
@@ -58,28 +85,70 @@ EtherSwitch::broadcast(int source, Packet *p)
   assert(sent == n - 1);
 }
 
-void
-EtherSwitch::push(int source, Packet *p)
+// Learns p's source address and returns the output port for its
+// destination, or -1 to flood.
+int
+EtherSwitch::lookup(int source, Packet *p)
 {
-    click_ether* e = (click_ether*) p->data();
-    int outport = -1;		// Broadcast
-
     // 0 timeout means dumb switch
-    if (_timeout != 0) {
-	_table.set(EtherAddress(e->ether_shost), AddrInfo(source, p->timestamp_anno()));
-
-	// Set outport if dst is unicast, we have info about it, and the
-	// info is still valid.
-	EtherAddress dst(e->ether_dhost);
-	if (!dst.is_group()) {
-	    if (Table::iterator dst_info = _table.find(dst)) {
-		if (p->timestamp_anno() < dst_info.value().stamp + Timestamp(_timeout, 0))
-		    outport = dst_info.value().port;
-		else
-		    _table.erase(dst_info);
-	    }
+    if (_timeout == 0)
+	return -1;
+
+    const click_ether *e = (const click_ether *) p->data();
+    uint16_t vlan = 0;
+    if (_vlan) {
+	const click_ether_vlan *ev = (const click_ether_vlan *) e;
+	if (ev->ether_vlan_proto == htons(ETHERTYPE_8021Q)
+	    && p->length() >= sizeof(click_ether_vlan))
+	    vlan = ntohs(ev->ether_vlan_tci) & 0x0FFF;
+	else
+	    vlan = ntohs(VLAN_TCI_ANNO(p)) & 0x0FFF;
+    }
+
+    // Look up both addresses under the read lock.  Only take the write lock
+    // if the source is new, has moved, or needs a fresher timestamp, or if
+    // the destination's association has expired.
+    const Timestamp &now = p->timestamp_anno();
+    Key src(e->ether_shost, vlan), dst(e->ether_dhost, vlan);
+    int outport = -1;
+    bool expired = false;
+    _lock.acquire_read();
+    Table::const_iterator src_info = _table.find(src);
+    bool learn = !src_info || src_info.value().port != source
+	|| src_info.value().stamp + Timestamp(1, 0) <= now;
+    // Set outport if dst is unicast, we have info about it, and the
+    // info is still valid.
+    if (!(e->ether_dhost[0] & 1))
+	if (Table::const_iterator dst_info = _table.find(dst)) {
+	    if (now < dst_info.value().stamp + Timestamp(_timeout, 0))
+		outport = dst_info.value().port;
+	    else
+		expired = true;
+	}
+    _lock.release_read();
+
+    if (learn || expired) {
+	_lock.acquire_write();
+	// _now only advances here; with traffic, known sources are relearned
+	// every second, so it lags the latest packet by at most that.
+	if (_now < now)
+	    _now = now;
+	if (learn)
+	    _table.set(src, AddrInfo(source, now));
+	if (expired) {
+	    Table::iterator dst_info = _table.find(dst);
+	    if (dst_info && !(now < dst_info.value().stamp + Timestamp(_timeout, 0)))
+		_table.erase(dst_info);
 	}
+	_lock.release_write();
     }
+    return outport;
+}
+
+void
+EtherSwitch::push(int source, Packet *p)
+{
+    int outport = lookup(source, p);
 
   if (outport < 0)
     broadcast(source, p);
@@ -96,12 +165,24 @@ EtherSwitch::reader(Element* f, void *thunk)
     switch ((intptr_t) thunk) {
     case 0: {
 	StringAccum sa;
-	for (Table::iterator iter = sw->_table.begin(); iter.live(); iter++)
-	    sa << iter.key() << ' ' << iter.value().port << '\n';
+	sw->_lock.acquire_read();
+	for (Table::iterator iter = sw->_table.begin(); iter.live(); iter++) {
+	    sa << iter.key().addr << ' ' << iter.value().port;
+	    if (sw->_vlan)
+		sa << ' ' << iter.key().vlan;
+	    sa << '\n';
+	}
+	sw->_lock.release_read();
 	return sa.take_string();
     }
     case 1:
 	return String(sw->_timeout);
+    case 2: {
+	sw->_lock.acquire_read();
+	int n = sw->_table.size();
+	sw->_lock.release_read();
+	return String(n);
+    }
     default:
 	return String();
     }
@@ -121,6 +202,7 @@ EtherSwitch::add_handlers()
 {
     add_read_handler("table", reader, 0);
     add_read_handler("timeout", reader, 1);
+    add_read_handler("count", reader, 2);
     add_write_handler("timeout", writer, 0);
 }
 
@@ -3,12 +3,14 @@
 #include <click/element.hh>
 #include <click/etheraddress.hh>
 #include <click/hashtable.hh>
+#include <click/timer.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 
 /*
 =c
 
-EtherSwitch([I<keywords> TIMEOUT])
+EtherSwitch([I<keywords> TIMEOUT, VLAN])
 
 =s ethernet
 
@@ -29,6 +31,13 @@ the one corresponding to the packet's input port.  The TIMEOUT parameter
 affects how long port associations last.  If it is 0, then the element does
 not learn addresses, and acts like a dumb hub.
 
+A known source address is relearned only when it moves to another port or
+its association is more than a second old, so steady traffic between known
+hosts reads the address table without writing it.  Lookups share a
+read/write lock; learning and expiry take it exclusively.  Expired
+associations are removed every TIMEOUT/4 seconds.  Times are taken from
+packets' timestamp annotations.
+
 Keyword arguments are:
 
 =over 8
@@ -39,16 +48,30 @@ The timeout for port associations, in seconds.  Any port mapping (i.e.,
 binding between an address and a port number) is dropped after TIMEOUT seconds
 of inactivity.  If 0, the element acts like a dumb hub.  Default is 300.
 
+=item VLAN
+
+Boolean.  If true, then learn addresses separately for each VLAN, so that
+the same address can be associated with different ports on different VLANs.
+A packet's VLAN ID is taken from its 802.1Q header, if it has one, and
+otherwise from its VLAN TCI annotation, as set by VLANDecap.  Packets are still
+flooded to every other port; use VLANEncap and Classifier downstream to
+restrict a VLAN to some ports.  Default is false.
+
 =back
 
 =n
 
 The EtherSwitch element has no limit on the memory consumed by cached Ethernet
-addresses.
+addresses, beyond the expiry of inactive associations.
 
 =h table read-only
 
-Returns the current port association table.
+Returns the current port association table.  Each line contains an address
+and a port number, followed by the VLAN ID if VLAN is true.
+
+=h count read-only
+
+Returns the number of associations in the table.
 
 =h timeout read/write
 
@@ -70,9 +93,11 @@ class EtherSwitch : public Element { public:
   const char *flow_code() const			{ return "#/[^#]"; }
 
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
     void add_handlers() CLICK_COLD;
 
   void push(int port, Packet* p);
+    void run_timer(Timer *);
 
     struct AddrInfo {
 	int port;
@@ -82,10 +107,32 @@ class EtherSwitch : public Element { public:
 
   private:
 
-    typedef HashTable<EtherAddress, AddrInfo> Table;
+    struct Key {
+	EtherAddress addr;
+	uint16_t vlan;
+	Key()
+	    : vlan(0) {
+	}
+	Key(const unsigned char *a, uint16_t v)
+	    : addr(a), vlan(v) {
+	}
+	hashcode_t hashcode() const {
+	    return addr.hashcode() + vlan;
+	}
+	bool operator==(const Key &x) const {
+	    return addr == x.addr && vlan == x.vlan;
+	}
+    };
+
+    typedef HashTable<Key, AddrInfo> Table;
+    ReadWriteLock _lock;	// protects _table and _now
     Table _table;
     uint32_t _timeout;
+    bool _vlan;
+    Timestamp _now;		// latest packet timestamp
+    Timer _expire_timer;
 
+    int lookup(int source, Packet *p);
     void broadcast(int source, Packet*);
 
     static String reader(Element *, void *);
@@ -60,17 +60,13 @@ DecIPTTL::simple_action(Packet *p)
 	if (!q)
 	    return 0;
 	click_ip *ip = q->ip_header();
-	--ip->ip_ttl;
 
 	// 19.Aug.1999 - incrementally update IP checksum as suggested by SOSP
-	// reviewers, according to RFC1141, as updated by RFC1624.
-	// new_sum = ~(~old_sum + ~old_halfword + new_halfword)
-	//         = ~(~old_sum + ~old_halfword + (old_halfword - 0x0100))
-	//         = ~(~old_sum + ~old_halfword + old_halfword + ~0x0100)
-	//         = ~(~old_sum + ~0 + ~0x0100)
-	//         = ~(~old_sum + 0xFEFF)
-	unsigned long sum = (~ntohs(ip->ip_sum) & 0xFFFF) + 0xFEFF;
-	ip->ip_sum = ~htons(sum + (sum >> 16));
+	// reviewers, according to RFC1141, as updated by RFC1624.  The TTL
+	// shares a halfword with the protocol.
+	uint16_t old_hw = htons((ip->ip_ttl << 8) | ip->ip_p);
+	--ip->ip_ttl;
+	click_update_in_cksum(&ip->ip_sum, old_hw, htons((ip->ip_ttl << 8) | ip->ip_p));
 
 	return q;
     }
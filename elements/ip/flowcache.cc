@@ -0,0 +1,322 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * flowcache.{cc,hh} -- memoizes per-flow classification decisions
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "flowcache.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ip.h>
+CLICK_DECLS
+
+FlowCache::FlowCache()
+    : _entries(0), _index(0), _pending_packet(0), _hits(0), _misses(0)
+{
+}
+
+FlowCache::~FlowCache()
+{
+    for (int i = 0; i < _hooks.size(); i++)
+	delete _hooks[i];
+}
+
+int
+FlowCache::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _capacity = 65536;
+    String eviction = "clock";
+    if (Args(conf, this, errh)
+	.read("CAPACITY", _capacity)
+	.read("EVICTION", WordArg(), eviction)
+	.read_all("INVALIDATE", ElementArg(), _invalidators)
+	.complete() < 0)
+	return -1;
+    if (_capacity <= 0)
+	return errh->error("CAPACITY must be positive");
+    if (eviction.equals("clock", -1))
+	_eviction = ev_clock;
+    else if (eviction.equals("lru", -1))
+	_eviction = ev_lru;
+    else
+	return errh->error("EVICTION must be %<clock%> or %<lru%>");
+    return 0;
+}
+
+int
+FlowCache::initialize(ErrorHandler *errh)
+{
+    // keep the open-addressed index at most half full
+    uint32_t index_size = 2;
+    while (index_size < (uint32_t) _capacity * 2)
+	index_size <<= 1;
+    _index_mask = index_size - 1;
+    _entries = new Entry[_capacity];
+    _index = new int32_t[index_size];
+    if (!_entries || !_index)
+	return errh->error("out of memory");
+    flush();
+
+    // Wrap the write handlers of INVALIDATE elements, so that changing their
+    // configuration or tables flushes stale decisions.
+    for (int i = 0; i < _invalidators.size(); i++) {
+	Element *e = _invalidators[i];
+	Vector<int> hindexes;
+	Router::element_hindexes(e, hindexes);
+	for (int j = 0; j < hindexes.size(); j++) {
+	    const Handler *h = Router::handler(router(), hindexes[j]);
+	    if (!h->writable())
+		continue;
+	    HandlerHook *hook = new HandlerHook(this, *h);
+	    _hooks.push_back(hook);
+	    Router::set_handler(e, h->name(), h->flags(), hook_handler, hook, hook);
+	}
+    }
+    return 0;
+}
+
+void
+FlowCache::cleanup(CleanupStage)
+{
+    // The wrapped handlers stay registered on the INVALIDATE elements until
+    // the router goes away, so detach them from the cache rather than free
+    // them; from now on they only forward.  The destructor frees them.
+    for (int i = 0; i < _hooks.size(); i++)
+	_hooks[i]->cache = 0;
+    delete[] _entries;
+    delete[] _index;
+    _entries = 0;
+    _index = 0;
+}
+
+void
+FlowCache::flush()
+{
+    for (uint32_t i = 0; i <= _index_mask; i++)
+	_index[i] = -1;
+    _nentries = 0;
+    _clock_hand = 0;
+    _lru_head = _lru_tail = -1;
+}
+
+void
+FlowCache::index_insert(int slot)
+{
+    const Entry &e = _entries[slot];
+    uint32_t i = hash(e.flow, e.proto) & _index_mask;
+    while (_index[i] >= 0)
+	i = (i + 1) & _index_mask;
+    _index[i] = slot;
+}
+
+void
+FlowCache::index_remove(int slot)
+{
+    const Entry &e = _entries[slot];
+    uint32_t i = hash(e.flow, e.proto) & _index_mask;
+    while (_index[i] != slot)
+	i = (i + 1) & _index_mask;
+
+    // Backward-shift deletion keeps linear probing chains intact without
+    // tombstones.
+    uint32_t j = i;
+    while (1) {
+	j = (j + 1) & _index_mask;
+	if (_index[j] < 0)
+	    break;
+	const Entry &ej = _entries[_index[j]];
+	uint32_t home = hash(ej.flow, ej.proto) & _index_mask;
+	if (((j - home) & _index_mask) >= ((j - i) & _index_mask)) {
+	    _index[i] = _index[j];
+	    i = j;
+	}
+    }
+    _index[i] = -1;
+}
+
+inline void
+FlowCache::lru_unlink(int slot)
+{
+    Entry &e = _entries[slot];
+    if (e.prev >= 0)
+	_entries[e.prev].next = e.next;
+    else
+	_lru_head = e.next;
+    if (e.next >= 0)
+	_entries[e.next].prev = e.prev;
+    else
+	_lru_tail = e.prev;
+}
+
+inline void
+FlowCache::lru_push_front(int slot)
+{
+    Entry &e = _entries[slot];
+    e.prev = -1;
+    e.next = _lru_head;
+    if (_lru_head >= 0)
+	_entries[_lru_head].prev = slot;
+    else
+	_lru_tail = slot;
+    _lru_head = slot;
+}
+
+int
+FlowCache::victim()
+{
+    int slot;
+    if (_eviction == ev_lru) {
+	slot = _lru_tail;
+	lru_unlink(slot);
+    } else {
+	while (_entries[_clock_hand].ref) {
+	    _entries[_clock_hand].ref = 0;
+	    _clock_hand = (_clock_hand + 1 == _capacity ? 0 : _clock_hand + 1);
+	}
+	slot = _clock_hand;
+	_clock_hand = (_clock_hand + 1 == _capacity ? 0 : _clock_hand + 1);
+    }
+    index_remove(slot);
+    return slot;
+}
+
+void
+FlowCache::push(int, Packet *p)
+{
+    const click_ip *iph = p->ip_header();
+    if (!p->has_network_header() || IP_ISFRAG(iph)
+	|| (iph->ip_p != IP_PROTO_TCP && iph->ip_p != IP_PROTO_UDP
+	    && iph->ip_p != IP_PROTO_DCCP && iph->ip_p != IP_PROTO_SCTP)
+	|| p->transport_length() < 4) {
+	output(0).push(p);
+	return;
+    }
+
+    IPFlowID flow(p);
+    int slot = find(flow, iph->ip_p);
+    if (slot >= 0) {
+	Entry &e = _entries[slot];
+	if (_eviction == ev_lru) {
+	    lru_unlink(slot);
+	    lru_push_front(slot);
+	} else
+	    e.ref = 1;
+	++_hits;
+	p->set_dst_ip_anno(e.dst_anno);
+	SET_PAINT_ANNO(p, e.paint);
+	e.learner->output(0).push(p);
+    } else {
+	++_misses;
+	_pending_packet = p;
+	_pending_flow = flow;
+	_pending_proto = iph->ip_p;
+	output(0).push(p);
+	_pending_packet = 0;
+    }
+}
+
+void
+FlowCache::learn(FlowCacheLearn *learner, Packet *p)
+{
+    if (p != _pending_packet)
+	return;
+    _pending_packet = 0;
+
+    int slot;
+    if (_nentries < _capacity)
+	slot = _nentries++;
+    else
+	slot = victim();
+
+    Entry &e = _entries[slot];
+    e.flow = _pending_flow;
+    e.proto = _pending_proto;
+    e.ref = 1;
+    e.paint = PAINT_ANNO(p);
+    e.dst_anno = p->dst_ip_anno();
+    e.learner = learner;
+    index_insert(slot);
+    if (_eviction == ev_lru)
+	lru_push_front(slot);
+}
+
+int
+FlowCache::hook_handler(int op, String &str, Element *e, const Handler *h, ErrorHandler *errh)
+{
+    HandlerHook *hook = static_cast<HandlerHook *>(h->user_data(op));
+    if (op == Handler::f_read) {
+	int nerrors = errh->nerrors();
+	str = hook->handler.call_read(e, str, errh);
+	return errh->nerrors() == nerrors ? 0 : -EINVAL;
+    }
+    int r = hook->handler.call_write(str, e, errh);
+    if (hook->cache)
+	hook->cache->flush();
+    return r;
+}
+
+String
+FlowCache::read_handler(Element *e, void *thunk)
+{
+    FlowCache *fc = static_cast<FlowCache *>(e);
+    switch ((intptr_t) thunk) {
+    case 0:
+	return String(fc->_hits);
+    case 1:
+	return String(fc->_misses);
+    default:
+	return String(fc->_nentries);
+    }
+}
+
+int
+FlowCache::flush_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    static_cast<FlowCache *>(e)->flush();
+    return 0;
+}
+
+void
+FlowCache::add_handlers()
+{
+    add_read_handler("hits", read_handler, 0);
+    add_read_handler("misses", read_handler, 1);
+    add_read_handler("count", read_handler, 2);
+    add_write_handler("flush", flush_handler, 0, Handler::f_button);
+}
+
+
+FlowCacheLearn::FlowCacheLearn()
+    : _cache(0)
+{
+}
+
+int
+FlowCacheLearn::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    return Args(conf, this, errh)
+	.read_mp("FLOWCACHE", ElementCastArg("FlowCache"), _cache)
+	.complete();
+}
+
+void
+FlowCacheLearn::push(int, Packet *p)
+{
+    _cache->learn(this, p);
+    output(0).push(p);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(FlowCache FlowCacheLearn)
@@ -0,0 +1,218 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_FLOWCACHE_HH
+#define CLICK_FLOWCACHE_HH
+#include <click/element.hh>
+#include <click/ipflowid.hh>
+#include <click/handler.hh>
+CLICK_DECLS
+class FlowCacheLearn;
+
+/*
+=c
+
+FlowCache([I<KEYWORDS>])
+
+FlowCacheLearn(FLOWCACHE)
+
+=s ip
+
+memoizes per-flow classification decisions
+
+=d
+
+FlowCache and FlowCacheLearn bypass an expensive classification pipeline for
+packets of flows that have already been classified.  FlowCache sits in front
+of the pipeline (the "slow path"), and one FlowCacheLearn element sits on each
+of the pipeline's exits.  Every FlowCacheLearn names the FlowCache it reports
+to.
+
+Expects IP packets with network headers set.  FlowCache looks up each TCP,
+UDP, DCCP, or SCTP packet's 5-tuple (source and destination addresses and
+ports, and protocol) in its cache.  On a miss, it emits the packet on its
+output; if that packet arrives at a FlowCacheLearn before FlowCache::push
+returns, the FlowCacheLearn records its own identity, along with the packet's
+destination IP address and paint annotations, as the flow's decision.  On a
+hit, FlowCache restores the memoized annotations and pushes the packet
+directly out of the memoized FlowCacheLearn's output, skipping the slow path
+altogether.
+
+Fragments, packets of other protocols, and packets whose decision was made
+asynchronously (for example, after a Queue in the slow path) are never
+cached; they always take the slow path.
+
+The cache holds at most CAPACITY flows.  When it is full, a new flow replaces
+one chosen by the EVICTION policy.
+
+Keyword arguments are:
+
+=over 8
+
+=item CAPACITY
+
+Integer.  Maximum number of cached flows.  Default is 65536.
+
+=item EVICTION
+
+Either C<clock> or C<lru>.  C<lru> evicts the least recently used flow;
+C<clock> approximates LRU with a reference bit per flow and avoids list
+updates on hits.  Default is C<clock>.
+
+=item INVALIDATE
+
+Element.  Flush the cache whenever any write handler on this element is
+called, for example when a route is added to an IPRouteTable or an
+IPClassifier is reconfigured.  May be given more than once.
+
+=back
+
+FlowCacheLearn has one push input and one push output.
+
+=n
+
+Caching is only correct when the slow path's decision and annotations depend
+on nothing but the 5-tuple.  A slow path that classifies on arriving
+annotations, TCP flags, lengths, or payload must not be cached.
+
+=h hits read-only
+
+Returns the number of packets that hit in the cache.
+
+=h misses read-only
+
+Returns the number of cacheable packets that missed in the cache.
+
+=h count read-only
+
+Returns the number of cached flows.
+
+=h flush write-only
+
+Removes all flows from the cache.
+
+=e
+
+  fc :: FlowCache(INVALIDATE rt);
+  ... -> fc -> rt :: RadixIPLookup(...);
+  rt[0] -> FlowCacheLearn(fc) -> ...;
+  rt[1] -> FlowCacheLearn(fc) -> ...;
+
+=a IPClassifier, IPFilter, IPRouteTable, AggregateIPFlows */
+
+class FlowCache : public Element { public:
+
+    FlowCache() CLICK_COLD;
+    ~FlowCache() CLICK_COLD;
+
+    const char *class_name() const	{ return "FlowCache"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+
+    void learn(FlowCacheLearn *learner, Packet *p);
+    void flush();
+
+  private:
+
+    struct Entry {
+	IPFlowID flow;
+	uint8_t proto;
+	uint8_t ref;
+	uint8_t paint;
+	IPAddress dst_anno;
+	FlowCacheLearn *learner;
+	int prev;
+	int next;
+    };
+
+    // Run the wrapped write handler, then flush the cache.
+    struct HandlerHook {
+	FlowCache *cache;
+	Handler handler;
+	HandlerHook(FlowCache *c, const Handler &h)
+	    : cache(c), handler(h) {
+	}
+    };
+
+    enum { ev_clock, ev_lru };
+
+    Entry *_entries;
+    int32_t *_index;		// open-addressed; -1 means empty
+    uint32_t _index_mask;
+    int _capacity;
+    int _nentries;
+    int _eviction;
+    int _clock_hand;
+    int _lru_head;		// most recently used
+    int _lru_tail;		// least recently used
+
+    Vector<Element *> _invalidators;
+    Vector<HandlerHook *> _hooks;
+
+    // The packet currently travelling the slow path, if any.
+    Packet *_pending_packet;
+    IPFlowID _pending_flow;
+    uint8_t _pending_proto;
+
+    uint64_t _hits;
+    uint64_t _misses;
+
+    static inline uint32_t hash(const IPFlowID &flow, uint8_t proto);
+    inline int find(const IPFlowID &flow, uint8_t proto) const;
+    void index_insert(int slot);
+    void index_remove(int slot);
+    inline void lru_unlink(int slot);
+    inline void lru_push_front(int slot);
+    int victim();
+
+    static int hook_handler(int, String &, Element *, const Handler *, ErrorHandler *);
+    static String read_handler(Element *, void *);
+    static int flush_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+class FlowCacheLearn : public Element { public:
+
+    FlowCacheLearn() CLICK_COLD;
+
+    const char *class_name() const	{ return "FlowCacheLearn"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+
+    void push(int, Packet *);
+
+  private:
+
+    FlowCache *_cache;
+
+};
+
+
+inline uint32_t
+FlowCache::hash(const IPFlowID &flow, uint8_t proto)
+{
+    uint32_t h = flow.hashcode() ^ (proto * 0x9E3779B1U);
+    return h ^ (h >> 16);
+}
+
+inline int
+FlowCache::find(const IPFlowID &flow, uint8_t proto) const
+{
+    for (uint32_t i = hash(flow, proto) & _index_mask; _index[i] >= 0;
+	 i = (i + 1) & _index_mask) {
+	const Entry &e = _entries[_index[i]];
+	if (e.flow == flow && e.proto == proto)
+	    return _index[i];
+    }
+    return -1;
+}
+
+CLICK_ENDDECLS
+#endif
@@ -151,7 +151,7 @@ class IPAddrPairRewriter : public IPRewriterBase { public:
 
   private:
 
-    SizedHashAllocator<sizeof(IPAddrPairFlow)> _allocator;
+    SizedHashAllocator<sizeof(IPAddrPairFlow), CLICK_CACHE_LINE_SIZE> _allocator;
     unsigned _annos;
 
     static String dump_mappings_handler(Element *, void *);
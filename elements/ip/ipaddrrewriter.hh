@@ -150,7 +150,7 @@ class IPAddrRewriter : public IPRewriterBase { public:
 
   protected:
 
-    SizedHashAllocator<sizeof(IPAddrFlow)> _allocator;
+    SizedHashAllocator<sizeof(IPAddrFlow), CLICK_CACHE_LINE_SIZE> _allocator;
     unsigned _annos;
 
     static String dump_mappings_handler(Element *, void *);
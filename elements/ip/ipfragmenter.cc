@@ -26,7 +26,7 @@
 CLICK_DECLS
 
 IPFragmenter::IPFragmenter()
-    : _honor_df(true), _verbose(false), _mtu(0)
+    : _honor_df(true), _verbose(false), _clone(false), _mtu(0)
 {
     _fragments = 0;
     _drops = 0;
@@ -46,6 +46,7 @@ IPFragmenter::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read_p("HONOR_DF", _honor_df)
 	.read_p("VERBOSE", _verbose)
 	.read("HEADROOM", _headroom)
+	.read("CLONE", _clone)
 	.complete() < 0)
 	return -1;
     if (_mtu < 8)
@@ -85,6 +86,22 @@ IPFragmenter::optcopy(const click_ip *ip1, click_ip *ip2)
     return outpos;
 }
 
+void
+IPFragmenter::write_header(const click_ip *ip, click_ip *qip, int out_hlen,
+			   int off, int out_dlen, bool last)
+{
+    memcpy(qip, ip, sizeof(click_ip));
+    optcopy(ip, qip);
+
+    qip->ip_hl = out_hlen >> 2;
+    qip->ip_off = htons(ntohs(ip->ip_off) + (off >> 3));
+    if (last)
+	qip->ip_off &= ~htons(IP_MF);
+    qip->ip_len = htons(out_hlen + out_dlen);
+    qip->ip_sum = 0;
+    qip->ip_sum = click_in_cksum((const unsigned char *)qip, out_hlen);
+}
+
 void
 IPFragmenter::fragment(Packet *p_in)
 {
@@ -125,36 +142,45 @@ IPFragmenter::fragment(Packet *p_in)
 
     // output the remaining fragments
     int out_hlen = sizeof(click_ip) + optcopy(ip, 0);
+    int prev_dlen = first_dlen;
+    bool prev_shared = true;
 
     for (int off = first_dlen; off < in_dlen; ) {
 	// prepare packet
 	int out_dlen = (_mtu - out_hlen) & ~7;
 	if (out_dlen + off > in_dlen)
 	    out_dlen = in_dlen - off;
-
-	WritablePacket *q = Packet::make(_headroom, 0, out_hlen + out_dlen, 0);
-	if (q) {
-	    q->set_network_header(q->data(), out_hlen);
-	    click_ip *qip = q->ip_header();
-
-	    memcpy(qip, ip, sizeof(click_ip));
-	    optcopy(ip, qip);
-	    memcpy(q->transport_header(), p->transport_header() + off, out_dlen);
-
-	    qip->ip_hl = out_hlen >> 2;
-	    qip->ip_off = htons(ntohs(ip->ip_off) + (off >> 3));
-	    if (out_dlen + off >= in_dlen && !had_mf)
-		qip->ip_off &= ~htons(IP_MF);
-	    qip->ip_len = htons(out_hlen + out_dlen);
-	    qip->ip_sum = 0;
-	    qip->ip_sum = click_in_cksum((const unsigned char *)qip, out_hlen);
-
-	    q->copy_annotations(p);
-
-	    output(0).push(q);
-	    _fragments++;
+	bool last = out_dlen + off >= in_dlen && !had_mf;
+
+	// In CLONE mode, every other fragment shares p's buffer.  Its header
+	// is written over the end of the previous fragment's data, so that
+	// fragment must have been copied out already.
+	if (_clone && !prev_shared && out_hlen <= prev_dlen) {
+	    unsigned char *qdata = p->transport_header() + off - out_hlen;
+	    write_header(ip, reinterpret_cast<click_ip *>(qdata), out_hlen, off, out_dlen, last);
+	    if (Packet *q = p->clone()) {
+		q->pull(qdata - q->data());
+		q->take(q->end_data() - (qdata + out_hlen + out_dlen));
+		q->set_network_header(qdata, out_hlen);
+		q->clear_mac_header();
+		output(0).push(q);
+		_fragments++;
+	    }
+	    prev_shared = true;
+	} else {
+	    WritablePacket *q = Packet::make(_headroom, 0, out_hlen + out_dlen, 0);
+	    if (q) {
+		q->set_network_header(q->data(), out_hlen);
+		write_header(ip, q->ip_header(), out_hlen, off, out_dlen, last);
+		memcpy(q->transport_header(), p->transport_header() + off, out_dlen);
+		q->copy_annotations(p);
+		output(0).push(q);
+		_fragments++;
+	    }
+	    prev_shared = false;
 	}
 
+	prev_dlen = out_dlen;
 	off += out_dlen;
     }
 
@@ -48,6 +48,15 @@ CLICK_DECLS
  * Unsigned.  Sets the headroom on the output packets to an explicit value,
  * rather than the default (which is usually about 28 bytes).
  *
+ * =item CLONE
+ *
+ * Boolean.  If true, emit every other fragment as a clone of the input
+ * packet's buffer, writing only its new IP header, rather than copying its
+ * data into a new packet.  This roughly halves the bytes copied when
+ * fragmenting large packets.  Cloned fragments share a buffer, so downstream
+ * elements that modify them will copy them first, and they have no MAC
+ * header.  Default is false.
+ *
  * =e
  *   ... -> fr::IPFragmenter(1024) -> Queue(20) -> ...
  *   fr[1] -> ICMPError(18.26.4.24, 3, 4) -> ...
@@ -76,6 +85,7 @@ class IPFragmenter : public Element { public:
 
   bool _honor_df;
   bool _verbose;
+  bool _clone;
   unsigned _mtu;
   unsigned _headroom;
   atomic_uint32_t _drops;
@@ -83,6 +93,8 @@ class IPFragmenter : public Element { public:
 
   void fragment(Packet *);
   int optcopy(const click_ip *ip1, click_ip *ip2);
+  void write_header(const click_ip *ip, click_ip *qip, int out_hlen,
+		    int off, int out_dlen, bool last);
 
 };
 
@@ -36,10 +36,9 @@ CLICK_DECLS
 #define IP_BYTE_OFF(iph)	((ntohs((iph)->ip_off) & IP_OFFMASK) << 3)
 
 IPReassembler::IPReassembler()
-    : _stat_frags_seen(0), _stat_good_assem(0), _stat_failed_assem(0), _stat_bad_pkts(0)
+    : _source_mem(0), _stat_frags_seen(0), _stat_good_assem(0),
+      _stat_failed_assem(0), _stat_bad_pkts(0), _stat_quota_drops(0)
 {
-    for (int i = 0; i < NMAP; i++)
-	_map[i] = 0;
     static_assert(IPREASSEMBLER_ANNO_OFFSET + IPREASSEMBLER_ANNO_SIZE <= Packet::anno_size, "anno too big");
     static_assert(sizeof(ChunkLink) == IPREASSEMBLER_ANNO_SIZE, "sizeof(ChunkLink) is expected to equal IPREASSEMBLER_ANNO_SIZE.");
 }
@@ -52,9 +51,11 @@ int
 IPReassembler::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     _mem_high_thresh = 256 * 1024;
+    _source_high_thresh = 0;
     int mtu_anno = -1;
     if (Args(conf, this, errh)
 	.read("HIMEM", _mem_high_thresh)
+	.read("SOURCE_HIMEM", _source_high_thresh)
 	.read("MAX_MTU_ANNO", AnnoArg(2), mtu_anno)
 	.complete() < 0)
 	return -1;
@@ -67,28 +68,22 @@ int
 IPReassembler::initialize(ErrorHandler *)
 {
     _mem_used = 0;
-    _reap_time = 0;
     return 0;
 }
 
 void
 IPReassembler::cleanup(CleanupStage)
 {
-    for (int i = 0; i < NMAP; i++)
-	while (_map[i]) {
-	    WritablePacket *next = (WritablePacket *)(_map[i]->next());
-	    _map[i]->kill();
-	    _map[i] = next;
-	}
+    while (FragQueue *fq = _age.front())
+	remove_queue(fq)->kill();
 }
 
 void
-IPReassembler::check_error(ErrorHandler *errh, int bucket, const Packet *p, const char *format, ...)
+IPReassembler::check_error(ErrorHandler *errh, const Packet *p, const char *format, ...)
 {
     va_list val;
     va_start(val, format);
     StringAccum sa;
-    sa << "buck " << bucket << ": ";
     if (p->has_network_header()) {
 	const click_ip *iph = p->ip_header();
 	sa << iph->ip_src << " > " << iph->ip_dst << " [" << ntohs(iph->ip_id) << ':' << PACKET_DLEN(p) << ((iph->ip_off & htons(IP_MF)) ? "+]: " : "]: ");
@@ -104,41 +99,52 @@ IPReassembler::check(ErrorHandler *errh)
     if (!errh)
 	errh = ErrorHandler::default_handler();
     uint32_t mem_used = 0;
-    for (int b = 0; b < NMAP; b++)
-	for (WritablePacket *q = _map[b]; q; q = (WritablePacket *)(q->next()))
-	    if (q->has_network_header()) {
-		const click_ip *qip = q->ip_header();
-		if (bucketno(qip) != b)
-		    check_error(errh, b, q, "in wrong bucket");
-		mem_used += IPH_MEM_USED + q->transport_length();
-		ChunkLink *chunk = &PACKET_CHUNK(q);
-		int off = 0;
+    HashTable<uint32_t, uint32_t> source_mem(0);
+    if (_age.size() != _table.size())
+	errh->error("age list has %u entries, table has %u", (unsigned) _age.size(), (unsigned) _table.size());
+    for (Table::iterator it = _table.begin(); it; ++it) {
+	WritablePacket *q = it->_q;
+	if (q->has_network_header()) {
+	    const click_ip *qip = q->ip_header();
+	    if (!(FragKey(qip) == it->_key))
+		check_error(errh, q, "in wrong queue");
+	    if (it->_mem != (uint32_t) (IPH_MEM_USED + q->transport_length()))
+		check_error(errh, q, "bad queue mem: have %u, claim %u", IPH_MEM_USED + q->transport_length(), it->_mem);
+	    mem_used += it->_mem;
+	    source_mem[it->_key.src] += it->_mem;
+	    ChunkLink *chunk = &PACKET_CHUNK(q);
+	    int off = 0;
 #if VERBOSE_DEBUG
-		check_error(errh, b, q, "");
-		StringAccum sa;
-		while (chunk && (!off || off < q->transport_length())) {
-		    sa << " (" << chunk->off << ',' << chunk->lastoff << ')';
-		    off = chunk->lastoff;
-		    chunk = next_chunk(q, chunk);
-		}
-		errh->message("  %s", sa.c_str());
-		chunk = &PACKET_CHUNK(q);
-		off = 0;
+	    check_error(errh, q, "");
+	    StringAccum sa;
+	    while (chunk && (!off || off < q->transport_length())) {
+		sa << " (" << chunk->off << ',' << chunk->lastoff << ')';
+		off = chunk->lastoff;
+		chunk = next_chunk(q, chunk);
+	    }
+	    errh->message("  %s", sa.c_str());
+	    chunk = &PACKET_CHUNK(q);
+	    off = 0;
 #endif
-		while (chunk) {
-		    if (chunk->off >= chunk->lastoff
-			|| chunk->lastoff > q->transport_length()
-			|| (off != 0 && chunk->off < off + 8)) {
-			check_error(errh, b, q, "bad chunk (%d, %d) at %d", chunk->off, chunk->lastoff, off);
-			break;
-		    }
-		    off = chunk->lastoff;
-		    chunk = next_chunk(q, chunk);
+	    while (chunk) {
+		if (chunk->off >= chunk->lastoff
+		    || chunk->lastoff > q->transport_length()
+		    || (off != 0 && chunk->off < off + 8)) {
+		    check_error(errh, q, "bad chunk (%d, %d) at %d", chunk->off, chunk->lastoff, off);
+		    break;
 		}
-	    } else
-		errh->error("buck %d: missing IP header", b);
+		off = chunk->lastoff;
+		chunk = next_chunk(q, chunk);
+	    }
+	} else
+	    errh->error("missing IP header");
+    }
     if (mem_used != _mem_used)
 	errh->error("bad mem_used: have %u, claim %u", mem_used, _mem_used);
+    if (_source_high_thresh)
+	for (HashTable<uint32_t, uint32_t>::iterator it = source_mem.begin(); it.live(); ++it)
+	    if (_source_mem.get(it.key()) != it.value())
+		errh->error("bad mem_used for %s: have %u, claim %u", IPAddress(it.key()).unparse().c_str(), it.value(), _source_mem.get(it.key()));
     return 0;
 }
 
@@ -153,47 +159,64 @@ IPReassembler::debug_dump(Element *e, void *)
 	"good reassemblies:   " << r->_stat_good_assem << "\n"
 	"failed reassemblies: " << r->_stat_failed_assem << "\n"
 	"bad fragments seen:  " << r->_stat_bad_pkts << "\n"
+	"over-quota drops:    " << r->_stat_quota_drops << "\n"
 	"cached chunk data:\n";
-    for (int b = 0; b < NMAP; b++)
-	for (WritablePacket *q = r->_map[b]; q; q = (WritablePacket *)(q->next()))
-	    if (const click_ip *qip = q->ip_header()) {
-		sa << ' ' << IPFlowID(qip) << ' ' << ntohs(qip->ip_id);
-		ChunkLink *chunk = &PACKET_CHUNK(q);
-		while (chunk &&
-		       (chunk->lastoff > chunk->off) &&
-		       (chunk->lastoff <= q->transport_length())) {
-		    sa << " (" << chunk->off << ',' << chunk->lastoff << ')';
-		    chunk = next_chunk(q, chunk);
-		}
-		sa << '\n';
+    for (FragQueue *fq = r->_age.front(); fq; fq = fq->_age_link.next()) {
+	WritablePacket *q = fq->_q;
+	if (const click_ip *qip = q->ip_header()) {
+	    sa << ' ' << IPFlowID(qip) << ' ' << ntohs(qip->ip_id);
+	    ChunkLink *chunk = &PACKET_CHUNK(q);
+	    while (chunk &&
+		   (chunk->lastoff > chunk->off) &&
+		   (chunk->lastoff <= q->transport_length())) {
+		sa << " (" << chunk->off << ',' << chunk->lastoff << ')';
+		chunk = next_chunk(q, chunk);
 	    }
+	    sa << '\n';
+	}
+    }
     return sa.take_string();
 }
 
-WritablePacket *
-IPReassembler::find_queue(Packet *p, WritablePacket ***store_pprev)
+void
+IPReassembler::charge(FragQueue *fq, int32_t delta)
 {
-    const click_ip *iph = p->ip_header();
-    int bucket = bucketno(iph);
-    WritablePacket **pprev = &_map[bucket];
-    WritablePacket *q;
-    for (q = *pprev; q; pprev = (WritablePacket **)&q->next(), q = *pprev) {
-	const click_ip *qiph = q->ip_header();
-	if (same_segment(iph, qiph)) {
-	    *store_pprev = pprev;
-	    return q;
-	}
+    fq->_mem += delta;
+    _mem_used += delta;
+    if (_source_high_thresh) {
+	HashTable<uint32_t, uint32_t>::iterator it = _source_mem.find_insert(fq->_key.src, 0);
+	it.value() += delta;
+	if (!it.value())
+	    _source_mem.erase(it);
     }
-    *store_pprev = &_map[bucket];
-    return 0;
+}
+
+WritablePacket *
+IPReassembler::remove_queue(FragQueue *fq)
+{
+    WritablePacket *q = fq->_q;
+    charge(fq, -(int32_t) fq->_mem);
+    _table.erase(fq->_key);
+    _age.erase(fq);
+    fq->~FragQueue();
+    _alloc.deallocate(fq);
+    return q;
+}
+
+void
+IPReassembler::expire_queue(FragQueue *fq)
+{
+    WritablePacket *q = remove_queue(fq);
+    q->set_next(0);
+    checked_output_push(1, q);
+    ++_stat_failed_assem;
 }
 
 Packet *
-IPReassembler::emit_whole_packet(WritablePacket *q, WritablePacket **q_pprev,
-				 Packet *p_in)
+IPReassembler::emit_whole_packet(FragQueue *fq, Packet *p_in)
 {
     ++_stat_good_assem;
-    *q_pprev = (WritablePacket *)q->next();
+    WritablePacket *q = remove_queue(fq);
 
     click_ip *q_iph = q->ip_header();
     q_iph->ip_len = htons(q->network_length());
@@ -206,12 +229,11 @@ IPReassembler::emit_whole_packet(WritablePacket *q, WritablePacket **q_pprev,
     q->set_next(0);
 
     p_in->kill();
-    _mem_used -= IPH_MEM_USED + q->transport_length();
     return q;
 }
 
 void
-IPReassembler::make_queue(Packet *p, WritablePacket **q_pprev)
+IPReassembler::make_queue(Packet *p, const FragKey &key, int now)
 {
     int p_off = IP_BYTE_OFF(p->ip_header());
     int p_lastoff = p_off + PACKET_DLEN(p);
@@ -237,7 +259,19 @@ IPReassembler::make_queue(Packet *p, WritablePacket **q_pprev)
 	p->kill();
     }
 
-    _mem_used += IPH_MEM_USED + p_lastoff;
+    void *x = _alloc.allocate();
+    if (!x) {
+	q->kill();
+	click_chatter("out of memory");
+	return;
+    }
+    FragQueue *fq = new(x) FragQueue(key);
+    fq->_q = q;
+    fq->_expiry = now + REAP_TIMEOUT;
+    _table.set(fq);
+    _table.balance();
+    _age.push_back(fq);
+    charge(fq, IPH_MEM_USED + p_lastoff);
 
     click_ip *q_iph = q->ip_header();
     q_iph->ip_off = (q_iph->ip_off & ~htons(IP_OFFMASK)); // leave MF, DF, RF
@@ -247,12 +281,7 @@ IPReassembler::make_queue(Packet *p, WritablePacket **q_pprev)
 
     PACKET_CHUNK(q).off = p_off;
     PACKET_CHUNK(q).lastoff = p_lastoff;
-
-    // link it up
-    q->set_next(*q_pprev);
-    *q_pprev = q;
-
-    check();
+    q->set_next(0);
 }
 
 IPReassembler::ChunkLink *
@@ -281,8 +310,7 @@ IPReassembler::simple_action(Packet *p)
 	p->timestamp_anno().assign_now();
 	now = p->timestamp_anno().sec();
     }
-    if (now >= _reap_time)
-	reap(now);
+    reap(now);
 
     // calculate packet edges
     int p_off = IP_BYTE_OFF(iph);
@@ -303,16 +331,20 @@ IPReassembler::simple_action(Packet *p)
 
     // clean up memory if necessary
     if (_mem_used > _mem_high_thresh)
-	reap_overfull(now);
+	reap_overfull();
 
     // get its Packet queue
-    WritablePacket **q_pprev;
-    WritablePacket *q = find_queue(p, &q_pprev);
-    if (!q) {			// make a new queue
-	make_queue(p, q_pprev);
+    FragKey key(iph);
+    FragQueue *fq = _table.get(key);
+    if (!fq) {			// make a new queue
+	if (over_quota(key.src, IPH_MEM_USED + p_lastoff)) {
+	    p->kill();
+	    ++_stat_quota_drops;
+	} else
+	    make_queue(p, key, now);
 	return 0;
     }
-    WritablePacket *q_bucket_next = (WritablePacket *)(q->next());
+    WritablePacket *q = fq->_q;
 
     if (_mtu_anno >= 0 && q->anno_u16(_mtu_anno) < p->network_length())
 	q->set_anno_u16(_mtu_anno, p->network_length());
@@ -330,24 +362,29 @@ IPReassembler::simple_action(Packet *p)
 	// packet copies linear in the final packet length.
 	int old_transport_length = q->transport_length();
 	assert((old_transport_length & 7) == 0);
+	if (over_quota(key.src, p_lastoff - old_transport_length)) {
+	    p->kill();
+	    ++_stat_quota_drops;
+	    return 0;
+	}
 	int want_space = p_lastoff - old_transport_length + 8;
 	if (iph->ip_off & htons(IP_MF))
 	    want_space += (p_lastoff - p_off);
 	// request space
 	if (!(q = q->put(want_space))) {
 	    click_chatter("out of memory");
-	    *q_pprev = q_bucket_next;
-	    _mem_used -= IPH_MEM_USED + old_transport_length;
+	    fq->_q = 0;
+	    remove_queue(fq);
 	    p->kill();
 	    return 0;
 	}
 	// get rid of extra space
 	q->take(q->transport_length() - p_lastoff);
 	// hook up packet, and add final chunk
-	*q_pprev = q;
+	fq->_q = q;
 	ChunkLink *last_chunk = (ChunkLink *)(q->transport_header() + old_transport_length);
 	last_chunk->off = last_chunk->lastoff = p_lastoff;
-	_mem_used += p_lastoff - old_transport_length;
+	charge(fq, p_lastoff - old_transport_length);
     }
 
     // find chunks before and after p
@@ -394,6 +431,7 @@ IPReassembler::simple_action(Packet *p)
 	    q->copy_annotations(p);
 	}
 	PACKET_CHUNK(q) = old_chunk;
+	fq->_q = q;
     }
 
     // clear MF if incoming packet has it cleared
@@ -404,7 +442,7 @@ IPReassembler::simple_action(Packet *p)
     if ((q->ip_header()->ip_off & htons(IP_MF)) == 0
 	&& PACKET_CHUNK(q).off == 0
 	&& PACKET_CHUNK(q).lastoff == q->transport_length())
-	return emit_whole_packet(q, q_pprev, p);
+	return emit_whole_packet(fq, p);
 
     // Otherwise, done for now
     //check();
@@ -413,27 +451,14 @@ IPReassembler::simple_action(Packet *p)
 }
 
 void
-IPReassembler::reap_overfull(int now)
+IPReassembler::reap_overfull()
 {
-    check();
-
-    // First throw away fragments at least 10 seconds old, then at least 5
-    // seconds old, then any fragments.
-    for (int delta = 10; delta >= 0; delta -= 5)
-	for (int bucket = 0; bucket < NMAP; bucket++) {
-	    WritablePacket **pprev = &_map[bucket];
-	    for (WritablePacket *q = *pprev; q; q = *pprev)
-		if (!delta || q->timestamp_anno().sec() < now - delta) {
-		    *pprev = (WritablePacket *)q->next();
-		    _mem_used -= IPH_MEM_USED + q->transport_length();
-		    q->set_next(0);
-		    checked_output_push(1, q);
-		    ++_stat_failed_assem;
-		    if (_mem_used <= _mem_low_thresh)
-			return;
-		} else
-		    pprev = (WritablePacket **)&q->next();
-	}
+    // Throw away the oldest reassemblies first.
+    while (FragQueue *fq = _age.front()) {
+	expire_queue(fq);
+	if (_mem_used <= _mem_low_thresh)
+	    return;
+    }
 
     click_chatter("IPReassembler: cannot free enough memory!");
 }
@@ -441,25 +466,12 @@ IPReassembler::reap_overfull(int now)
 void
 IPReassembler::reap(int now)
 {
-    // look at all queues. If no activity for 30 seconds, kill that queue
-
-    int kill_time = now - REAP_TIMEOUT;
-
-    for (int i = 0; i < NMAP; i++) {
-	WritablePacket **q_pprev = &_map[i];
-	for (WritablePacket *q = *q_pprev; q; ) {
-	    if (q->timestamp_anno().sec() < kill_time) {
-		*q_pprev = (WritablePacket *)q->next();
-		q->set_next(0);
-		_mem_used -= IPH_MEM_USED + q->transport_length();
-		checked_output_push(1, q);
-	    } else
-		q_pprev = (WritablePacket **)&q->next();
-	    q = *q_pprev;
-	}
+    // Queues are in order of creation, so expired queues are at the front.
+    while (FragQueue *fq = _age.front()) {
+	if (fq->_expiry >= now)
+	    break;
+	expire_queue(fq);
     }
-
-    _reap_time = now + REAP_INTERVAL;
 }
 
 void
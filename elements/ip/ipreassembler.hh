@@ -4,7 +4,10 @@
 #include <click/element.hh>
 #include <click/glue.hh>
 #include <clicknet/ip.h>
-#include <click/timer.hh>
+#include <click/hashcontainer.hh>
+#include <click/hashallocator.hh>
+#include <click/hashtable.hh>
+#include <click/list.hh>
 CLICK_DECLS
 
 /*
@@ -27,8 +30,16 @@ outputs, however, a single packet containing all the received fragments at
 their proper offsets is pushed onto output 1.
 
 IPReassembler's memory usage is bounded. When memory consumption rises above
-HIMEM bytes, IPReassembler throws away old fragments until memory consumption
-drops below 3/4*HIMEM bytes. Default HIMEM is 256K.
+HIMEM bytes, IPReassembler throws away the oldest reassemblies until memory
+consumption drops below 3/4*HIMEM bytes. Default HIMEM is 256K.  To keep a
+single source from monopolizing that memory, set SOURCE_HIMEM; fragments
+from a source that already holds SOURCE_HIMEM bytes of partial packets are
+dropped.
+
+Reassemblies in progress are kept in a hash table keyed on source,
+destination, protocol, and IP ID, which grows with the number of
+reassemblies, and on a list ordered by age, so lookup and expiry take
+constant time regardless of how many reassemblies are pending.
 
 Output packets have the same MAC header as the fragment that contains
 offset 0.  Other than that, input MAC headers are ignored.
@@ -45,6 +56,11 @@ Keyword arguments are:
 
 The upper bound for memory consumption, in bytes. Default is 256K.
 
+=item SOURCE_HIMEM
+
+The upper bound for memory consumed by fragments from any one IP source
+address, in bytes.  Default is 0, which means no per-source bound.
+
 =item MAX_MTU_ANNO
 
 Optional. A 2 byte annotation that will be filled with the maximum size of any
@@ -53,8 +69,17 @@ is unchanged.
 
 =back
 
+=h dump read-only
+
+Returns statistics and the chunks held by each reassembly in progress, oldest
+first.
+
 =n
 
+IPReassembler is not MT-safe.  To reassemble on several threads, partition
+fragments among several IPReassembler elements by source and destination
+address, for example with HashSwitch(12, 8).
+
 You may want to attach an C<ICMPError(ADDR, timeexceeded, reassembly)> to the
 second output.
 
@@ -89,51 +114,89 @@ class IPReassembler : public Element { public:
   private:
 
     enum { REAP_TIMEOUT = 30, // seconds
-	   REAP_INTERVAL = 10, // seconds
 	   IPH_MEM_USED = 40 };
 
-    enum { NMAP = 256 };
-    WritablePacket *_map[NMAP];
+    struct FragKey {
+	uint32_t src;
+	uint32_t dst;
+	uint16_t id;
+	uint8_t proto;
+	FragKey(const click_ip *iph)
+	    : src(iph->ip_src.s_addr), dst(iph->ip_dst.s_addr),
+	      id(iph->ip_id), proto(iph->ip_p) {
+	}
+	inline hashcode_t hashcode() const;
+	bool operator==(const FragKey &x) const {
+	    return src == x.src && dst == x.dst && id == x.id && proto == x.proto;
+	}
+    };
+
+    // One reassembly in progress.  _q holds the data received so far.
+    struct FragQueue {
+	FragKey _key;
+	FragQueue *_hashnext;
+	List_member<FragQueue> _age_link;
+	WritablePacket *_q;
+	uint32_t _mem;		// bytes charged to _mem_used
+	int _expiry;		// seconds
+	typedef FragKey key_type;
+	typedef const FragKey &key_const_reference;
+	FragQueue(const FragKey &key)
+	    : _key(key), _hashnext(), _q(), _mem(0), _expiry(0) {
+	}
+	key_const_reference hashkey() const {
+	    return _key;
+	}
+    };
 
-    int _reap_time;
+    typedef HashContainer<FragQueue> Table;
+    Table _table;
+    typedef List<FragQueue, &FragQueue::_age_link> AgeList;
+    AgeList _age;		// oldest first
+    SizedHashAllocator<sizeof(FragQueue)> _alloc;
+    HashTable<uint32_t, uint32_t> _source_mem;
 
     uint32_t _stat_frags_seen;
     uint32_t _stat_good_assem;
     uint32_t _stat_failed_assem;
     uint32_t _stat_bad_pkts;
+    uint32_t _stat_quota_drops;
 
     uint32_t _mem_used;
     uint32_t _mem_high_thresh;	// defaults to 256K
     uint32_t _mem_low_thresh;	// defaults to 3/4 * _mem_high_thresh
+    uint32_t _source_high_thresh; // 0 means unlimited
     int8_t _mtu_anno;
 
-    static inline int bucketno(const click_ip *);
-    static inline bool same_segment(const click_ip *, const click_ip *);
     static String debug_dump(Element *e, void *);
 
-    WritablePacket *find_queue(Packet *, WritablePacket ***);
-    void make_queue(Packet *, WritablePacket **);
+    inline bool over_quota(uint32_t src, uint32_t more) const;
+    void charge(FragQueue *, int32_t delta);
+    void make_queue(Packet *, const FragKey &, int now);
+    WritablePacket *remove_queue(FragQueue *);
+    void expire_queue(FragQueue *);
     static ChunkLink *next_chunk(WritablePacket *, ChunkLink *);
-    Packet *emit_whole_packet(WritablePacket *, WritablePacket **, Packet *);
-    void reap_overfull(int);
+    Packet *emit_whole_packet(FragQueue *, Packet *);
+    void reap_overfull();
     void reap(int);
-    static void check_error(ErrorHandler *, int, const Packet *, const char *, ...);
+    static void check_error(ErrorHandler *, const Packet *, const char *, ...);
 
 };
 
 
-inline int
-IPReassembler::bucketno(const click_ip *h)
+inline hashcode_t
+IPReassembler::FragKey::hashcode() const
 {
-    return (h->ip_id % NMAP);
+    uint32_t h = (src ^ ((uint32_t) id << 16) ^ proto) * 0x9E3779B1U;
+    h = (h ^ (h >> 16) ^ dst) * 0x85EBCA6BU;
+    return h ^ (h >> 13);
 }
 
 inline bool
-IPReassembler::same_segment(const click_ip *h, const click_ip *h2)
+IPReassembler::over_quota(uint32_t src, uint32_t more) const
 {
-    return h->ip_id == h2->ip_id && h->ip_p == h2->ip_p
-	&& h->ip_src.s_addr == h2->ip_src.s_addr
-	&& h->ip_dst.s_addr == h2->ip_dst.s_addr;
+    return _source_high_thresh
+	&& _source_mem.get(src) + more > _source_high_thresh;
 }
 
 CLICK_ENDDECLS
@@ -68,7 +68,8 @@ IPMapper::rewrite_flowid(IPRewriterInput *, const IPFlowID &, IPFlowID &,
 //
 
 IPRewriterBase::IPRewriterBase()
-    : _map(0), _heap(new IPRewriterHeap), _gc_timer(gc_timer_hook, this)
+    : _map(0), _heap(new IPRewriterHeap), _gc_timer(gc_timer_hook, this),
+      _journal_on(false), _journal_overflow(false), _importing(false)
 {
     _timeouts[0] = default_timeout;
     _timeouts[1] = default_guarantee;
@@ -158,6 +159,7 @@ IPRewriterBase::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("GUARANTEE", SecondsArg(), _timeouts[1])
 	.read("REAP_INTERVAL", SecondsArg(), _gc_interval_sec)
 	.read("REAP_TIME", Args::deprecated, SecondsArg(), _gc_interval_sec)
+	.read("JOURNAL", _journal_on)
 	.consume() < 0)
 	return -1;
 
@@ -238,6 +240,9 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
     IPRewriterBase *reply_element = _input_specs[input].reply_element;
     if ((unsigned) flow->entry(false).output() >= (unsigned) noutputs()
 	|| (unsigned) flow->entry(true).output() >= (unsigned) reply_element->noutputs()) {
+	if (flow->owner()->kind == IPRewriterInput::i_pattern)
+	    flow->owner()->u.pattern->release(flow->entry(false).flowid(),
+					      flow->entry(false).rewritten_flowid());
 	flow->owner()->owner->destroy_flow(flow);
 	return 0;
     }
@@ -255,9 +260,16 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 
     Vector<IPRewriterFlow *> &myheap = _heap->_heaps[flow->guaranteed()];
     myheap.push_back(flow);
+    ++_input_specs[input].count;
+    if (unlikely(_importing)) {
+	// import() heapifies and rebalances once at the end
+	flow->_place = myheap.size() - 1;
+	return &flow->entry(false);
+    }
     push_heap(myheap.begin(), myheap.end(),
 	      IPRewriterFlow::heap_less(), IPRewriterFlow::heap_place());
-    ++_input_specs[input].count;
+    if (_journal_on)
+	journal(flow, fr_add);
 
     if (unlikely(_heap->size() > _heap->capacity())) {
 	// This may destroy the newly added mapping, if it has the lowest
@@ -328,6 +340,150 @@ IPRewriterBase::shrink_heap(bool clear_all)
     }
 }
 
+void
+IPRewriterBase::unparse_record(StringAccum &sa, const IPRewriterFlow *flow,
+			       int op, click_jiffies_t now_j) const
+{
+    FlowRecord *r = reinterpret_cast<FlowRecord *>(sa.extend(sizeof(FlowRecord)));
+    if (!r)
+	return;
+    memset(r, 0, sizeof(FlowRecord));
+    r->op = op;
+    r->ip_p = flow->ip_p();
+    r->input = htons(flow->owner()->owner_input);
+    r->flags = flow->guaranteed() ? fr_guaranteed : 0;
+    memcpy(r->flowid, &flow->entry(false).flowid(), sizeof(r->flowid));
+    IPFlowID rewritten_flowid = flow->entry(false).rewritten_flowid();
+    memcpy(r->rewritten_flowid, &rewritten_flowid, sizeof(r->rewritten_flowid));
+    click_jiffies_difference_t left = flow->expiry() - now_j;
+    uint64_t left_ms = left > 0 ? (uint64_t) left * 1000 / CLICK_HZ : 0;
+    r->lifetime_ms = htonl(left_ms > 0xFFFFFFFFU ? 0xFFFFFFFFU : (uint32_t) left_ms);
+    r->tflags = flow->_tflags;
+    r->reply_anno = flow->reply_anno();
+}
+
+void
+IPRewriterBase::journal(const IPRewriterFlow *flow, int op)
+{
+    if (_journal_overflow)
+	return;
+    else if (_journal.length() + sizeof(FlowRecord) > (size_t) journal_capacity) {
+	// Nobody is reading the changes; the next reader gets a snapshot.
+	_journal_overflow = true;
+	_journal.clear();
+    } else
+	unparse_record(_journal, flow, op, click_jiffies());
+}
+
+String
+IPRewriterBase::snapshot() const
+{
+    StringAccum sa;
+    FlowRecord *r = reinterpret_cast<FlowRecord *>(sa.extend(sizeof(FlowRecord)));
+    if (!r)
+	return String();
+    memset(r, 0, sizeof(FlowRecord));
+    r->op = fr_clear;
+    click_jiffies_t now_j = click_jiffies();
+    for (int which_heap = 0; which_heap < 2; ++which_heap) {
+	const Vector<IPRewriterFlow *> &myheap = _heap->_heaps[which_heap];
+	for (int i = 0; i < myheap.size(); ++i)
+	    if (myheap[i]->owner()->owner == this)
+		unparse_record(sa, myheap[i], fr_add, now_j);
+    }
+    return sa.take_string();
+}
+
+int
+IPRewriterBase::import(const String &str, ErrorHandler *errh)
+{
+    if (str.length() % sizeof(FlowRecord))
+	return errh->error("flow state has bad length");
+
+    // Flows are appended to the heaps unordered, then heapified at the end,
+    // so loading N flows takes O(N) rather than O(N log N) heap work.
+    click_jiffies_t now_j = click_jiffies();
+    int nbad = 0;
+    _importing = true;
+    for (const char *s = str.begin(); s != str.end(); s += sizeof(FlowRecord)) {
+	FlowRecord r;
+	memcpy(&r, s, sizeof(FlowRecord));
+	IPFlowID flowid = IPFlowID::uninitialized_t();
+	memcpy(&flowid, r.flowid, sizeof(r.flowid));
+
+	if (r.op == fr_clear) {
+	    for (int which_heap = 0; which_heap < 2; ++which_heap) {
+		Vector<IPRewriterFlow *> &myheap = _heap->_heaps[which_heap];
+		for (int i = myheap.size() - 1; i >= 0; --i)
+		    if (myheap[i]->owner()->owner == this) {
+			myheap[i]->destroy(_heap);
+			if (i < myheap.size())
+			    ++i;
+		    }
+	    }
+	    continue;
+	} else if (r.op != fr_add && r.op != fr_delete) {
+	    ++nbad;
+	    continue;
+	}
+
+	if (IPRewriterEntry *m = get_entry(r.ip_p, flowid, get_entry_check))
+	    m->flow()->destroy(_heap);
+	if (r.op == fr_delete)
+	    continue;
+
+	uint32_t lifetime_j = (uint64_t) ntohl(r.lifetime_ms) * CLICK_HZ / 1000;
+	if (!lifetime_j)
+	    continue;
+	IPFlowID rewritten_flowid = IPFlowID::uninitialized_t();
+	memcpy(&rewritten_flowid, r.rewritten_flowid, sizeof(r.rewritten_flowid));
+	IPRewriterEntry *m = 0;
+	int input = ntohs(r.input);
+	if (input < _input_specs.size())
+	    m = add_flow(r.ip_p, flowid, rewritten_flowid, input);
+	if (!m) {
+	    ++nbad;
+	    continue;
+	}
+
+	IPRewriterFlow *flow = m->flow();
+	if (flow->owner()->kind == IPRewriterInput::i_pattern)
+	    flow->owner()->u.pattern->claim(flowid, rewritten_flowid);
+	flow->_tflags = r.tflags;
+	flow->_reply_anno = r.reply_anno;
+	flow->_expiry_j = now_j + lifetime_j;
+	bool guaranteed = r.flags & fr_guaranteed;
+	if (guaranteed != flow->_guaranteed) {
+	    // still the last flow in its heap
+	    _heap->_heaps[flow->_guaranteed].pop_back();
+	    flow->_guaranteed = guaranteed;
+	    _heap->_heaps[guaranteed].push_back(flow);
+	    flow->_place = _heap->_heaps[guaranteed].size() - 1;
+	}
+	if (_journal_on)
+	    journal(flow, fr_add);
+    }
+    _importing = false;
+
+    for (int which_heap = 0; which_heap < 2; ++which_heap) {
+	Vector<IPRewriterFlow *> &myheap = _heap->_heaps[which_heap];
+	make_heap(myheap.begin(), myheap.end(),
+		  IPRewriterFlow::heap_less(), IPRewriterFlow::heap_place());
+    }
+    for (int i = 0; i < _input_specs.size(); ++i)
+	for (int mapid = 0; mapid < 2; ++mapid)
+	    if (Map *map = _input_specs[i].reply_element->get_map(mapid))
+		map->balance();
+    for (int mapid = 0; mapid < 2; ++mapid)
+	if (Map *map = get_map(mapid))
+	    map->balance();
+    shrink_heap(false);
+
+    if (nbad)
+	return errh->error("%d flow records could not be imported", nbad);
+    return 0;
+}
+
 void
 IPRewriterBase::gc_timer_hook(Timer *t, void *user_data)
 {
@@ -365,6 +521,14 @@ IPRewriterBase::read_handler(Element *e, void *user_data)
     case h_capacity:
 	sa << rw->_heap->_capacity;
 	break;
+    case h_snapshot:
+	return rw->snapshot();
+    case h_changes:
+	if (rw->_journal_overflow) {
+	    rw->_journal_overflow = false;
+	    return rw->snapshot();
+	} else
+	    return rw->_journal.take_string();
     default:
 	for (int i = 0; i < rw->_input_specs.size(); ++i) {
 	    if (what != h_patterns && what != i)
@@ -410,7 +574,9 @@ IPRewriterBase::write_handler(const String &str, Element *e, void *user_data, Er
     } else if (what == h_clear) {
 	rw->shrink_heap(true);
 	return 0;
-    } else
+    } else if (what == h_import)
+	return rw->import(str, errh);
+    else
 	return -1;
 }
 
@@ -454,6 +620,9 @@ IPRewriterBase::add_rewriter_handlers(bool writable_patterns)
     add_read_handler("capacity", read_handler, h_capacity);
     add_write_handler("capacity", write_handler, h_capacity);
     add_write_handler("clear", write_handler, h_clear);
+    add_read_handler("snapshot", read_handler, h_snapshot, Handler::f_raw | Handler::f_expensive);
+    add_read_handler("changes", read_handler, h_changes, Handler::f_raw);
+    add_write_handler("import", write_handler, h_import, Handler::f_raw);
     for (int i = 0; i < ninputs(); ++i) {
 	String name = "pattern" + String(i);
 	add_read_handler(name, read_handler, i);
@@ -4,6 +4,7 @@
 #include <click/timer.hh>
 #include "elements/ip/iprwmapping.hh"
 #include <click/bitvector.hh>
+#include <click/straccum.hh>
 CLICK_DECLS
 class IPMapper;
 class IPRewriterPattern;
@@ -157,12 +158,43 @@ class IPRewriterBase : public Element { public:
 
     static void gc_timer_hook(Timer *t, void *user_data);
 
+    // Flow state records for the snapshot, changes, and import handlers.
+    // Multibyte fields are in network byte order.
+    struct FlowRecord {
+	uint8_t op;
+	uint8_t ip_p;
+	uint16_t input;
+	uint32_t flowid[3];
+	uint32_t rewritten_flowid[3];
+	uint32_t lifetime_ms;
+	uint8_t tflags;
+	uint8_t reply_anno;
+	uint8_t flags;
+	uint8_t reserved;
+    };
+    enum {
+	fr_add = 'A', fr_delete = 'D', fr_clear = 'C', fr_guaranteed = 1,
+	journal_capacity = 1 << 26 // bytes
+    };
+
+    StringAccum _journal;
+    bool _journal_on;
+    bool _journal_overflow;
+    bool _importing;
+
+    void journal(const IPRewriterFlow *flow, int op);
+    void unparse_record(StringAccum &sa, const IPRewriterFlow *flow, int op,
+			click_jiffies_t now_j) const;
+    String snapshot() const;
+    int import(const String &str, ErrorHandler *errh);
+
     int parse_input_spec(const String &str, IPRewriterInput &is,
 			 int input_number, ErrorHandler *errh);
 
     enum {			// < 0 because individual patterns are >= 0
 	h_nmappings = -1, h_mapping_failures = -2, h_patterns = -3,
-	h_size = -4, h_capacity = -5, h_clear = -6
+	h_size = -4, h_capacity = -5, h_clear = -6,
+	h_snapshot = -7, h_changes = -8, h_import = -9
     };
     static String read_handler(Element *e, void *user_data) CLICK_COLD;
     static int write_handler(const String &str, Element *e, void *user_data, ErrorHandler *errh) CLICK_COLD;
@@ -36,22 +36,20 @@ IPRewriterFlow::IPRewriterFlow(IPRewriterInput *owner, const IPFlowID &flowid,
 			       const IPFlowID &rewritten_flowid,
 			       uint8_t ip_p, bool guaranteed,
 			       click_jiffies_t expiry_j)
-    : _expiry_j(expiry_j), _ip_p(ip_p), _tflags(0),
-      _guaranteed(guaranteed), _reply_anno(0),
-      _owner(owner)
+    : _ip_p(ip_p), _tflags(0), _reply_anno(0), _guaranteed(guaranteed),
+      _owner(owner), _expiry_j(expiry_j)
 {
     _e[0].initialize(flowid, owner->foutput, false);
     _e[1].initialize(rewritten_flowid.reverse(), owner->routput, true);
 
     // set checksum deltas
-    const uint16_t *swords = reinterpret_cast<const uint16_t *>(&flowid);
-    const uint16_t *dwords = reinterpret_cast<const uint16_t *>(&rewritten_flowid);
+    const uint32_t *swords = reinterpret_cast<const uint32_t *>(&flowid);
+    const uint32_t *dwords = reinterpret_cast<const uint32_t *>(&rewritten_flowid);
     _ip_csum_delta = 0;
-    for (int i = 0; i < 4; ++i)
-	click_update_in_cksum(&_ip_csum_delta, swords[i], dwords[i]);
+    click_update_in_cksum32(&_ip_csum_delta, swords[0], dwords[0]);
+    click_update_in_cksum32(&_ip_csum_delta, swords[1], dwords[1]);
     _udp_csum_delta = _ip_csum_delta;
-    for (int i = 4; i < 6; ++i)
-	click_update_in_cksum(&_udp_csum_delta, swords[i], dwords[i]);
+    click_update_in_cksum32(&_udp_csum_delta, swords[2], dwords[2]);
 }
 
 void
@@ -120,6 +118,10 @@ IPRewriterFlow::destroy(IPRewriterHeap *heap)
 		heap_less(), heap_place());
     myheap.pop_back();
     --_owner->count;
+    if (_owner->owner->_journal_on)
+	_owner->owner->journal(this, IPRewriterBase::fr_delete);
+    if (_owner->kind == IPRewriterInput::i_pattern)
+	_owner->u.pattern->release(_e[0].flowid(), _e[0].rewritten_flowid());
     _owner->owner->destroy_flow(this);
 }
 
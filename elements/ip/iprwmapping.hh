@@ -153,16 +153,20 @@ class IPRewriterFlow { public:
 
   protected:
 
+    // Lookup and apply() use only the first 64 bytes on 64-bit machines,
+    // and the rewriters allocate flows on cache line boundaries, so that is
+    // one line; the heap bookkeeping after _owner is touched when the expiry
+    // changes.
     IPRewriterEntry _e[2];
     uint16_t _ip_csum_delta;
     uint16_t _udp_csum_delta;
-    click_jiffies_t _expiry_j;
-    size_t _place : 32;
     uint8_t _ip_p;
     uint8_t _tflags;
-    bool _guaranteed;
     uint8_t _reply_anno;
+    bool _guaranteed;
     IPRewriterInput *_owner;
+    click_jiffies_t _expiry_j;
+    size_t _place : 32;
 
     friend class IPRewriterBase;
     friend class IPRewriterEntry;
@@ -184,7 +188,7 @@ inline void
 IPRewriterFlow::update_csum(uint16_t *csum, bool direction, uint16_t csum_delta)
 {
     if (csum_delta)
-	click_update_in_cksum(csum, 0, direction ? csum_delta : ~csum_delta);
+	click_update_in_cksum_delta(csum, direction ? csum_delta : ~csum_delta);
 }
 
 CLICK_ENDDECLS
@@ -32,6 +32,8 @@
 #include <click/nameinfo.hh>
 #include <click/straccum.hh>
 #include <click/error.hh>
+#include <click/integers.hh>
+#include <click/timestamp.hh>
 CLICK_DECLS
 
 IPRewriterPattern::IPRewriterPattern(const IPAddress &saddr, int sport,
@@ -40,10 +42,19 @@ IPRewriterPattern::IPRewriterPattern(const IPAddress &saddr, int sport,
 		       uint32_t variation_top)
     : _saddr(saddr), _sport(sport), _daddr(daddr), _dport(dport),
       _variation_top(variation_top), _next_variation(0), _is_napt(is_napt),
-      _sequential(sequential), _same_first(same_first), _refcount(0)
+      _sequential(sequential), _same_first(same_first), _refcount(0),
+      _block_size(0), _addr_variation(0), _blocks_per_addr(0), _fresh_block(0),
+      _blocks(0), _subscribers(no_block)
 {
 }
 
+IPRewriterPattern::~IPRewriterPattern()
+{
+    for (HashTable<uint32_t, PortBlock *>::iterator it = _blocks.begin();
+	 it.live(); ++it)
+	delete[] reinterpret_cast<char *>(it.value());
+}
+
 namespace {
 enum { PE_SYNTAX, PE_NOPATTERN, PE_SADDR, PE_SPORT, PE_DADDR, PE_DPORT };
 static const char* const pe_messages[] = {
@@ -98,9 +109,16 @@ ip_address_variation(const String &str, IPAddress *addr, int32_t *variation,
 
 static bool
 port_variation(const String &str, int32_t *port, int32_t *variation,
-	       bool *sequential, bool *same_first)
+	       bool *sequential, bool *same_first, int32_t *block_size)
 {
     const char *end = str.end();
+    const char *slash = find(str.begin(), end, '/');
+    if (slash != end) {
+	if (!IntArg().parse(str.substring(slash + 1, end), *block_size)
+	    || *block_size <= 0)
+	    return false;
+	end = slash;
+    }
     if (end > str.begin() && end[-1] == '#')
 	*sequential = true, *same_first = false, --end;
     else if (end > str.begin() && end[-1] == '?')
@@ -142,7 +160,7 @@ IPRewriterPattern::parse(const Vector<String> &words,
     }
 
     IPAddress saddr, daddr;
-    int32_t sport = 0, dport = 0, variation = 0;
+    int32_t sport = 0, dport = 0, variation = 0, addr_variation, block_size = 0;
     bool sequential = false, same_first = true;
 
     // source address
@@ -152,6 +170,7 @@ IPRewriterPattern::parse(const Vector<String> &words,
 	  || ip_address_variation(words[i], &saddr, &variation,
 				  &sequential, &same_first, context)))
 	return pattern_error(PE_SADDR, errh);
+    addr_variation = variation;
 
     // source port
     if (words.size() >= 3) {
@@ -159,7 +178,7 @@ IPRewriterPattern::parse(const Vector<String> &words,
 	if (!(words[i].equals("-", 1)
 	      || (IntArg().parse(words[i], sport) && sport > 0 && sport < 65536)
 	      || port_variation(words[i], &sport, &variation,
-				&sequential, &same_first)))
+				&sequential, &same_first, &block_size)))
 	    return pattern_error(PE_SPORT, errh);
 	i = words.size() == 3 ? 0 : 1;
     }
@@ -178,9 +197,20 @@ IPRewriterPattern::parse(const Vector<String> &words,
 	    return pattern_error(PE_DPORT, errh);
     }
 
-    *pstore = new IPRewriterPattern(saddr, htons(sport), daddr, htons(dport),
-				    words.size() >= 3,
-				    sequential, same_first, variation);
+    if (block_size && !saddr)
+	return errh->error("port blocks require a source address"), false;
+    else if (block_size > variation + 1)
+	return errh->error("port block larger than port range"), false;
+
+    IPRewriterPattern *pat = new IPRewriterPattern(saddr, htons(sport), daddr, htons(dport),
+						   words.size() >= 3,
+						   sequential, same_first, variation);
+    if (block_size) {
+	pat->_block_size = block_size;
+	pat->_addr_variation = addr_variation;
+	pat->_blocks_per_addr = (variation + 1) / block_size;
+    }
+    *pstore = pat;
     return true;
 }
 
@@ -231,7 +261,9 @@ IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
     if (_dport)
 	rewritten_flowid.set_dport(_dport);
 
-    if (_variation_top) {
+    if (_block_size)
+	return rewrite_block(flowid, rewritten_flowid, reply_map);
+    else if (_variation_top) {
 	IPFlowID lookup = rewritten_flowid.reverse();
 	uint32_t base = (_is_napt ? ntohs(_sport) : ntohl(_saddr.addr()));
 
@@ -271,11 +303,194 @@ IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
     return IPRewriterBase::rw_addmap;
 }
 
+int
+IPRewriterPattern::rewrite_block(const IPFlowID &flowid,
+				 IPFlowID &rewritten_flowid,
+				 const HashContainer<IPRewriterEntry> &reply_map)
+{
+    uint32_t subscriber = flowid.saddr().addr();
+    HashTable<uint32_t, uint32_t>::iterator it = _subscribers.find(subscriber);
+    uint32_t first = it.live() ? it.value() : (uint32_t) no_block;
+    for (uint32_t b = first; b != no_block; ) {
+	PortBlock *pb = _blocks.get(b);
+	if (pb->nused < _block_size
+	    && find_port(b, pb, rewritten_flowid, reply_map))
+	    return IPRewriterBase::rw_addmap;
+	b = pb->next;
+    }
+
+    // The subscriber's blocks are full; give it another.
+    uint32_t b;
+    if (_free_blocks.size()) {
+	b = _free_blocks.back();
+	_free_blocks.pop_back();
+    } else if (_fresh_block < (_addr_variation + 1) * _blocks_per_addr)
+	b = _fresh_block++;
+    else
+	return IPRewriterBase::rw_drop;
+
+    PortBlock *pb = new_block(b, subscriber);
+    if (!pb) {
+	_free_blocks.push_back(b);
+	return IPRewriterBase::rw_drop;
+    }
+    if (find_port(b, pb, rewritten_flowid, reply_map))
+	return IPRewriterBase::rw_addmap;
+    // every port in the block conflicts with some other mapping
+    free_block(b, pb);
+    return IPRewriterBase::rw_drop;
+}
+
+bool
+IPRewriterPattern::find_port(uint32_t b, PortBlock *pb,
+			     IPFlowID &rewritten_flowid,
+			     const HashContainer<IPRewriterEntry> &reply_map)
+{
+    uint32_t port0 = ntohs(_sport) + (b % _blocks_per_addr) * _block_size;
+    IPFlowID lookup = rewritten_flowid.reverse();
+    lookup.set_daddr(IPAddress(htonl(ntohl(_saddr.addr()) + b / _blocks_per_addr)));
+
+    // Ports are normally free for the taking; the reply map check only
+    // guards against mappings made by other patterns.
+    for (uint32_t w = 0; w < (_block_size + 31) / 32; ++w)
+	for (uint32_t avail = ~pb->bits[w]; avail; avail &= avail - 1) {
+	    int bit = ffs_lsb(avail) - 1;
+	    lookup.set_dport(htons(port0 + w * 32 + bit));
+	    if (!reply_map.find(lookup)) {
+		pb->bits[w] |= 1U << bit;
+		++pb->nused;
+		rewritten_flowid.set_saddr(lookup.daddr());
+		rewritten_flowid.set_sport(lookup.dport());
+		return true;
+	    }
+	}
+    return false;
+}
+
+void
+IPRewriterPattern::release_port(const IPFlowID &flowid,
+				const IPFlowID &rewritten_flowid)
+{
+    uint32_t ai = ntohl(rewritten_flowid.saddr().addr()) - ntohl(_saddr.addr());
+    uint32_t pi = ntohs(rewritten_flowid.sport()) - ntohs(_sport);
+    if (ai > _addr_variation || pi >= _blocks_per_addr * _block_size)
+	return;
+    uint32_t b = ai * _blocks_per_addr + pi / _block_size;
+    uint32_t bit = pi % _block_size;
+    PortBlock *pb = _blocks.get(b);
+    if (!pb || pb->subscriber != flowid.saddr().addr()
+	|| !(pb->bits[bit / 32] & (1U << (bit % 32))))
+	return;
+    pb->bits[bit / 32] &= ~(1U << (bit % 32));
+    if (--pb->nused == 0)
+	free_block(b, pb);
+}
+
+IPRewriterPattern::PortBlock *
+IPRewriterPattern::new_block(uint32_t b, uint32_t subscriber)
+{
+    uint32_t nwords = (_block_size + 31) / 32;
+    PortBlock *pb = reinterpret_cast<PortBlock *>
+	(new char[sizeof(PortBlock) + (nwords - 1) * sizeof(uint32_t)]);
+    if (!pb)
+	return 0;
+    pb->subscriber = subscriber;
+    pb->next = _subscribers.get(subscriber);
+    pb->nused = 0;
+    memset(pb->bits, 0, nwords * sizeof(uint32_t));
+    if (_block_size % 32)	// mark ports past the end of the block in use
+	pb->bits[nwords - 1] = ~0U << (_block_size % 32);
+    _blocks.set(b, pb);
+    _subscribers.set(subscriber, b);
+    log_block(b, pb, "allocated to");
+    return pb;
+}
+
+void
+IPRewriterPattern::claim_port(const IPFlowID &flowid,
+			      const IPFlowID &rewritten_flowid)
+{
+    uint32_t ai = ntohl(rewritten_flowid.saddr().addr()) - ntohl(_saddr.addr());
+    uint32_t pi = ntohs(rewritten_flowid.sport()) - ntohs(_sport);
+    if (ai > _addr_variation || pi >= _blocks_per_addr * _block_size)
+	return;
+    uint32_t b = ai * _blocks_per_addr + pi / _block_size;
+    uint32_t bit = pi % _block_size;
+    uint32_t subscriber = flowid.saddr().addr();
+
+    PortBlock *pb = _blocks.get(b);
+    if (!pb) {
+	// Take the block out of the pool: blocks below _fresh_block that are
+	// not in use are on _free_blocks; skipped fresh blocks go there.
+	if (b < _fresh_block) {
+	    uint32_t *it = _free_blocks.begin();
+	    while (it != _free_blocks.end() && *it != b)
+		++it;
+	    if (it == _free_blocks.end())
+		return;
+	    *it = _free_blocks.back();
+	    _free_blocks.pop_back();
+	} else {
+	    while (_fresh_block < b)
+		_free_blocks.push_back(_fresh_block++);
+	    ++_fresh_block;
+	}
+	if (!(pb = new_block(b, subscriber))) {
+	    _free_blocks.push_back(b);
+	    return;
+	}
+    } else if (pb->subscriber != subscriber)
+	// another subscriber owns the block; the reply map still guards the
+	// port against reuse
+	return;
+
+    if (!(pb->bits[bit / 32] & (1U << (bit % 32)))) {
+	pb->bits[bit / 32] |= 1U << (bit % 32);
+	++pb->nused;
+    }
+}
+
+void
+IPRewriterPattern::free_block(uint32_t b, PortBlock *pb)
+{
+    HashTable<uint32_t, uint32_t>::iterator it = _subscribers.find(pb->subscriber);
+    if (it.value() == b) {
+	if (pb->next == no_block)
+	    _subscribers.erase(it);
+	else
+	    it.value() = pb->next;
+    } else {
+	PortBlock *prev = _blocks.get(it.value());
+	while (prev->next != b)
+	    prev = _blocks.get(prev->next);
+	prev->next = pb->next;
+    }
+    log_block(b, pb, "released by");
+    _blocks.erase(b);
+    _free_blocks.push_back(b);
+    delete[] reinterpret_cast<char *>(pb);
+}
+
+void
+IPRewriterPattern::log_block(uint32_t b, const PortBlock *pb,
+			     const char *what) const
+{
+    Timestamp now = Timestamp::now();
+    IPAddress addr(htonl(ntohl(_saddr.addr()) + b / _blocks_per_addr));
+    uint32_t port0 = ntohs(_sport) + (b % _blocks_per_addr) * _block_size;
+    click_chatter("%p{timestamp}: port block %s:%u-%u %s %s", &now,
+		  addr.unparse().c_str(), port0, port0 + _block_size - 1,
+		  what, IPAddress(pb->subscriber).unparse().c_str());
+}
+
 String
 IPRewriterPattern::unparse() const
 {
     StringAccum sa;
-    if (!_is_napt && _variation_top)
+    if (_block_size && _addr_variation)
+	sa << _saddr << '-'
+	   << IPAddress(htonl(ntohl(_saddr.addr()) + _addr_variation));
+    else if (!_is_napt && _variation_top)
 	sa << _saddr << '-'
 	   << IPAddress(htonl(ntohl(_saddr.addr()) + _variation_top));
     else if (_saddr)
@@ -287,9 +502,11 @@ IPRewriterPattern::unparse() const
 	/* nada */;
     else if (!_sport)
 	sa << " -";
-    else if (_variation_top)
+    else if (_variation_top) {
 	sa << ' ' << ntohs(_sport) << '-' << (ntohs(_sport) + _variation_top);
-    else
+	if (_block_size)
+	    sa << '/' << _block_size;
+    } else
 	sa << ' ' << ntohs(_sport);
 
     if (_daddr)
@@ -3,7 +3,9 @@
 #define CLICK_IPRW_PATTERN_HH
 #include <click/element.hh>
 #include <click/hashcontainer.hh>
+#include <click/hashtable.hh>
 #include <click/ipflowid.hh>
+#include <click/vector.hh>
 CLICK_DECLS
 class IPRewriterFlow;
 class IPRewriterEntry;
@@ -15,6 +17,7 @@ class IPRewriterPattern { public:
 		      const IPAddress &daddr, int dport,
 		      bool is_napt, bool sequential, bool same_first,
 		      uint32_t variation);
+    ~IPRewriterPattern();
     static bool parse(const Vector<String> &words, IPRewriterPattern **result,
 		      Element *context, ErrorHandler *errh);
     static bool parse_ports(const Vector<String> &words, IPRewriterInput *input,
@@ -40,6 +43,25 @@ class IPRewriterPattern { public:
     int rewrite_flowid(const IPFlowID &flowid, IPFlowID &rewritten_flowid,
 		       const HashContainer<IPRewriterEntry> &reply_map);
 
+    /** @brief Note that a flow created by this pattern has been destroyed.
+     *
+     * Only matters for port-block allocation, which must free the flow's
+     * port. */
+    void release(const IPFlowID &flowid, const IPFlowID &rewritten_flowid) {
+	if (_block_size)
+	    release_port(flowid, rewritten_flowid);
+    }
+
+    /** @brief Note that a flow for this pattern was created elsewhere, for
+     * example imported from another rewriter.
+     *
+     * Only matters for port-block allocation, which marks the flow's port in
+     * use so it is not handed out again. */
+    void claim(const IPFlowID &flowid, const IPFlowID &rewritten_flowid) {
+	if (_block_size)
+	    claim_port(flowid, rewritten_flowid);
+    }
+
     String unparse() const;
 
   private:
@@ -58,6 +80,36 @@ class IPRewriterPattern { public:
 
     int _refcount;
 
+    // Port-block allocation: the source addresses and ports are divided into
+    // blocks of _block_size ports, numbered address-major.  Each subscriber
+    // (internal source address) owns a chain of blocks, allocated as needed
+    // and freed when their last port is released.
+    struct PortBlock {
+	uint32_t subscriber;
+	uint32_t next;		// subscriber's next block, or no_block
+	uint32_t nused;
+	uint32_t bits[1];	// one per port, set if in use
+    };
+    enum { no_block = 0xFFFFFFFFU };
+
+    uint32_t _block_size;	// 0 unless port-block allocation
+    uint32_t _addr_variation;
+    uint32_t _blocks_per_addr;
+    uint32_t _fresh_block;	// blocks at or above this were never used
+    Vector<uint32_t> _free_blocks;
+    HashTable<uint32_t, PortBlock *> _blocks;
+    HashTable<uint32_t, uint32_t> _subscribers;
+
+    int rewrite_block(const IPFlowID &flowid, IPFlowID &rewritten_flowid,
+		      const HashContainer<IPRewriterEntry> &reply_map);
+    bool find_port(uint32_t b, PortBlock *pb, IPFlowID &rewritten_flowid,
+		   const HashContainer<IPRewriterEntry> &reply_map);
+    void claim_port(const IPFlowID &flowid, const IPFlowID &rewritten_flowid);
+    void release_port(const IPFlowID &flowid, const IPFlowID &rewritten_flowid);
+    PortBlock *new_block(uint32_t b, uint32_t subscriber);
+    void free_block(uint32_t b, PortBlock *pb);
+    void log_block(uint32_t b, const PortBlock *pb, const char *what) const;
+
     IPRewriterPattern(const IPRewriterPattern&);
     IPRewriterPattern& operator=(const IPRewriterPattern&);
 
@@ -0,0 +1,237 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * haship6lookup.{cc,hh} -- IPv6 route lookup by binary search on prefix
+ * lengths
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, subject to the conditions listed in the Click LICENSE
+ * file. These conditions include: you must preserve this copyright
+ * notice, and you cannot mention the copyright holders in advertising
+ * related to the Software without their permission.  The Software is
+ * provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This notice is a
+ * summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/ip6address.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/straccum.hh>
+#include "haship6lookup.hh"
+CLICK_DECLS
+
+HashIP6Lookup::HashIP6Lookup()
+    : _route_index(-1), _defer_rebuild(false)
+{
+}
+
+HashIP6Lookup::~HashIP6Lookup()
+{
+}
+
+int
+HashIP6Lookup::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    int before = errh->nerrors();
+    _defer_rebuild = true;
+    for (int i = 0; i < conf.size(); i++)
+	add_route_handler(conf[i], this, 0, errh);
+    _defer_rebuild = false;
+    rebuild();
+    return errh->nerrors() == before ? 0 : -1;
+}
+
+void
+HashIP6Lookup::rebuild()
+{
+    if (_defer_rebuild)
+	return;
+
+    int level_of[129];
+    for (int i = 0; i <= 128; i++)
+	level_of[i] = -1;
+    for (int i = 0; i < _routes.size(); i++)
+	level_of[_routes[i].prefix_len] = 0;
+
+    Vector<Level> levels;
+    int nlevels = 0;
+    for (int i = 0; i <= 128; i++)
+	if (level_of[i] >= 0)
+	    level_of[i] = nlevels++;
+    levels.resize(nlevels);
+    for (int i = 0; i <= 128; i++)
+	if (level_of[i] >= 0) {
+	    levels[level_of[i]].prefix_len = i;
+	    levels[level_of[i]].mask = IP6Address::make_prefix(i);
+	}
+
+    // Insert each route at its own level, leaving markers at every level
+    // where the binary search must turn toward longer prefixes to find it.
+    for (int ri = 0; ri < _routes.size(); ri++) {
+	const Route &r = _routes[ri];
+	int target = level_of[r.prefix_len];
+	int lo = 0, hi = nlevels - 1;
+	while (1) {
+	    int mid = (lo + hi) >> 1;
+	    Level &l = levels[mid];
+	    Key k(r.addr & l.mask, l.prefix_len);
+	    if (mid == target) {
+		l.table.set(k, ri);
+		break;
+	    } else if (mid < target) {
+		l.table.find_insert(k, -1);
+		lo = mid + 1;
+	    } else
+		hi = mid - 1;
+	}
+    }
+
+    // Give each marker the best matching real prefix, so a search that
+    // follows the marker and then fails still returns the right answer.
+    for (int li = 1; li < nlevels; li++)
+	for (HashTable<Key, int>::iterator it = levels[li].table.begin();
+	     it.live(); ++it)
+	    if (it.value() < 0)
+		for (int lj = li - 1; lj >= 0; lj--) {
+		    const Level &l = levels[lj];
+		    int ri = _route_index.get(Key(it.key().addr & l.mask, l.prefix_len));
+		    if (ri >= 0) {
+			it.value() = ri;
+			break;
+		    }
+		}
+
+    _levels.swap(levels);
+}
+
+void
+HashIP6Lookup::push(int, Packet *p)
+{
+    IP6Address gw;
+    int port = lookup_route(DST_IP6_ANNO(p), gw);
+    if (port >= 0) {
+	if (gw)
+	    SET_DST_IP6_ANNO(p, gw);
+	output(port).push(p);
+    } else
+	p->kill();
+}
+
+int
+HashIP6Lookup::lookup_route(const IP6Address &addr, IP6Address &gw) const
+{
+    int ri = lookup_index(addr);
+    if (ri < 0)
+	return -1;
+    gw = _routes[ri].gw;
+    return _routes[ri].port;
+}
+
+int
+HashIP6Lookup::add_route(IP6Address addr, IP6Address mask, IP6Address gw,
+			 int port, ErrorHandler *errh)
+{
+    int prefix_len = mask.mask_to_prefix_len();
+    if (prefix_len < 0)
+	return errh->error("bad prefix mask %s", mask.unparse().c_str());
+
+    Route r;
+    r.addr = addr & mask;
+    r.gw = gw;
+    r.prefix_len = prefix_len;
+    r.port = port;
+
+    HashTable<Key, int>::iterator it = _route_index.find_insert(Key(r.addr, prefix_len));
+    if (it.value() >= 0)
+	_routes[it.value()] = r;
+    else {
+	it.value() = _routes.size();
+	_routes.push_back(r);
+    }
+
+    rebuild();
+    return 0;
+}
+
+int
+HashIP6Lookup::remove_route(IP6Address addr, IP6Address mask, ErrorHandler *errh)
+{
+    int prefix_len = mask.mask_to_prefix_len();
+    HashTable<Key, int>::iterator it = _route_index.find(Key(addr & mask, prefix_len));
+    if (!it.live())
+	return errh->error("no route for %s/%d", (addr & mask).unparse().c_str(), prefix_len);
+
+    // Move the last route into the hole to keep _routes dense.
+    int ri = it.value();
+    _route_index.erase(it);
+    if (ri != _routes.size() - 1) {
+	const Route &last = _routes.back();
+	_route_index.set(Key(last.addr, last.prefix_len), ri);
+	_routes[ri] = last;
+    }
+    _routes.pop_back();
+
+    rebuild();
+    return 0;
+}
+
+String
+HashIP6Lookup::dump_routes()
+{
+    StringAccum sa;
+    for (int i = 0; i < _routes.size(); i++) {
+	const Route &r = _routes[i];
+	sa << r.addr << '/' << r.prefix_len << '\t' << r.gw << '\t' << r.port << '\n';
+    }
+    return sa.take_string();
+}
+
+int
+HashIP6Lookup::ctrl_handler(const String &conf_in, Element *e, void *thunk, ErrorHandler *errh)
+{
+    HashIP6Lookup *t = static_cast<HashIP6Lookup *>(e);
+    String conf = cp_uncomment(conf_in);
+    const char *s = conf.begin(), *end = conf.end();
+    int r = 0;
+
+    t->_defer_rebuild = true;
+    while (s < end && r >= 0) {
+	const char *nl = find(s, end, '\n');
+	String line = conf.substring(s, nl);
+	if (cp_uncomment(line))
+	    r = IP6RouteTable::ctrl_handler(line, e, thunk, errh);
+	s = nl + 1;
+    }
+    t->_defer_rebuild = false;
+    t->rebuild();
+    return r;
+}
+
+int
+HashIP6Lookup::flush_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    HashIP6Lookup *t = static_cast<HashIP6Lookup *>(e);
+    t->_routes.clear();
+    t->_route_index.clear();
+    t->rebuild();
+    return 0;
+}
+
+void
+HashIP6Lookup::add_handlers()
+{
+    add_write_handler("add", add_route_handler, 0);
+    add_write_handler("remove", remove_route_handler, 0);
+    add_write_handler("ctrl", ctrl_handler, 0);
+    add_write_handler("flush", flush_handler, 0, Handler::f_button);
+    add_read_handler("table", table_handler, 0, Handler::f_expensive);
+    set_handler("lookup", Handler::f_read | Handler::f_read_param, lookup_handler);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(IP6RouteTable)
+EXPORT_ELEMENT(HashIP6Lookup)
@@ -0,0 +1,172 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_HASHIP6LOOKUP_HH
+#define CLICK_HASHIP6LOOKUP_HH
+#include <click/element.hh>
+#include <click/hashtable.hh>
+#include <click/vector.hh>
+#include "ip6routetable.hh"
+CLICK_DECLS
+
+/*
+=c
+
+HashIP6Lookup(ADDR1/MASK1 [GW1] OUT1, ADDR2/MASK2 [GW2] OUT2, ...)
+
+=s ip6
+
+IPv6 routing lookup using binary search on prefix lengths
+
+=d
+
+Input: IPv6 packets (no ether header).  Expects a destination IPv6 address
+annotation with each packet.  Looks up that address in its routing table,
+using longest-prefix-match, sets the destination annotation to the
+corresponding GW (if non-zero), and emits the packet on the indicated OUTput
+port.  Packets that match no route are dropped.
+
+Each argument is a route, specifying a destination and mask, an optional
+gateway IPv6 address, and an output port.
+
+HashIP6Lookup keeps one hash table per distinct prefix length present in the
+table, and performs a binary search over those lengths, using marker entries
+to steer the search toward longer prefixes.  A lookup therefore costs at most
+log2(L)+1 hash probes, where L is the number of distinct prefix lengths
+(at most 8 probes for any IPv6 table).  Lookup cost does not grow with the
+number of routes, unlike LookupIP6Route's linear scan.
+
+Adding or removing a route rebuilds the marker tables.  To install many routes
+at once, use the C<ctrl> handler, which rebuilds only once per write.
+
+This scheme is described by Waldvogel, Varghese, Turner, and Plattner in the
+paper cited below.
+
+=h table read-only
+
+Outputs a human-readable version of the current routing table.
+
+=h lookup read-only, requires parameters
+
+Reports the OUTput port and GW corresponding to an address.
+
+=h add write-only
+
+Adds a route to the table.  Format should be `C<ADDR/MASK [GW] OUT>'.  An
+existing route for C<ADDR/MASK> is replaced.
+
+=h remove write-only
+
+Removes a route from the table.  Format should be `C<ADDR/MASK>'.
+
+=h ctrl write-only
+
+Adds or removes a group of routes.  Write `C<add ADDR/MASK [GW] OUT>' to add
+a route, and `C<remove ADDR/MASK>' to remove a route.  You can supply multiple
+commands, one per line.
+
+=h flush write-only
+
+Clears the entire routing table.
+
+=a LookupIP6Route, RadixIPLookup
+
+Marcel Waldvogel, George Varghese, Jon Turner, and Bernhard Plattner.
+"Scalable High Speed IP Routing Lookups".  In Proc. ACM SIGCOMM 1997,
+pp. 25-36.
+
+*/
+
+class HashIP6Lookup : public IP6RouteTable { public:
+
+    HashIP6Lookup() CLICK_COLD;
+    ~HashIP6Lookup() CLICK_COLD;
+
+    const char *class_name() const	{ return "HashIP6Lookup"; }
+    const char *port_count() const	{ return "1/-"; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *p);
+
+    int add_route(IP6Address, IP6Address, IP6Address, int, ErrorHandler *);
+    int remove_route(IP6Address, IP6Address, ErrorHandler *);
+    int lookup_route(const IP6Address &, IP6Address &) const;
+    String dump_routes();
+
+  private:
+
+    struct Key {
+	IP6Address addr;
+	int prefix_len;
+	Key(const IP6Address &a, int l)
+	    : addr(a), prefix_len(l) {
+	}
+	inline hashcode_t hashcode() const;
+	bool operator==(const Key &x) const {
+	    return addr == x.addr && prefix_len == x.prefix_len;
+	}
+    };
+
+    struct Route {
+	IP6Address addr;
+	IP6Address gw;
+	int prefix_len;
+	int port;
+    };
+
+    // One hash table per distinct prefix length.  Each entry maps a masked
+    // address to the index of its best matching prefix in _routes, or -1 for
+    // markers that do not lie under any route.
+    struct Level {
+	int prefix_len;
+	IP6Address mask;
+	HashTable<Key, int> table;
+    };
+
+    Vector<Route> _routes;
+    HashTable<Key, int> _route_index;
+    Vector<Level> _levels;
+    bool _defer_rebuild;
+
+    inline int lookup_index(const IP6Address &addr) const;
+    void rebuild();
+
+    static int ctrl_handler(const String &, Element *, void *, ErrorHandler *);
+    static int flush_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+inline hashcode_t
+HashIP6Lookup::Key::hashcode() const
+{
+    // IP6Address::hashcode() only looks at the low 64 bits, which are zero
+    // for most routing prefixes; mix in every word.
+    const uint32_t *a = addr.data32();
+    uint32_t h = prefix_len;
+    for (int i = 0; i < 4; ++i) {
+	h = (h ^ a[i]) * 0x9E3779B1U;
+	h ^= h >> 16;
+    }
+    return h;
+}
+
+inline int
+HashIP6Lookup::lookup_index(const IP6Address &addr) const
+{
+    int lo = 0, hi = _levels.size() - 1, best = -1;
+    while (lo <= hi) {
+	int mid = (lo + hi) >> 1;
+	const Level &l = _levels[mid];
+	if (const int *v = l.table.get_pointer(Key(addr & l.mask, l.prefix_len))) {
+	    if (*v >= 0)
+		best = *v;
+	    lo = mid + 1;
+	} else
+	    hi = mid - 1;
+    }
+    return best;
+}
+
+CLICK_ENDDECLS
+#endif
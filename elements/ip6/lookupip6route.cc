@@ -151,6 +151,7 @@ LookupIP6Route::add_route(IP6Address addr, IP6Address mask, IP6Address gw,
     return errh->error("port number out of range"); // Can't happen...
 
   _t.add(addr, mask, gw, output);
+  initialize(0);		// flush the lookup cache
   return 0;
 }
 
@@ -159,9 +160,20 @@ LookupIP6Route::remove_route(IP6Address addr, IP6Address mask,
 			     ErrorHandler *)
 {
   _t.del(addr, mask);
+  initialize(0);		// flush the lookup cache
   return 0;
 }
 
+int
+LookupIP6Route::lookup_route(const IP6Address &addr, IP6Address &gw) const
+{
+  int ifi;
+  if (_t.lookup(addr, gw, ifi))
+    return ifi;
+  else
+    return -1;
+}
+
 void
 LookupIP6Route::add_handlers()
 {
@@ -169,6 +181,7 @@ LookupIP6Route::add_handlers()
     add_write_handler("remove", remove_route_handler, 0);
     add_write_handler("ctrl", ctrl_handler, 0);
     add_read_handler("table", table_handler, 0);
+    set_handler("lookup", Handler::f_read | Handler::f_read_param, lookup_handler);
 }
 
 CLICK_ENDDECLS
@@ -56,6 +56,7 @@ public:
 
   int add_route(IP6Address, IP6Address, IP6Address, int, ErrorHandler *);
   int remove_route(IP6Address, IP6Address, ErrorHandler *);
+  int lookup_route(const IP6Address &, IP6Address &) const;
   String dump_routes()				{ return _t.dump(); };
 
 private:
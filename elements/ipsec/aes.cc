@@ -31,6 +31,10 @@
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
 #include "sadatatuple.hh"
+#if CLICK_USERLEVEL && (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+# define IPSEC_AESNI 1
+# include <wmmintrin.h>
+#endif
 
 CLICK_DECLS
 
@@ -54,7 +58,10 @@ Aes::configure(Vector<String> &conf, ErrorHandler *errh)
   int dec_int;
   _ignore = 12;/*This is the message digest*/
 
-  if (Args(conf, this, errh).read_mp("ENCRYPT", dec_int).complete() < 0)
+  if (Args(conf, this, errh)
+      .read_mp("ENCRYPT", dec_int)
+      .read_p("IGNORE", _ignore)
+      .complete() < 0)
     return -1;
   _op = dec_int;
   return 0;
@@ -71,10 +78,8 @@ Aes::simple_action(Packet *p_in)
 {
 
   WritablePacket *p = p_in->uniqueify();
-  unsigned char hold[8];
   struct esp_new *esp = (struct esp_new *)p->data();
   SADataTuple * sa_data;
-  unsigned char iv[8];
   unsigned char *ivp = esp->esp_iv;
   unsigned char * idat = p->data() + sizeof(esp_new);
   int plen = p->length() - sizeof(esp_new) - _ignore;
@@ -85,58 +90,192 @@ Aes::simple_action(Packet *p_in)
     encapsulation process to use a different padding scheme, because 128-bit key AES operates on 16 byte blocks
   */
   if ((plen % 16) != 0) { plen += 8; }
-  i = plen;
 
   sa_data =(SADataTuple *)IPSEC_SA_DATA_REFERENCE_ANNO(p);
-
-  if (_op == AES_DECRYPT) {
-    memcpy(iv, ivp, 8);
-    if(sa_data==NULL) {
-	click_chatter("AES: No SADataTuple reference annotation. check man page\n");
-        p->kill();
-        return 0;
-    }
-    /*Set the Decrypt key*/
-    AES_set_decrypt_key((const unsigned char *)&sa_data->Encryption_key, 128, &_key);
-  } else {
-    if(sa_data==NULL) {
-	click_chatter("AES: No SADataTuple annotation. This module is not properly placed check man page\n");
-        p->kill();
-        return 0;
-    }
-    AES_set_encrypt_key((const unsigned char *)&sa_data->Encryption_key, 128,&_key);
+  if(sa_data==NULL) {
+    click_chatter("AES: No SADataTuple reference annotation. check man page\n");
+    p->kill();
+    return 0;
   }
 
 #ifdef DEBUG
    click_chatter("Key: %x%x%x%x%x%x%x%x",sa_data->Encryption_key[0], sa_data->Encryption_key[1], sa_data->Encryption_key[2], sa_data->Encryption_key[3],sa_data->Encryption_key[4], sa_data->Encryption_key[5], sa_data->Encryption_key[6], sa_data->Encryption_key[7]);
 #endif
 
-// de/encrypt the payload
-   while (plen > 0) {
-
-    if(_op == AES_DECRYPT) {
-      memcpy(hold, idat, 8);
-      AES_decrypt((const unsigned char *)idat, (unsigned char *)idat, (const AES_KEY *)&_key);
-      /* CBC: XOR with the IV */
-      for (i = 0; i < 8; i++)
-	idat[i] ^= ivp[i];
-      memcpy(ivp, hold, 8);
-    } else {
+  if (_op == AES_DECRYPT) {
+    /* Decryption has no chaining dependency, so decrypt up to four blocks
+       at a time, then XOR each with the previous ciphertext block. */
+    unsigned char prev[8], hold[4][8];
+    memcpy(prev, ivp, 8);
+    while (plen > 0) {
+      int n = (plen >= 64 ? 4 : (plen + 15) / 16);
+      for (int b = 0; b < n; b++)
+	memcpy(hold[b], idat + 16 * b, 8);
+      decrypt_blocks(idat, idat, n, &sa_data->decrypt_key);
+      for (int b = 0; b < n; b++)
+	for (i = 0; i < 8; i++)
+	  idat[16 * b + i] ^= (b ? hold[b - 1][i] : prev[i]);
+      memcpy(prev, hold[n - 1], 8);
+      idat += 16 * n;
+      plen -= 16 * n;
+    }
+  } else {
+    while (plen > 0) {
       /* CBC: XOR with the IV */
       for (i = 0; i < 8; i++)
 	idat[i] ^= ivp[i];
-      AES_encrypt((const unsigned char *)idat, (unsigned char *)idat,&_key);
+      encrypt_blocks(idat, idat, 1, &sa_data->encrypt_key);
       ivp = idat;
+      idat += 16;
+      plen -= 16;
     }
-    idat += 16;
-    plen -= 16;
   }
-  if (_op == AES_DECRYPT)
-    memcpy(ivp, iv, 8);
 
   return(p);
 }
 
+#if IPSEC_AESNI
+# define AESNI_TARGET __attribute__((target("aes,sse2")))
+
+static AESNI_TARGET void
+aesni_encrypt_blocks(const unsigned char *in, unsigned char *out, int n,
+		     const AES_KEY *key)
+{
+  const unsigned char *rk = key->rd_key_bytes;
+  int nr = key->rounds;
+  __m128i k0 = _mm_loadu_si128((const __m128i *) rk);
+  /* four independent blocks keep the AES unit's pipeline full */
+  for (; n >= 4; n -= 4, in += 64, out += 64) {
+    __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in), k0);
+    __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 16)), k0);
+    __m128i b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 32)), k0);
+    __m128i b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 48)), k0);
+    for (int r = 1; r < nr; r++) {
+      __m128i k = _mm_loadu_si128((const __m128i *) (rk + 16 * r));
+      b0 = _mm_aesenc_si128(b0, k);
+      b1 = _mm_aesenc_si128(b1, k);
+      b2 = _mm_aesenc_si128(b2, k);
+      b3 = _mm_aesenc_si128(b3, k);
+    }
+    __m128i k = _mm_loadu_si128((const __m128i *) (rk + 16 * nr));
+    _mm_storeu_si128((__m128i *) out, _mm_aesenclast_si128(b0, k));
+    _mm_storeu_si128((__m128i *) (out + 16), _mm_aesenclast_si128(b1, k));
+    _mm_storeu_si128((__m128i *) (out + 32), _mm_aesenclast_si128(b2, k));
+    _mm_storeu_si128((__m128i *) (out + 48), _mm_aesenclast_si128(b3, k));
+  }
+  for (; n > 0; n--, in += 16, out += 16) {
+    __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in), k0);
+    for (int r = 1; r < nr; r++)
+      b = _mm_aesenc_si128(b, _mm_loadu_si128((const __m128i *) (rk + 16 * r)));
+    b = _mm_aesenclast_si128(b, _mm_loadu_si128((const __m128i *) (rk + 16 * nr)));
+    _mm_storeu_si128((__m128i *) out, b);
+  }
+}
+
+static AESNI_TARGET void
+aesni_decrypt_blocks(const unsigned char *in, unsigned char *out, int n,
+		     const AES_KEY *key)
+{
+  const unsigned char *rk = key->rd_key_bytes;
+  int nr = key->rounds;
+  __m128i k0 = _mm_loadu_si128((const __m128i *) rk);
+  for (; n >= 4; n -= 4, in += 64, out += 64) {
+    __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in), k0);
+    __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 16)), k0);
+    __m128i b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 32)), k0);
+    __m128i b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 48)), k0);
+    for (int r = 1; r < nr; r++) {
+      __m128i k = _mm_loadu_si128((const __m128i *) (rk + 16 * r));
+      b0 = _mm_aesdec_si128(b0, k);
+      b1 = _mm_aesdec_si128(b1, k);
+      b2 = _mm_aesdec_si128(b2, k);
+      b3 = _mm_aesdec_si128(b3, k);
+    }
+    __m128i k = _mm_loadu_si128((const __m128i *) (rk + 16 * nr));
+    _mm_storeu_si128((__m128i *) out, _mm_aesdeclast_si128(b0, k));
+    _mm_storeu_si128((__m128i *) (out + 16), _mm_aesdeclast_si128(b1, k));
+    _mm_storeu_si128((__m128i *) (out + 32), _mm_aesdeclast_si128(b2, k));
+    _mm_storeu_si128((__m128i *) (out + 48), _mm_aesdeclast_si128(b3, k));
+  }
+  for (; n > 0; n--, in += 16, out += 16) {
+    __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in), k0);
+    for (int r = 1; r < nr; r++)
+      b = _mm_aesdec_si128(b, _mm_loadu_si128((const __m128i *) (rk + 16 * r)));
+    b = _mm_aesdeclast_si128(b, _mm_loadu_si128((const __m128i *) (rk + 16 * nr)));
+    _mm_storeu_si128((__m128i *) out, b);
+  }
+}
+#endif
+
+bool
+Aes::have_aesni()
+{
+#if IPSEC_AESNI
+  static int have = -1;
+  if (have < 0)
+    have = __builtin_cpu_supports("aes") ? 1 : 0;
+  return have;
+#else
+  return false;
+#endif
+}
+
+void
+Aes::encrypt_blocks(const unsigned char *in, unsigned char *out, int nblocks,
+		    const AES_KEY *key)
+{
+#if IPSEC_AESNI
+  if (have_aesni()) {
+    aesni_encrypt_blocks(in, out, nblocks, key);
+    return;
+  }
+#endif
+  for (; nblocks > 0; nblocks--, in += 16, out += 16)
+    AES_encrypt(in, out, key);
+}
+
+void
+Aes::decrypt_blocks(const unsigned char *in, unsigned char *out, int nblocks,
+		    const AES_KEY *key)
+{
+#if IPSEC_AESNI
+  if (have_aesni()) {
+    aesni_decrypt_blocks(in, out, nblocks, key);
+    return;
+  }
+#endif
+  for (; nblocks > 0; nblocks--, in += 16, out += 16)
+    AES_decrypt(in, out, key);
+}
+
+void
+Aes::gcm_set_key(const AES_KEY *key, GCM_KEY *g)
+{
+  memset(g->h, 0, sizeof(g->h));
+  encrypt_blocks(g->h, g->h, 1, key);
+
+  uint64_t vh = 0, vl = 0;
+  for (int i = 0; i < 8; i++) {
+    vh = (vh << 8) | g->h[i];
+    vl = (vl << 8) | g->h[i + 8];
+  }
+  g->hl[0] = g->hh[0] = 0;
+  g->hl[8] = vl;
+  g->hh[8] = vh;
+  for (int i = 4; i > 0; i >>= 1) {
+    uint64_t t = (vl & 1) * 0xE100000000000000ULL;
+    vl = (vh << 63) | (vl >> 1);
+    vh = (vh >> 1) ^ t;
+    g->hl[i] = vl;
+    g->hh[i] = vh;
+  }
+  for (int i = 2; i <= 8; i *= 2)
+    for (int j = 1; j < i; j++) {
+      g->hh[i + j] = g->hh[i] ^ g->hh[j];
+      g->hl[i + j] = g->hl[i] ^ g->hl[j];
+    }
+}
+
 /***************************AES BELOW********************************/
 
 static const unsigned long Te0[256] = {
@@ -808,11 +947,30 @@ static const unsigned long rcon[] = {
 	0x1B000000, 0x36000000, /* for 128-bit blocks, Rijndael never uses more than 10 rcon values */
 };
 
+/**
+ * Copy the round keys into rd_key_bytes.  The decryption schedule built
+ * below is the "equivalent inverse cipher" schedule that AES-NI also uses.
+ */
+void Aes::store_key_bytes(AES_KEY *key)
+{
+	for (int i = 0; i < 4 * (key->rounds + 1); i++)
+		PUTU32(key->rd_key_bytes + 4 * i, key->rd_key[i]);
+}
+
 /**
  * Expand the cipher key into the encryption key schedule.
  */
 int Aes::AES_set_encrypt_key(const unsigned char *userKey, const int bits,
 			AES_KEY *key)
+{
+	int status = expand_key(userKey, bits, key);
+	if (status >= 0)
+		store_key_bytes(key);
+	return status;
+}
+
+int Aes::expand_key(const unsigned char *userKey, const int bits,
+			AES_KEY *key)
  {
 
 	unsigned long *rk;
@@ -921,7 +1079,7 @@ int Aes::AES_set_decrypt_key(const unsigned char *userKey, const int bits,
 	unsigned long temp;
 
 	/* first, start with an encryption schedule */
-	status = AES_set_encrypt_key(userKey, bits, key);
+	status = expand_key(userKey, bits, key);
 	if (status < 0)
 		return status;
 
@@ -958,6 +1116,7 @@ int Aes::AES_set_decrypt_key(const unsigned char *userKey, const int bits,
 			Td2[Te4[(rk[3] >>  8) & 0xff] & 0xff] ^
 			Td3[Te4[(rk[3]      ) & 0xff] & 0xff];
 	}
+	store_key_bytes(key);
 	return 0;
 }
 
@@ -1239,3 +1398,4 @@ void Aes::AES_decrypt(const unsigned char *in, unsigned char *out,
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(Aes)
+ELEMENT_MT_SAFE(Aes)
@@ -6,7 +6,7 @@ CLICK_DECLS
 
 /*
  * =c
- * IPsecAES(ENCRYPT)
+ * IPsecAES(ENCRYPT [, IGNORE])
  * =s ipsec
  * encrypt packet using DES-CBC
  * =d
@@ -15,9 +15,14 @@ CLICK_DECLS
  * IPsecAES will decrypt. If the first argument is 1, IPsecAES will encrypt.
  * KEY is the DES secret key. Gets IV value from ESP header. IGNORE is the
  * number of bytes at the end of the payload to ignore. By default, IGNORE is
- * 12, which is the number of SHA1 authentication digest bytes for ESP or AH.
+ * 12, which is the number of SHA1 authentication digest bytes for ESP or AH;
+ * use 16 with IPsecAuthHMACSHA256.
  *
- * =a IPsecESPEncap, IPsecESPUnencap, IPsecAuthSHA1
+ * Expanded keys are cached in each security association, and on x86 CPUs
+ * with the AES-NI instructions, blocks are processed with those instructions;
+ * decryption works on four blocks at a time.
+ *
+ * =a IPsecESPEncap, IPsecESPUnencap, IPsecAuthSHA1, IPsecAESGCM
  */
 
 # define GETU32(pt) (((unsigned long)(pt)[0] << 24) ^ ((unsigned long)(pt)[1] << 16) ^ ((unsigned long)(pt)[2] <<  8) ^ ((unsigned long)(pt)[3]))
@@ -30,9 +35,19 @@ CLICK_DECLS
 struct aes_key_st {
     unsigned long rd_key[4 *(AES_MAXNR + 1)];
     int rounds;
+    /* the same round keys as byte strings, as AES-NI expects them */
+    unsigned char rd_key_bytes[AES_BLOCK_SIZE * (AES_MAXNR + 1)];
 };
 typedef struct aes_key_st AES_KEY;
 
+/* GCM hash subkey H = E(K, 0), and Shoup's 4-bit multiplication tables for
+   it, computed once per key. */
+struct gcm_key_st {
+    unsigned char h[AES_BLOCK_SIZE];
+    uint64_t hl[16], hh[16];
+};
+typedef struct gcm_key_st GCM_KEY;
+
 
 class Address;
 
@@ -53,14 +68,23 @@ class Aes : public Element {
 
    enum { AES_DECRYPT = 0, AES_ENCRYPT = 1 };
 
+   static int AES_set_encrypt_key(const unsigned char *userKey, const int bits, AES_KEY *key);
+   static int AES_set_decrypt_key(const unsigned char *userKey, const int bits, AES_KEY *key);
+   static void AES_encrypt(const unsigned char *in, unsigned char *out,const AES_KEY *key);
+   static void AES_decrypt(const unsigned char *in, unsigned char *out,const AES_KEY *key);
+
+   /* Encrypt or decrypt nblocks independent blocks, using AES-NI if the CPU
+      has it.  in and out may be equal. */
+   static void encrypt_blocks(const unsigned char *in, unsigned char *out, int nblocks, const AES_KEY *key);
+   static void decrypt_blocks(const unsigned char *in, unsigned char *out, int nblocks, const AES_KEY *key);
+   static bool have_aesni();
+   static void gcm_set_key(const AES_KEY *key, GCM_KEY *gkey);
+
  private:
-   int AES_set_encrypt_key(const unsigned char *userKey, const int bits, AES_KEY *key);
-   int AES_set_decrypt_key(const unsigned char *userKey, const int bits, AES_KEY *key);
-   void AES_encrypt(const unsigned char *in, unsigned char *out,const AES_KEY *key);
-   void AES_decrypt(const unsigned char *in, unsigned char *out,const AES_KEY *key);
+   static int expand_key(const unsigned char *userKey, const int bits, AES_KEY *key);
+   static void store_key_bytes(AES_KEY *key);
    unsigned _op;
    int _ignore;
-   AES_KEY _key;
 };
 
 CLICK_ENDDECLS
@@ -0,0 +1,329 @@
+/*
+ * aesgcm.{cc,hh} -- element implements IPsec ESP encryption using AES-GCM
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#ifndef HAVE_IPSEC
+# error "Must #define HAVE_IPSEC in config.h"
+#endif
+#include "aesgcm.hh"
+#include "esp.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/packet_anno.hh>
+#include "sadatatuple.hh"
+#if CLICK_USERLEVEL && (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+# define IPSEC_PCLMUL 1
+# include <wmmintrin.h>
+# include <tmmintrin.h>
+#endif
+CLICK_DECLS
+
+IPsecAESGCM::IPsecAESGCM()
+    : _op(0)
+{
+}
+
+IPsecAESGCM::~IPsecAESGCM()
+{
+}
+
+int
+IPsecAESGCM::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    return Args(conf, this, errh).read_mp("ENCRYPT", _op).complete();
+}
+
+int
+IPsecAESGCM::initialize(ErrorHandler *)
+{
+    _drops = 0;
+    return 0;
+}
+
+static inline void
+put_u64(unsigned char *p, uint64_t x)
+{
+    for (int i = 7; i >= 0; i--, x >>= 8)
+	p[i] = x;
+}
+
+// Portable GHASH using Shoup's 4-bit tables, which the SA precomputes.
+namespace {
+struct GHashSoft {
+    const uint64_t *hl, *hh;
+    uint64_t zh, zl;
+
+    GHashSoft(const GCM_KEY *gkey)
+	: hl(gkey->hl), hh(gkey->hh), zh(0), zl(0) {
+    }
+
+    void block(const unsigned char *x) {
+	static const uint64_t last4[16] = {
+	    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+	    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+	};
+	unsigned char y[16];
+	put_u64(y, zh);
+	put_u64(y + 8, zl);
+	for (int i = 0; i < 16; i++)
+	    y[i] ^= x[i];
+
+	int lo = y[15] & 0xF;
+	uint64_t h = hh[lo], l = hl[lo];
+	for (int i = 15; i >= 0; i--) {
+	    lo = y[i] & 0xF;
+	    int hi = y[i] >> 4;
+	    if (i != 15) {
+		int rem = l & 0xF;
+		l = (h << 60) | (l >> 4);
+		h = (h >> 4) ^ (last4[rem] << 48);
+		h ^= hh[lo];
+		l ^= hl[lo];
+	    }
+	    int rem = l & 0xF;
+	    l = (h << 60) | (l >> 4);
+	    h = (h >> 4) ^ (last4[rem] << 48);
+	    h ^= hh[hi];
+	    l ^= hl[hi];
+	}
+	zh = h;
+	zl = l;
+    }
+
+    void finish(unsigned char *out) const {
+	put_u64(out, zh);
+	put_u64(out + 8, zl);
+    }
+};
+}
+
+template <typename G> static void
+ghash_data(G &g, const unsigned char *data, int len)
+{
+    for (; len >= 16; data += 16, len -= 16)
+	g.block(data);
+    if (len > 0) {
+	unsigned char last[16];
+	memcpy(last, data, len);
+	memset(last + len, 0, 16 - len);
+	g.block(last);
+    }
+}
+
+template <typename G> static void
+ghash_all(G &g, const unsigned char *aad, int aadlen,
+	  const unsigned char *c, int clen, unsigned char *out)
+{
+    unsigned char lengths[16];
+    ghash_data(g, aad, aadlen);
+    ghash_data(g, c, clen);
+    put_u64(lengths, (uint64_t) aadlen * 8);
+    put_u64(lengths + 8, (uint64_t) clen * 8);
+    g.block(lengths);
+    g.finish(out);
+}
+
+#if IPSEC_PCLMUL
+# define PCLMUL_TARGET __attribute__((target("pclmul,ssse3,sse2")))
+
+// GHASH with carry-less multiplication, after Intel's white paper
+// "Intel Carry-Less Multiplication Instruction and its Usage for Computing
+// the GCM Mode".
+namespace {
+struct GHashCLMul {
+    __m128i h, y, bswap;
+
+    PCLMUL_TARGET GHashCLMul(const unsigned char *hkey) {
+	bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	h = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) hkey), bswap);
+	y = _mm_setzero_si128();
+    }
+
+    PCLMUL_TARGET void block(const unsigned char *x) {
+	__m128i a = _mm_xor_si128(y, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) x), bswap));
+	__m128i t3 = _mm_clmulepi64_si128(a, h, 0x00);
+	__m128i t4 = _mm_clmulepi64_si128(a, h, 0x10);
+	__m128i t5 = _mm_clmulepi64_si128(a, h, 0x01);
+	__m128i t6 = _mm_clmulepi64_si128(a, h, 0x11);
+	t4 = _mm_xor_si128(t4, t5);
+	t5 = _mm_slli_si128(t4, 8);
+	t4 = _mm_srli_si128(t4, 8);
+	t3 = _mm_xor_si128(t3, t5);
+	t6 = _mm_xor_si128(t6, t4);
+	// shift the 256-bit product left by one bit
+	__m128i t7 = _mm_srli_epi32(t3, 31);
+	__m128i t8 = _mm_srli_epi32(t6, 31);
+	t3 = _mm_slli_epi32(t3, 1);
+	t6 = _mm_slli_epi32(t6, 1);
+	__m128i t9 = _mm_srli_si128(t7, 12);
+	t8 = _mm_slli_si128(t8, 4);
+	t7 = _mm_slli_si128(t7, 4);
+	t3 = _mm_or_si128(t3, t7);
+	t6 = _mm_or_si128(t6, t8);
+	t6 = _mm_or_si128(t6, t9);
+	// reduce modulo x^128 + x^7 + x^2 + x + 1
+	t7 = _mm_slli_epi32(t3, 31);
+	t8 = _mm_slli_epi32(t3, 30);
+	t9 = _mm_slli_epi32(t3, 25);
+	t7 = _mm_xor_si128(t7, t8);
+	t7 = _mm_xor_si128(t7, t9);
+	t8 = _mm_srli_si128(t7, 4);
+	t7 = _mm_slli_si128(t7, 12);
+	t3 = _mm_xor_si128(t3, t7);
+	__m128i t2 = _mm_srli_epi32(t3, 1);
+	t4 = _mm_srli_epi32(t3, 2);
+	t5 = _mm_srli_epi32(t3, 7);
+	t2 = _mm_xor_si128(t2, t4);
+	t2 = _mm_xor_si128(t2, t5);
+	t2 = _mm_xor_si128(t2, t8);
+	t3 = _mm_xor_si128(t3, t2);
+	y = _mm_xor_si128(t6, t3);
+    }
+
+    PCLMUL_TARGET void finish(unsigned char *out) const {
+	_mm_storeu_si128((__m128i *) out, _mm_shuffle_epi8(y, bswap));
+    }
+};
+}
+
+static bool
+have_pclmul()
+{
+    static int have = -1;
+    if (have < 0)
+	have = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+    return have;
+}
+#endif
+
+void
+IPsecAESGCM::ghash(const GCM_KEY *gkey, const unsigned char *aad, int aadlen,
+		   const unsigned char *c, int clen, unsigned char *out)
+{
+#if IPSEC_PCLMUL
+    if (have_pclmul()) {
+	GHashCLMul g(gkey->h);
+	ghash_all(g, aad, aadlen, c, clen, out);
+	return;
+    }
+#endif
+    GHashSoft g(gkey);
+    ghash_all(g, aad, aadlen, c, clen, out);
+}
+
+// XOR data with the keystream that starts at counter block inc32(j0).
+void
+IPsecAESGCM::ctr(const AES_KEY *key, const unsigned char *j0,
+		 unsigned char *data, int len)
+{
+    unsigned char counters[64], stream[64];
+    uint32_t counter = 2;
+    while (len > 0) {
+	int n = (len >= 64 ? 4 : (len + 15) / 16);
+	for (int b = 0; b < n; b++, counter++) {
+	    unsigned char *cb = counters + 16 * b;
+	    memcpy(cb, j0, 12);
+	    cb[12] = counter >> 24;
+	    cb[13] = counter >> 16;
+	    cb[14] = counter >> 8;
+	    cb[15] = counter;
+	}
+	Aes::encrypt_blocks(counters, stream, n, key);
+	int m = (len < 64 ? len : 64);
+	for (int i = 0; i < m; i++)
+	    data[i] ^= stream[i];
+	data += m;
+	len -= m;
+    }
+}
+
+Packet *
+IPsecAESGCM::simple_action(Packet *p_in)
+{
+    SADataTuple *sa_data = (SADataTuple *) IPSEC_SA_DATA_REFERENCE_ANNO(p_in);
+    int hdrlen = sizeof(esp_new);
+    int plen = p_in->length() - hdrlen - (_op ? 0 : ICV_LEN);
+    if (!sa_data || plen < 0) {
+	p_in->kill();
+	return 0;
+    }
+
+    WritablePacket *p = p_in->uniqueify();
+    if (!p)
+	return 0;
+    if (_op) {
+	p = p->put(ICV_LEN);
+	if (!p)
+	    return 0;
+    }
+    struct esp_new *esp = (struct esp_new *) p->data();
+    unsigned char *payload = p->data() + hdrlen;
+    unsigned char *icv = payload + plen;
+
+    // The IV is the sequence number, which is unique within the SA.
+    if (_op) {
+	memset(esp->esp_iv, 0, 4);
+	memcpy(esp->esp_iv + 4, &esp->esp_rpl, 4);
+    }
+
+    const AES_KEY *key = &sa_data->encrypt_key;
+    unsigned char j0[16], tag[16];
+    memcpy(j0, sa_data->Authentication_key, SALT_LEN);
+    memcpy(j0 + SALT_LEN, esp->esp_iv, 8);
+    j0[12] = j0[13] = j0[14] = 0;
+    j0[15] = 1;
+
+    if (!_op) {
+	ghash(&sa_data->gcm_key, p->data(), AAD_LEN, payload, plen, tag);
+	unsigned char ej0[16];
+	Aes::encrypt_blocks(j0, ej0, 1, key);
+	for (int i = 0; i < ICV_LEN; i++)
+	    tag[i] ^= ej0[i];
+	if (!ipsec_icv_equal(icv, tag, ICV_LEN)) {
+	    if (_drops == 0)
+		click_chatter("Invalid AES-GCM integrity check value");
+	    _drops++;
+	    checked_output_push(1, p);
+	    return 0;
+	}
+	ctr(key, j0, payload, plen);
+	p->take(ICV_LEN);
+    } else {
+	ctr(key, j0, payload, plen);
+	ghash(&sa_data->gcm_key, p->data(), AAD_LEN, payload, plen, tag);
+	Aes::encrypt_blocks(j0, icv, 1, key);
+	for (int i = 0; i < ICV_LEN; i++)
+	    icv[i] ^= tag[i];
+    }
+    return p;
+}
+
+String
+IPsecAESGCM::drop_handler(Element *e, void *)
+{
+    IPsecAESGCM *a = (IPsecAESGCM *) e;
+    return String(a->_drops);
+}
+
+void
+IPsecAESGCM::add_handlers()
+{
+    add_read_handler("drops", drop_handler, 0);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(Aes)
+EXPORT_ELEMENT(IPsecAESGCM)
+ELEMENT_MT_SAFE(IPsecAESGCM)
@@ -0,0 +1,76 @@
+#ifndef CLICK_IPSECAESGCM_HH
+#define CLICK_IPSECAESGCM_HH
+#include <click/element.hh>
+#include <click/atomic.hh>
+#include <click/glue.hh>
+#include "aes.hh"
+CLICK_DECLS
+
+/*
+ * =c
+ * IPsecAESGCM(ENCRYPT)
+ * =s ipsec
+ * encrypt and authenticate ESP packets using AES-GCM
+ * =d
+ *
+ * Encrypts and authenticates, or verifies and decrypts, ESP packets using
+ * AES-128 in Galois/Counter Mode as specified by RFC 4106.  If the first
+ * argument is 1, IPsecAESGCM encrypts the payload following the ESP header
+ * and appends a 16-byte integrity check value; if it is 0, it verifies and
+ * removes the check value and decrypts.  Packets that fail verification are
+ * sent to output 1, if it exists, and dropped otherwise.  There is no need
+ * for a separate authentication element.
+ *
+ * The key is the security association's encryption key.  The first four
+ * bytes of the SA's authentication key serve as the nonce salt.  On
+ * encryption the ESP IV is set from the sequence number, so an SA must be
+ * rekeyed before its sequence number wraps.
+ *
+ * On x86 CPUs, IPsecAESGCM uses the AES-NI and PCLMULQDQ instructions when
+ * the CPU has them, encrypting four counter blocks at a time.
+ *
+ * =h drops read-only
+ *
+ * Returns the number of packets that failed verification.
+ *
+ * =e
+ *
+ *   rt[1] -> IPsecESPEncap -> IPsecAESGCM(1) -> IPsecEncap(50) -> ...
+ *   rt[0] -> StripIPHeader -> IPsecAESGCM(0) -> IPsecESPUnencap -> ...
+ *
+ * =a IPsecESPEncap, IPsecESPUnencap, IPsecAES, IPsecAuthHMACSHA256
+ */
+
+class IPsecAESGCM : public Element {
+
+public:
+  IPsecAESGCM() CLICK_COLD;
+  ~IPsecAESGCM() CLICK_COLD;
+
+  const char *class_name() const	{ return "IPsecAESGCM"; }
+  const char *port_count() const	{ return "1/1-2"; }
+
+  int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+  int initialize(ErrorHandler *) CLICK_COLD;
+
+  Packet *simple_action(Packet *);
+  void add_handlers() CLICK_COLD;
+
+  enum { ICV_LEN = 16, SALT_LEN = 4, AAD_LEN = 8 };
+
+  // GHASH over aad and c with hash key gkey, as defined by the GCM spec.
+  static void ghash(const GCM_KEY *gkey, const unsigned char *aad, int aadlen,
+		    const unsigned char *c, int clen, unsigned char *out);
+
+private:
+
+  unsigned _op;
+  atomic_uint32_t _drops;
+
+  static void ctr(const AES_KEY *key, const unsigned char *j0,
+		  unsigned char *data, int len);
+  static String drop_handler(Element *e, void *thunk);
+};
+
+CLICK_ENDDECLS
+#endif
@@ -45,20 +45,30 @@ int
 IPsecESPUnencap::checkreplaywindow(SADataTuple * sa_data,unsigned long seq)
   {
 	unsigned long diff;
+	uint32_t bit = 1U << (seq & 31);
+	uint32_t *word = &sa_data->bitmap[(seq >> 5) % SADataTuple::REPLAY_WORDS];
 
 	if (seq == 0)
 		return 0;		/* first == 0 or wrapped */
 	/*This logic has been added for the time being to deal with replay rollover*/
-	if((seq == sa_data->replay_start_counter) && (sa_data->lastseq!=sa_data->replay_start_counter)) { sa_data->bitmap=0;sa_data->lastseq=seq;return 1;}
+	if((seq == sa_data->replay_start_counter) && (sa_data->lastseq!=sa_data->replay_start_counter)) {
+		memset(sa_data->bitmap, 0, sizeof(sa_data->bitmap));
+		sa_data->lastseq=seq;
+		*word = bit;
+		return 1;
+	}
 
 	if (seq > sa_data->lastseq)	/* new larger sequence number */
 	{
-		diff = seq - sa_data->lastseq;
-		if (diff < sa_data->ooowin) /* In win, set bit for this pkt */
-			sa_data->bitmap = (sa_data->bitmap << diff) | 1;
-		else
-			sa_data->bitmap = 1; /* This packet has way larger */
-
+		/* Clear the words the window slides over, then set the bit for
+		   this packet. */
+		unsigned long cur = sa_data->lastseq >> 5;
+		diff = (seq >> 5) - cur;
+		if (diff > SADataTuple::REPLAY_WORDS)
+			diff = SADataTuple::REPLAY_WORDS;
+		for (unsigned long i = 1; i <= diff; i++)
+			sa_data->bitmap[(cur + i) % SADataTuple::REPLAY_WORDS] = 0;
+		*word |= bit;
 		sa_data->lastseq = seq;
 		return 1;		/* larger is good */
 	}
@@ -68,11 +78,11 @@ IPsecESPUnencap::checkreplaywindow(SADataTuple * sa_data,unsigned long seq)
 		return 0;
 
         }
-	if (sa_data->bitmap & (1 << diff)) { /* this packet already seen */
+	if (*word & bit) { /* this packet already seen */
 		click_chatter("Replay protection: This packet is already seen...\n");
 		return 0;
         }
-	sa_data->bitmap |= (1 << diff);	/* mark as seen */
+	*word |= bit;	/* mark as seen */
 	return 1;			/* out of order but good */
 }
 
@@ -13,8 +13,12 @@ CLICK_DECLS
  * removes IPSec encapsulation
  * =d
  *
- * Removes ESP header added by IPsecESPEncap. see RFC 2406. Does not perform
- * the optional anti-replay attack checks.
+ * Removes ESP header added by IPsecESPEncap. see RFC 2406. Checks each
+ * packet's sequence number against its security association's anti-replay
+ * window, whose size is the route's OOSIZE (at most 1024 packets), and drops
+ * replayed packets and packets older than the window.  The window is not
+ * locked, so all packets for one security association should be handled by
+ * one thread.
  *
  * =a IPsecESPUnencap, IPsecDES, IPsecAuthSHA1
  */
@@ -74,12 +74,15 @@ IPsecESPEncap::simple_action(Packet *p)
   // copy in ESP header
   // Get SPI from packet user annotation. This is the fourth user integer.
   esp->esp_spi = htonl((uint32_t)IPSEC_SPI_ANNO(p));
-  esp->esp_rpl = htonl(sa_data->cur_rpl);
-
-  if((sa_data->cur_rpl++) == 0) {
-	//if the replay counter rolls over...set it to the agreed start value
-        sa_data->cur_rpl = sa_data->replay_start_counter;
-  }
+  // Claim this packet's sequence number atomically, so threads sharing
+  // an SA never send duplicates.
+  uint32_t rpl, next_rpl;
+  do {
+    rpl = sa_data->cur_rpl;
+    //if the replay counter rolls over...set it to the agreed start value
+    next_rpl = (rpl == 0 ? sa_data->replay_start_counter : rpl + 1);
+  } while (atomic_uint32_t::compare_swap(sa_data->cur_rpl, rpl, next_rpl) != rpl);
+  esp->esp_rpl = htonl(rpl);
   i = click_random() >> 2;
   memmove(&esp->esp_iv[0], &i, 4);
   i = click_random() >> 2;
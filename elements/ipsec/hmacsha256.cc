@@ -0,0 +1,254 @@
+/*
+ * hmacsha256.{cc,hh} -- element implements IPsec HMAC-SHA-256 authentication
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#ifndef HAVE_IPSEC
+# error "Must #define HAVE_IPSEC in config.h"
+#endif
+#include "hmacsha256.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/packet_anno.hh>
+#include "sadatatuple.hh"
+CLICK_DECLS
+
+IPsecAuthHMACSHA256::IPsecAuthHMACSHA256()
+{
+}
+
+IPsecAuthHMACSHA256::~IPsecAuthHMACSHA256()
+{
+}
+
+int
+IPsecAuthHMACSHA256::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    return Args(conf, this, errh).read_mp("VERIFY", _op).complete();
+}
+
+int
+IPsecAuthHMACSHA256::initialize(ErrorHandler *)
+{
+    _drops = 0;
+    return 0;
+}
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t
+ror32(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+void
+IPsecAuthHMACSHA256::sha256_block(uint32_t *h, const unsigned char *block)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+	w[i] = ((uint32_t) block[4*i] << 24) | (block[4*i+1] << 16) | (block[4*i+2] << 8) | block[4*i+3];
+    for (int i = 16; i < 64; i++) {
+	uint32_t s0 = ror32(w[i-15], 7) ^ ror32(w[i-15], 18) ^ (w[i-15] >> 3);
+	uint32_t s1 = ror32(w[i-2], 17) ^ ror32(w[i-2], 19) ^ (w[i-2] >> 10);
+	w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3],
+	e = h[4], f = h[5], g = h[6], hh = h[7];
+    for (int i = 0; i < 64; i++) {
+	uint32_t t1 = hh + (ror32(e, 6) ^ ror32(e, 11) ^ ror32(e, 25))
+	    + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+	uint32_t t2 = (ror32(a, 2) ^ ror32(a, 13) ^ ror32(a, 22))
+	    + ((a & b) ^ (a & c) ^ (b & c));
+	hh = g;
+	g = f;
+	f = e;
+	e = d + t1;
+	d = c;
+	c = b;
+	b = a;
+	a = t1 + t2;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+    h[5] += f;
+    h[6] += g;
+    h[7] += hh;
+}
+
+void
+IPsecAuthHMACSHA256::sha256_init(sha256_ctx *ctx)
+{
+    static const uint32_t h0[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->h, h0, sizeof(h0));
+    ctx->length = 0;
+}
+
+void
+IPsecAuthHMACSHA256::sha256_update(sha256_ctx *ctx, const unsigned char *data, size_t len)
+{
+    size_t used = ctx->length % BLOCK_LEN;
+    ctx->length += len;
+    if (used) {
+	size_t n = (len < BLOCK_LEN - used ? len : BLOCK_LEN - used);
+	memcpy(ctx->buf + used, data, n);
+	data += n;
+	len -= n;
+	if (used + n < BLOCK_LEN)
+	    return;
+	sha256_block(ctx->h, ctx->buf);
+    }
+    for (; len >= BLOCK_LEN; data += BLOCK_LEN, len -= BLOCK_LEN)
+	sha256_block(ctx->h, data);
+    memcpy(ctx->buf, data, len);
+}
+
+void
+IPsecAuthHMACSHA256::sha256_final(sha256_ctx *ctx, unsigned char *digest)
+{
+    uint64_t bits = ctx->length * 8;
+    size_t used = ctx->length % BLOCK_LEN;
+    ctx->buf[used++] = 0x80;
+    if (used > BLOCK_LEN - 8) {
+	memset(ctx->buf + used, 0, BLOCK_LEN - used);
+	sha256_block(ctx->h, ctx->buf);
+	used = 0;
+    }
+    memset(ctx->buf + used, 0, BLOCK_LEN - 8 - used);
+    for (int i = 0; i < 8; i++)
+	ctx->buf[BLOCK_LEN - 1 - i] = bits >> (8 * i);
+    sha256_block(ctx->h, ctx->buf);
+    for (int i = 0; i < 8; i++) {
+	digest[4*i] = ctx->h[i] >> 24;
+	digest[4*i+1] = ctx->h[i] >> 16;
+	digest[4*i+2] = ctx->h[i] >> 8;
+	digest[4*i+3] = ctx->h[i];
+    }
+}
+
+void
+IPsecAuthHMACSHA256::hmac_set_key(const unsigned char *key, size_t keylen,
+				  HMAC_SHA256_KEY *hkey)
+{
+    unsigned char pad[BLOCK_LEN], keydigest[DIGEST_LEN];
+    sha256_ctx ctx;
+    if (keylen > BLOCK_LEN) {
+	sha256_init(&ctx);
+	sha256_update(&ctx, key, keylen);
+	sha256_final(&ctx, keydigest);
+	key = keydigest;
+	keylen = DIGEST_LEN;
+    }
+
+    memset(pad, 0x36, BLOCK_LEN);
+    for (size_t i = 0; i < keylen; i++)
+	pad[i] ^= key[i];
+    sha256_init(&ctx);
+    sha256_block(ctx.h, pad);
+    memcpy(hkey->inner, ctx.h, sizeof(hkey->inner));
+
+    memset(pad, 0x5c, BLOCK_LEN);
+    for (size_t i = 0; i < keylen; i++)
+	pad[i] ^= key[i];
+    sha256_init(&ctx);
+    sha256_block(ctx.h, pad);
+    memcpy(hkey->outer, ctx.h, sizeof(hkey->outer));
+}
+
+void
+IPsecAuthHMACSHA256::hmac(const HMAC_SHA256_KEY *hkey,
+			  const unsigned char *data, size_t len,
+			  unsigned char *digest)
+{
+    // Start from the states left by the padded keys, so each packet
+    // costs two fewer compression rounds.
+    sha256_ctx ctx;
+    memcpy(ctx.h, hkey->inner, sizeof(ctx.h));
+    ctx.length = BLOCK_LEN;
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, digest);
+
+    memcpy(ctx.h, hkey->outer, sizeof(ctx.h));
+    ctx.length = BLOCK_LEN;
+    sha256_update(&ctx, digest, DIGEST_LEN);
+    sha256_final(&ctx, digest);
+}
+
+Packet *
+IPsecAuthHMACSHA256::simple_action(Packet *p)
+{
+    SADataTuple *sa_data = (SADataTuple *) IPSEC_SA_DATA_REFERENCE_ANNO(p);
+    unsigned char digest[DIGEST_LEN];
+
+    if (!sa_data) {
+	click_chatter("HMAC-SHA-256: No SADataTuple reference annotation. check man page");
+	p->kill();
+	return 0;
+    }
+
+    if (_op == COMPUTE_AUTH) {
+	hmac(&sa_data->hmac_sha256_key, p->data(), p->length(), digest);
+	WritablePacket *q = p->put(ICV_LEN);
+	if (q)
+	    memcpy(q->end_data() - ICV_LEN, digest, ICV_LEN);
+	return q;
+    }
+
+    if (p->length() >= ICV_LEN) {
+	hmac(&sa_data->hmac_sha256_key, p->data(), p->length() - ICV_LEN, digest);
+	if (ipsec_icv_equal(p->end_data() - ICV_LEN, digest, ICV_LEN)) {
+	    p->take(ICV_LEN);
+	    return p;
+	}
+    }
+
+    if (_drops == 0)
+	click_chatter("Invalid SHA-256 authentication digest");
+    _drops++;
+    checked_output_push(1, p);
+    return 0;
+}
+
+String
+IPsecAuthHMACSHA256::drop_handler(Element *e, void *)
+{
+    IPsecAuthHMACSHA256 *a = (IPsecAuthHMACSHA256 *) e;
+    return String(a->_drops);
+}
+
+void
+IPsecAuthHMACSHA256::add_handlers()
+{
+    add_read_handler("drops", drop_handler, 0);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(IPsecAuthHMACSHA256)
+ELEMENT_MT_SAFE(IPsecAuthHMACSHA256)
@@ -0,0 +1,81 @@
+#ifndef CLICK_IPSECAUTHHMACSHA256_HH
+#define CLICK_IPSECAUTHHMACSHA256_HH
+#include <click/element.hh>
+#include <click/atomic.hh>
+#include <click/glue.hh>
+CLICK_DECLS
+
+/*
+ * =c
+ * IPsecAuthHMACSHA256(VERIFY)
+ * =s ipsec
+ * compute or verify HMAC-SHA-256 authentication digest.
+ * =d
+ *
+ * If first argument is 0, computes the HMAC-SHA-256-128 authentication
+ * digest for an ESP packet per RFC 4868 and appends it.  If first argument is
+ * 1, verifies the digest and removes it.  Packets that fail verification are
+ * sent to output 1, if it exists, and dropped otherwise.  The key is the
+ * security association's authentication key, which RFC 4868 requires to be
+ * 256 bits: give the security association a 32-byte AUTH_KEY.  (A 16-byte
+ * key also works, but no RFC 4868 peer will accept the result.)  The hash
+ * states of the padded key are computed once, when the security association
+ * is set up.  Packets without a security association annotation are dropped.
+ * When used with IPsecAES, give IPsecAES an IGNORE argument of 16.
+ *
+ * =h drops read-only
+ *
+ * Returns the number of packets that failed verification.
+ *
+ * =a IPsecAuthHMACSHA1, IPsecESPEncap, IPsecAES, IPsecAESGCM
+ */
+
+// HMAC-SHA-256 key schedule: the SHA-256 states after hashing the inner
+// and outer padded keys.
+struct HMAC_SHA256_KEY {
+  uint32_t inner[8];
+  uint32_t outer[8];
+};
+
+class IPsecAuthHMACSHA256 : public Element {
+
+public:
+  IPsecAuthHMACSHA256() CLICK_COLD;
+  ~IPsecAuthHMACSHA256() CLICK_COLD;
+
+  const char *class_name() const	{ return "IPsecAuthHMACSHA256"; }
+  const char *port_count() const	{ return "1/1-2"; }
+
+  int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+  int initialize(ErrorHandler *) CLICK_COLD;
+
+  Packet *simple_action(Packet *);
+  void add_handlers() CLICK_COLD;
+
+  enum { DIGEST_LEN = 32, ICV_LEN = 16, BLOCK_LEN = 64 };
+
+  struct sha256_ctx {
+    uint32_t h[8];
+    uint64_t length;
+    unsigned char buf[BLOCK_LEN];
+  };
+  static void sha256_init(sha256_ctx *ctx);
+  static void sha256_update(sha256_ctx *ctx, const unsigned char *data, size_t len);
+  static void sha256_final(sha256_ctx *ctx, unsigned char *digest);
+  static void hmac_set_key(const unsigned char *key, size_t keylen, HMAC_SHA256_KEY *hkey);
+  static void hmac(const HMAC_SHA256_KEY *hkey,
+		   const unsigned char *data, size_t len, unsigned char *digest);
+
+private:
+
+  int _op;
+  atomic_uint32_t _drops;
+
+  enum { COMPUTE_AUTH = 0, VERIFY_AUTH = 1 };
+
+  static void sha256_block(uint32_t *h, const unsigned char *block);
+  static String drop_handler(Element *e, void *thunk);
+};
+
+CLICK_ENDDECLS
+#endif
@@ -39,16 +39,39 @@
 
 CLICK_DECLS
 
+// Parses 'SPI ENCRYPT_KEY AUTH_KEY REPLAY OOSIZE' into a security association.
+static bool
+cp_ipsec_sa(const Vector<String> &words, uint32_t &spi, SADataTuple &sa_data, Element *context, ErrorHandler *errh)
+{
+    unsigned int replay;
+    uint16_t oowin;
+    String enc_key, auth_key;
+    if (Args(words, context, errh)
+	.read_mp("SPI", spi)
+	.read_mp("ENCRYPT_KEY", enc_key)
+	.read_mp("AUTH_KEY", auth_key)
+	.read_mp("REPLAY", replay)
+	.read_mp("OOSIZE", oowin)
+	.complete() < 0)
+	return false;
+    if (enc_key.length() != KEY_SIZE
+	|| (auth_key.length() != KEY_SIZE && auth_key.length() != AUTH_KEY_MAX)) {
+	errh->error("key has bad length");
+	return false;
+    }
+    if (oowin > SADataTuple::REPLAY_WINDOW) {
+	errh->error("OOSIZE too large, max %d", (int) SADataTuple::REPLAY_WINDOW);
+	return false;
+    }
+    sa_data = SADataTuple(enc_key.data(), auth_key.data(), replay, oowin, auth_key.length());
+    return true;
+}
+
 //changed to support IPsec extensions
 bool
 cp_ipsec_route(String s, IPsecRoute *r_store, bool remove_route, Element *context)
 {
     IPsecRoute r;
-    //Data to initialize the SADataTuple
-    unsigned int replay;
-    uint8_t  oowin;
-
-    SADataTuple * sa_data;
 
     if (!IPPrefixArg(true).parse(cp_shift_spacevec(s), r.addr, r.mask, context))
 	return false;
@@ -80,23 +103,15 @@ cp_ipsec_route(String s, IPsecRoute *r_store, bool remove_route, Element *contex
     Vector<String> words;
     words.push_back(word);
     cp_spacevec(s, words);
-    String enc_key, auth_key;
-    if (Args(words, context, ErrorHandler::default_handler())
-	.read_mp("SPI", r.spi)
-	.read_mp("ENCRYPT_KEY", enc_key)
-	.read_mp("AUTH_KEY", auth_key)
-	.read_mp("REPLAY", replay)
-	.read_mp("OOSIZE", oowin)
-	.complete() < 0)
-	return false;
-    if (enc_key.length() != 16 || auth_key.length() != 16) {
-	click_chatter("key has bad length");
+    SADataTuple *sa_data = new SADataTuple;
+    if (!cp_ipsec_sa(words, r.spi, *sa_data, context, ErrorHandler::default_handler())) {
+	delete sa_data;
 	return false;
     }
 
     // Create new Security Association Table entry
-    sa_data = new SADataTuple(enc_key.data(), auth_key.data(), replay, oowin);
-    ((IPsecRouteTable*)context)->_sa_table.insert(SPI(r.spi),*sa_data);
+    if (!remove_route)
+	((IPsecRouteTable*)context)->_sa_table.insert(SPI(r.spi),*sa_data);
     //Set Tuple reference in the Routing entry
     r.sa_data = sa_data;
     //store routing table
@@ -141,6 +156,25 @@ IPsecRoute::unparse() const
 }
 
 
+IPsecRouteTable::IPsecRouteTable()
+    : _sa_timer(this)
+{
+}
+
+int
+IPsecRouteTable::initialize(ErrorHandler *)
+{
+    _sa_timer.initialize(this);
+    return 0;
+}
+
+void
+IPsecRouteTable::run_timer(Timer *)
+{
+    if (_sa_table.reclaim())
+	_sa_timer.reschedule_after_msec(SA_GRACE_MSEC);
+}
+
 void *
 IPsecRouteTable::cast(const char *name)
 {
@@ -193,13 +227,17 @@ IPsecRouteTable::dump_routes()
 void
 IPsecRouteTable::push(int, Packet *p)
 {
-
     IPAddress gw;
     uint32_t spi;
     SADataTuple * sa_data;
-    const click_ip *ip = reinterpret_cast< const click_ip *>(p->data());
-
     int port = lookup_route(p->dst_ip_anno(), gw, spi, sa_data);
+    route_packet(p, port, gw, spi, sa_data);
+}
+
+void
+IPsecRouteTable::route_packet(Packet *p, int port, IPAddress gw, uint32_t spi, SADataTuple *sa_data)
+{
+    const click_ip *ip = reinterpret_cast< const click_ip *>(p->data());
 
     if (port >= 0) {
 	switch(port) {
@@ -221,11 +259,12 @@ IPsecRouteTable::push(int, Packet *p)
 	      /*This not an IPSEC packet and it should be delivered to the host's linux network stack
                 In a typical setup one would send anything that is directed to port 2 to Linux */
                 port = 2;
+		break;
             }
             // This is an ipsec packet and belongs to a tunneled connection
 	    // so we set the proper annotation with reference to Security Data Table to be used by IPsec modules
             // Careful this enhancement is 32-bit architecture specific!!
-            struct esp_new * esp =(struct esp_new *)(p->data()+sizeof(click_ip));
+            struct esp_new * esp =(struct esp_new *)(p->data() + (ip->ip_hl << 2));
             sa_data = _sa_table.lookup(SPI(ntohl(esp->esp_spi)));
 	    if(sa_data == NULL) {
 		click_chatter("Invalid SPI %d, Dropping packet",ntohl(esp->esp_spi));
@@ -356,6 +395,69 @@ IPsecRouteTable::table_handler(Element *e, void *)
     return r->dump_routes();
 }
 
+int
+IPsecRouteTable::sa_handler(const String &conf_in, Element *e, void *thunk, ErrorHandler *errh)
+{
+    IPsecRouteTable *table = static_cast<IPsecRouteTable *>(e);
+    String conf = cp_uncomment(conf_in);
+
+    if (thunk == (void *) CMD_REMOVE) {
+	Vector<String> words;
+	cp_spacevec(conf, words);
+	Vector<uint32_t> spis;
+	for (int i = 0; i < words.size(); i++) {
+	    uint32_t spi;
+	    if (!IntArg().parse(words[i], spi) || !spi)
+		return errh->error("expected SPI, not '%s'", words[i].c_str());
+	    spis.push_back(spi);
+	}
+	int r = 0;
+	for (int i = 0; i < spis.size(); i++)
+	    if (table->_sa_table.remove(spis[i]) < 0)
+		r = errh->error("no SA with SPI %u", spis[i]);
+	if (table->_sa_table.has_retired() && !table->_sa_timer.scheduled())
+	    table->_sa_timer.schedule_after_msec(SA_GRACE_MSEC);
+	return r;
+    }
+
+    // Parse every line before changing anything, so a bad line changes
+    // nothing.
+    Vector<uint32_t> spis;
+    Vector<SADataTuple> sas;
+    HashTable<uint32_t, int> seen;
+    const char *s = conf.begin(), *end = conf.end();
+    while (s < end) {
+	const char *nl = find(s, end, '\n');
+	Vector<String> words;
+	cp_spacevec(conf.substring(s, nl), words);
+	s = nl + 1;
+	if (!words.size())
+	    continue;
+	uint32_t spi;
+	SADataTuple sa;
+	if (!cp_ipsec_sa(words, spi, sa, table, errh))
+	    return -EINVAL;
+	if (thunk == (void *) CMD_ADD && table->_sa_table.lookup(SPI(spi)))
+	    return errh->error("SA with SPI %u already exists", spi);
+	if (!seen.set(spi, 1))
+	    return errh->error("SPI %u appears twice", spi);
+	spis.push_back(spi);
+	sas.push_back(sa);
+    }
+    for (int i = 0; i < spis.size(); i++)
+	table->_sa_table.insert(SPI(spis[i]), sas[i], thunk == (void *) CMD_SET);
+    if (table->_sa_table.has_retired() && !table->_sa_timer.scheduled())
+	table->_sa_timer.schedule_after_msec(SA_GRACE_MSEC);
+    return 0;
+}
+
+String
+IPsecRouteTable::sa_count_handler(Element *e, void *)
+{
+    IPsecRouteTable *table = static_cast<IPsecRouteTable *>(e);
+    return String(table->_sa_table.size());
+}
+
 int
 IPsecRouteTable::lookup_handler(int, String& s, Element* e, const Handler*, ErrorHandler* errh)
 {
@@ -384,7 +486,12 @@ IPsecRouteTable::add_handlers()
     add_write_handler("ctrl", ctrl_handler, 0);
     add_read_handler("table", table_handler, 0);
     set_handler("lookup", Handler::OP_READ | Handler::READ_PARAM, lookup_handler);
+    add_write_handler("sa_add", sa_handler, CMD_ADD);
+    add_write_handler("sa_set", sa_handler, CMD_SET);
+    add_write_handler("sa_remove", sa_handler, CMD_REMOVE);
+    add_read_handler("sa_count", sa_count_handler, 0);
 }
 
 CLICK_ENDDECLS
+ELEMENT_REQUIRES(Aes IPsecAuthHMACSHA256)
 ELEMENT_PROVIDES(IPsecRouteTable)
@@ -3,6 +3,7 @@
 #define CLICK_IPSECROUTETABLE_HH
 #include <click/glue.hh>
 #include <click/element.hh>
+#include <click/timer.hh>
 #include "satable.hh"
 #include "sadatatuple.hh"
 CLICK_DECLS
@@ -166,8 +167,20 @@ tunneled traffic accordingly. All the routing table entries that refer to an IPS
 |SPI| |128-BIT ENCRYPTION_KEY| |128-BIT AUTHENTICATION_KEY| |REPLAY PROTECTION COUNTER| |OUT-OF-ORDER REPLAY WINDOW|
 The encryption and authentication keys will generally be specified using
 syntax such as C<\E<lt>0183 A947 1ABE 01FF FA04 103B B102<gt>>.
+The authentication key may also be 256 bits, as IPsecAuthHMACSHA256 needs
+for RFC 4868 HMAC-SHA-256-128.
  This module uses 4 and 5 annotation space integers to pass Security Association Data between IPsec modules.
 
+Inbound security associations are kept in a hash table indexed by SPI.  Each
+holds an anti-replay window of OUT-OF-ORDER REPLAY WINDOW packets, at most
+1024.  The C<sa_add>, C<sa_set>, and C<sa_remove> handlers install, rekey,
+and remove many security associations in one write, one per line; a batch
+may not name the same SPI twice.  A rekey normally installs a security
+association with a new SPI, switches the route to it with C<set>, and removes
+the old SPI once in-flight packets have drained.  Security associations that
+C<sa_set> replaces or C<sa_remove> removes are freed one to two seconds later,
+so packets already carrying them stay valid for at least a second.
+
 =a RadixIPLookup, RangeIPsecLookup */
 
 
@@ -201,9 +214,13 @@ struct IPsecRoute {
 
 class IPsecRouteTable : public Element { public:
 
+    IPsecRouteTable();
+
     void* cast(const char*);
     int configure(Vector<String>&, ErrorHandler*) CLICK_COLD;
+    int initialize(ErrorHandler*) CLICK_COLD;
     void add_handlers() CLICK_COLD;
+    void run_timer(Timer*);
 
     virtual int add_route(const IPsecRoute& route, bool allow_replace, IPsecRoute* replaced_route, ErrorHandler* errh);
     virtual int remove_route(const IPsecRoute& route, IPsecRoute* removed_route, ErrorHandler* errh);
@@ -217,11 +234,19 @@ class IPsecRouteTable : public Element { public:
     static int ctrl_handler(const String&, Element*, void*, ErrorHandler*);
     static int lookup_handler(int operation, String&, Element*, const Handler*, ErrorHandler*);
     static String table_handler(Element*, void*);
+    static int sa_handler(const String&, Element*, void*, ErrorHandler*);
+    static String sa_count_handler(Element*, void*);
     /*IPSEC extension: The security association database entry*/
     SATable _sa_table;
 
+  protected:
+    void route_packet(Packet* p, int port, IPAddress gw, uint32_t spi, SADataTuple* sa_data);
+
   private:
     enum { CMD_ADD, CMD_SET, CMD_REMOVE };
+    enum { SA_GRACE_MSEC = 1000 };
+    Timer _sa_timer;	// reclaims retired security associations
+
     int run_command(int command, const String &, Vector<IPsecRoute>* old_routes, ErrorHandler*);
 
 };
@@ -210,6 +210,18 @@ RadixIPsecLookup::remove_route(const IPsecRoute& route, IPsecRoute* old_route, E
     return r;
 }
 
+void
+RadixIPsecLookup::push(int, Packet* p)
+{
+    IPAddress addr = p->dst_ip_anno();
+    int key = Radix::lookup(_radix, _default_key, ntohl(addr.addr()));
+    if (key >= 0 && _v[key].contains(addr)) {
+	const IPsecRoute& r = _v[key];
+	route_packet(p, r.port, r.gw, r.spi, r.sa_data);
+    } else
+	route_packet(p, -1, IPAddress(), 0, 0);
+}
+
 int
 RadixIPsecLookup::lookup_route(IPAddress addr, IPAddress &gw, unsigned int &spi, SADataTuple* &sa_data) const
 {
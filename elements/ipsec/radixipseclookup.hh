@@ -29,7 +29,11 @@ annotation to the corresponding GW (if specified), and emits the packet on the
 indicated OUTput port.
 
 Each argument is a route, specifying a destination and mask, an optional
-gateway IP address, and an output port.
+gateway IP address, and an output port.  Routes to output 1 also give the
+tunnel's security association, as 'C<SPI ENCKEY AUTHKEY REPLAY OOSIZE>'; see
+IPsecRouteTable.  Since the security policy lookup is a longest-prefix match
+in the trie and inbound security associations are found by hashing the SPI,
+neither slows down as the number of tunnels grows.
 
 Uses the IPsecRouteTable interface; see IPsecRouteTable for description.
 
@@ -61,6 +65,26 @@ add a route, and `C<remove ADDR/MASK>' to remove a route. You can supply
 multiple commands, one per line; all commands are executed as one atomic
 operation.
 
+=h sa_add write-only
+
+Adds inbound security associations, one per line, each formatted as
+`C<SPI ENCKEY AUTHKEY REPLAY OOSIZE>'.  Fails, changing nothing, if any line
+is malformed or names an existing SPI.
+
+=h sa_set write-only
+
+Like C<sa_add>, but replaces the keys and replay state of existing security
+associations, which rekeys them in place.
+
+=h sa_remove write-only
+
+Removes the inbound security associations with the given space-separated
+SPIs.
+
+=h sa_count read-only
+
+Returns the number of inbound security associations.
+
 =n
 
 See IPsecRouteTable for a performance comparison of the various IP routing
@@ -81,6 +105,8 @@ class RadixIPsecLookup : public IPsecRouteTable { public:
 
     void cleanup(CleanupStage) CLICK_COLD;
 
+    void push(int port, Packet* p);
+
     int add_route(const IPsecRoute&, bool, IPsecRoute*, ErrorHandler *);
     int remove_route(const IPsecRoute&, IPsecRoute*, ErrorHandler *);
     int lookup_route(IPAddress, IPAddress&, unsigned int&, SADataTuple*&) const;
@@ -5,6 +5,8 @@
 #include <click/etheraddress.hh>
 #include <click/bighashmap.hh>
 #include <click/glue.hh>
+#include "aes.hh"
+#include "hmacsha256.hh"
 CLICK_DECLS
 
 /*
@@ -27,6 +29,17 @@ CLICK_DECLS
  */
 
 #define KEY_SIZE 16
+#define AUTH_KEY_MAX 32
+
+/* Compare integrity check values in time independent of where they differ. */
+static inline bool
+ipsec_icv_equal(const unsigned char *a, const unsigned char *b, int len)
+{
+    unsigned char diff = 0;
+    for (int i = 0; i < len; i++)
+	diff |= a[i] ^ b[i];
+    return diff == 0;
+}
 
 /* Security Parameter Index (SPI) Class*/
 
@@ -73,27 +86,43 @@ class SADataTuple {
 
     //SA Data must be added here...
     uint8_t Encryption_key[KEY_SIZE]; // The Data key
-    uint8_t Authentication_key[KEY_SIZE];//The Authentication key
+    uint8_t Authentication_key[AUTH_KEY_MAX];//The Authentication key
+    uint8_t auth_key_len;	/* KEY_SIZE, or AUTH_KEY_MAX for HMAC-SHA-256 */
     /*These fields below deal with replay protection*/
+    enum { REPLAY_WINDOW = 1024,	/* largest out-of-order window */
+	   REPLAY_WORDS = REPLAY_WINDOW / 32 + 1 };
     uint32_t replay_start_counter;
     uint32_t cur_rpl;
-    uint8_t  ooowin;	/* out-of-order window size */
-    uint32_t bitmap;	/* Support out-of-order receive support */
+    uint16_t ooowin;	/* out-of-order window size */
     uint32_t lastseq;	/* in host order */
+    /* Ring of received sequence numbers: bit (seq % 32) of word
+       ((seq / 32) % REPLAY_WORDS).  One word more than the window, so
+       the word holding lastseq never aliases the oldest one (RFC 6479). */
+    uint32_t bitmap[REPLAY_WORDS];
+    /*Expanded AES keys, computed once per SA rather than per packet*/
+    AES_KEY encrypt_key;
+    AES_KEY decrypt_key;
+    GCM_KEY gcm_key;
+    /*HMAC-SHA-256 inner and outer hash states*/
+    HMAC_SHA256_KEY hmac_sha256_key;
 
     SADataTuple() {
 	memset(this, 0, sizeof(*this));
     }
 
-    SADataTuple(const void * enc_key , const void * Auth_key, uint32_t counter, uint8_t o_oowin)
+    SADataTuple(const void * enc_key , const void * Auth_key, uint32_t counter, uint16_t o_oowin, int auth_len = KEY_SIZE)
      {
 		memset(this, 0, sizeof(*this));
 		memcpy(Encryption_key, enc_key, KEY_SIZE);
-		memcpy(Authentication_key, Auth_key, KEY_SIZE);
+		memcpy(Authentication_key, Auth_key, auth_len);
+		auth_key_len = auth_len;
 		replay_start_counter = counter;
 		ooowin = o_oowin;
-	        bitmap=0;
 		lastseq=cur_rpl=counter;
+		Aes::AES_set_encrypt_key(Encryption_key, KEY_SIZE * 8, &encrypt_key);
+		Aes::AES_set_decrypt_key(Encryption_key, KEY_SIZE * 8, &decrypt_key);
+		Aes::gcm_set_key(&encrypt_key, &gcm_key);
+		IPsecAuthHMACSHA256::hmac_set_key(Authentication_key, auth_key_len, &hmac_sha256_key);
      }
 
      operator bool() const
@@ -103,18 +132,19 @@ class SADataTuple {
 
 String unparse_entries() const
      {
-         char buf[71];
+         char buf[2 * KEY_SIZE + 2 * AUTH_KEY_MAX + 8];
 	 int i,j;
 	 sprintf(buf," |");
-	 for(i=0,j=0;i<16;i++,j+=2) {
+	 for(i=0,j=0;i<KEY_SIZE;i++,j+=2) {
 		sprintf(&buf[2+j],"%02x",Encryption_key[i]);
 	 }
-	 sprintf(&buf[34],"| |");
-	 for(i=0,j=0;i<16;i++,j+=2) {
-		sprintf(&buf[37+j],"%02x",Authentication_key[i]);
+	 sprintf(&buf[2+j],"| |");
+	 j += 5;
+	 for(i=0;i<auth_key_len;i++,j+=2) {
+		sprintf(&buf[j],"%02x",Authentication_key[i]);
 	 }
-	 sprintf(&buf[69],"|");
-         return String(buf, 70);
+	 sprintf(&buf[j],"|");
+         return String(buf, j + 1);
     }
 };
 
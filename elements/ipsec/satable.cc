@@ -33,6 +33,11 @@ SATable::SATable()
 
 SATable::~SATable()
 {
+  for (SIter iter = _table.begin(); iter.live(); iter++)
+    delete iter.value();
+  for (int g = 0; g < 2; g++)
+    for (int i = 0; i < _retired[g].size(); i++)
+      delete _retired[g][i];
 }
 
 /*Get a reference to SA Data*/
@@ -43,23 +48,35 @@ SATable::lookup(SPI this_spi)
     click_chatter("%s: lookup called with NULL spi!\n", name().c_str());
     return NULL;
   }
-  //retrieve security association
-  SADataTuple  *dat = _table.findp(this_spi);
+  //retrieve security association; if it is removed or replaced later, it
+  //stays allocated until reclaim() runs twice
+  _lock.acquire_read();
+  SADataTuple  *dat = _table.get(this_spi.getValue());
+  _lock.release_read();
   return dat;
 }
 
 /*Eventually this will be called from userspace Internet Key Exchange transactions*/
 int
-SATable::insert(SPI spi , SADataTuple SA_data)
+SATable::insert(SPI spi , const SADataTuple &SA_data, bool replace)
 {
   if ((!spi) || (!SA_data)) {
     click_chatter("SATable %s: Attempt to insert data failed. Invalid arguments\n",name().c_str());
     return -1;
   }
-  SADataTuple * dat = _table.findp(spi);
-  if (!dat) {
-    _table.insert(spi, SA_data);
+  // Build the replacement before taking the lock, and never modify an
+  // installed entry: readers use it without holding the lock.
+  SADataTuple *fresh = new SADataTuple(SA_data);
+  _lock.acquire_write();
+  SADataTuple *&dat = _table[spi.getValue()];
+  if (!dat)
+    dat = fresh, fresh = 0;
+  else if (replace) {
+    _retired[0].push_back(dat);
+    dat = fresh, fresh = 0;
   }
+  _lock.release_write();
+  delete fresh;
   return 0;
 }
 
@@ -71,17 +88,34 @@ SATable::remove(unsigned int spi)
 	click_chatter("Invalid SPI parameter");
 	return -1;
   }
-  SADataTuple  *dat = _table.findp(spi);
+  _lock.acquire_write();
+  SADataTuple *dat = _table.get(spi);
+  if (dat) {
+    _table.erase(spi);
+    _retired[0].push_back(dat);
+  }
+  _lock.release_write();
   if(!dat) {
 	click_chatter("No such entry");
 	return -1;
   }
-  delete dat;
-  _table.remove(SPI(spi));
-
   return 0;
 }
 
+bool
+SATable::reclaim()
+{
+  _lock.acquire_write();
+  Vector<SADataTuple *> old;
+  old.swap(_retired[1]);
+  _retired[1].swap(_retired[0]);
+  bool more = _retired[1].size() != 0;
+  _lock.release_write();
+  for (int i = 0; i < old.size(); i++)
+    delete old[i];
+  return more;
+}
+
 /*Return data to user space file*/
 String
 SATable::print_sa_data()
@@ -89,12 +123,12 @@ SATable::print_sa_data()
   StringAccum sa;
   int k;
   for (SIter iter = _table.begin(); iter.live(); iter++) {
-    SADataTuple n = iter.value();
+    const SADataTuple &n = *iter.value();
     sa << "\nNew Entry\n";
     for(k=0; k< 16;k++)
 	{sa << n.Encryption_key[k];}
     sa <<" ";
-    for(k=0; k< 16;k++)
+    for(k=0; k< n.auth_key_len;k++)
         {sa << n.Authentication_key[k];}
     sa << " ";
   }
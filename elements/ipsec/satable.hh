@@ -3,8 +3,9 @@
 #include <click/element.hh>
 #include <click/ipaddress.hh>
 #include <click/etheraddress.hh>
-#include <click/bighashmap.hh>
+#include <click/hashtable.hh>
 #include <click/glue.hh>
+#include <click/sync.hh>
 #include "sadatatuple.hh"
 
 CLICK_DECLS
@@ -16,15 +17,27 @@ class SATable : public Element { public:
 
   const char *class_name() const		{ return "SATable"; }
   String print_sa_data();
-  int insert(SPI this_spi , SADataTuple SA_data) ;
+  int insert(SPI this_spi , const SADataTuple &SA_data, bool replace = false);
   int remove(unsigned int spi);
   SADataTuple * lookup(SPI this_spi);
+  int size() const			{ return _table.size(); }
+
+  //Replaced and removed security associations are retired rather than
+  //deleted, since packets may still point to them.  Each call to reclaim()
+  //frees the entries retired before the previous call, so an entry outlives
+  //its removal by at least one reclaim period.  Returns true if retired
+  //entries remain.
+  bool reclaim();
+  bool has_retired() const		{ return _retired[0].size() || _retired[1].size(); }
 
 private:
-  //Defines a click hashmap object the SA table in our case
-  typedef HashMap<SPI,SADataTuple> STable;
+  //Maps SPIs to security associations.  Entries are allocated separately,
+  //so the pointers handed to packet annotations stay put as the table grows.
+  typedef HashTable<uint32_t, SADataTuple *> STable;
   typedef STable::const_iterator SIter;
   STable _table;
+  Vector<SADataTuple *> _retired[2];	// newer, older
+  ReadWriteLock _lock;	// lookups share, insert and remove exclude
 
 };
 
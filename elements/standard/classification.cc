@@ -200,6 +200,7 @@ Program::add_insn(Vector<int> &tree, int offset, uint32_t value, uint32_t mask)
     _insn.push_back(Insn(offset, value, mask));
     tree.push_back(tree[0]);
     _output_everything = -1;
+    _spec.match = 0;
 }
 
 void
@@ -842,6 +843,7 @@ Program::bubble_sort_and_exprs(const int *offset_map_begin,
 {
     Vector<int> inbranch;
     count_inbranches(inbranch);
+    _spec.match = 0;
 
     // do bubblesort
     for (int i = 0; i < _insn.size(); i++) {
@@ -914,9 +916,87 @@ Program::optimize(const int *offset_map_begin,
     }
     _safe_length -= _align_offset;
 
+    specialize();
+
     // click_chatter("%s", unparse().c_str());
 }
 
+template <int G, int N> int
+Program::specialized_match(const Program &prog, const Packet *p)
+{
+    // G and N are compile-time constants, so these loops are fully unrolled.
+    const Specialized &k = prog._spec;
+    const unsigned char *packet_data = p->data() - prog._align_offset;
+    for (int i = 0; i < G; ++i) {
+	uint32_t data = *(const uint32_t *)(packet_data + k.guard[i].offset);
+	if (((data & k.guard[i].mask) == k.guard[i].value) != k.guard[i].pass_if_equal)
+	    return k.guard[i].output;
+    }
+    uint32_t data = *(const uint32_t *)(packet_data + k.offset) & k.mask;
+    for (int i = 0; i < N; ++i)
+	if (data == k.value[i])
+	    return k.output[i];
+    return k.default_output;
+}
+
+#define CLICK_SPECIALIZED_ROW(g) \
+    { &Program::specialized_match<g, 1>, &Program::specialized_match<g, 2>, \
+      &Program::specialized_match<g, 3>, &Program::specialized_match<g, 4>, \
+      &Program::specialized_match<g, 5>, &Program::specialized_match<g, 6>, \
+      &Program::specialized_match<g, 7>, &Program::specialized_match<g, 8> }
+
+void
+Program::specialize()
+{
+    static int (* const kernels[max_guards + 1][max_values])(const Program &, const Packet *) = {
+	CLICK_SPECIALIZED_ROW(0), CLICK_SPECIALIZED_ROW(1), CLICK_SPECIALIZED_ROW(2)
+    };
+
+    _spec.match = 0;
+    if (_output_everything >= 0 || _insn.size() == 0)
+	return;
+
+    int pos = 0, nguards = 0;
+    while (1) {
+	// Try a comparison chain: instructions that test the same masked
+	// word, linked by their "no" branches, each "yes" going to an output.
+	const Insn &first = _insn[pos];
+	int nvalues = 0, p = pos;
+	do {
+	    const Insn &in = _insn[p];
+	    if (in.offset != first.offset || in.mask.u != first.mask.u
+		|| in.yes() > 0 || nvalues == max_values)
+		break;
+	    _spec.value[nvalues] = in.value.u;
+	    _spec.output[nvalues] = -in.yes();
+	    ++nvalues;
+	    p = in.no();
+	} while (p > 0);
+	if (p <= 0 && nvalues > 0) {
+	    _spec.offset = first.offset;
+	    _spec.mask = first.mask.u;
+	    _spec.default_output = -p;
+	    _spec.match = kernels[nguards][nvalues - 1];
+	    return;
+	}
+
+	// Otherwise this must be a guard: one branch to an output, the other
+	// to the rest of the program.
+	if (nguards == max_guards || (first.yes() > 0) == (first.no() > 0))
+	    return;
+	Specialized::Guard &g = _spec.guard[nguards];
+	g.offset = first.offset;
+	g.mask = first.mask.u;
+	g.value = first.value.u;
+	g.pass_if_equal = first.yes() > 0;
+	g.output = -(g.pass_if_equal ? first.no() : first.yes());
+	++nguards;
+	pos = g.pass_if_equal ? first.yes() : first.no();
+    }
+}
+
+#undef CLICK_SPECIALIZED_ROW
+
 void
 Program::set_failure(int failure)
 {
@@ -930,6 +1010,8 @@ Program::set_failure(int failure)
             if (insn.j[k] == j_failure)
                 insn.j[k] = failure;
     }
+    if (_spec.match)
+        specialize();
 }
 
 void
@@ -939,6 +1021,8 @@ Program::add_or_program(const Program& next_program)
     // jumps in this program will jump to `next_program`. Expectation:
     // This program has been part-finished (contains no j_success jumps).
 
+    _spec.match = 0;
+
     // If this program sends all output somewhere, ignore next_program.
     if (_output_everything < 0 || _output_everything == -j_failure) {
         // Update this program's unlinked jumps
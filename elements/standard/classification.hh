@@ -157,6 +157,7 @@ class Program { public:
     Program(unsigned align_offset = 0)
 	: _output_everything(-j_never), _safe_length((unsigned) -1),
 	  _align_offset(align_offset) {
+	_spec.match = 0;
     }
 
     unsigned align_offset() const {
@@ -211,6 +212,18 @@ class Program { public:
     void bubble_sort_and_exprs(const int *offset_map_begin, const int *offset_map_end, int last_offset);
     void optimize(const int *offset_map_begin, const int *offset_map_end, int last_offset);
 
+    /** @brief Select a precompiled match() kernel if this program has a
+     * recognized shape.
+     *
+     * Called by optimize().  Methods that change the program afterwards
+     * turn the kernel off again. */
+    void specialize();
+    /** @brief Return true iff match() uses a precompiled kernel rather than
+     * interpreting the instructions. */
+    bool specialized() const {
+	return _spec.match != 0;
+    }
+
     void warn_unused_outputs(int noutputs, ErrorHandler *errh) const;
 
     int match(const Packet *p);
@@ -219,14 +232,37 @@ class Program { public:
 
   private:
 
+    // A program shaped like "up to max_guards single-word tests, then a
+    // chain of up to max_values comparisons of one masked word" -- ethertype
+    // dispatch, IP protocol dispatch, small port sets -- runs through a
+    // kernel specialized on the number of guards and values.
+    enum { max_guards = 2, max_values = 8 };
+    struct Specialized {
+	int (*match)(const Program &, const Packet *);
+	struct Guard {
+	    uint32_t offset;
+	    uint32_t mask;
+	    uint32_t value;
+	    int32_t output;	// taken when the test does not pass
+	    bool pass_if_equal;
+	} guard[max_guards];
+	uint32_t offset;
+	uint32_t mask;
+	uint32_t value[max_values];
+	int32_t output[max_values];
+	int32_t default_output;
+    };
+
     Vector<Insn> _insn;
     int _output_everything;
     unsigned _safe_length;
     unsigned _align_offset;
+    Specialized _spec;
 
     void redirect_subtree(int first, int next, int success, int failure);
 
     int length_checked_match(const Packet *p);
+    template <int G, int N> static int specialized_match(const Program &prog, const Packet *p);
     static inline int map_offset(int offset, const int *begin, const int *end);
     static int hard_map_offset(int offset, const int *begin, const int *end);
 
@@ -377,6 +413,8 @@ Program::match(const Packet *p)
     else if (p->length() < _safe_length)
 	// common case never checks packet length
 	return length_checked_match(p);
+    else if (_spec.match)
+	return _spec.match(*this, p);
 
     const unsigned char *packet_data = p->data() - _align_offset;
     int pos = 0;
@@ -80,6 +80,19 @@ sequentially (which can make testing easier), append a pound sign to the
 range, as in '1024-65535#'.  To choose a random port rather than preferring
 the source, append a '?'.
 
+For carrier-grade NAT, append '/N' to the SPORT range, as in
+'1.0.0.1-1.0.0.8 1024-65535/512 - -', to allocate ports in blocks of N.
+SADDR may then be an address range as well.  Each internal source address
+(subscriber) is given a block of N consecutive ports on one external address
+when it first needs one, and another block when its blocks fill up.  Ports
+are then assigned from the subscriber's blocks, and a block is returned to the
+pool when its last mapping is removed.  Each block allocation and release is
+reported with one log message giving the time, the external address and port
+range, and the subscriber, so a subscriber can be identified from an external
+address and port without logging every mapping.  The pattern should have the
+external addresses to itself, and be used directly by an input spec rather
+than through an IPMapper.
+
 Say a packet with flow ID (SA, SP, DA, DP, PROTO) is received, and the
 corresponding new flow ID is (SA', SP', DA', DP').  Then two mappings are
 installed:
@@ -169,6 +182,11 @@ element, in which case this element will share the other element's capacity.
 Boolean. If true, then set the destination IP address annotation on passing
 packets to the rewritten destination address. Default is true.
 
+=item JOURNAL
+
+Boolean. If true, then record each mapping added or removed so that a standby
+rewriter can follow this one through the 'changes' handler. Default is false.
+
 =back
 
 =h table_size r
@@ -213,6 +231,31 @@ Takes a TCP flow as a space-separated
 and attempts to find a forward mapping for that flow. If found, rewrites the
 flow and returns in the same format.  Otherwise, returns nothing.
 
+=h snapshot read-only
+
+Returns a binary description of every mapping in this IPRewriter's tables.
+The result starts with a record that clears all mappings, so writing it to
+another rewriter's 'import' handler makes that rewriter's tables match this
+one.  Each mapping keeps its output ports and remaining lifetime.
+
+=h changes read-only
+
+Returns the mappings added and removed since the last read of 'changes', in
+the same format as 'snapshot'.  Requires JOURNAL true.  If too many changes
+have built up since the last read, returns a snapshot instead.  Mappings
+whose lifetimes are merely extended by new packets are not recorded, so a
+standby should also import a snapshot every so often.
+
+=h import write-only
+
+Loads mappings in the format returned by 'snapshot' and 'changes'.  Imported
+mappings replace any existing mappings for the same flows, and mappings made
+by a port-block pattern reserve their ports in that pattern's blocks.  The
+rewriter should have the same input specifications as the rewriter that
+produced the data.  A standby rewriter might be kept in sync with a Script element, or
+through a ControlSocket, for example by copying 'rw.changes' to
+'standby.import' every second.
+
 =a TCPRewriter, IPAddrRewriter, IPAddrPairRewriter, IPRewriterPatterns,
 RoundRobinIPMapper, FTPPortMapper, ICMPRewriter, ICMPPingRewriter */
 
@@ -254,7 +297,7 @@ class IPRewriter : public TCPRewriter { public:
   private:
 
     Map _udp_map;
-    SizedHashAllocator<sizeof(UDPFlow)> _udp_allocator;
+    SizedHashAllocator<sizeof(UDPFlow), CLICK_CACHE_LINE_SIZE> _udp_allocator;
     uint32_t _udp_timeouts[2];
     uint32_t _udp_streaming_timeout;
 
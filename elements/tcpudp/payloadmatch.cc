@@ -0,0 +1,237 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * payloadmatch.{cc,hh} -- multi-pattern payload classifier
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "payloadmatch.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/confparse.hh>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+#include <clicknet/udp.h>
+CLICK_DECLS
+
+PayloadMatch::PayloadMatch()
+    : _npatterns(0), _count(0)
+{
+}
+
+PayloadMatch::~PayloadMatch()
+{
+}
+
+int
+PayloadMatch::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    bool nocase = false;
+    _stream = false;
+    _max_flows = 65536;
+    _anno = -1;
+    if (Args(this, errh).bind(conf)
+	.read("NOCASE", nocase)
+	.read("STREAM", _stream)
+	.read("MAX_FLOWS", _max_flows)
+	.read("ANNO", AnnoArg(1), _anno)
+	.consume() < 0)
+	return -1;
+
+    Vector<String> patterns;
+    for (int i = 0; i < conf.size(); i++) {
+	String s = cp_unquote(conf[i]);
+	if (!s)
+	    return errh->error("pattern %d is empty", i + 1);
+	patterns.push_back(s);
+    }
+    if (!patterns.size())
+	return errh->error("no patterns");
+    _npatterns = patterns.size();
+    if (_anno >= 0 && _npatterns > 255)
+	return errh->error("ANNO supports at most 255 patterns");
+    if (noutputs() != 1 && noutputs() != 2 && noutputs() != _npatterns + 1)
+	return errh->error("need 1, 2, or %d output ports", _npatterns + 1);
+    if (_max_flows <= 0)
+	return errh->error("MAX_FLOWS must be positive");
+
+    return build(patterns, nocase, errh);
+}
+
+int
+PayloadMatch::build(const Vector<String> &patterns, bool nocase, ErrorHandler *errh)
+{
+    // Build the keyword trie; _delta entries of 0 mean "no edge" for now,
+    // since no edge leads back to the root.
+    _delta.assign(256, 0);
+    _match.assign(1, -1);
+    for (int pi = 0; pi < patterns.size(); pi++) {
+	uint32_t s = 0;
+	const String &pat = patterns[pi];
+	for (int i = 0; i < pat.length(); i++) {
+	    unsigned char c = pat[i];
+	    if (nocase && c >= 'A' && c <= 'Z')
+		c += 'a' - 'A';
+	    if (!_delta[(s << 8) + c]) {
+		if (_match.size() >= max_states)
+		    return errh->error("patterns too long: more than %d states", (int) max_states);
+		_delta[(s << 8) + c] = _match.size();
+		_delta.resize(_delta.size() + 256, 0);
+		_match.push_back(-1);
+	    }
+	    s = _delta[(s << 8) + c];
+	}
+	if (_match[s] < 0)
+	    _match[s] = pi;
+    }
+
+    // Breadth-first pass computing failure links and filling in the missing
+    // edges, which turns the trie into a DFA.  A state's match is the
+    // lowest-numbered pattern ending there, including patterns that are
+    // suffixes of its path, which the failure state has already absorbed.
+    Vector<uint32_t> fail(_match.size(), 0);
+    Vector<uint32_t> queue;
+    for (int c = 0; c < 256; c++)
+	if (uint32_t t = _delta[c])
+	    queue.push_back(t);
+    for (int qi = 0; qi < queue.size(); qi++) {
+	uint32_t s = queue[qi];
+	int fm = _match[fail[s]];
+	if (fm >= 0 && (_match[s] < 0 || fm < _match[s]))
+	    _match[s] = fm;
+	for (int c = 0; c < 256; c++) {
+	    uint32_t &t = _delta[(s << 8) + c];
+	    if (t) {
+		fail[t] = _delta[(fail[s] << 8) + c];
+		queue.push_back(t);
+	    } else
+		t = _delta[(fail[s] << 8) + c];
+	}
+    }
+
+    if (nocase)
+	for (int s = 0; s < _match.size(); s++)
+	    for (int c = 'A'; c <= 'Z'; c++)
+		_delta[(s << 8) + c] = _delta[(s << 8) + c + 'a' - 'A'];
+
+    // Flag edges into matching states so the scan loop tests one bit.
+    for (int i = 0; i < _delta.size(); i++)
+	if (_match[_delta[i]] >= 0)
+	    _delta[i] |= match_flag;
+    return 0;
+}
+
+int
+PayloadMatch::stream_scan(Packet *p, const unsigned char *data, const unsigned char *end)
+{
+    const click_tcp *tcph = p->tcp_header();
+    IPFlowID flow(p);
+    uint32_t seq = ntohl(tcph->th_seq);
+    uint32_t next_seq = seq + (end - data);
+    if (tcph->th_flags & TH_SYN)
+	++next_seq;
+
+    int m;
+    HashTable<IPFlowID, Flow>::iterator it = _flows.find(flow);
+    if (!it.live()) {
+	if (_flows.size() >= (uint32_t) _max_flows)
+	    _flows.clear();
+	it = _flows.find_insert(flow, Flow());
+	it.value().state = 0;
+	it.value().pattern = -1;
+	it.value().next_seq = seq;
+    }
+
+    Flow &f = it.value();
+    if (f.pattern >= 0)
+	m = f.pattern;
+    else if (SEQ_LT(seq, f.next_seq) && SEQ_GEQ(f.next_seq, next_seq))
+	// retransmission of data already scanned
+	m = -1;
+    else {
+	if (seq != f.next_seq) {
+	    // gap or partial overlap: start over from this segment
+	    f.state = 0;
+	}
+	m = f.pattern = scan(data, end, f.state);
+	f.next_seq = next_seq;
+    }
+
+    if (tcph->th_flags & (TH_FIN | TH_RST))
+	_flows.erase(it);
+    return m;
+}
+
+void
+PayloadMatch::push(int, Packet *p)
+{
+    const unsigned char *data = p->data(), *end = p->end_data();
+    bool tcp = false;
+    if (p->has_network_header()) {
+	const click_ip *iph = p->ip_header();
+	data = p->transport_header();
+	if (IP_FIRSTFRAG(iph)) {
+	    if (iph->ip_p == IP_PROTO_TCP && p->transport_length() >= (int) sizeof(click_tcp)) {
+		data += p->tcp_header()->th_off << 2;
+		tcp = true;
+	    } else if (iph->ip_p == IP_PROTO_UDP && p->transport_length() >= (int) sizeof(click_udp))
+		data += sizeof(click_udp);
+	}
+	const unsigned char *ip_end = p->network_header() + ntohs(iph->ip_len);
+	if (ip_end < end && ip_end >= p->transport_header())
+	    end = ip_end;
+	if (data > end)
+	    data = end;
+    }
+
+    int m;
+    if (_stream && tcp && !IP_ISFRAG(p->ip_header()))
+	m = stream_scan(p, data, end);
+    else {
+	uint32_t state = 0;
+	m = scan(data, end, state);
+    }
+
+    if (m >= 0)
+	++_count;
+    if (_anno >= 0)
+	p->set_anno_u8(_anno, m + 1);
+
+    int port;
+    if (noutputs() == 1)
+	port = 0;
+    else if (noutputs() == 2)
+	port = (m >= 0 ? 0 : 1);
+    else
+	port = (m >= 0 ? m : _npatterns);
+    output(port).push(p);
+}
+
+String
+PayloadMatch::read_handler(Element *e, void *thunk)
+{
+    PayloadMatch *pm = static_cast<PayloadMatch *>(e);
+    if (thunk)
+	return String(pm->_flows.size());
+    else
+	return String(pm->_count);
+}
+
+void
+PayloadMatch::add_handlers()
+{
+    add_read_handler("count", read_handler, 0);
+    add_read_handler("flows", read_handler, 1);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(PayloadMatch)
@@ -0,0 +1,147 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_PAYLOADMATCH_HH
+#define CLICK_PAYLOADMATCH_HH
+#include <click/element.hh>
+#include <click/hashtable.hh>
+#include <click/ipflowid.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+=c
+
+PayloadMatch(PATTERN1, ..., PATTERNn [, I<KEYWORDS>])
+
+=s classification
+
+classifies packets by payload content
+
+=d
+
+Searches each packet's payload for any of the given byte strings at once,
+using an Aho-Corasick automaton compiled into a dense state machine.  The
+search time is linear in the payload length and independent of the number of
+patterns.  Each automaton state takes 1 kilobyte, with one state per distinct
+pattern prefix; the automaton is limited to 65536 states, or 64 megabytes.
+
+Each PATTERN is a string; use double quotes for spaces and C-style or Click
+hex escapes (C<"\E<lt>0d 0a 0d 0aE<gt>">) for binary data.
+
+For IP packets, PayloadMatch searches the TCP or UDP payload, or the whole IP
+payload for other protocols.  Packets without a network header are searched
+from the beginning of their data.
+
+A packet matches the pattern whose first occurrence ends earliest in the
+payload; ties go to the pattern listed first.  PayloadMatch can have
+1, 2, or n+1 outputs.  With n+1 outputs, packets matching PATTERNi go to
+output i-1 and other packets to output n.  With 2 outputs, matching packets
+go to output 0 and other packets to output 1.  With 1 output, all packets go
+to output 0; use ANNO to see which pattern matched.
+
+Keyword arguments are:
+
+=over 8
+
+=item NOCASE
+
+Boolean.  If true, letters match regardless of case.  Default is false.
+
+=item STREAM
+
+Boolean.  If true, track TCP connections, so that a pattern split across
+consecutive in-order segments still matches.  Once a connection matches, all
+its later packets are classified the same way.  Out-of-order segments restart
+the search.  Default is false.
+
+=item MAX_FLOWS
+
+Integer.  Maximum number of TCP connections tracked in STREAM mode.  When the
+table is full, it is cleared.  Connections are forgotten on FIN or RST.
+Default is 65536.
+
+=item ANNO
+
+Annotation specification.  If given, store the matching pattern's number
+(1 to n), or 0 for no match, in this one-byte annotation.  With ANNO, at
+most 255 patterns are allowed.
+
+=back
+
+=h count read-only
+
+Returns the number of packets that matched a pattern.
+
+=h flows read-only
+
+Returns the number of TCP connections tracked in STREAM mode.
+
+=e
+
+  PayloadMatch("GET /admin", "\<90 90 90 90>", NOCASE true, STREAM true)
+
+=a Classifier, IPClassifier */
+
+class PayloadMatch : public Element { public:
+
+    PayloadMatch() CLICK_COLD;
+    ~PayloadMatch() CLICK_COLD;
+
+    const char *class_name() const	{ return "PayloadMatch"; }
+    const char *port_count() const	{ return "1/1-"; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+
+  private:
+
+    enum { match_flag = 0x80000000U, max_states = 65536 };
+
+    // _delta[(state << 8) + byte] is the next state, with match_flag set if
+    // some pattern ends there; _match[state] is the pattern that ends.
+    Vector<uint32_t> _delta;
+    Vector<int> _match;
+    int _npatterns;
+    int _anno;
+    bool _stream;
+
+    struct Flow {
+	uint32_t next_seq;
+	uint32_t state;
+	int pattern;		// -1 until the connection matches
+    };
+    HashTable<IPFlowID, Flow> _flows;
+    int _max_flows;
+
+    uint64_t _count;
+
+    int build(const Vector<String> &patterns, bool nocase, ErrorHandler *errh);
+    inline int scan(const unsigned char *data, const unsigned char *end,
+		    uint32_t &state) const;
+    int stream_scan(Packet *p, const unsigned char *data, const unsigned char *end);
+
+    static String read_handler(Element *, void *);
+
+};
+
+inline int
+PayloadMatch::scan(const unsigned char *data, const unsigned char *end,
+		   uint32_t &state) const
+{
+    const uint32_t *delta = _delta.begin();
+    uint32_t s = state;
+    for (; data != end; ++data) {
+	s = delta[(s << 8) + *data];
+	if (s & match_flag) {
+	    state = s & ~match_flag;
+	    return _match[state];
+	}
+    }
+    state = s;
+    return -1;
+}
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,424 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * tcpreassembler.{cc,hh} -- puts TCP segments in order
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "tcpreassembler.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+CLICK_DECLS
+
+static inline const unsigned char *
+segment_payload(const Packet *p, uint32_t &len)
+{
+    const unsigned char *data = p->transport_header() + (p->tcp_header()->th_off << 2);
+    const unsigned char *end = p->network_header() + ntohs(p->ip_header()->ip_len);
+    if (end > p->end_data())
+	end = p->end_data();
+    len = (data < end ? end - data : 0);
+    return data;
+}
+
+// Sequence space occupied by a segment: its payload, plus one each for SYN
+// and FIN.
+static inline uint32_t
+segment_length(const Packet *p)
+{
+    uint32_t len;
+    (void) segment_payload(p, len);
+    uint8_t flags = p->tcp_header()->th_flags;
+    return len + ((flags & TH_SYN) != 0) + ((flags & TH_FIN) != 0);
+}
+
+static inline uint32_t
+segment_seq(const Packet *p)
+{
+    return ntohl(p->tcp_header()->th_seq);
+}
+
+
+TCPReassembler::TCPReassembler()
+    : _expire_timer(this), _nheld(0), _drops(0), _trimmed(0)
+{
+}
+
+TCPReassembler::~TCPReassembler()
+{
+}
+
+int
+TCPReassembler::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    uint32_t timeout = 300, closed_timeout = 4;
+    _buffer = 65536;
+    _max_flows = 1048576;
+    if (Args(conf, this, errh)
+	.read("BUFFER", _buffer)
+	.read("MAX_FLOWS", _max_flows)
+	.read("TIMEOUT", SecondsArg(), timeout)
+	.read("CLOSED_TIMEOUT", SecondsArg(), closed_timeout)
+	.complete() < 0)
+	return -1;
+    if (_max_flows == 0)
+	return errh->error("MAX_FLOWS must be positive");
+    _timeout_j = timeout * CLICK_HZ;
+    _closed_timeout_j = closed_timeout * CLICK_HZ;
+    return 0;
+}
+
+int
+TCPReassembler::initialize(ErrorHandler *)
+{
+    _expire_timer.initialize(this);
+    _expire_timer.schedule_after_sec(1);
+    return 0;
+}
+
+void
+TCPReassembler::cleanup(CleanupStage)
+{
+    while (Flow *f = _age.front())
+	remove_flow(f, false);
+    while (Flow *f = _closed_age.front())
+	remove_flow(f, false);
+}
+
+const TCPReassembler::Flow *
+TCPReassembler::lookup(const IPFlowID &flowid) const
+{
+    if (Flow *f = _table.get(flowid))
+	return f;
+    return _table.get(flowid.reverse());
+}
+
+TCPReassembler::Flow *
+TCPReassembler::find_flow(const IPFlowID &flowid, int &dir, bool syn)
+{
+    if (Flow *f = _table.get(flowid)) {
+	dir = 0;
+	return f;
+    } else if ((f = _table.get(flowid.reverse()))) {
+	dir = 1;
+	return f;
+    }
+
+    if (_table.size() >= _max_flows)
+	remove_flow(_closed_age.front() ? _closed_age.front() : _age.front(), true);
+    void *x = _alloc.allocate();
+    if (!x)
+	return 0;
+    Flow *f = new(x) Flow(flowid);
+    if (syn)
+	f->_state = s_opening;
+    _table.set(f);
+    _table.balance();
+    _age.push_back(f);
+    dir = 0;
+    return f;
+}
+
+void
+TCPReassembler::remove_flow(Flow *f, bool notify)
+{
+    if (notify)
+	for (int i = 0; i < _listeners.size(); i++)
+	    _listeners[i]->tcp_stream_closed(*f);
+    for (int dir = 0; dir < 2; dir++)
+	while (Packet *p = f->_half[dir].held) {
+	    f->_half[dir].held = p->next();
+	    p->set_next(0);
+	    --_nheld;
+	    if (notify)
+		drop(p);
+	    else
+		p->kill();
+	}
+    _table.erase(f->_key);
+    if (f->_state == s_closed)
+	_closed_age.erase(f);
+    else
+	_age.erase(f);
+    f->~Flow();
+    _alloc.deallocate(f);
+}
+
+void
+TCPReassembler::touch(Flow *f, click_jiffies_t now)
+{
+    if (f->_state == s_closed)
+	return;
+    _age.erase(f);
+    _age.push_back(f);
+    f->_expiry = now + _timeout_j;
+}
+
+void
+TCPReassembler::expire(AgeList &age, click_jiffies_t now)
+{
+    while (Flow *f = age.front()) {
+	if (!click_jiffies_less(f->_expiry, now))
+	    break;
+	remove_flow(f, true);
+    }
+}
+
+void
+TCPReassembler::run_timer(Timer *)
+{
+    click_jiffies_t now = click_jiffies();
+    expire(_closed_age, now);
+    expire(_age, now);
+    _expire_timer.reschedule_after_sec(1);
+}
+
+void
+TCPReassembler::drop(Packet *p)
+{
+    ++_drops;
+    checked_output_push(1, p);
+}
+
+void
+TCPReassembler::hold(Half &h, Packet *p, uint32_t seq, uint32_t len)
+{
+    if (h.held_bytes + len > _buffer) {
+	drop(p);
+	return;
+    }
+
+    // Keep the held chain sorted by sequence number.  Of two segments with
+    // the same starting sequence number, keep the longer.
+    Packet *prev = 0, *q = h.held;
+    while (q && SEQ_LT(segment_seq(q), seq)) {
+	prev = q;
+	q = q->next();
+    }
+    if (q && segment_seq(q) == seq) {
+	uint32_t qlen = segment_length(q);
+	if (qlen >= len) {
+	    drop(p);
+	    return;
+	}
+	Packet *next = q->next();
+	q->set_next(0);
+	h.held_bytes -= qlen;
+	--_nheld;
+	drop(q);
+	q = next;
+    }
+    p->set_next(q);
+    if (prev)
+	prev->set_next(p);
+    else
+	h.held = p;
+    h.held_bytes += len;
+    ++_nheld;
+}
+
+Packet *
+TCPReassembler::trim(Packet *p, uint32_t amount)
+{
+    WritablePacket *q = p->uniqueify();
+    if (!q)
+	return 0;
+
+    click_tcp *tcph = q->tcp_header();
+    uint32_t seq = ntohl(tcph->th_seq);
+    if (tcph->th_flags & TH_SYN) {
+	tcph->th_flags &= ~TH_SYN;
+	++seq;
+	--amount;
+    }
+
+    // Slide everything before the payload forward over the unwanted bytes.
+    uint32_t len;
+    const unsigned char *payload = segment_payload(q, len);
+    if (amount > len)
+	amount = len;
+    unsigned char *start = q->data();
+    memmove(start + amount, start, payload - start);
+    q->pull(amount);
+    if (q->has_mac_header() && q->mac_header() >= start)
+	q->set_mac_header(q->mac_header() + amount);
+    q->set_network_header(q->network_header() + amount, q->network_header_length());
+
+    click_ip *iph = q->ip_header();
+    uint16_t old_len = iph->ip_len;
+    iph->ip_len = htons(ntohs(old_len) - amount);
+    click_update_in_cksum(&iph->ip_sum, old_len, iph->ip_len);
+
+    tcph = q->tcp_header();
+    tcph->th_seq = htonl(seq + amount);
+    unsigned tlen = ntohs(iph->ip_len) - (iph->ip_hl << 2);
+    tcph->th_sum = 0;
+    unsigned csum = click_in_cksum((unsigned char *) tcph, tlen);
+    tcph->th_sum = click_in_cksum_pseudohdr(csum, iph, tlen);
+
+    ++_trimmed;
+    return q;
+}
+
+void
+TCPReassembler::emit(Flow *f, int dir, Packet *p)
+{
+    if (_listeners.size()) {
+	uint32_t len;
+	const unsigned char *data = segment_payload(p, len);
+	if (len)
+	    for (int i = 0; i < _listeners.size(); i++)
+		_listeners[i]->tcp_stream_data(*f, dir, data, len, p);
+    }
+    output(0).push(p);
+}
+
+void
+TCPReassembler::advance(Flow *f, int dir, Packet *p)
+{
+    Half &h = f->_half[dir];
+    uint32_t seq = segment_seq(p);
+    if (SEQ_LT(seq, h.next_seq)) {
+	if (!(p = trim(p, h.next_seq - seq))) {
+	    ++_drops;
+	    return;
+	}
+	seq = h.next_seq;
+    }
+
+    uint8_t flags = p->tcp_header()->th_flags;
+    h.next_seq = seq + segment_length(p);
+    h.syn = h.syn || (flags & TH_SYN);
+    h.fin = h.fin || (flags & TH_FIN);
+
+    const Half &other = f->_half[!dir];
+    if (f->_state == s_opening && other.started)
+	f->_state = s_established;
+    if (h.fin && f->_state != s_closed) {
+	if (other.fin) {
+	    f->_state = s_closed;
+	    _age.erase(f);
+	    _closed_age.push_back(f);
+	    f->_expiry = click_jiffies() + _closed_timeout_j;
+	} else
+	    f->_state = s_closing;
+    }
+
+    emit(f, dir, p);
+}
+
+void
+TCPReassembler::emit_held(Flow *f, int dir)
+{
+    Half &h = f->_half[dir];
+    while (Packet *p = h.held) {
+	uint32_t seq = segment_seq(p);
+	if (SEQ_GT(seq, h.next_seq))
+	    break;
+	uint32_t len = segment_length(p);
+	h.held = p->next();
+	p->set_next(0);
+	h.held_bytes -= len;
+	--_nheld;
+	if (SEQ_LEQ(seq + len, h.next_seq))
+	    drop(p);
+	else
+	    advance(f, dir, p);
+    }
+}
+
+void
+TCPReassembler::push(int, Packet *p)
+{
+    const click_ip *iph = p->ip_header();
+    if (!p->has_network_header() || iph->ip_p != IP_PROTO_TCP
+	|| IP_ISFRAG(iph) || p->transport_length() < (int) sizeof(click_tcp)) {
+	output(0).push(p);
+	return;
+    }
+
+    uint8_t flags = p->tcp_header()->th_flags;
+    int dir;
+    Flow *f = find_flow(IPFlowID(p), dir, (flags & (TH_SYN | TH_ACK)) == TH_SYN);
+    if (!f) {
+	drop(p);
+	return;
+    }
+    touch(f, click_jiffies());
+
+    Half &h = f->_half[dir];
+    uint32_t seq = segment_seq(p);
+    uint32_t len = segment_length(p);
+    if (!h.started) {
+	h.next_seq = seq;
+	h.started = true;
+    }
+
+    if (flags & TH_RST) {
+	// The connection is over; drop anything still held.
+	if (f->_state != s_closed) {
+	    f->_state = s_closed;
+	    _age.erase(f);
+	    _closed_age.push_back(f);
+	    f->_expiry = click_jiffies() + _closed_timeout_j;
+	    for (int d = 0; d < 2; d++)
+		while (Packet *q = f->_half[d].held) {
+		    f->_half[d].held = q->next();
+		    q->set_next(0);
+		    --_nheld;
+		    drop(q);
+		}
+	    f->_half[0].held_bytes = f->_half[1].held_bytes = 0;
+	}
+	output(0).push(p);
+    } else if (len == 0)
+	output(0).push(p);
+    else if (SEQ_LEQ(seq + len, h.next_seq))
+	drop(p);
+    else if (SEQ_GT(seq, h.next_seq))
+	hold(h, p, seq, len);
+    else {
+	advance(f, dir, p);
+	emit_held(f, dir);
+    }
+}
+
+String
+TCPReassembler::read_handler(Element *e, void *thunk)
+{
+    TCPReassembler *tr = static_cast<TCPReassembler *>(e);
+    switch ((intptr_t) thunk) {
+    case 0:
+	return String(tr->_table.size());
+    case 1:
+	return String(tr->_nheld);
+    case 2:
+	return String(tr->_drops);
+    default:
+	return String(tr->_trimmed);
+    }
+}
+
+void
+TCPReassembler::add_handlers()
+{
+    add_read_handler("flows", read_handler, 0);
+    add_read_handler("held", read_handler, 1);
+    add_read_handler("drops", read_handler, 2);
+    add_read_handler("trimmed", read_handler, 3);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(TCPReassembler)
@@ -0,0 +1,249 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_TCPREASSEMBLER_HH
+#define CLICK_TCPREASSEMBLER_HH
+#include <click/element.hh>
+#include <click/ipflowid.hh>
+#include <click/hashcontainer.hh>
+#include <click/hashallocator.hh>
+#include <click/list.hh>
+#include <click/timer.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+class TCPStreamListener;
+
+/*
+=c
+
+TCPReassembler([I<KEYWORDS>])
+
+=s tcp
+
+puts TCP segments in order and tracks connection state
+
+=d
+
+Expects IP packets with network headers set.  TCPReassembler tracks every TCP
+connection it sees and emits each direction's segments on output 0 in
+sequence number order, with no gaps, duplicates, or overlaps.  Downstream
+elements can thus treat each direction as a byte stream: a segment's payload
+always begins exactly where the previous segment's payload in that direction
+ended.
+
+Segments that arrive early are held, unmodified and uncopied, until the
+missing data arrives; then they are released in order.  Retransmitted
+segments whose data has already been emitted are dropped.  A segment that
+partially overlaps emitted data is trimmed so that only new bytes remain; its
+IP and TCP headers are fixed up accordingly.  Segments without data, such as
+pure acknowledgments, pass through at once.
+
+A connection's state follows its SYN, FIN, and RST flags.  The first segment
+seen for a connection sets the starting sequence number for that direction,
+so connections picked up midstream are handled too.  A connection is
+forgotten TIMEOUT seconds after its last segment, or CLOSED_TIMEOUT seconds
+after both sides have sent FIN or either side has sent RST.  Any segments
+still held for a forgotten connection are dropped.
+
+Non-TCP packets and IP fragments are emitted on output 0 unchanged.  Dropped
+segments are emitted on output 1, if it exists, and killed otherwise.
+
+Keyword arguments are:
+
+=over 8
+
+=item BUFFER
+
+Integer.  The maximum number of out-of-order payload bytes held for each
+direction of a connection.  Early segments that would exceed this limit are
+dropped.  Default is 65536.
+
+=item MAX_FLOWS
+
+Integer.  The maximum number of connections tracked.  When a new connection
+would exceed this limit, the least recently active connection is forgotten.
+Default is 1048576.
+
+=item TIMEOUT
+
+Time in seconds.  Idle timeout for open connections.  Default is 300.
+
+=item CLOSED_TIMEOUT
+
+Time in seconds.  Timeout for closed connections, which absorbs their final
+acknowledgments and retransmitted FINs.  Default is 4.
+
+=back
+
+=n
+
+Other elements can receive each direction's byte stream directly by
+implementing the TCPStreamListener interface declared in tcpreassembler.hh
+and calling add_listener() from their initialize() methods.  Listeners are
+told about each in-order segment carrying data, before the segment is
+emitted, and about each connection as it is forgotten.
+
+TCPReassembler is not MT-safe.  To use it on several threads, partition the
+traffic so that both directions of each connection reach the same
+TCPReassembler, for example with HashSwitch on the connection's addresses.
+
+=h flows read-only
+
+Returns the number of connections currently tracked.
+
+=h held read-only
+
+Returns the number of out-of-order segments currently held.
+
+=h drops read-only
+
+Returns the number of segments dropped.
+
+=h trimmed read-only
+
+Returns the number of segments trimmed to remove overlapping data.
+
+=e
+
+  FromDump(trace.pcap, STOP true, FORCE_IP true)
+	-> CheckIPHeader
+	-> TCPReassembler(BUFFER 131072)
+	-> PayloadMatch(...)
+	-> ...
+
+=a IPReassembler, PayloadMatch, TCPRewriter */
+
+class TCPReassembler : public Element { public:
+
+    TCPReassembler() CLICK_COLD;
+    ~TCPReassembler() CLICK_COLD;
+
+    const char *class_name() const	{ return "TCPReassembler"; }
+    const char *port_count() const	{ return PORTS_1_1X2; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+    void run_timer(Timer *);
+
+    enum State {
+	s_opening,		// SYN seen, not yet answered
+	s_established,
+	s_closing,		// one side has sent FIN
+	s_closed		// both sides have sent FIN, or RST seen
+    };
+
+    // One direction of a connection.
+    struct Half {
+	uint32_t next_seq;	// next sequence number to emit
+	uint32_t held_bytes;	// sequence space held
+	Packet *held;		// early segments, in sequence order
+	bool started;
+	bool syn;
+	bool fin;
+	Half()
+	    : next_seq(0), held_bytes(0), held(0),
+	      started(false), syn(false), fin(false) {
+	}
+    };
+
+    // A connection.  Direction 0 of _key is the side that sent the first
+    // segment TCPReassembler saw.
+    class Flow { public:
+
+	const IPFlowID &flowid() const	{ return _key; }
+	State state() const		{ return _state; }
+	const Half &half(int dir) const	{ return _half[dir]; }
+
+      private:
+
+	IPFlowID _key;
+	Flow *_hashnext;
+	List_member<Flow> _age_link;
+	Half _half[2];
+	click_jiffies_t _expiry;
+	State _state;
+
+	typedef IPFlowID key_type;
+	typedef const IPFlowID &key_const_reference;
+
+	Flow(const IPFlowID &key)
+	    : _key(key), _hashnext(), _expiry(0), _state(s_established) {
+	}
+	key_const_reference hashkey() const {
+	    return _key;
+	}
+
+	friend class TCPReassembler;
+	friend class HashContainer_adapter<Flow>;
+
+    };
+
+    void add_listener(TCPStreamListener *l) {
+	_listeners.push_back(l);
+    }
+
+    const Flow *lookup(const IPFlowID &flowid) const;
+
+  private:
+
+    typedef HashContainer<Flow> Table;
+    Table _table;
+    typedef List<Flow, &Flow::_age_link> AgeList;
+    AgeList _age;		// open flows, least recently active first
+    AgeList _closed_age;	// closed flows, oldest first
+    SizedHashAllocator<sizeof(Flow)> _alloc;
+    Timer _expire_timer;
+    Vector<TCPStreamListener *> _listeners;
+
+    uint32_t _buffer;
+    uint32_t _max_flows;
+    click_jiffies_t _timeout_j;
+    click_jiffies_t _closed_timeout_j;
+
+    uint32_t _nheld;
+    uint64_t _drops;
+    uint64_t _trimmed;
+
+    Flow *find_flow(const IPFlowID &flowid, int &dir, bool syn);
+    void remove_flow(Flow *f, bool notify);
+    void touch(Flow *f, click_jiffies_t now);
+    void expire(AgeList &age, click_jiffies_t now);
+    void drop(Packet *p);
+    void hold(Half &h, Packet *p, uint32_t seq, uint32_t len);
+    Packet *trim(Packet *p, uint32_t amount);
+    void emit(Flow *f, int dir, Packet *p);
+    void emit_held(Flow *f, int dir);
+    void advance(Flow *f, int dir, Packet *p);
+
+    static String read_handler(Element *, void *);
+
+};
+
+/** @class TCPStreamListener
+ * @brief Interface for elements that consume TCPReassembler's byte streams.
+ *
+ * tcp_stream_data() is called for each in-order segment that carries data,
+ * just before TCPReassembler emits it.  @a data and @a len describe the
+ * segment's payload, which directly follows the payload passed to the
+ * previous call for the same @a flow and @a dir.  tcp_stream_closed() is
+ * called once per connection, just before TCPReassembler forgets it.  The
+ * Flow reference is valid only during the call. */
+class TCPStreamListener { public:
+
+    virtual ~TCPStreamListener() {
+    }
+
+    virtual void tcp_stream_data(const TCPReassembler::Flow &flow, int dir,
+				 const unsigned char *data, uint32_t len,
+				 Packet *p) = 0;
+    virtual void tcp_stream_closed(const TCPReassembler::Flow &flow) {
+	(void) flow;
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
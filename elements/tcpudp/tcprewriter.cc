@@ -43,7 +43,7 @@ TCPRewriter::TCPFlow::update_seqno_delta(bool direction,
     if (!_dt || (_dt->nextptr & (1 << direction)
 		 ? trigger != _dt->trigger[direction]
 		 : _dt->delta[direction])) {
-	delta_transition *ndt = new delta_transition;
+	delta_transition *ndt = new_transition();
 	if (!ndt)
 	    return -1;
 	ndt->nextptr = reinterpret_cast<uintptr_t>(_dt);
@@ -76,7 +76,7 @@ TCPRewriter::TCPFlow::update_seqno_delta(bool direction,
 	if (!(ndt->nextptr & 3))
 	    while (delta_transition *x = ndt->next()) {
 		ndt->nextptr = x->nextptr - (x->nextptr & 3);
-		delete x;
+		free_transition(x);
 	    }
     }
 
@@ -197,21 +197,19 @@ TCPRewriter::TCPFlow::apply(WritablePacket *p, bool direction, unsigned annos)
 	if (!(_dt->nextptr & 3))
 	    while (delta_transition *ndt = _dt->next()) {
 		_dt->nextptr = ndt->nextptr - (ndt->nextptr & 3);
-		delete ndt;
+		free_transition(ndt);
 	    }
     }
 
     if (_dt->delta[direction] || _dt->has_trigger(direction)) {
 	uint32_t newval = htonl(new_seq(direction, ntohl(tcph->th_seq)));
-	click_update_in_cksum(&tcph->th_sum, tcph->th_seq >> 16, newval >> 16);
-	click_update_in_cksum(&tcph->th_sum, tcph->th_seq, newval);
+	click_update_in_cksum32(&tcph->th_sum, tcph->th_seq, newval);
 	tcph->th_seq = newval;
     }
 
     if (_dt->delta[!direction] || _dt->has_trigger(!direction)) {
 	uint32_t newval = htonl(new_ack(direction, ntohl(tcph->th_ack)));
-	click_update_in_cksum(&tcph->th_sum, tcph->th_ack >> 16, newval >> 16);
-	click_update_in_cksum(&tcph->th_sum, tcph->th_ack, newval);
+	click_update_in_cksum32(&tcph->th_sum, tcph->th_ack, newval);
 	tcph->th_ack = newval;
 
 	// update SACK sequence numbers
@@ -106,7 +106,7 @@ class TCPRewriter : public IPRewriterBase { public:
 	~TCPFlow() {
 	    while (delta_transition *x = _dt) {
 		_dt = x->next();
-		delete x;
+		free_transition(x);
 	    }
 	}
 
@@ -150,8 +150,14 @@ class TCPRewriter : public IPRewriterBase { public:
 
 	delta_transition *_dt;
 
+	inline HashAllocator &transition_allocator() const;
+	inline delta_transition *new_transition() const;
+	inline void free_transition(delta_transition *dt) const;
+
 	void apply_sack(bool direction, click_tcp *tcp, int transport_len);
 
+	friend class TCPRewriter;
+
     };
 
     TCPRewriter() CLICK_COLD;
@@ -175,7 +181,8 @@ class TCPRewriter : public IPRewriterBase { public:
 
  protected:
 
-    SizedHashAllocator<sizeof(TCPFlow)> _allocator;
+    SizedHashAllocator<sizeof(TCPFlow), CLICK_CACHE_LINE_SIZE> _allocator;
+    SizedHashAllocator<sizeof(TCPFlow::delta_transition)> _dt_allocator;
     unsigned _annos;
     uint32_t _tcp_data_timeout;
     uint32_t _tcp_done_timeout;
@@ -202,6 +209,29 @@ TCPRewriter::destroy_flow(IPRewriterFlow *flow)
     _allocator.deallocate(flow);
 }
 
+inline HashAllocator &
+TCPRewriter::TCPFlow::transition_allocator() const
+{
+    // TCPFlows are only created by TCPRewriter::add_flow, so the owner is
+    // always a TCPRewriter.
+    return static_cast<TCPRewriter *>(_owner->owner)->_dt_allocator;
+}
+
+inline TCPRewriter::TCPFlow::delta_transition *
+TCPRewriter::TCPFlow::new_transition() const
+{
+    if (void *data = transition_allocator().allocate())
+	return new(data) delta_transition;
+    else
+	return 0;
+}
+
+inline void
+TCPRewriter::TCPFlow::free_transition(delta_transition *dt) const
+{
+    transition_allocator().deallocate(dt);
+}
+
 inline tcp_seq_t
 TCPRewriter::TCPFlow::new_seq(bool direction, tcp_seq_t seqno) const
 {
@@ -200,7 +200,7 @@ class UDPRewriter : public IPRewriterBase { public:
 
   private:
 
-    SizedHashAllocator<sizeof(UDPFlow)> _allocator;
+    SizedHashAllocator<sizeof(UDPFlow), CLICK_CACHE_LINE_SIZE> _allocator;
     unsigned _annos;
     uint32_t _udp_streaming_timeout;
 
@@ -0,0 +1,167 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * checksumtest.{cc,hh} -- regression test and benchmark element for
+ * Internet checksums
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "checksumtest.hh"
+#include <click/glue.hh>
+#include <click/error.hh>
+#include <click/args.hh>
+#include <click/timestamp.hh>
+#include <clicknet/ip.h>
+CLICK_DECLS
+
+ChecksumTest::ChecksumTest()
+{
+}
+
+int
+ChecksumTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _benchmark = false;
+    _length = 9000;
+    _iterations = 100000;
+    if (Args(conf, this, errh)
+	.read("BENCHMARK", _benchmark)
+	.read("LENGTH", _length)
+	.read("ITERATIONS", _iterations)
+	.complete() < 0)
+	return -1;
+    if (_length < 0 || _iterations <= 0)
+	return errh->error("bad LENGTH or ITERATIONS");
+    return 0;
+}
+
+// The original 16-bit-at-a-time loop, safe at any alignment.
+static uint16_t
+reference_cksum(const unsigned char *x, int len)
+{
+    uint32_t sum = 0;
+    for (; len > 1; len -= 2, x += 2) {
+	uint16_t w;
+	memcpy(&w, x, 2);
+	sum += w;
+    }
+    if (len == 1) {
+	uint16_t answer = 0;
+	*reinterpret_cast<unsigned char *>(&answer) = *x;
+	sum += answer;
+    }
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum += sum >> 16;
+    return ~sum;
+}
+
+// One's-complement sums have two zeros, 0x0000 and 0xFFFF.
+static inline bool
+cksum_equal(uint16_t a, uint16_t b)
+{
+    return a == b || ((a == 0 || a == 0xFFFF) && (b == 0 || b == 0xFFFF));
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x);
+
+enum { bufsize = 9000 + 8 };
+
+static int
+check_cksums(uint32_t *storage, ErrorHandler *errh)
+{
+    unsigned char *buf = reinterpret_cast<unsigned char *>(storage);
+
+    // full checksums at every alignment, including maximal carries
+    for (int fill = 0; fill < 3; fill++) {
+	for (int i = 0; i < bufsize; i++)
+	    buf[i] = (fill == 0 ? click_random() : fill == 1 ? 0xFF : 0);
+	for (int align = 0; align < 4; align++)
+	    for (int len = 0; len + align <= bufsize; len += (len < 300 ? 1 : 997)) {
+		uint16_t a = click_in_cksum(buf + align, len);
+		uint16_t b = reference_cksum(buf + align, len);
+		if (a != b)
+		    return errh->error("click_in_cksum(align %d, len %d) == %04x, not %04x", align, len, a, b);
+	    }
+    }
+
+    // incremental updates
+    for (int i = 0; i < 10000; i++) {
+	int len = 4 * (1 + click_random(0, 15));
+	for (int j = 0; j < len; j++)
+	    buf[j] = click_random();
+	uint16_t csum = click_in_cksum(buf, len);
+	uint16_t csum32 = csum, csum_delta = csum, delta = 0;
+	uint32_t *w = &storage[click_random(0, len / 4 - 1)];
+	uint32_t old_w = *w, new_w = click_random() ^ (click_random() << 16);
+	// halfwords in network byte order, as they appear in the buffer
+	uint32_t old_h = ntohl(old_w), new_h = ntohl(new_w);
+	click_update_in_cksum(&csum, htons(old_h >> 16), htons(new_h >> 16));
+	click_update_in_cksum(&csum, htons(old_h & 0xFFFF), htons(new_h & 0xFFFF));
+	click_update_in_cksum32(&csum32, old_w, new_w);
+	click_update_in_cksum32(&delta, old_w, new_w);
+	click_update_in_cksum_delta(&csum_delta, ~delta);
+	*w = new_w;
+	uint16_t want = click_in_cksum(buf, len);
+	CHECK(cksum_equal(csum, want));
+	CHECK(cksum_equal(csum32, want));
+	CHECK(cksum_equal(csum_delta, want));
+	click_update_in_cksum_delta(&csum_delta, delta);
+	*w = old_w;
+	CHECK(cksum_equal(csum_delta, click_in_cksum(buf, len)));
+    }
+
+    return 0;
+}
+
+int
+ChecksumTest::initialize(ErrorHandler *errh)
+{
+    uint32_t *storage = new uint32_t[bufsize / 4 + 1];
+    int r = check_cksums(storage, errh);
+    delete[] storage;
+    if (r < 0)
+	return r;
+    errh->message("All tests pass!");
+
+    if (_benchmark)
+	benchmark(errh);
+    return 0;
+}
+
+void
+ChecksumTest::benchmark(ErrorHandler *errh)
+{
+    uint32_t *storage = new uint32_t[_length / 4 + 1];
+    unsigned char *buf = reinterpret_cast<unsigned char *>(storage);
+    for (int i = 0; i < _length; i++)
+	buf[i] = click_random();
+
+    for (int which = 0; which < 2; which++) {
+	uint16_t result = 0;
+	Timestamp start = Timestamp::now_steady();
+	for (int i = 0; i < _iterations; i++) {
+	    // perturb the data so the calls cannot be hoisted
+	    buf[0] = i;
+	    result += (which ? reference_cksum(buf, _length) : click_in_cksum(buf, _length));
+	}
+	Timestamp elapsed = Timestamp::now_steady() - start;
+	double ns = elapsed.doubleval() * 1e9 / _iterations;
+	errh->message("%s: %d bytes, %.1f ns/checksum, %.2f Gb/s [%04x]",
+		      which ? "reference" : "click_in_cksum", _length, ns,
+		      ns > 0 ? _length * 8 / ns : 0., result);
+    }
+
+    delete[] storage;
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(ChecksumTest)
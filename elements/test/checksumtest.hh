@@ -0,0 +1,67 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_CHECKSUMTEST_HH
+#define CLICK_CHECKSUMTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+ChecksumTest([keywords])
+
+=s test
+
+runs regression tests and benchmarks for Internet checksums
+
+=d
+
+ChecksumTest checks click_in_cksum() against a simple reference
+implementation over many lengths and alignments, and checks the incremental
+update functions click_update_in_cksum(), click_update_in_cksum32(), and
+click_update_in_cksum_delta() against full recomputation.  It does all its
+work at initialization time and does not route packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item BENCHMARK
+
+Boolean.  If true, also time click_in_cksum() and the reference
+implementation over a LENGTH-byte buffer and report their speeds.  Default is
+false.
+
+=item LENGTH
+
+Integer.  Buffer length for BENCHMARK.  Default is 9000, a jumbo frame.
+
+=item ITERATIONS
+
+Integer.  Number of checksums computed per implementation for BENCHMARK.
+Default is 100000.
+
+=back
+
+*/
+
+class ChecksumTest : public Element { public:
+
+    ChecksumTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "ChecksumTest"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+
+  private:
+
+    bool _benchmark;
+    int _length;
+    int _iterations;
+
+    void benchmark(ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
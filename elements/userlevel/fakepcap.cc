@@ -29,6 +29,11 @@
 #include <click/args.hh>
 CLICK_DECLS
 
+#define	SWAPLONG(y) \
+	((((y)&0xff)<<24) | (((y)&0xff00)<<8) | (((y)&0xff0000)>>8) | (((y)>>24)&0xff))
+#define	SWAPSHORT(y) \
+	( (((y)&0xff)<<8) | ((u_short)((y)&0xff00)>>8) )
+
 static const struct dlt_name {
     const char* name;
     int dlt;
@@ -53,6 +58,63 @@ static const struct dlt_name {
     { "PRISM", FAKE_DLT_PRISM_HEADER }
 };
 
+String
+fake_pcap_parse_file_header(const void *data, fake_pcap_file_info &info)
+{
+    fake_pcap_file_header fh;
+    memcpy(&fh, data, sizeof(fh));
+    info.swapped = fh.magic != FAKE_PCAP_MAGIC
+	&& fh.magic != FAKE_PCAP_MAGIC_NANO
+	&& fh.magic != FAKE_MODIFIED_PCAP_MAGIC;
+    if (info.swapped) {
+	fh.magic = SWAPLONG(fh.magic);
+	fh.version_major = SWAPSHORT(fh.version_major);
+	fh.version_minor = SWAPSHORT(fh.version_minor);
+	fh.linktype = SWAPLONG(fh.linktype);
+    }
+    if (fh.magic != FAKE_PCAP_MAGIC && fh.magic != FAKE_PCAP_MAGIC_NANO
+	&& fh.magic != FAKE_MODIFIED_PCAP_MAGIC)
+	return "not a tcpdump file (bad magic number)";
+    if (fh.version_major != FAKE_PCAP_VERSION_MAJOR)
+	return "unknown major version " + String((int) fh.version_major);
+
+    // compensate for extra crap appended to packet headers
+    if (fh.magic == FAKE_MODIFIED_PCAP_MAGIC)
+	info.extra_pkthdr_crap = sizeof(fake_modified_pcap_pkthdr) - sizeof(fake_pcap_pkthdr);
+    else
+	info.extra_pkthdr_crap = 0;
+    info.nano = fh.magic == FAKE_PCAP_MAGIC_NANO;
+    info.minor_version = fh.version_minor;
+    // map possible host link types to global link types
+    info.linktype = fake_pcap_canonical_dlt(fh.linktype, true);
+    return String();
+}
+
+Timestamp
+fake_pcap_parse_pkthdr(const void *data, const fake_pcap_file_info &info,
+		       uint32_t &caplen, uint32_t &len)
+{
+    fake_pcap_pkthdr ph;
+    memcpy(&ph, data, sizeof(ph));
+    if (info.swapped) {
+	ph.ts.tv.tv_sec = SWAPLONG(ph.ts.tv.tv_sec);
+	ph.ts.tv.tv_usec = SWAPLONG(ph.ts.tv.tv_usec);
+	ph.caplen = SWAPLONG(ph.caplen);
+	ph.len = SWAPLONG(ph.len);
+    }
+
+    // may need to swap 'caplen' and 'len' fields at or before version 2.3
+    if (info.minor_version > 3
+	|| (info.minor_version == 3 && ph.caplen <= ph.len)) {
+	caplen = ph.caplen;
+	len = ph.len;
+    } else {
+	caplen = ph.len;
+	len = ph.caplen;
+    }
+    return fake_bpf_timeval_union::make_timestamp(&ph.ts, info.nano);
+}
+
 int
 fake_pcap_parse_dlt(const String &str)
 {
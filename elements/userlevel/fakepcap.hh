@@ -10,6 +10,13 @@ CLICK_DECLS
 #define FAKE_PCAP_VERSION_MAJOR		2
 #define FAKE_PCAP_VERSION_MINOR		4
 
+/* pcapng block types */
+#define FAKE_PCAPNG_SHB			0x0A0D0D0A	/* section header */
+#define FAKE_PCAPNG_IDB			1	/* interface description */
+#define FAKE_PCAPNG_EPB			6	/* enhanced packet */
+#define FAKE_PCAPNG_BYTE_ORDER_MAGIC	0x1A2B3C4D
+#define FAKE_PCAPNG_OPT_IF_TSRESOL	9
+
 /* Canonical (pcap file) data link types (may differ from host versions) */
 #define FAKE_DLT_NONE			(-1)	/* Unknown */
 #define FAKE_DLT_NULL			0	/* Null encapsulation */
@@ -79,6 +86,27 @@ struct fake_modified_pcap_pkthdr {
 	uint8_t pad;		/* pad to a 4-byte boundary */
 };
 
+// What a tcpdump file header says about the records that follow.
+struct fake_pcap_file_info {
+    bool swapped;		// file byte order is not the host's
+    bool nano;			// timestamps have nanosecond precision
+    unsigned extra_pkthdr_crap;	// bytes following each record header
+    int minor_version;
+    int linktype;		// canonical data link type
+    inline unsigned pkthdr_len() const {
+	return sizeof(fake_pcap_pkthdr) + extra_pkthdr_crap;
+    }
+};
+
+// Reading tcpdump files.  Headers may be unaligned.
+// fake_pcap_parse_file_header returns an error message, or an empty string
+// if the header is OK.  fake_pcap_parse_pkthdr returns the record's timestamp
+// and sets its lengths, undoing the caplen/len swap of version 2.3 and
+// earlier files.
+String fake_pcap_parse_file_header(const void *, fake_pcap_file_info &);
+Timestamp fake_pcap_parse_pkthdr(const void *, const fake_pcap_file_info &,
+				 uint32_t &caplen, uint32_t &len);
+
 // Parsing and unparsing.
 int fake_pcap_parse_dlt(const String&);
 String fake_pcap_unparse_dlt(int);
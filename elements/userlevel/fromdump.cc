@@ -41,11 +41,6 @@
 #endif
 CLICK_DECLS
 
-#define	SWAPLONG(y) \
-	((((y)&0xff)<<24) | (((y)&0xff00)<<8) | (((y)&0xff0000)>>8) | (((y)>>24)&0xff))
-#define	SWAPSHORT(y) \
-	( (((y)&0xff)<<8) | ((u_short)((y)&0xff00)>>8) )
-
 FromDump::FromDump()
     : _packet(0), _end_h(0), _count(0), _timer(this), _task(this)
 {
@@ -86,6 +81,7 @@ FromDump::configure(Vector<String> &conf, ErrorHandler *errh)
     bool per_node = false;
 #endif
     _packet_filepos = 0;
+    _index_interval = 4096;
 
     if (_ff.configure_keywords(conf, this, errh) < 0)
 	return -1;
@@ -106,8 +102,12 @@ FromDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("PER_NODE", per_node)
 #endif
 	.read("FILEPOS", _packet_filepos)
+	.read("INDEX", FilenameArg(), _index_filename)
+	.read("INDEX_INTERVAL", _index_interval)
 	.complete() < 0)
 	return -1;
+    if (_index_interval == 0)
+	return errh->error("INDEX_INTERVAL must be positive");
 
     // check sampling rate
     if (_sampling_prob > (1 << SAMPLING_SHIFT)) {
@@ -167,27 +167,6 @@ FromDump::configure(Vector<String> &conf, ErrorHandler *errh)
     return 0;
 }
 
-static void
-swap_file_header(const fake_pcap_file_header *hp, fake_pcap_file_header *outp)
-{
-    outp->magic = SWAPLONG(hp->magic);
-    outp->version_major = SWAPSHORT(hp->version_major);
-    outp->version_minor = SWAPSHORT(hp->version_minor);
-    outp->thiszone = SWAPLONG(hp->thiszone);
-    outp->sigfigs = SWAPLONG(hp->sigfigs);
-    outp->snaplen = SWAPLONG(hp->snaplen);
-    outp->linktype = SWAPLONG(hp->linktype);
-}
-
-static void
-swap_packet_header(const fake_pcap_pkthdr *hp, fake_pcap_pkthdr *outp)
-{
-    outp->ts.tv.tv_sec = SWAPLONG(hp->ts.tv.tv_sec);
-    outp->ts.tv.tv_usec = SWAPLONG(hp->ts.tv.tv_usec);
-    outp->caplen = SWAPLONG(hp->caplen);
-    outp->len = SWAPLONG(hp->len);
-}
-
 FromDump *
 FromDump::hotswap_element() const
 {
@@ -225,28 +204,10 @@ FromDump::initialize(ErrorHandler *errh)
     const fake_pcap_file_header *fh = (const fake_pcap_file_header *)_ff.get_aligned(sizeof(fake_pcap_file_header), &swapped_fh);
     if (!fh)
 	return _ff.error(errh, "not a tcpdump file (too short)");
-
-    if (fh->magic == FAKE_PCAP_MAGIC || fh->magic == FAKE_PCAP_MAGIC_NANO || fh->magic == FAKE_MODIFIED_PCAP_MAGIC)
-	_swapped = false;
-    else {
-	swap_file_header(fh, &swapped_fh);
-	_swapped = true;
-	fh = &swapped_fh;
-    }
-    if (fh->magic != FAKE_PCAP_MAGIC && fh->magic != FAKE_PCAP_MAGIC_NANO && fh->magic != FAKE_MODIFIED_PCAP_MAGIC)
-	return _ff.error(errh, "not a tcpdump file (bad magic number)");
-    // compensate for extra crap appended to packet headers
-    if (fh->magic == FAKE_PCAP_MAGIC || fh->magic == FAKE_PCAP_MAGIC_NANO)
-	_extra_pkthdr_crap = 0;
-    else
-	_extra_pkthdr_crap = sizeof(fake_modified_pcap_pkthdr) - sizeof(fake_pcap_pkthdr);
-    _have_nanosecond_timestamps = fh->magic == FAKE_PCAP_MAGIC_NANO;
-
-    if (fh->version_major != FAKE_PCAP_VERSION_MAJOR)
-	return _ff.error(errh, "unknown major version %d", fh->version_major);
-    _minor_version = fh->version_minor;
-    // map possible host link types to global link types
-    _linktype = fake_pcap_canonical_dlt(fh->linktype, true);
+    String msg = fake_pcap_parse_file_header(fh, _info);
+    if (msg)
+	return _ff.error(errh, "%s", msg.c_str());
+    _linktype = _info.linktype;
 
     // if forcing IP packets, check datalink type to ensure we understand it
     if (_force_ip) {
@@ -256,13 +217,174 @@ FromDump::initialize(ErrorHandler *errh)
 	// force FORCE_IP.
 	_force_ip = true;
 
+    _data_filepos = _ff.file_pos();
+    if (_index_filename) {
+	off_t size = _ff.file_size();
+	struct stat st;
+	if (size < 0 || stat(_ff.filename().c_str(), &st) < 0)
+	    return _ff.error(errh, "INDEX requires an uncompressed file");
+	if (load_index(size, st.st_mtime) < 0
+	    && build_index(size, st.st_mtime, errh) < 0)
+	    return -1;
+    }
+
     // maybe skip ahead in the file
     if (_packet_filepos != 0) {
 	int result = _ff.seek(_packet_filepos, errh);
 	_packet_filepos = 0;
 	return result;
-    } else
-	return 0;
+    } else if (_index.size()) {
+	// the index knows the first timestamp, so resolve relative times now
+	if (_have_first_time && _first_time_relative) {
+	    _first_time += _index[0].ts;
+	    _first_time_relative = false;
+	}
+	if (_last_time_relative) {
+	    _last_time += _index[0].ts;
+	    _last_time_relative = false;
+	}
+	if (_have_first_time)
+	    return _ff.seek(index_lookup(_first_time), errh);
+    }
+    return 0;
+}
+
+// Index files are in host byte order.
+struct fromdump_index_header {
+    char magic[8];
+    uint64_t file_size;		// size and modification time of the dump
+    int64_t file_mtime;
+    uint32_t interval;
+    uint32_t nentries;
+};
+
+struct fromdump_index_entry {
+    int64_t sec;
+    uint32_t nsec;
+    uint32_t pad;
+    uint64_t pos;
+};
+
+static const char fromdump_index_magic[8] = {'C', 'l', 'i', 'c', 'k', 'I', 'd', 'x'};
+
+int
+FromDump::load_index(off_t file_size, time_t mtime)
+{
+    String data = file_string(_index_filename, ErrorHandler::silent_handler());
+    fromdump_index_header h;
+    if (data.length() < (int) sizeof(h))
+	return -1;
+    memcpy(&h, data.data(), sizeof(h));
+    size_t nfit = (data.length() - sizeof(h)) / sizeof(fromdump_index_entry);
+    if (memcmp(h.magic, fromdump_index_magic, sizeof(h.magic)) != 0
+	|| h.file_size != (uint64_t) file_size
+	|| h.file_mtime != (int64_t) mtime
+	|| h.interval != _index_interval
+	|| h.nentries > nfit
+	|| (uint64_t) data.length() != sizeof(h) + (uint64_t) h.nentries * sizeof(fromdump_index_entry))
+	return -1;
+
+    // positions must start at the first record and stay inside the file
+    const fromdump_index_entry *e = reinterpret_cast<const fromdump_index_entry *>(data.data() + sizeof(h));
+    Vector<IndexEntry> index(h.nentries, IndexEntry());
+    uint64_t last_pos = _data_filepos;
+    for (uint32_t i = 0; i < h.nentries; ++i) {
+	fromdump_index_entry x;
+	memcpy(&x, e + i, sizeof(x));
+	if ((i == 0 && x.pos != last_pos) || x.pos < last_pos
+	    || x.pos >= (uint64_t) file_size || x.nsec >= 1000000000)
+	    return -1;
+	index[i].ts = Timestamp::make_nsec(x.sec, x.nsec);
+	index[i].pos = last_pos = x.pos;
+    }
+    _index.swap(index);
+    return 0;
+}
+
+int
+FromDump::build_index(off_t file_size, time_t mtime, ErrorHandler *errh)
+{
+    _index.clear();
+    Timestamp max_ts;
+    for (uint32_t n = 0; true; ++n) {
+	off_t pos = _ff.file_pos();
+	Timestamp ts = Timestamp::uninitialized_t();
+	int len, caplen, skiplen;
+	if (!read_packet_header(ts, len, caplen, skiplen, errh))
+	    break;
+	if (n == 0 || ts > max_ts)
+	    max_ts = ts;
+	if (n % _index_interval == 0) {
+	    IndexEntry ie;
+	    ie.ts = max_ts;
+	    ie.pos = pos;
+	    _index.push_back(ie);
+	}
+	_ff.shift_pos(caplen + skiplen);
+    }
+    if (_ff.seek(_data_filepos, errh) < 0)
+	return -1;
+
+    // Failing to save the index is not fatal; it will be rebuilt next time.
+    FILE *f = fopen(_index_filename.c_str(), "wb");
+    fromdump_index_header h;
+    memcpy(h.magic, fromdump_index_magic, sizeof(h.magic));
+    h.file_size = file_size;
+    h.file_mtime = mtime;
+    h.interval = _index_interval;
+    h.nentries = _index.size();
+    bool ok = f && fwrite(&h, sizeof(h), 1, f) == 1;
+    for (int i = 0; ok && i < _index.size(); ++i) {
+	fromdump_index_entry x;
+	x.sec = _index[i].ts.sec();
+	x.nsec = _index[i].ts.nsec();
+	x.pad = 0;
+	x.pos = _index[i].pos;
+	ok = fwrite(&x, sizeof(x), 1, f) == 1;
+    }
+    if (f && fclose(f) != 0)
+	ok = false;
+    if (!ok)
+	errh->warning("%s: %s", _index_filename.c_str(), strerror(errno));
+    return 0;
+}
+
+off_t
+FromDump::index_lookup(const Timestamp &ts) const
+{
+    // find the last entry whose packets all precede ts
+    int l = 0, r = _index.size();
+    while (l < r) {
+	int m = l + (r - l) / 2;
+	if (_index[m].ts < ts)
+	    l = m + 1;
+	else
+	    r = m;
+    }
+    return l ? _index[l - 1].pos : _data_filepos;
+}
+
+int
+FromDump::seek_time(const Timestamp &ts, ErrorHandler *errh)
+{
+    if (_ff.file_size() < 0)
+	return errh->error("cannot seek in a compressed file");
+    if (_packet)
+	_packet->kill();
+    _packet = 0;
+    if (_ff.seek(index_lookup(ts), errh) < 0)
+	return -1;
+    _first_time = ts;
+    _have_first_time = true;
+    _first_time_relative = false;
+    // restart TIMING so the packet at ts is due now
+    if (!_have_any_times)
+	prepare_times(ts);
+    else if (_timing)
+	_timing_offset = Timestamp::now_steady() - ts;
+    if (_active)
+	set_active(true);
+    return 0;
 }
 
 void
@@ -275,9 +397,7 @@ FromDump::take_state(Element *e, ErrorHandler *errh)
     _packet = o->_packet;
     o->_packet = 0;
 
-    _swapped = o->_swapped;
-    _extra_pkthdr_crap = o->_extra_pkthdr_crap;
-    _minor_version = o->_minor_version;
+    _info = o->_info;
 
     _linktype = o->_linktype;
     if (_linktype == FAKE_DLT_RAW)
@@ -287,6 +407,8 @@ FromDump::take_state(Element *e, ErrorHandler *errh)
 
     _timing_offset = o->_timing_offset;
     _packet_filepos = o->_packet_filepos;
+    _data_filepos = o->_data_filepos;
+    _index.swap(o->_index);
 }
 
 void
@@ -325,34 +447,19 @@ FromDump::prepare_times(const Timestamp &ts)
 }
 
 bool
-FromDump::read_packet(ErrorHandler *errh)
+FromDump::read_packet_header(Timestamp &ts, int &len, int &caplen, int &skiplen, ErrorHandler *errh)
 {
-    fake_pcap_pkthdr swapped_ph;
+    fake_pcap_pkthdr aligned_ph;
     const fake_pcap_pkthdr *ph;
-    Timestamp ts = Timestamp::uninitialized_t();
-    int len, caplen, skiplen = 0;
-    Packet *p;
-    assert(!_packet);
-
-    // record file position
-    _packet_filepos = _ff.file_pos();
+    skiplen = 0;
 
     // read the packet header
-    if (!(ph = reinterpret_cast<const fake_pcap_pkthdr *>(_ff.get_aligned(sizeof(*ph), &swapped_ph))))
+    if (!(ph = reinterpret_cast<const fake_pcap_pkthdr *>(_ff.get_aligned(sizeof(*ph), &aligned_ph))))
 	return false;
-    if (_swapped) {
-	swap_packet_header(ph, &swapped_ph);
-	ph = &swapped_ph;
-    }
-
-    // may need to swap 'caplen' and 'len' fields at or before version 2.3
-    if (_minor_version > 3 || (_minor_version == 3 && ph->caplen <= ph->len)) {
-	len = ph->len;
-	caplen = ph->caplen;
-    } else {
-	len = ph->caplen;
-	caplen = ph->len;
-    }
+    uint32_t ulen, ucaplen;
+    ts = fake_pcap_parse_pkthdr(ph, _info, ucaplen, ulen);
+    len = ulen;
+    caplen = ucaplen;
 
     // check for errors
     // 3.Jul.2002 -- Angelos Stavrou discovered that tcptrace-generated
@@ -368,11 +475,26 @@ FromDump::read_packet(ErrorHandler *errh)
     }
 
     // compensate for modified pcap versions
-    _ff.shift_pos(_extra_pkthdr_crap);
+    _ff.shift_pos(_info.extra_pkthdr_crap);
+    return true;
+}
+
+bool
+FromDump::read_packet(ErrorHandler *errh)
+{
+    Timestamp ts = Timestamp::uninitialized_t();
+    int len, caplen, skiplen;
+    Packet *p;
+    assert(!_packet);
+
+    // record file position
+    _packet_filepos = _ff.file_pos();
+
+    if (!read_packet_header(ts, len, caplen, skiplen, errh))
+	return false;
 
     // check times
   check_times:
-    ts = fake_bpf_timeval_union::make_timestamp(&ph->ts, _have_nanosecond_timestamps);
     if (!_have_any_times)
 	prepare_times(ts);
     if (_have_first_time) {
@@ -508,7 +630,7 @@ FromDump::pull(int)
 
 enum {
     H_SAMPLING_PROB, H_ACTIVE, H_ENCAP, H_STOP, H_PACKET_FILEPOS,
-    H_EXTEND_INTERVAL, H_COUNT, H_RESET_COUNTS, H_RESET_TIMING
+    H_EXTEND_INTERVAL, H_COUNT, H_RESET_COUNTS, H_RESET_TIMING, H_SEEK_TIME
 };
 
 String
@@ -561,6 +683,13 @@ FromDump::write_handler(const String &s_in, Element *e, void *thunk, ErrorHandle
 	fd->_last_time_relative = fd->_last_time_interval = false;
 	fd->_have_any_times = false;
 	return 0;
+      case H_SEEK_TIME: {
+	  Timestamp ts;
+	  if (cp_time(s, &ts))
+	      return fd->seek_time(ts, errh);
+	  else
+	      return errh->error("'seek_time' takes a timestamp");
+      }
       default:
 	return -EINVAL;
     }
@@ -580,6 +709,7 @@ FromDump::add_handlers()
     add_data_handlers("count", Handler::OP_READ, &_count);
     add_write_handler("reset_counts", write_handler, H_RESET_COUNTS, Handler::BUTTON);
     add_write_handler("reset_timing", write_handler, H_RESET_TIMING, Handler::BUTTON);
+    add_write_handler("seek_time", write_handler, H_SEEK_TIME);
     if (output_is_push(0))
 	add_task_handlers(&_task);
 }
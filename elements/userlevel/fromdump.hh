@@ -6,13 +6,14 @@
 #include <click/timer.hh>
 #include <click/notifier.hh>
 #include <click/fromfile.hh>
+#include "elements/userlevel/fakepcap.hh"
 CLICK_DECLS
 class HandlerCall;
 
 /*
 =c
 
-FromDump(FILENAME [, I<keywords> STOP, TIMING, SAMPLE, FORCE_IP, START, START_AFTER, END, END_AFTER, INTERVAL, END_CALL, FILEPOS, MMAP])
+FromDump(FILENAME [, I<keywords> STOP, TIMING, SAMPLE, FORCE_IP, START, START_AFTER, END, END_AFTER, INTERVAL, END_CALL, FILEPOS, MMAP, INDEX, INDEX_INTERVAL])
 
 =s traces
 
@@ -24,8 +25,9 @@ Reads packets from a file produced by `tcpdump -w FILENAME' or ToDump and
 emits them from the output, optionally stopping the driver when there are no
 more packets.
 
-FromDump also transparently reads gzip- and bzip2-compressed tcpdump files, if
-you have zcat(1) and bzcat(1) installed.
+FromDump also transparently reads gzip-, bzip2-, xz-, zstd-, and
+lz4-compressed tcpdump files, if you have the corresponding decompression
+programs, such as zcat(1) and bzcat(1), installed.
 
 Keyword arguments are:
 
@@ -108,6 +110,23 @@ This can result in slightly better performance on some machines. FromDump's
 regular file discipline is pretty optimized, so the difference is often small
 in practice. Default is true on most operating systems, but false on Linux.
 
+=item INDEX
+
+Filename. If supplied, FromDump uses a side-car time index stored in this
+file to find packets by timestamp without reading the file from the start.
+The index lists the file position of every INDEX_INTERVAL'th packet and the
+latest timestamp up to that packet.  If the index file is missing, was built
+with a different INDEX_INTERVAL, or was built for a file of a different length
+or modification time, FromDump builds it during initialization by reading
+every packet header once, then saves it.  START,
+START_AFTER, and the C<seek_time> handler use the index.  The dump file must
+not be compressed.
+
+=item INDEX_INTERVAL
+
+Unsigned. The number of packets between index entries when building an index.
+Default is 4096.
+
 =back
 
 You can supply at most one of START and START_AFTER, and at most one of END,
@@ -181,10 +200,30 @@ set to true.
 Resets timing information.  Useful when TIMING is true and you skate around in
 the file by writing C<filepos>.
 
+=h seek_time write-only
+
+Text is an absolute timestamp. FromDump moves to the first packet at or after
+that time and continues from there. With INDEX, finding the position takes
+O(log I<n>) index lookups plus at most INDEX_INTERVAL packet headers;
+without it, FromDump reads from the start of the file. With TIMING, the packet
+at that time is due immediately. The dump file must not be compressed.
+
+=e
+
+This configuration builds an index for a large trace, then emits the packets
+from one minute of it.
+
+  FromDump(big.pcap, INDEX big.pcap.idx, MMAP true,
+           START 1300000000, END 1300000060, STOP true)
+    -> ...;
+
+Later, C<write fd.seek_time 1300003600> jumps ahead without rereading the
+file.
+
 =a
 
-ToDump, FromDevice.u, ToDevice.u, tcpdump(1), mmap(2), AggregateIPFlows,
-FromTcpdump */
+ToDump, FromDumps, FromDevice.u, ToDevice.u, tcpdump(1), mmap(2),
+AggregateIPFlows, FromTcpdump */
 
 class FromDump : public Element { public:
 
@@ -218,7 +257,6 @@ class FromDump : public Element { public:
 
     Packet *_packet;
 
-    bool _swapped : 1;
     bool _timing : 1;
     bool _force_ip : 1;
     bool _have_first_time : 1;
@@ -227,11 +265,9 @@ class FromDump : public Element { public:
     bool _first_time_relative : 1;
     bool _last_time_relative : 1;
     bool _last_time_interval : 1;
-    bool _have_nanosecond_timestamps : 1;
     bool _active;
-    unsigned _extra_pkthdr_crap;
     unsigned _sampling_prob;
-    int _minor_version;
+    fake_pcap_file_info _info;
     int _linktype;
 
     Timestamp _first_time;
@@ -251,9 +287,26 @@ class FromDump : public Element { public:
 
     Timestamp _timing_offset;
     off_t _packet_filepos;
-
+    off_t _data_filepos;	// position of the first packet
+
+    // Every INDEX_INTERVAL'th packet's position, and the latest timestamp
+    // up to and including that packet, so 'ts' never decreases.
+    struct IndexEntry {
+	Timestamp ts;
+	off_t pos;
+    };
+    Vector<IndexEntry> _index;
+    String _index_filename;
+    uint32_t _index_interval;
+
+    bool read_packet_header(Timestamp &ts, int &len, int &caplen, int &skiplen, ErrorHandler *);
     bool read_packet(ErrorHandler *);
 
+    int load_index(off_t file_size, time_t mtime);
+    int build_index(off_t file_size, time_t mtime, ErrorHandler *);
+    off_t index_lookup(const Timestamp &ts) const;
+    int seek_time(const Timestamp &ts, ErrorHandler *);
+
     void prepare_times(const Timestamp &);
     bool check_timing(Packet *p);
 
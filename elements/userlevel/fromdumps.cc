@@ -0,0 +1,592 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * fromdumps.{cc,hh} -- element reads and merges packets from tcpdump files
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "fromdumps.hh"
+#include <click/args.hh>
+#include <click/confparse.hh>
+#include <click/router.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <click/error.hh>
+#include <click/handlercall.hh>
+#include <click/heap.hh>
+#include <click/packet_anno.hh>
+#include <click/userutils.hh>
+#include "fakepcap.hh"
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+CLICK_DECLS
+
+FromDumps::FromDumps()
+    : _end_h(0), _count(0), _stalls(0), _task(this)
+{
+}
+
+FromDumps::~FromDumps()
+{
+    delete _end_h;
+}
+
+int
+FromDumps::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    bool stop = false;
+    HandlerCall end_h;
+    _active = true;
+    _force_ip = _preload = false;
+    _chunk_size = 1048576;
+    _nchunks = 8;
+    _burst = 32;
+
+    if (Args(this, errh).bind(conf)
+	.read("STOP", stop)
+	.read("END_CALL", HandlerCallArg(HandlerCall::writable), end_h)
+	.read("ACTIVE", _active)
+	.read("FORCE_IP", _force_ip)
+	.read("PRELOAD", _preload)
+	.read("CHUNK_SIZE", _chunk_size)
+	.read("CHUNKS", _nchunks)
+	.read("BURST", _burst)
+	.consume() < 0)
+	return -1;
+
+    if (!conf.size())
+	return errh->error("no files");
+    if (_chunk_size < 131072)
+	return errh->error("CHUNK_SIZE must be at least 131072");
+    if (_nchunks < 2)
+	return errh->error("CHUNKS must be at least 2");
+    if (_burst <= 0)
+	return errh->error("BURST must be positive");
+
+    if (stop && end_h)
+	return errh->error("END_CALL and STOP are mutually exclusive");
+    else if (end_h)
+	_end_h = new HandlerCall(end_h);
+    else if (stop)
+	_end_h = new HandlerCall(name() + ".stop");
+
+    Vector<String> filenames;
+    for (int i = 0; i < conf.size(); i++) {
+	String filename;
+	if (!FilenameArg::parse(conf[i], filename))
+	    return errh->error("argument %d should be filename", i + 1);
+	if (filename.find_left('*') < 0 && filename.find_left('?') < 0
+	    && filename.find_left('[') < 0) {
+	    filenames.push_back(filename);
+	    continue;
+	}
+	glob_t g;
+	int r = glob(filename.c_str(), 0, 0, &g);
+	if (r == 0)
+	    for (size_t j = 0; j < g.gl_pathc; ++j)
+		filenames.push_back(String(g.gl_pathv[j]));
+	globfree(&g);
+	if (r == GLOB_NOMATCH)
+	    return errh->error("%<%s%> matches no files", filename.c_str());
+	else if (r != 0)
+	    return errh->error("%s: cannot expand pattern", filename.c_str());
+    }
+
+    for (int i = 0; i < filenames.size(); i++) {
+	Source *s = new Source;
+	s->owner = this;
+	s->filename = filenames[i];
+	s->index = i;
+	s->fd = -1;
+	s->pipe = 0;
+	s->carry = 0;
+	s->carry_len = 0;
+	s->skip = 0;
+	s->error = 0;
+	s->free = s->full_head = 0;
+	s->full_tail = &s->full_head;
+	s->eof = s->stop = false;
+#if HAVE_USER_MULTITHREAD
+	pthread_mutex_init(&s->lock, 0);
+	pthread_cond_init(&s->cond, 0);
+	s->running = false;
+#endif
+	s->cur = 0;
+	s->pos = 0;
+	_sources.push_back(s);
+    }
+    return 0;
+}
+
+static int
+read_some(int fd, FILE *pipe, unsigned char *buf, uint32_t len)
+{
+    if (pipe) {
+	size_t r = fread(buf, 1, len, pipe);
+	return r ? (int) r : (ferror(pipe) ? -1 : 0);
+    }
+    while (1) {
+	ssize_t r = read(fd, buf, len);
+	if (r >= 0 || errno != EINTR)
+	    return r;
+    }
+}
+
+static uint32_t
+read_full(int fd, FILE *pipe, unsigned char *buf, uint32_t len)
+{
+    uint32_t n = 0;
+    int r;
+    while (n < len && (r = read_some(fd, pipe, buf + n, len - n)) > 0)
+	n += r;
+    return n;
+}
+
+
+// Record headers may be unaligned, since records have any length.
+
+uint32_t
+FromDumps::Source::record_caplen(const unsigned char *h, uint32_t &len) const
+{
+    uint32_t caplen;
+    (void) fake_pcap_parse_pkthdr(h, info, caplen, len);
+    return caplen;
+}
+
+Timestamp
+FromDumps::Source::record_timestamp(const unsigned char *h) const
+{
+    uint32_t caplen, len;
+    return fake_pcap_parse_pkthdr(h, info, caplen, len);
+}
+
+int
+FromDumps::open_source(Source *s, ErrorHandler *errh)
+{
+    s->fd = open(s->filename.c_str(), O_RDONLY);
+    if (s->fd < 0)
+	return errh->error("%s: %s", s->filename.c_str(), strerror(errno));
+
+    fake_pcap_file_header fh;
+    unsigned char *buf = reinterpret_cast<unsigned char *>(&fh);
+    uint32_t n = read_full(s->fd, 0, buf, sizeof(fh));
+    if (n && compressed_data(buf, n)) {
+	close(s->fd);
+	s->fd = -1;
+	if (!(s->pipe = open_uncompress_pipe(s->filename, buf, n, errh)))
+	    return -1;
+	n = read_full(-1, s->pipe, buf, sizeof(fh));
+    }
+    if (n < sizeof(fh))
+	return errh->error("%s: not a tcpdump file (too short)", s->filename.c_str());
+
+    String msg = fake_pcap_parse_file_header(&fh, s->info);
+    if (msg)
+	return errh->error("%s: %s", s->filename.c_str(), msg.c_str());
+    if (_force_ip && !fake_pcap_dlt_force_ipable(s->info.linktype))
+	return errh->error("%s: unknown linktype %d; can't force IP packets", s->filename.c_str(), s->info.linktype);
+
+    s->carry = new unsigned char[sizeof(fake_modified_pcap_pkthdr) + 65536];
+    return 0;
+}
+
+FromDumps::Chunk *
+FromDumps::new_chunk()
+{
+    Chunk *c = new Chunk;
+    c->data = new unsigned char[_chunk_size];
+    c->len = 0;
+    c->next = 0;
+    return c;
+}
+
+void
+FromDumps::delete_chunk(Chunk *c)
+{
+    delete[] c->data;
+    delete c;
+}
+
+/** @brief Fill @a c with whole records from @a s's file.  Returns false at
+    end of file or on error. */
+bool
+FromDumps::fill_chunk(Source *s, Chunk *c)
+{
+    memcpy(c->data, s->carry, s->carry_len);
+    uint32_t n = s->carry_len;
+    bool more = true;
+    while (n < _chunk_size) {
+	int r = read_some(s->fd, s->pipe, c->data + n, _chunk_size - n);
+	if (r <= 0) {
+	    if (r < 0)
+		s->error = errno;
+	    more = false;
+	    break;
+	}
+	if (s->skip) {
+	    uint32_t k = (s->skip < (uint32_t) r ? s->skip : r);
+	    memmove(c->data + n, c->data + n + k, r - k);
+	    s->skip -= k;
+	    r -= k;
+	}
+	n += r;
+    }
+
+    uint32_t pos = 0, hl = s->info.pkthdr_len();
+    while (pos + hl <= n) {
+	uint32_t len, caplen = s->record_caplen(c->data + pos, len);
+	if (caplen > 65535) {
+	    // skip the record, which may continue past this chunk
+	    uint64_t end = (uint64_t) pos + hl + caplen;
+	    if (end <= n) {
+		memmove(c->data + pos, c->data + end, n - end);
+		n -= end - pos;
+	    } else {
+		s->skip = end - n;
+		n = pos;
+	    }
+	    continue;
+	} else if (pos + hl + caplen > n)
+	    break;
+	pos += hl + caplen;
+    }
+
+    // a partial record at end of file is dropped
+    c->len = pos;
+    s->carry_len = n - pos;
+    if (more)
+	memcpy(s->carry, c->data + pos, s->carry_len);
+    return more;
+}
+
+void
+FromDumps::queue_chunk(Source *s, Chunk *c, bool eof)
+{
+#if HAVE_USER_MULTITHREAD
+    pthread_mutex_lock(&s->lock);
+#endif
+    c->next = 0;
+    *s->full_tail = c;
+    s->full_tail = &c->next;
+    if (eof)
+	s->eof = true;
+#if HAVE_USER_MULTITHREAD
+    pthread_mutex_unlock(&s->lock);
+#endif
+}
+
+#if HAVE_USER_MULTITHREAD
+void *
+FromDumps::reader_thread(void *arg)
+{
+    Source *s = static_cast<Source *>(arg);
+    FromDumps *fd = s->owner;
+    bool more = true;
+    while (more) {
+	Chunk *c;
+	if (fd->_preload)
+	    c = fd->new_chunk();
+	else {
+	    pthread_mutex_lock(&s->lock);
+	    while (!s->free && !s->stop)
+		pthread_cond_wait(&s->cond, &s->lock);
+	    if ((c = s->free))
+		s->free = c->next;
+	    pthread_mutex_unlock(&s->lock);
+	    if (!c)
+		break;
+	}
+	more = fd->fill_chunk(s, c);
+	fd->queue_chunk(s, c, !more);
+	// wake the router thread in case it is waiting for this source
+	fd->_task.reschedule();
+    }
+    return 0;
+}
+#endif
+
+/** @brief Advance @a s to its next chunk.  Returns 1 if @a s has a current
+    record, 0 if its reader has not caught up, and -1 if @a s is done. */
+int
+FromDumps::take_chunk(Source *s)
+{
+    while (1) {
+#if HAVE_USER_MULTITHREAD
+	pthread_mutex_lock(&s->lock);
+#endif
+	if (Chunk *c = s->cur) {
+	    if (_preload)
+		delete_chunk(c);
+	    else {
+		c->next = s->free;
+		s->free = c;
+#if HAVE_USER_MULTITHREAD
+		pthread_cond_signal(&s->cond);
+#endif
+	    }
+	    s->cur = 0;
+	}
+	Chunk *c = s->full_head;
+	if (c && !(s->full_head = c->next))
+	    s->full_tail = &s->full_head;
+	bool eof = s->eof;
+#if HAVE_USER_MULTITHREAD
+	pthread_mutex_unlock(&s->lock);
+#else
+	if (!c && !eof) {
+	    c = s->free;
+	    s->free = c->next;
+	    if (!fill_chunk(s, c))
+		s->eof = true;
+	}
+#endif
+	if (!c) {
+	    if (eof && s->error)
+		click_chatter("%p{element}: %s: %s", this, s->filename.c_str(), strerror(s->error));
+	    return eof ? -1 : 0;
+	}
+	s->cur = c;
+	s->pos = 0;
+	if (c->len) {
+	    s->ts = s->record_timestamp(c->data);
+	    return 1;
+	}
+    }
+}
+
+void
+FromDumps::stop_reader(Source *s)
+{
+#if HAVE_USER_MULTITHREAD
+    if (s->running) {
+	pthread_mutex_lock(&s->lock);
+	s->stop = true;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->thread, 0);
+	s->running = false;
+    }
+#else
+    (void) s;
+#endif
+}
+
+int
+FromDumps::initialize(ErrorHandler *errh)
+{
+    if (_end_h && _end_h->initialize_write(this, errh) < 0)
+	return -1;
+    ScheduleInfo::initialize_task(this, &_task, _active, errh);
+
+    for (int i = 0; i < _sources.size(); i++) {
+	Source *s = _sources[i];
+	if (open_source(s, errh) < 0)
+	    return -1;
+	if (!_force_ip && s->info.linktype != _sources[0]->info.linktype)
+	    return errh->error("%s: encapsulation type differs from %s; use FORCE_IP", s->filename.c_str(), _sources[0]->filename.c_str());
+	if (!_preload)
+	    for (uint32_t j = 0; j < _nchunks; j++) {
+		Chunk *c = new_chunk();
+		c->next = s->free;
+		s->free = c;
+	    }
+    }
+
+#if HAVE_USER_MULTITHREAD
+    for (int i = 0; i < _sources.size(); i++) {
+	Source *s = _sources[i];
+	int err = pthread_create(&s->thread, 0, reader_thread, s);
+	if (err != 0)
+	    return errh->error("cannot start reader thread: %s", strerror(err));
+	s->running = true;
+    }
+    // preloading readers exit at end of file
+    if (_preload)
+	for (int i = 0; i < _sources.size(); i++)
+	    stop_reader(_sources[i]);
+#else
+    if (_preload)
+	for (int i = 0; i < _sources.size(); i++) {
+	    Source *s = _sources[i];
+	    bool more = true;
+	    while (more) {
+		Chunk *c = new_chunk();
+		more = fill_chunk(s, c);
+		queue_chunk(s, c, !more);
+	    }
+	}
+#endif
+
+    for (int i = 0; i < _sources.size(); i++)
+	_waiting.push_back(_sources[i]);
+    return 0;
+}
+
+void
+FromDumps::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _sources.size(); i++) {
+	Source *s = _sources[i];
+	stop_reader(s);
+	if (s->pipe)
+	    pclose(s->pipe);
+	if (s->fd >= 0)
+	    close(s->fd);
+	if (s->cur)
+	    delete_chunk(s->cur);
+	while (Chunk *c = s->free) {
+	    s->free = c->next;
+	    delete_chunk(c);
+	}
+	while (Chunk *c = s->full_head) {
+	    s->full_head = c->next;
+	    delete_chunk(c);
+	}
+	delete[] s->carry;
+#if HAVE_USER_MULTITHREAD
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->cond);
+#endif
+	delete s;
+    }
+    _sources.clear();
+}
+
+void
+FromDumps::set_active(bool active)
+{
+    _active = active;
+    if (active && !_task.scheduled())
+	_task.reschedule();
+}
+
+bool
+FromDumps::run_task(Task *)
+{
+    if (!_active)
+	return false;
+
+    for (int i = 0; i < _waiting.size(); ) {
+	Source *s = _waiting[i];
+	int r = take_chunk(s);
+	if (r > 0) {
+	    _heap.push_back(s);
+	    push_heap(_heap.begin(), _heap.end(), heap_less());
+	}
+	if (r != 0) {
+	    _waiting[i] = _waiting.back();
+	    _waiting.pop_back();
+	} else
+	    i++;
+    }
+    if (_waiting.size()) {
+	// Merging needs every file's next packet.  Reader threads reschedule
+	// the task when they queue a chunk.
+#if !HAVE_USER_MULTITHREAD
+	_task.fast_reschedule();
+#endif
+	return false;
+    }
+
+    int n = 0;
+    while (n < _burst && _heap.size()) {
+	Source *s = _heap[0];
+	const unsigned char *h = s->cur->data + s->pos;
+	uint32_t len, caplen = s->record_caplen(h, len);
+	uint32_t hl = s->info.pkthdr_len();
+	s->pos += hl + caplen;
+	// tcptrace-generated files may have caplen > len
+	if (caplen > len)
+	    caplen = len;
+
+	if (Packet *p = Packet::make(h + hl, caplen)) {
+	    p->timestamp_anno() = s->ts;
+	    SET_EXTRA_LENGTH_ANNO(p, len - caplen);
+	    p->set_mac_header(p->data());
+	    if ((_force_ip || s->info.linktype == FAKE_DLT_RAW)
+		&& !fake_pcap_force_ip(p, s->info.linktype))
+		checked_output_push(1, p);
+	    else {
+		output(0).push(p);
+		_count++;
+	    }
+	}
+	n++;
+
+	if (s->pos < s->cur->len) {
+	    s->ts = s->record_timestamp(s->cur->data + s->pos);
+	    change_heap(_heap.begin(), _heap.end(), _heap.begin(), heap_less());
+	} else {
+	    pop_heap(_heap.begin(), _heap.end(), heap_less());
+	    _heap.pop_back();
+	    int r = take_chunk(s);
+	    if (r > 0) {
+		_heap.push_back(s);
+		push_heap(_heap.begin(), _heap.end(), heap_less());
+	    } else if (r == 0) {
+		_waiting.push_back(s);
+		_stalls++;
+		break;
+	    }
+	}
+    }
+
+    if (_heap.size() || _waiting.size())
+	_task.fast_reschedule();
+    else if (_end_h)
+	_end_h->call_write(ErrorHandler::default_handler());
+    return n > 0;
+}
+
+enum { H_ACTIVE, H_STOP, H_RESET_COUNTS };
+
+int
+FromDumps::write_handler(const String &s_in, Element *e, void *thunk, ErrorHandler *errh)
+{
+    FromDumps *fd = static_cast<FromDumps *>(e);
+    String s = cp_uncomment(s_in);
+    switch ((intptr_t)thunk) {
+      case H_ACTIVE: {
+	  bool active;
+	  if (BoolArg().parse(s, active)) {
+	      fd->set_active(active);
+	      return 0;
+	  } else
+	      return errh->error("type mismatch");
+      }
+      case H_STOP:
+	fd->set_active(false);
+	fd->router()->please_stop_driver();
+	return 0;
+      case H_RESET_COUNTS:
+	fd->_count = fd->_stalls = 0;
+	return 0;
+      default:
+	return -EINVAL;
+    }
+}
+
+void
+FromDumps::add_handlers()
+{
+    add_data_handlers("active", Handler::OP_READ | Handler::CHECKBOX, &_active);
+    add_write_handler("active", write_handler, H_ACTIVE);
+    add_write_handler("stop", write_handler, H_STOP, Handler::BUTTON);
+    add_data_handlers("count", Handler::OP_READ, &_count);
+    add_data_handlers("stalls", Handler::OP_READ, &_stalls);
+    add_write_handler("reset_counts", write_handler, H_RESET_COUNTS, Handler::BUTTON);
+    add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel FakePcap)
+EXPORT_ELEMENT(FromDumps)
@@ -0,0 +1,243 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_FROMDUMPS_HH
+#define CLICK_FROMDUMPS_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/vector.hh>
+#include "elements/userlevel/fakepcap.hh"
+#include <stdio.h>
+#if HAVE_USER_MULTITHREAD
+# include <pthread.h>
+#endif
+CLICK_DECLS
+class HandlerCall;
+
+/*
+=c
+
+FromDumps(FILENAME1, FILENAME2, ... [, I<keywords> STOP, END_CALL, ACTIVE, FORCE_IP, PRELOAD, CHUNK_SIZE, CHUNKS, BURST])
+
+=s traces
+
+reads packets from several tcpdump files, merged by timestamp
+
+=d
+
+Reads packets from one or more files produced by `tcpdump -w' or ToDump and
+pushes them out in timestamp order.  FromDumps(A, B) is like FromDump(A) and
+FromDump(B) feeding a TimeSortedSched, but faster: each file is read, and if
+necessary decompressed, by its own reader thread, so the router thread only
+merges and emits packets.  Packets with equal timestamps are emitted in file
+order.
+
+A FILENAME containing C<*>, C<?>, or C<[> is a glob(3) pattern, and stands for
+the matching files in sorted order; for example, C<FromDumps(dumps/link*.pcap)>
+merges every per-link capture in a directory.  A pattern that matches no files is an
+error.
+
+Like FromDump, FromDumps reads gzip-, bzip2-, xz-, zstd-, and lz4-compressed
+files through the corresponding decompression programs, which then also run
+in parallel.
+
+Each reader fills fixed-size chunks of whole packet records.  When the router
+thread needs a chunk that a reader has not finished, FromDumps counts a stall
+and sleeps until the reader queues the chunk.  Reader threads are only available
+when Click is built with --enable-user-multithread.  Otherwise, the router
+thread reads each chunk as it is needed.
+
+Keyword arguments are:
+
+=over 8
+
+=item STOP
+
+Boolean.  If true, then FromDumps will ask the router to stop when it is done
+reading all its files.  Default is false.
+
+=item END_CALL
+
+Specify a handler to call once all files run out of packets.  END_CALL and
+STOP are mutually exclusive.
+
+=item ACTIVE
+
+Boolean.  If false, then FromDumps will not emit packets (until the
+`C<active>' handler is written).  Default is true.
+
+=item FORCE_IP
+
+Boolean.  If true, then FromDumps will emit only IP packets with their IP
+header annotations correctly set.  (If FromDumps has two outputs, non-IP
+packets are pushed out on output 1; otherwise, they are dropped.)  Default is
+false.  Without FORCE_IP, all files must have the same encapsulation type.
+
+=item PRELOAD
+
+Boolean.  If true, then FromDumps reads all its files into memory during
+initialization, before the router starts, so that replay speed does not
+depend on the disk or on decompression.  Files are read in parallel when
+reader threads are available.  Default is false.
+
+=item CHUNK_SIZE
+
+Integer.  The size of each chunk in bytes.  Must be at least 131072.  Default
+is 1048576.
+
+=item CHUNKS
+
+Integer.  The number of chunks per file, which bounds how far each reader
+may run ahead.  Ignored with PRELOAD.  Default is 8.
+
+=item BURST
+
+Integer.  The maximum number of packets to emit per task invocation.
+Default is 32.
+
+=back
+
+Only available in user-level processes.
+
+=n
+
+FromDumps sets packets' extra length annotations to any additional length
+recorded in the dump.  It skips records that capture more than 65535 bytes.
+
+=h count read-only
+
+Returns the number of packets output so far.
+
+=h reset_counts write-only
+
+Resets "count" and "stalls" to 0.
+
+=h stalls read-only
+
+Returns the number of times FromDumps had to wait for a reader.
+
+=h active read/write
+
+Value is a Boolean.
+
+=h stop write-only
+
+Stops the element and asks the driver to stop.
+
+=e
+
+  FromDumps(link0.pcap.zst, link1.pcap.zst, PRELOAD true, STOP true)
+    -> Queue -> ToDevice(eth0);
+
+=a
+
+FromDump, TimeSortedSched, ToDump */
+
+class FromDumps : public Element { public:
+
+    FromDumps() CLICK_COLD;
+    ~FromDumps() CLICK_COLD;
+
+    const char *class_name() const		{ return "FromDumps"; }
+    const char *port_count() const		{ return "0/1-2"; }
+    const char *processing() const		{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    bool run_task(Task *);
+
+  private:
+
+    // A run of whole packet records.
+    struct Chunk {
+	unsigned char *data;
+	uint32_t len;
+	Chunk *next;
+    };
+
+    struct Source {
+	FromDumps *owner;
+	String filename;
+	int index;
+
+	// file format
+	fake_pcap_file_info info;
+
+	// reader state
+	int fd;
+	FILE *pipe;
+	unsigned char *carry;	// partial record left over from last chunk
+	uint32_t carry_len;
+	uint64_t skip;		// bytes left of an oversized record
+	int error;
+
+	// shared between reader and router thread, protected by lock
+	Chunk *free;
+	Chunk *full_head;
+	Chunk **full_tail;
+	bool eof;
+	bool stop;
+#if HAVE_USER_MULTITHREAD
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	bool running;
+#endif
+
+	// router thread state
+	Chunk *cur;
+	uint32_t pos;
+	Timestamp ts;		// timestamp of record at cur->data + pos
+
+	uint32_t record_caplen(const unsigned char *h, uint32_t &len) const;
+	Timestamp record_timestamp(const unsigned char *h) const;
+    };
+
+    Vector<Source *> _sources;
+    Vector<Source *> _heap;	// sources with a current record, by time
+    Vector<Source *> _waiting;	// sources waiting for a chunk
+
+    bool _active;
+    bool _force_ip;
+    bool _preload;
+    uint32_t _chunk_size;
+    uint32_t _nchunks;
+    int _burst;
+    HandlerCall *_end_h;
+
+#if HAVE_INT64_TYPES
+    typedef uint64_t counter_t;
+#else
+    typedef uint32_t counter_t;
+#endif
+    counter_t _count;
+    counter_t _stalls;
+
+    Task _task;
+
+    struct heap_less {
+	bool operator()(const Source *a, const Source *b) const {
+	    return a->ts < b->ts || (a->ts == b->ts && a->index < b->index);
+	}
+    };
+
+    int open_source(Source *s, ErrorHandler *errh);
+    Chunk *new_chunk();
+    void delete_chunk(Chunk *c);
+    bool fill_chunk(Source *s, Chunk *c);
+    void queue_chunk(Source *s, Chunk *c, bool eof);
+    int take_chunk(Source *s);
+    void stop_reader(Source *s);
+#if HAVE_USER_MULTITHREAD
+    static void *reader_thread(void *);
+#endif
+
+    void set_active(bool active);
+
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
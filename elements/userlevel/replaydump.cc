@@ -0,0 +1,439 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * replaydump.{cc,hh} -- element replays a tcpdump file from memory
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "replaydump.hh"
+#include <click/args.hh>
+#include <click/router.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+#include <clicknet/udp.h>
+#include "fakepcap.hh"
+CLICK_DECLS
+
+// Poll rather than sleep when the next packet is due this soon.
+#define SPIN_NSEC	2000000
+
+ReplayDump::ReplayDump()
+    : _arena(0), _arena_len(0), _arena_cap(0), _npackets(0),
+      _task(this), _timer(this)
+{
+}
+
+ReplayDump::~ReplayDump()
+{
+}
+
+int
+ReplayDump::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _speed = 1;
+    _loop_limit = 1;
+    _stop = false;
+    _active = true;
+    _burst = 32;
+    IPAddress ip_src_step, ip_dst_step;
+    _set_eth_src = _set_eth_dst = false;
+
+    if (_ff.configure_keywords(conf, this, errh) < 0)
+	return -1;
+    if (Args(conf, this, errh)
+	.read_mp("FILENAME", FilenameArg(), _ff.filename())
+	.read("SPEED", _speed)
+	.read("LOOP", _loop_limit)
+	.read("STOP", _stop)
+	.read("ACTIVE", _active)
+	.read("BURST", _burst)
+	.read("IP_SRC_STEP", ip_src_step)
+	.read("IP_DST_STEP", ip_dst_step)
+	.read("ETH_SRC", _eth_src).read_status(_set_eth_src)
+	.read("ETH_DST", _eth_dst).read_status(_set_eth_dst)
+	.complete() < 0)
+	return -1;
+
+    if (_speed < 0)
+	return errh->error("SPEED must be nonnegative");
+    if (_burst <= 0)
+	return errh->error("BURST must be positive");
+    _ip_src_step = ntohl(ip_src_step.addr());
+    _ip_dst_step = ntohl(ip_dst_step.addr());
+    return 0;
+}
+
+unsigned char *
+ReplayDump::grow(size_t len)
+{
+    if (_arena_len + len > _arena_cap) {
+	size_t cap = _arena_cap ? _arena_cap * 2 : 1048576;
+	while (cap < _arena_len + len)
+	    cap *= 2;
+	unsigned char *arena = (unsigned char *) realloc(_arena, cap);
+	if (!arena)
+	    return 0;
+	_arena = arena;
+	_arena_cap = cap;
+    }
+    unsigned char *x = _arena + _arena_len;
+    _arena_len += len;
+    return x;
+}
+
+int
+ReplayDump::load(ErrorHandler *errh)
+{
+    if (_ff.initialize(errh) < 0)
+	return -1;
+
+    fake_pcap_file_header swapped_fh;
+    const fake_pcap_file_header *fh = (const fake_pcap_file_header *)_ff.get_aligned(sizeof(fake_pcap_file_header), &swapped_fh);
+    if (!fh)
+	return _ff.error(errh, "not a tcpdump file (too short)");
+    fake_pcap_file_info info;
+    String msg = fake_pcap_parse_file_header(fh, info);
+    if (msg)
+	return _ff.error(errh, "%s", msg.c_str());
+    _linktype = info.linktype;
+    bool force_ipable = fake_pcap_dlt_force_ipable(_linktype);
+
+    uint64_t last_time = 0;
+    while (1) {
+	fake_pcap_pkthdr aligned_ph;
+	const fake_pcap_pkthdr *ph = reinterpret_cast<const fake_pcap_pkthdr *>(_ff.get_aligned(sizeof(*ph), &aligned_ph));
+	if (!ph)
+	    break;
+	uint32_t len, caplen, skiplen = 0;
+	Timestamp ts = fake_pcap_parse_pkthdr(ph, info, caplen, len);
+	if (caplen > 65535)
+	    return _ff.error(errh, "bad packet header");
+	else if (caplen > len) {
+	    skiplen = caplen - len;
+	    caplen = len;
+	}
+	_ff.shift_pos(info.extra_pkthdr_crap);
+
+	if (!_npackets)
+	    _first_ts = ts;
+	// keep time monotonic even if the trace is not
+	Timestamp delta = ts - _first_ts;
+	uint64_t time = delta > Timestamp() ? delta.nsecval() : 0;
+	if (time < last_time)
+	    time = last_time;
+
+	size_t rlen = sizeof(Record) + ((caplen + 7) & ~7);
+	unsigned char *x = grow(rlen);
+	if (!x)
+	    return errh->error("out of memory after %u packets", _npackets);
+	Record *r = reinterpret_cast<Record *>(x);
+	r->time = last_time = time;
+	r->caplen = caplen;
+	r->len = len;
+	r->ip_off = -1;
+	r->pad = 0;
+	if (_ff.read(x + sizeof(Record), caplen, errh) != (int) caplen) {
+	    // truncated final packet
+	    _arena_len -= rlen;
+	    break;
+	}
+	_ff.shift_pos(skiplen);
+
+	if (force_ipable)
+	    if (Packet *p = Packet::make(x + sizeof(Record), caplen)) {
+		if (fake_pcap_force_ip(p, _linktype) && p->ip_header()->ip_v == 4)
+		    r->ip_off = p->network_header() - p->data();
+		p->kill();
+	    }
+	_npackets++;
+    }
+    _ff.cleanup();
+
+    // The next loop starts one average gap after the last packet.
+    _period = last_time;
+    if (_npackets > 1)
+	_period += last_time / (_npackets - 1);
+    return 0;
+}
+
+void
+ReplayDump::calibrate()
+{
+    // Measure the cycle counter against the steady clock for 10ms.
+    Timestamp t0 = Timestamp::now_steady();
+    click_cycles_t c0 = click_get_cycles();
+    Timestamp t1;
+    do {
+	t1 = Timestamp::now_steady();
+    } while ((t1 - t0).msecval() < 10);
+    click_cycles_t c1 = click_get_cycles();
+    _use_cycles = c1 > c0;
+    _cycles_per_ns = _use_cycles ? (double) (c1 - c0) / (t1 - t0).nsecval() : 1;
+}
+
+inline click_cycles_t
+ReplayDump::now() const
+{
+    if (_use_cycles)
+	return click_get_cycles();
+    else
+	return Timestamp::now_steady().nsecval();
+}
+
+inline click_cycles_t
+ReplayDump::due(const Record *r) const
+{
+    return _start + (click_cycles_t) (((double) _loop * _period + r->time) * _factor);
+}
+
+double
+ReplayDump::to_sec(uint64_t units) const
+{
+    return units / _cycles_per_ns / 1e9;
+}
+
+int
+ReplayDump::initialize(ErrorHandler *errh)
+{
+    if (load(errh) < 0)
+	return -1;
+    if (!_npackets)
+	errh->warning("%s: no packets", _ff.filename().c_str());
+    calibrate();
+    _factor = _speed ? _cycles_per_ns / _speed : 0;
+
+    ScheduleInfo::initialize_task(this, &_task, _active, errh);
+    _timer.initialize(this);
+    restart();
+    return 0;
+}
+
+void
+ReplayDump::cleanup(CleanupStage)
+{
+    free(_arena);
+    _arena = 0;
+}
+
+void
+ReplayDump::restart()
+{
+    _pos = 0;
+    _loop = 0;
+    _count = 0;
+    _error_sum = _error_max = 0;
+    _first_due = _last_due = _last_sent = 0;
+    _started = false;
+}
+
+Packet *
+ReplayDump::make_packet(const Record *r)
+{
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(r + 1);
+    WritablePacket *p = Packet::make(data, r->caplen);
+    if (!p)
+	return 0;
+    p->timestamp_anno() = _first_ts + Timestamp::make_nsec(r->time);
+    SET_EXTRA_LENGTH_ANNO(p, r->len - r->caplen);
+    p->set_mac_header(p->data());
+
+    if (_linktype == FAKE_DLT_EN10MB && r->caplen >= 12) {
+	if (_set_eth_dst)
+	    memcpy(p->data(), _eth_dst.data(), 6);
+	if (_set_eth_src)
+	    memcpy(p->data() + 6, _eth_src.data(), 6);
+    }
+
+    if (r->ip_off >= 0) {
+	click_ip *iph = reinterpret_cast<click_ip *>(p->data() + r->ip_off);
+	p->set_ip_header(iph, iph->ip_hl << 2);
+	if (_loop && (_ip_src_step || _ip_dst_step)) {
+	    uint32_t old_src = iph->ip_src.s_addr, old_dst = iph->ip_dst.s_addr;
+	    iph->ip_src.s_addr = htonl(ntohl(old_src) + _loop * _ip_src_step);
+	    iph->ip_dst.s_addr = htonl(ntohl(old_dst) + _loop * _ip_dst_step);
+	    uint32_t new_src = iph->ip_src.s_addr, new_dst = iph->ip_dst.s_addr;
+	    click_update_in_cksum32(&iph->ip_sum, old_src, new_src);
+	    click_update_in_cksum32(&iph->ip_sum, old_dst, new_dst);
+
+	    // TCP and UDP checksums cover the addresses too
+	    uint16_t *csum = 0;
+	    if (IP_FIRSTFRAG(iph)) {
+		if (iph->ip_p == IP_PROTO_TCP && p->transport_length() >= 18)
+		    csum = &p->tcp_header()->th_sum;
+		else if (iph->ip_p == IP_PROTO_UDP && p->transport_length() >= 8
+			 && p->udp_header()->uh_sum)
+		    csum = &p->udp_header()->uh_sum;
+	    }
+	    if (csum) {
+		click_update_in_cksum32(csum, old_src, new_src);
+		click_update_in_cksum32(csum, old_dst, new_dst);
+		// a computed UDP checksum of 0 is sent as all ones
+		if (iph->ip_p == IP_PROTO_UDP && *csum == 0)
+		    *csum = 0xFFFF;
+	    }
+	    p->set_dst_ip_anno(iph->ip_dst);
+	} else
+	    p->set_dst_ip_anno(iph->ip_dst);
+    }
+    return p;
+}
+
+bool
+ReplayDump::run_task(Task *)
+{
+    if (!_active || !_npackets)
+	return false;
+
+    int n = 0;
+    click_cycles_t t = now();
+    if (!_started) {
+	// start the clock when the router does, not at initialization
+	_start = t;
+	_started = true;
+    }
+    while (n < _burst) {
+	const Record *r = reinterpret_cast<const Record *>(_arena + _pos);
+	click_cycles_t d = due(r);
+	if (t < d) {
+	    if ((d - t) / _cycles_per_ns > SPIN_NSEC) {
+		Timestamp wait = Timestamp::make_nsec((int64_t) ((d - t) / _cycles_per_ns) - SPIN_NSEC / 2);
+		_timer.schedule_after(wait);
+		return n > 0;
+	    }
+	    break;
+	}
+
+	if (Packet *p = make_packet(r)) {
+	    output(0).push(p);
+	    _count++;
+	}
+	// pushing takes time; the next packet's deadline is checked against
+	// the current time, not the time the burst began
+	t = now();
+	if (_count == 1 && !n)
+	    _first_due = d;
+	uint64_t err = t - d;
+	_error_sum += err;
+	if (err > _error_max)
+	    _error_max = err;
+	_last_due = d;
+	_last_sent = t;
+	n++;
+
+	_pos += sizeof(Record) + ((r->caplen + 7) & ~7);
+	if (_pos >= _arena_len) {
+	    _pos = 0;
+	    _loop++;
+	    if (finished()) {
+		_active = false;
+		if (_stop)
+		    router()->please_stop_driver();
+		return true;
+	    }
+	}
+    }
+
+    _task.fast_reschedule();
+    return n > 0;
+}
+
+void
+ReplayDump::run_timer(Timer *)
+{
+    if (_active)
+	_task.reschedule();
+}
+
+enum {
+    H_COUNT, H_LOOPS, H_ACTIVE, H_RESET, H_ERROR_AVG, H_ERROR_MAX,
+    H_REQUESTED_TIME, H_ELAPSED_TIME, H_CYCLES_PER_SEC
+};
+
+String
+ReplayDump::read_handler(Element *e, void *thunk)
+{
+    ReplayDump *rd = static_cast<ReplayDump *>(e);
+    switch ((intptr_t) thunk) {
+    case H_COUNT:
+	return String(rd->_count);
+    case H_LOOPS:
+	return String(rd->_loop);
+    case H_ERROR_AVG:
+	return String(rd->_count ? (uint64_t) (rd->_error_sum / rd->_cycles_per_ns / rd->_count) : 0);
+    case H_ERROR_MAX:
+	return String((uint64_t) (rd->_error_max / rd->_cycles_per_ns));
+    case H_REQUESTED_TIME:
+	return String(rd->to_sec(rd->_last_due - rd->_first_due));
+    case H_ELAPSED_TIME:
+	return String(rd->to_sec(rd->_last_sent - rd->_first_due));
+    case H_CYCLES_PER_SEC:
+	return String(rd->_use_cycles ? (uint64_t) (rd->_cycles_per_ns * 1e9) : 0);
+    default:
+	return String();
+    }
+}
+
+int
+ReplayDump::write_handler(const String &s, Element *e, void *thunk, ErrorHandler *errh)
+{
+    ReplayDump *rd = static_cast<ReplayDump *>(e);
+    switch ((intptr_t) thunk) {
+    case H_ACTIVE: {
+	bool active;
+	if (!BoolArg().parse(s, active))
+	    return errh->error("syntax error");
+	// a finished replay stays finished until reset
+	if (active && rd->finished())
+	    active = false;
+	if (active && !rd->_active) {
+	    // shift the schedule so the next packet is due now
+	    const Record *r = reinterpret_cast<const Record *>(rd->_arena + rd->_pos);
+	    if (rd->_npackets && rd->_started)
+		rd->_start += rd->now() - rd->due(r);
+	    rd->_task.reschedule();
+	}
+	rd->_active = active;
+	return 0;
+    }
+    case H_RESET:
+	rd->restart();
+	if (rd->_active)
+	    rd->_task.reschedule();
+	return 0;
+    default:
+	return -EINVAL;
+    }
+}
+
+void
+ReplayDump::add_handlers()
+{
+    add_read_handler("count", read_handler, H_COUNT);
+    add_read_handler("loops", read_handler, H_LOOPS);
+    add_data_handlers("active", Handler::OP_READ | Handler::CHECKBOX, &_active);
+    add_write_handler("active", write_handler, H_ACTIVE);
+    add_write_handler("reset", write_handler, H_RESET, Handler::BUTTON);
+    add_read_handler("error_avg", read_handler, H_ERROR_AVG);
+    add_read_handler("error_max", read_handler, H_ERROR_MAX);
+    add_read_handler("requested_time", read_handler, H_REQUESTED_TIME);
+    add_read_handler("elapsed_time", read_handler, H_ELAPSED_TIME);
+    add_read_handler("cycles_per_sec", read_handler, H_CYCLES_PER_SEC);
+    add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel FakePcap)
+EXPORT_ELEMENT(ReplayDump)
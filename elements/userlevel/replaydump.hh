@@ -0,0 +1,240 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_REPLAYDUMP_HH
+#define CLICK_REPLAYDUMP_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/timer.hh>
+#include <click/etheraddress.hh>
+#include <click/fromfile.hh>
+CLICK_DECLS
+
+/*
+=c
+
+ReplayDump(FILENAME [, I<keywords> SPEED, LOOP, STOP, ACTIVE, BURST, IP_SRC_STEP, IP_DST_STEP, ETH_SRC, ETH_DST, MMAP])
+
+=s traces
+
+replays a tcpdump file with accurate timing
+
+=d
+
+Reads the tcpdump file FILENAME into memory during initialization, then
+pushes its packets out with the original inter-packet timing, scaled by
+SPEED.  ReplayDump is meant for traffic generation: the trace lives in one
+contiguous arena, so replay never touches the disk, and packets are paced
+with the CPU's cycle counter rather than with timers.
+
+ReplayDump calibrates the cycle counter against the system's steady clock at
+initialization.  This assumes a constant-rate cycle counter, as on modern
+x86 processors.  Where no cycle counter is available, ReplayDump paces with
+the steady clock instead.  Pacing is done by polling: while a packet is due
+within a couple of milliseconds, ReplayDump keeps its task scheduled, which
+keeps its thread busy.
+
+When ReplayDump falls behind, it emits packets back to back, up to BURST per
+task invocation, until it catches up.  The timing error handlers report how
+late packets were.
+
+Like FromDump, ReplayDump reads compressed files and accepts the MMAP
+keyword.
+
+Keyword arguments are:
+
+=over 8
+
+=item SPEED
+
+Real number.  Replay speed relative to the original trace: 2 replays twice as
+fast, 0.5 half as fast.  0 means no pacing at all; packets are emitted as fast
+as possible.  Default is 1.
+
+=item LOOP
+
+Integer.  Number of times to replay the trace.  0 means forever.  Default is
+1.  Each loop starts one average inter-packet gap after the previous loop's
+last packet.
+
+=item STOP
+
+Boolean.  If true, then ReplayDump will ask the router to stop after the last
+loop.  Default is false.
+
+=item ACTIVE
+
+Boolean.  If false, then ReplayDump will not emit packets (until the
+`C<active>' handler is written).  Default is true.
+
+=item BURST
+
+Integer.  The maximum number of packets to emit per task invocation.  Default
+is 32.
+
+=item IP_SRC_STEP, IP_DST_STEP
+
+IP addresses, treated as numbers.  On loop I<k>, counting from 0, ReplayDump
+adds I<k> times IP_SRC_STEP to each IPv4 packet's source address, and I<k>
+times IP_DST_STEP to its destination address, so every loop carries
+different flows.  IP, TCP, and UDP checksums are updated to match.  Default
+is 0.0.0.0, which leaves addresses alone.
+
+=item ETH_SRC, ETH_DST
+
+Ethernet addresses.  If given, and the trace has Ethernet encapsulation,
+ReplayDump rewrites every packet's Ethernet source or destination address.
+
+=back
+
+ReplayDump sets packets' timestamp annotations to their timestamps in the
+trace, and their extra length annotations to any additional length recorded
+in the trace.
+
+Only available in user-level processes.
+
+=h count read-only
+
+Returns the number of packets output so far.
+
+=h loops read-only
+
+Returns the number of complete loops so far.
+
+=h active read/write
+
+Value is a Boolean.  Setting it to true after a pause restarts the pacing
+clock, so the packets that would have been sent during the pause are not
+sent in a burst.  Once all LOOP loops are done, setting it to true has no
+effect; write C<reset> first.
+
+=h reset write-only
+
+Restarts the replay from the beginning of the first loop, and clears the
+counts and timing statistics.
+
+=h error_avg read-only
+
+Returns the average number of nanoseconds by which packets were emitted
+after their due times.
+
+=h error_max read-only
+
+Returns the largest number of nanoseconds by which a packet was emitted after
+its due time.
+
+=h requested_time read-only
+
+Returns the time in seconds the emitted packets should have taken, according
+to the trace and SPEED.
+
+=h elapsed_time read-only
+
+Returns the time in seconds the emitted packets actually took.
+
+=h cycles_per_sec read-only
+
+Returns the calibrated cycle counter frequency, or 0 if ReplayDump is using
+the steady clock.
+
+=e
+
+  ReplayDump(lab.pcap, SPEED 4, LOOP 100, IP_SRC_STEP 0.0.1.0)
+    -> Queue(1024) -> ToDevice(eth0);
+
+=a
+
+FromDump, FromDumps, RatedUnqueue */
+
+class ReplayDump : public Element { public:
+
+    ReplayDump() CLICK_COLD;
+    ~ReplayDump() CLICK_COLD;
+
+    const char *class_name() const		{ return "ReplayDump"; }
+    const char *port_count() const		{ return PORTS_0_1; }
+    const char *processing() const		{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    bool run_task(Task *);
+    void run_timer(Timer *);
+
+  private:
+
+    // Each packet in the arena is a Record followed by its data, padded to
+    // a multiple of 8 bytes.
+    struct Record {
+	uint64_t time;		// nanoseconds after the first packet
+	uint32_t caplen;
+	uint32_t len;
+	int32_t ip_off;		// offset of IPv4 header, or -1
+	uint32_t pad;
+    };
+
+    FromFile _ff;
+    unsigned char *_arena;
+    size_t _arena_len;
+    size_t _arena_cap;
+    uint32_t _npackets;
+    Timestamp _first_ts;
+    uint64_t _period;		// nanoseconds per loop
+    int _linktype;
+
+    double _speed;
+    uint32_t _loop_limit;
+    bool _stop;
+    bool _active;
+    int _burst;
+    uint32_t _ip_src_step;
+    uint32_t _ip_dst_step;
+    EtherAddress _eth_src;
+    EtherAddress _eth_dst;
+    bool _set_eth_src;
+    bool _set_eth_dst;
+
+    // pacing: now() counts cycles, or nanoseconds without a cycle counter
+    bool _use_cycles;
+    double _cycles_per_ns;
+    double _factor;		// now() units per trace nanosecond
+    click_cycles_t _start;	// now() when loop 0's first packet was due
+    bool _started;		// false until the first packet is due
+
+    size_t _pos;		// offset of next Record in the arena
+    uint32_t _loop;
+
+#if HAVE_INT64_TYPES
+    typedef uint64_t counter_t;
+#else
+    typedef uint32_t counter_t;
+#endif
+    counter_t _count;
+    uint64_t _error_sum;	// in now() units
+    uint64_t _error_max;
+    click_cycles_t _first_due;
+    click_cycles_t _last_due;
+    click_cycles_t _last_sent;
+
+    Task _task;
+    Timer _timer;
+
+    int load(ErrorHandler *errh);
+    unsigned char *grow(size_t len);
+    void calibrate();
+    inline click_cycles_t now() const;
+    inline click_cycles_t due(const Record *r) const;
+    bool finished() const {
+	return _loop_limit && _loop >= _loop_limit;
+    }
+    void restart();
+    Packet *make_packet(const Record *r);
+    double to_sec(uint64_t units) const;
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -32,6 +32,8 @@
 #include <click/packet_anno.hh>
 #include "fakepcap.hh"
 #include <click/userutils.hh>
+#include <fcntl.h>
+#include <unistd.h>
 #if HAVE_PCAP
 extern "C" {
 # include <pcap.h>
@@ -40,12 +42,24 @@ extern "C" {
 CLICK_DECLS
 
 ToDump::ToDump()
-    : _fp(0), _count(0), _task(this), _use_encap_from(0)
+    : _fp(0), _count(0), _drops(0), _blocks(0), _cur(0), _free(0), _nfree(0),
+      _full_head(0), _full_tail(&_full_head), _writer_stop(false),
+      _fd(-1), _fd_file(-1), _task(this), _use_encap_from(0)
 {
+    _writer_errno = 0;
+#if HAVE_USER_MULTITHREAD
+    pthread_mutex_init(&_lock, 0);
+    pthread_cond_init(&_cond, 0);
+    _writer_running = false;
+#endif
 }
 
 ToDump::~ToDump()
 {
+#if HAVE_USER_MULTITHREAD
+    pthread_mutex_destroy(&_lock);
+    pthread_cond_destroy(&_cond);
+#endif
 }
 
 int
@@ -64,6 +78,13 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
     bool per_node = false;
 #endif
 
+    String format = "pcap";
+    _async = _direct = false;
+    _block_size = 1048576;
+    _nblocks = 4;
+    _rotate_size = 0;
+    _rotate_interval = Timestamp();
+
     if (Args(conf, this, errh)
 	.read_mp("FILENAME", FilenameArg(), _filename)
 	.read_p("SNAPLEN", _snaplen)
@@ -72,6 +93,13 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("EXTRA_LENGTH", _extra_length)
 	.read("UNBUFFERED", _unbuffered)
         .read("NANO", _nano)
+	.read("FORMAT", WordArg(), format)
+	.read("ASYNC", _async)
+	.read("BLOCK_SIZE", _block_size)
+	.read("BLOCKS", _nblocks)
+	.read("DIRECT", _direct)
+	.read("ROTATE_SIZE", _rotate_size)
+	.read("ROTATE_INTERVAL", _rotate_interval)
 #if CLICK_NS
 	.read("PER_NODE", per_node)
 #endif
@@ -81,6 +109,26 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
     if (_snaplen == 0)
 	_snaplen = 0xFFFFFFFFU;
 
+    if (format == "pcap")
+	_pcapng = false;
+    else if (format == "pcapng")
+	_pcapng = true;
+    else
+	return errh->error("bad FORMAT");
+    if (_direct && !_async)
+	return errh->error("DIRECT requires ASYNC");
+    if (_async && _nblocks < 2)
+	return errh->error("BLOCKS must be at least 2");
+    if (_async && _block_size < 4096)
+	return errh->error("BLOCK_SIZE too small");
+    if (_direct)
+	_block_size = (_block_size + DIRECT_ALIGN - 1) & ~(DIRECT_ALIGN - 1);
+    if ((_rotate_size || _rotate_interval) && _filename == "-")
+	return errh->error("cannot rotate standard output");
+    if ((_async || _rotate_size || _rotate_interval)
+	&& compressed_filename(_filename) > 0)
+	return errh->error("ASYNC and rotation do not work with compressed files");
+
     if (use_encap_from && encap_type)
 	return errh->error("specify at most one of 'ENCAP' and 'USE_ENCAP_FROM'");
     else if (use_encap_from) {
@@ -116,7 +164,11 @@ ToDump::hotswap_element() const
     if (Element *e = Element::hotswap_element())
 	if (ToDump *td = (ToDump *)e->cast("ToDump"))
 	    if (td->_filename == _filename
-		&& td->_linktype == _linktype)
+		&& td->_linktype == _linktype
+		&& !td->_async && !_async
+		&& td->_pcapng == _pcapng
+		&& !td->_rotate_size && !_rotate_size
+		&& !td->_rotate_interval && !_rotate_interval)
 		return td;
     return 0;
 }
@@ -152,38 +204,33 @@ ToDump::initialize(ErrorHandler *errh)
 
     // skip initialization if we're hotswapping later
     if (!hotswap_element()) {
-
-	// prepare files
-	assert(!_fp);
-	if (_filename != "-") {
-	    if (compressed_filename(_filename) > 0)
-		_fp = open_compress_pipe(_filename, errh);
-	    else
-		_fp = fopen(_filename.c_str(), "wb");
-	    if (!_fp)
+	_file_index = 0;
+	if (_async) {
+	    _blocks = new Block[_nblocks]();
+	    for (uint32_t i = 0; i < _nblocks; i++) {
+		void *data;
+		if (posix_memalign(&data, DIRECT_ALIGN, _block_size) != 0)
+		    return errh->error("out of memory");
+		_blocks[i].data = (unsigned char *) data;
+		_blocks[i].next = _free;
+		_free = &_blocks[i];
+	    }
+	    _nfree = _nblocks;
+	    if (open_fd(0) < 0)
 		return errh->error("%s: %s", _filename.c_str(), strerror(errno));
-	} else {
-	    _fp = stdout;
-	    _filename = "<stdout>";
-	}
-
-	if (_unbuffered)
-	    setvbuf(_fp, (char *) 0, _IONBF, 0);
-
-	struct fake_pcap_file_header h;
-
-	h.magic = _nano ? FAKE_PCAP_MAGIC_NANO : FAKE_PCAP_MAGIC;
-	h.version_major = FAKE_PCAP_VERSION_MAJOR;
-	h.version_minor = FAKE_PCAP_VERSION_MINOR;
-
-	h.thiszone = 0;		// timestamps are in GMT
-	h.sigfigs = 0;		// XXX accuracy of timestamps?
-	h.snaplen = _snaplen;
-	h.linktype = _linktype;
-
-	size_t wrote_header = fwrite(&h, sizeof(h), 1, _fp);
-	if (wrote_header != 1)
-	    return errh->error("%s: unable to write file header", _filename.c_str());
+	    unsigned char h[64];
+	    int hlen = file_header(h);
+	    append(h, hlen);
+	    _file_bytes = hlen;
+	    _header_bytes = hlen;
+#if HAVE_USER_MULTITHREAD
+	    int err = pthread_create(&_writer, 0, writer_thread, this);
+	    if (err != 0)
+		return errh->error("cannot start writer thread: %s", strerror(err));
+	    _writer_running = true;
+#endif
+	} else if (open_file(0, errh) < 0)
+	    return -1;
     }
 
     if (input_is_pull(0) && noutputs() == 0) {
@@ -208,34 +255,399 @@ ToDump::cleanup(CleanupStage)
     if (_fp && _fp != stdout)
 	fclose(_fp);
     _fp = 0;
+
+    if (_blocks) {
+	if (_cur && _cur->length)
+	    seal();
+#if HAVE_USER_MULTITHREAD
+	if (_writer_running) {
+	    lock();
+	    _writer_stop = true;
+	    pthread_cond_signal(&_cond);
+	    unlock();
+	    pthread_join(_writer, 0);
+	    _writer_running = false;
+	}
+#endif
+	close_fd();
+	for (uint32_t i = 0; i < _nblocks; i++)
+	    free(_blocks[i].data);
+	delete[] _blocks;
+	_blocks = 0;
+    }
+}
+
+String
+ToDump::file_name(int index) const
+{
+    if (index == 0)
+	return _filename;
+    else
+	return _filename + "." + String(index);
+}
+
+int
+ToDump::file_header(unsigned char *buf) const
+{
+    if (!_pcapng) {
+	struct fake_pcap_file_header h;
+	h.magic = _nano ? FAKE_PCAP_MAGIC_NANO : FAKE_PCAP_MAGIC;
+	h.version_major = FAKE_PCAP_VERSION_MAJOR;
+	h.version_minor = FAKE_PCAP_VERSION_MINOR;
+	h.thiszone = 0;		// timestamps are in GMT
+	h.sigfigs = 0;		// XXX accuracy of timestamps?
+	h.snaplen = _snaplen;
+	h.linktype = _linktype;
+	memcpy(buf, &h, sizeof(h));
+	return sizeof(h);
+    }
+
+    // section header block, then one interface description block; fields
+    // are in host byte order, which the byte-order magic records
+    uint32_t *w = (uint32_t *) buf;
+    w[0] = FAKE_PCAPNG_SHB;
+    w[1] = 28;
+    w[2] = FAKE_PCAPNG_BYTE_ORDER_MAGIC;
+    uint16_t version[2] = { 1, 0 };	// major, minor
+    memcpy(&w[3], version, 4);
+    w[4] = w[5] = 0xFFFFFFFFU;	// section length unknown
+    w[6] = 28;
+    w += 7;
+    int idblen = _nano ? 32 : 20;
+    w[0] = FAKE_PCAPNG_IDB;
+    w[1] = idblen;
+    uint16_t linktype[2] = { (uint16_t) _linktype, 0 };	// linktype, reserved
+    memcpy(&w[2], linktype, 4);
+    w[3] = (_snaplen == 0xFFFFFFFFU ? 0 : _snaplen);
+    if (_nano) {
+	uint16_t opt[2] = { FAKE_PCAPNG_OPT_IF_TSRESOL, 1 };
+	memcpy(&w[4], opt, 4);
+	uint8_t tsresol[4] = { 9, 0, 0, 0 };	// 10^-9 seconds, then padding
+	memcpy(&w[5], tsresol, 4);
+	w[6] = 0;		// end of options
+	w[7] = idblen;
+    } else
+	w[4] = idblen;
+    return 28 + idblen;
+}
+
+int
+ToDump::open_file(int index, ErrorHandler *errh)
+{
+    assert(!_fp);
+    String filename = file_name(index);
+    if (filename != "-") {
+	if (compressed_filename(filename) > 0)
+	    _fp = open_compress_pipe(filename, errh);
+	else
+	    _fp = fopen(filename.c_str(), "wb");
+	if (!_fp)
+	    return errh->error("%s: %s", filename.c_str(), strerror(errno));
+    } else {
+	_fp = stdout;
+	_filename = "<stdout>";
+    }
+
+    if (_unbuffered)
+	setvbuf(_fp, (char *) 0, _IONBF, 0);
+
+    unsigned char h[64];
+    int hlen = file_header(h);
+    if (fwrite(h, hlen, 1, _fp) != 1)
+	return errh->error("%s: unable to write file header", filename.c_str());
+    _file_index = index;
+    _file_bytes = hlen;
+    _header_bytes = hlen;
+    return 0;
 }
 
 void
-ToDump::write_packet(Packet *p)
+ToDump::rotate()
+{
+    if (_async) {
+	if (_cur)
+	    seal();
+	_file_index++;
+	unsigned char h[64];
+	int hlen = file_header(h);
+	append(h, hlen);
+	_file_bytes = hlen;
+	_header_bytes = hlen;
+    } else {
+	fclose(_fp);
+	_fp = 0;
+	if (open_file(_file_index + 1, ErrorHandler::default_handler()) < 0)
+	    _active = false;
+    }
+}
+
+
+// ASYNC support
+
+inline void
+ToDump::lock()
+{
+#if HAVE_USER_MULTITHREAD
+    pthread_mutex_lock(&_lock);
+#endif
+}
+
+inline void
+ToDump::unlock()
+{
+#if HAVE_USER_MULTITHREAD
+    pthread_mutex_unlock(&_lock);
+#endif
+}
+
+/** @brief Return true iff @a need more bytes fit in the current block and the
+    free blocks.  Only the Click thread takes blocks from the free list, so
+    the answer cannot become false before the bytes are appended. */
+bool
+ToDump::reserve(uint32_t need)
 {
-    struct fake_pcap_pkthdr ph;
+    uint32_t avail = _cur ? _block_size - _cur->length : 0;
+    if (need <= avail)
+	return true;
+    lock();
+    uint32_t nfree = _nfree;
+    unlock();
+    return need - avail <= (uint64_t) nfree * _block_size;
+}
+
+void
+ToDump::append(const void *data, uint32_t len)
+{
+    const unsigned char *d = (const unsigned char *) data;
+    while (len) {
+	if (!_cur) {
+	    lock();
+	    _cur = _free;
+	    _free = _cur->next;
+	    _nfree--;
+	    unlock();
+	    _cur->length = 0;
+	    _cur->file = _file_index;
+	}
+	uint32_t n = _block_size - _cur->length;
+	if (n > len)
+	    n = len;
+	memcpy(_cur->data + _cur->length, d, n);
+	_cur->length += n;
+	d += n;
+	len -= n;
+	if (_cur->length == _block_size)
+	    seal();
+    }
+}
 
+/** @brief Hand the current block to the writer. */
+void
+ToDump::seal()
+{
+    Block *b = _cur;
+    _cur = 0;
+    b->next = 0;
+#if HAVE_USER_MULTITHREAD
+    lock();
+    *_full_tail = b;
+    _full_tail = &b->next;
+    pthread_cond_signal(&_cond);
+    unlock();
+#else
+    write_block(b);
+    b->next = _free;
+    _free = b;
+    _nfree++;
+#endif
+}
+
+int
+ToDump::open_fd(int index)
+{
+    if (_filename == "-") {
+	_fd = STDOUT_FILENO;
+	_filename = "<stdout>";
+    } else {
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+	if (_direct)
+	    flags |= O_DIRECT;
+#endif
+	_fd = open(file_name(index).c_str(), flags, 0666);
+    }
+    _fd_file = index;
+    return _fd;
+}
+
+void
+ToDump::close_fd()
+{
+    if (_fd >= 0 && _fd != STDOUT_FILENO)
+	close(_fd);
+    _fd = -1;
+}
+
+void
+ToDump::write_block(Block *b)
+{
+    if (b->file != _fd_file) {
+	close_fd();
+	if (open_fd(b->file) < 0)
+	    _writer_errno.compare_swap(0, errno);
+    }
+    if (_fd < 0)
+	return;
+#ifdef O_DIRECT
+    // Only a file's last block can be partial; O_DIRECT cannot write it.
+    if (_direct && b->length % DIRECT_ALIGN)
+	fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) & ~O_DIRECT);
+#endif
+    const unsigned char *d = b->data;
+    uint32_t len = b->length;
+    while (len) {
+	ssize_t w = write(_fd, d, len);
+	if (w < 0 && errno == EINTR)
+	    continue;
+	else if (w <= 0) {
+	    _writer_errno.compare_swap(0, w < 0 ? errno : EIO);
+	    close_fd();
+	    return;
+	}
+	d += w;
+	len -= w;
+    }
+}
+
+#if HAVE_USER_MULTITHREAD
+void *
+ToDump::writer_thread(void *arg)
+{
+    ToDump *td = static_cast<ToDump *>(arg);
+    td->lock();
+    while (1) {
+	while (!td->_full_head && !td->_writer_stop)
+	    pthread_cond_wait(&td->_cond, &td->_lock);
+	Block *b = td->_full_head;
+	if (!b)
+	    break;
+	if (!(td->_full_head = b->next))
+	    td->_full_tail = &td->_full_head;
+	td->unlock();
+
+	td->write_block(b);
+
+	td->lock();
+	b->next = td->_free;
+	td->_free = b;
+	td->_nfree++;
+    }
+    td->unlock();
+    return 0;
+}
+#endif
+
+void
+ToDump::write_packet(Packet *p)
+{
     Timestamp ts = p->timestamp_anno();
     if (!ts)
         ts = Timestamp::now();
-    ph.ts.tv.tv_sec = ts.sec();
-    ph.ts.tv.tv_usec = _nano ? ts.nsec() : ts.usec();
 
-    unsigned to_write = p->length();
-    ph.len = to_write + (_extra_length ? EXTRA_LENGTH_ANNO(p) : 0);
+    uint32_t to_write = p->length();
+    uint32_t len = to_write + (_extra_length ? EXTRA_LENGTH_ANNO(p) : 0);
     if (_snaplen && to_write > _snaplen)
 	to_write = _snaplen;
-    ph.caplen = to_write;
+
+    // record header, and for pcapng, padding and trailing length
+    union {
+	struct fake_pcap_pkthdr ph;
+	uint32_t w[7];
+    } hdr;
+    uint32_t hlen, tail[2], pad = 0, tlen = 0;
+    if (!_pcapng) {
+	hdr.ph.ts.tv.tv_sec = ts.sec();
+	hdr.ph.ts.tv.tv_usec = _nano ? ts.nsec() : ts.usec();
+	hdr.ph.caplen = to_write;
+	hdr.ph.len = len;
+	hlen = sizeof(hdr.ph);
+    } else {
+	pad = (4 - (to_write & 3)) & 3;
+	uint64_t t = (uint64_t) ts.sec() * (_nano ? 1000000000 : 1000000)
+	    + (_nano ? ts.nsec() : ts.usec());
+	hdr.w[0] = FAKE_PCAPNG_EPB;
+	hdr.w[1] = 32 + to_write + pad;
+	hdr.w[2] = 0;		// interface
+	hdr.w[3] = t >> 32;
+	hdr.w[4] = t;
+	hdr.w[5] = to_write;
+	hdr.w[6] = len;
+	hlen = 28;
+	tail[0] = 0;
+	tail[1] = hdr.w[1];
+	tlen = pad + 4;
+    }
+    uint32_t need = hlen + to_write + tlen;
+
+    bool rotate_now = false, interval_due = false;
+    if (_rotate_size && _file_bytes + need > _rotate_size
+	&& _file_bytes > _header_bytes)
+	rotate_now = true;
+    // _rotate_at advances only when the rotation happens, so a dropped
+    // packet leaves the rotation pending for the next one
+    if (_rotate_interval) {
+	if (!_rotate_at)
+	    _rotate_at = ts + _rotate_interval;
+	else if (ts >= _rotate_at)
+	    rotate_now = interval_due = true;
+    }
+
+    if (_async) {
+	if (int e = _writer_errno.value()) {
+	    _active = false;
+	    click_chatter("ToDump(%s): %s", _filename.c_str(), strerror(e));
+	    return;
+	}
+	// a new file's header must start a new block
+	uint32_t extra = (rotate_now ? (_cur ? _block_size : 0) + 64 : 0);
+	if (!reserve(need + extra)) {
+	    _drops++;
+	    return;
+	}
+	if (rotate_now) {
+	    rotate();
+	    if (interval_due)
+		_rotate_at = ts + _rotate_interval;
+	}
+	append(&hdr, hlen);
+	append(p->data(), to_write);
+	if (tlen)
+	    append((const unsigned char *) tail + 4 - pad, tlen);
+	_file_bytes += need;
+	_count++;
+	return;
+    }
+
+    if (rotate_now) {
+	rotate();
+	if (interval_due)
+	    _rotate_at = ts + _rotate_interval;
+	if (!_active)
+	    return;
+    }
 
     // XXX writing to pipe?
-    if (fwrite(&ph, sizeof(ph), 1, _fp) == 0
-	|| (to_write > 0 && fwrite(p->data(), 1, to_write, _fp) == 0)) {
+    if (fwrite(&hdr, hlen, 1, _fp) == 0
+	|| (to_write > 0 && fwrite(p->data(), 1, to_write, _fp) == 0)
+	|| (tlen && fwrite((const unsigned char *) tail + 4 - pad, 1, tlen, _fp) == 0)) {
 	if (errno != EAGAIN) {
 	    _active = false;
 	    click_chatter("ToDump(%s): %s", _filename.c_str(), strerror(errno));
 	}
-    } else
+    } else {
+	_file_bytes += need;
 	_count++;
+    }
 }
 
 void
@@ -270,7 +682,7 @@ ToDump::run_task(Task *)
     return p != 0;
 }
 
-enum { H_FILENAME = 0, H_COUNT = 1, H_RESET_COUNTS = 2 };
+enum { H_FILENAME = 0, H_COUNT = 1, H_RESET_COUNTS = 2, H_DROPS = 3 };
 
 String
 ToDump::read_handler(Element *e, void *thunk)
@@ -281,6 +693,8 @@ ToDump::read_handler(Element *e, void *thunk)
 	return td->_filename;
     case H_COUNT:
 	return String(td->_count);
+    case H_DROPS:
+	return String(td->_drops);
     default:
 	return "<error>";
     }
@@ -290,7 +704,7 @@ int
 ToDump::write_handler(const String &, Element *e, void *, ErrorHandler *)
 {
     ToDump *td = static_cast<ToDump *>(e);
-    td->_count = 0;
+    td->_count = td->_drops = 0;
     return 0;
 }
 
@@ -299,6 +713,7 @@ ToDump::add_handlers()
 {
     add_read_handler("filename", read_handler, H_FILENAME);
     add_read_handler("count", read_handler, H_COUNT);
+    add_read_handler("drops", read_handler, H_DROPS);
     add_write_handler("reset_counts", write_handler, H_RESET_COUNTS, Handler::BUTTON);
     if (input_is_pull(0) && noutputs() == 0)
 	add_task_handlers(&_task);
@@ -6,12 +6,16 @@
 #include <click/task.hh>
 #include <click/notifier.hh>
 #include <stdio.h>
+#if HAVE_USER_MULTITHREAD
+# include <pthread.h>
+#endif
 CLICK_DECLS
 
 /*
 =c
 
-ToDump(FILENAME [, I<keywords> SNAPLEN, ENCAP, USE_ENCAP_FROM, EXTRA_LENGTH, NANO])
+ToDump(FILENAME [, I<keywords> SNAPLEN, ENCAP, USE_ENCAP_FROM, EXTRA_LENGTH, NANO,
+FORMAT, ASYNC, BLOCK_SIZE, BLOCKS, DIRECT, ROTATE_SIZE, ROTATE_INTERVAL])
 
 =s traces
 
@@ -71,8 +75,53 @@ false.
 Boolean. Set to true to write nanosecond-precision timestamps. Default depends
 on the version of tcpdump/pcap on the machine.
 
+=item FORMAT
+
+Either C<pcap> or C<pcapng>.  The C<pcapng> format writes one section with one
+interface, and an enhanced packet block per packet.  Default is C<pcap>.
+
+=item ASYNC
+
+Boolean.  If true, ToDump copies packets into large memory blocks and a
+separate writer thread writes each block to the file as it fills, so a slow
+disk never stalls packet processing.  When every block is full and waiting to
+be written, ToDump drops packets from the dump, rather than waiting, and
+counts them in the C<drops> handler; the packets themselves are still emitted.
+ASYNC does not work with compressed files.  The writer thread requires Click
+built with multithreading support; without it, blocks are written from the
+Click thread as they fill.  Default is false.
+
+=item BLOCK_SIZE
+
+Integer.  The size of each ASYNC block in bytes.  Default is 1048576.
+
+=item BLOCKS
+
+Integer.  The number of ASYNC blocks.  At least two are needed: one being
+filled while another is written.  Default is 4.
+
+=item DIRECT
+
+Boolean.  If true, ASYNC blocks are written with O_DIRECT, bypassing the page
+cache.  BLOCK_SIZE is then rounded up to a multiple of 4096.  Not every file
+system supports O_DIRECT.  Default is false.
+
+=item ROTATE_SIZE
+
+Integer.  If nonzero, start a new file once the current file would grow past
+this many bytes.  Default is 0.
+
+=item ROTATE_INTERVAL
+
+Time.  If nonzero, start a new file when a packet's timestamp is at least this
+long after the current file's first packet.  Default is 0.
+
 =back
 
+When rotating, the first file is FILENAME, and later files are FILENAME.1,
+FILENAME.2, and so forth.  Each file is a complete dump with its own header.
+Rotation does not work with compressed files or standard output.
+
 This element is only available at user level.
 
 =n
@@ -83,9 +132,14 @@ ToDump stores packets' true length annotations when available.
 
 Returns the number of packets emitted so far.
 
+=h drops read-only
+
+Returns the number of packets left out of the dump because every ASYNC block
+was waiting to be written.
+
 =h reset_counts write-only
 
-Resets "count" to 0.
+Resets "count" and "drops" to 0.
 
 =h filename read-only
 
@@ -127,6 +181,7 @@ class ToDump : public Element { public:
     bool _extra_length;
     bool _unbuffered;
     bool _nano;
+    bool _pcapng;
 
 #if HAVE_INT64_TYPES
     typedef uint64_t counter_t;
@@ -134,6 +189,50 @@ class ToDump : public Element { public:
     typedef uint32_t counter_t;
 #endif
     counter_t _count;
+    counter_t _drops;
+
+    // Rotation
+    uint64_t _rotate_size;
+    Timestamp _rotate_interval;
+    Timestamp _rotate_at;
+    uint64_t _file_bytes;	// bytes in the current file
+    uint32_t _header_bytes;	// bytes in each file's header
+    int _file_index;
+
+    // ASYNC mode: full blocks go from the Click thread to the writer, which
+    // returns them to the free list once written.  Every block but the last
+    // of each file is full, which keeps O_DIRECT writes aligned.
+    struct Block {
+	unsigned char *data;
+	uint32_t length;
+	int file;		// index of the file this block belongs to
+	Block *next;
+    };
+    enum { DIRECT_ALIGN = 4096 };
+    bool _async;
+    bool _direct;
+    uint32_t _block_size;
+    uint32_t _nblocks;
+    Block *_blocks;
+    Block *_cur;		// block being filled, or null
+
+    // shared with the writer, protected by _lock
+    Block *_free;
+    uint32_t _nfree;
+    Block *_full_head;
+    Block **_full_tail;
+    bool _writer_stop;
+    atomic_uint32_t _writer_errno;	// first write error, set once
+#if HAVE_USER_MULTITHREAD
+    pthread_mutex_t _lock;
+    pthread_cond_t _cond;
+    pthread_t _writer;
+    bool _writer_running;
+#endif
+
+    // used only by the writer
+    int _fd;
+    int _fd_file;
 
     Task _task;
     NotifierSignal _signal;
@@ -143,6 +242,21 @@ class ToDump : public Element { public:
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
     void write_packet(Packet *);
 
+    String file_name(int index) const;
+    int file_header(unsigned char *buf) const;
+    int open_file(int index, ErrorHandler *errh);
+    void rotate();
+
+    void lock();
+    void unlock();
+    bool reserve(uint32_t need);
+    void append(const void *data, uint32_t len);
+    void seal();
+    void write_block(Block *b);
+    int open_fd(int index);
+    void close_fd();
+    static void *writer_thread(void *);
+
 };
 
 CLICK_ENDDECLS
@@ -27,6 +27,7 @@ class FromFile { public:
     void set_lineno(int lineno)		{ _lineno = lineno; }
 
     off_t file_pos() const		{ return _file_offset + _pos; }
+    off_t file_size() const;
 
     int configure_keywords(Vector<String>& conf, Element* e, ErrorHandler* errh);
     int set_data(const String& data, ErrorHandler* errh);
@@ -8,12 +8,12 @@ CLICK_DECLS
 
 class HashAllocator { public:
 
-    HashAllocator(size_t size);
+    HashAllocator(size_t size, size_t align = 0);
     ~HashAllocator();
 
     inline void increase_size(size_t new_size) {
 	assert(!_free && !_buffer && new_size >= _size);
-	_size = new_size;
+	_size = align_size(new_size, _align);
     }
 
     inline void *allocate();
@@ -46,6 +46,11 @@ class HashAllocator { public:
     link *_free;
     buffer *_buffer;
     size_t _size;
+    size_t _align;
+
+    static inline size_t align_size(size_t size, size_t align) {
+	return align ? (size + align - 1) & ~(align - 1) : size;
+    }
 
     void *hard_allocate();
 
@@ -55,11 +60,11 @@ class HashAllocator { public:
 };
 
 
-template <size_t size>
+template <size_t size, size_t align = 0>
 class SizedHashAllocator : public HashAllocator { public:
 
     SizedHashAllocator()
-	: HashAllocator(size) {
+	: HashAllocator(size, align) {
     }
 
 };
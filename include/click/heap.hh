@@ -203,6 +203,57 @@ inline void pop_heap(iterator_type begin, iterator_type end,
     pop_heap(begin, end, comp, do_nothing<iterator_type, iterator_type>());
 }
 
+/** @brief Rearrange a sequence into a heap.
+ * @param begin begin random-access iterator
+ * @param end end random-access iterator
+ * @param comp compare function object, such as less<>
+ * @param place placement function object, defaults to do_nothing<>
+ * @post [@a begin, @a end) is a heap
+ *
+ * This function rearranges the elements in [@a begin, @a end) to be a heap
+ * in linear time.  It is faster than calling push_heap once per element
+ * when building a large heap from scratch.
+ *
+ * The comparison function @a comp defines the heap order.
+ *
+ * The placement function @a place is called at least once for every
+ * element, the last time with an iterator pointing to the element's final
+ * place.
+ *
+ * @sa push_heap, change_heap */
+template <typename iterator_type, typename compare_type, typename place_type>
+void make_heap(iterator_type begin, iterator_type end,
+	       compare_type comp, place_type place)
+{
+    size_t size = end - begin;
+    for (size_t i = 0; i < size; ++i)
+	place(begin, begin + i);
+    for (size_t start = size / 2; start > 0; --start) {
+	size_t i = start - 1;
+	while (1) {
+	    size_t smallest = i, trial = i*2 + 1;
+	    if (trial < size && comp(begin[trial], begin[smallest]))
+		smallest = trial;
+	    if (trial + 1 < size && comp(begin[trial + 1], begin[smallest]))
+		smallest = trial + 1;
+	    if (smallest == i)
+		break;
+	    click_swap(begin[i], begin[smallest]);
+	    place(begin, begin + i);
+	    place(begin, begin + smallest);
+	    i = smallest;
+	}
+    }
+}
+
+/** @overload */
+template <typename iterator_type, typename compare_type>
+inline void make_heap(iterator_type begin, iterator_type end,
+		      compare_type comp)
+{
+    make_heap(begin, end, comp, do_nothing<iterator_type, iterator_type>());
+}
+
 
 
 /** @brief Add an element to a d-ary heap.
@@ -76,8 +76,8 @@ String shell_command_output_string(String command_line, const String &command_st
  * @param buf buffer
  * @param len number of characters in @a buf, should be >= 10
  *
- * Checks @a buf for signatures corresponding to zip, gzip, and bzip2
- * compressed data, returning true iff a signature matches.  @a len can be any
+ * Checks @a buf for signatures corresponding to zip, gzip, bzip2, xz, zstd,
+ * and lz4 compressed data, returning true iff a signature matches.  @a len can be any
  * number, but should be relatively large or compression might not be
  * detected.  Currently it must be at least 10 to detect bzip2 compression. */
 bool compressed_data(const unsigned char *buf, int len);
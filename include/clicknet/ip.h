@@ -182,6 +182,39 @@ click_update_in_cksum(uint16_t *csum, uint16_t old_hw, uint16_t new_hw)
     *csum = ~(sum + (sum >> 16));
 }
 
+/** @brief Incrementally adjust an Internet checksum for a changed word.
+ * @param[in, out] csum points to checksum
+ * @param old_w old 32-bit word
+ * @param new_w new 32-bit word
+ *
+ * Equivalent to calling click_update_in_cksum() on both halfwords of a
+ * 32-bit field, such as an IP address or TCP sequence number, but folds
+ * carries only once.  The words may be in either byte order, as long as
+ * both use the same one. */
+static inline void
+click_update_in_cksum32(uint16_t *csum, uint32_t old_w, uint32_t new_w)
+{
+    uint32_t sum = (~*csum & 0xFFFF) + (~old_w & 0xFFFF) + (~old_w >> 16)
+	+ (new_w & 0xFFFF) + (new_w >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    *csum = ~(sum + (sum >> 16));
+}
+
+/** @brief Apply a precomputed Internet checksum delta.
+ * @param[in, out] csum points to checksum
+ * @param delta checksum delta
+ *
+ * A delta is the one's-complement sum of ~old + new over a set of changed
+ * halfwords.  Rewriters that apply the same change to many packets compute
+ * the delta once and apply it with this function.  Updating a zero checksum
+ * with click_update_in_cksum() or click_update_in_cksum32() yields ~delta;
+ * passing that complemented value instead undoes the change. */
+static inline void
+click_update_in_cksum_delta(uint16_t *csum, uint16_t delta)
+{
+    click_update_in_cksum(csum, 0, delta);
+}
+
 /** @brief Potentially fix a zero-valued Internet checksum.
  * @param[in, out] csum points to checksum
  * @param x data to checksum
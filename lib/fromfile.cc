@@ -316,7 +316,7 @@ int
 FromFile::seek(off_t want, ErrorHandler* errh)
 {
     if (want >= _file_offset && want < (off_t) (_file_offset + _len)) {
-	_pos = want;
+	_pos = want - _file_offset;
 	return 0;
     }
 
@@ -574,13 +574,23 @@ FromFile::filename_handler(Element *e, void *thunk)
     return fd->print_filename();
 }
 
+off_t
+FromFile::file_size() const
+{
+    struct stat s;
+    if (_fd >= 0 && fstat(_fd, &s) >= 0 && S_ISREG(s.st_mode))
+	return s.st_size;
+    else
+	return -1;
+}
+
 String
 FromFile::filesize_handler(Element *e, void *thunk)
 {
     FromFile *fd = reinterpret_cast<FromFile *>((uint8_t *)e + (intptr_t)thunk);
-    struct stat s;
-    if (fd->_fd >= 0 && fstat(fd->_fd, &s) >= 0 && S_ISREG(s.st_mode))
-	return String(s.st_size);
+    off_t size = fd->file_size();
+    if (size >= 0)
+	return String(size);
     else
 	return "-";
 }
@@ -22,9 +22,10 @@
 #include <click/integers.hh>
 CLICK_DECLS
 
-HashAllocator::HashAllocator(size_t size)
-    : _free(0), _buffer(0), _size(size)
+HashAllocator::HashAllocator(size_t size, size_t align)
+    : _free(0), _buffer(0), _size(align_size(size, align)), _align(align)
 {
+    assert((align & (align - 1)) == 0);
 #ifdef VALGRIND_CREATE_MEMPOOL
     VALGRIND_CREATE_MEMPOOL(this, 0, 0);
 #endif
@@ -57,13 +58,19 @@ void *HashAllocator::hard_allocate()
     if (nelements < min_nelements)
 	nelements = min_nelements;
 
-    buffer *b = reinterpret_cast<buffer *>(new char[sizeof(buffer) + _size * nelements]);
+    // With an alignment, the first element starts at the first aligned
+    // address after the header; _size is a multiple of _align, so the rest
+    // follow.
+    size_t slop = _align ? _align - 1 : 0;
+    buffer *b = reinterpret_cast<buffer *>(new char[sizeof(buffer) + _size * nelements + slop]);
     if (b) {
+	uintptr_t first = reinterpret_cast<uintptr_t>(b) + sizeof(buffer);
+	size_t offset = sizeof(buffer) + ((-first) & slop);
 	b->next = _buffer;
 	_buffer = b;
-	b->maxpos = sizeof(buffer) + _size * nelements;
-	b->pos = sizeof(buffer) + _size;
-	void *data = reinterpret_cast<char *>(_buffer) + sizeof(buffer);
+	b->maxpos = offset + _size * nelements;
+	b->pos = offset + _size;
+	void *data = reinterpret_cast<char *>(_buffer) + offset;
 #ifdef VALGRIND_MEMPOOL_ALLOC
 	VALGRIND_MEMPOOL_ALLOC(this, data, _size);
 #endif
@@ -78,6 +85,10 @@ void HashAllocator::swap(HashAllocator &x)
     _size = x._size;
     x._size = xsize;
 
+    size_t xalign = _align;
+    _align = x._align;
+    x._align = xalign;
+
     link *xfree = _free;
     _free = x._free;
     x._free = xfree;
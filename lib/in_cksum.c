@@ -22,15 +22,29 @@ click_in_cksum(const unsigned char *addr, int len)
 {
     int nleft = len;
     const uint16_t *w = (const uint16_t *)addr;
-    uint32_t sum = 0;
+    const uint32_t *dw;
+    uint64_t sum = 0;
     uint16_t answer = 0;
 
     /*
-     * Our algorithm is simple, using a 32 bit accumulator (sum), we add
-     * sequential 16 bit words to it, and at the end, fold back all the
-     * carry bits from the top 16 bits into the lower 16 bits.
+     * Add 32-bit words into a 64-bit accumulator, eight words per loop
+     * iteration, and fold the carries back in at the end.  Since
+     * 2^16 == 1 modulo 0xFFFF, this yields the same one's-complement sum
+     * as adding 16-bit words, at a quarter of the additions; the unrolled
+     * loop has no carry dependencies, so compilers can vectorize it.
      */
-    while (nleft > 1)  {
+    if (((uintptr_t) w & 2) && nleft > 1) {
+	sum += *w++;
+	nleft -= 2;
+    }
+    dw = (const uint32_t *)w;
+    for (; nleft >= 32; nleft -= 32, dw += 8)
+	sum += (uint64_t) dw[0] + dw[1] + dw[2] + dw[3]
+	    + dw[4] + dw[5] + dw[6] + dw[7];
+    for (; nleft >= 4; nleft -= 4)
+	sum += *dw++;
+    w = (const uint16_t *)dw;
+    if (nleft > 1) {
 	sum += *w++;
 	nleft -= 2;
     }
@@ -41,7 +55,9 @@ click_in_cksum(const unsigned char *addr, int len)
 	sum += answer;
     }
 
-    /* add back carry outs from top 16 bits to low 16 bits */
+    /* fold 64 bits down to 16, adding back carry outs each time */
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
     sum = (sum & 0xffff) + (sum >> 16);
     sum += (sum >> 16);
     /* guaranteed now that the lower 16 bits of sum are correct */
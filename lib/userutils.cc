@@ -709,6 +709,13 @@ compressed_data(const unsigned char *buf, int len)
 	if (len >= 10 && memcmp(buf + 4, "1AY&SY", 6) == 0)
 	    return true;
     }
+    // check for xz, zstd, and lz4 signatures
+    if (len >= 6 && memcmp(buf, "\3757zXZ\0", 6) == 0)
+	return true;
+    if (len >= 4 && memcmp(buf, "\050\265\057\375", 4) == 0)
+	return true;
+    if (len >= 4 && memcmp(buf, "\004\042\115\030", 4) == 0)
+	return true;
     // otherwise unknown
     return false;
 }
@@ -720,6 +727,12 @@ open_uncompress_pipe(const String &filename, const unsigned char *buf, int len,
     StringAccum cmd;
     if (buf[0] == 'B')
 	cmd << "bzcat";
+    else if (buf[0] == 0375)
+	cmd << "xz -dc";
+    else if (buf[0] == 050)
+	cmd << "zstd -dc";
+    else if (buf[0] == 004)
+	cmd << "lz4 -dc";
     else if (access("/usr/bin/gzcat", X_OK) >= 0)
 	cmd << "/usr/bin/gzcat";
     else
@@ -734,7 +747,8 @@ open_uncompress_pipe(const String &filename, const unsigned char *buf, int len,
 }
 
 enum {
-    COMP_COMPRESS = 1, COMP_GZIP = 2, COMP_BZ2 = 3
+    COMP_COMPRESS = 1, COMP_GZIP = 2, COMP_BZ2 = 3, COMP_XZ = 4,
+    COMP_ZSTD = 5, COMP_LZ4 = 6
 };
 
 int
@@ -746,6 +760,12 @@ compressed_filename(const String &filename)
 	return COMP_GZIP;
     else if (filename.length() >= 4 && memcmp(filename.end() - 4, ".bz2", 4) == 0)
 	return COMP_BZ2;
+    else if (filename.length() >= 3 && memcmp(filename.end() - 3, ".xz", 3) == 0)
+	return COMP_XZ;
+    else if (filename.length() >= 4 && memcmp(filename.end() - 4, ".zst", 4) == 0)
+	return COMP_ZSTD;
+    else if (filename.length() >= 4 && memcmp(filename.end() - 4, ".lz4", 4) == 0)
+	return COMP_LZ4;
     else
 	return 0;
 }
@@ -765,6 +785,15 @@ open_compress_pipe(const String &filename, ErrorHandler *errh)
       case COMP_BZ2:
 	cmd << "bzip2";
 	break;
+      case COMP_XZ:
+	cmd << "xz";
+	break;
+      case COMP_ZSTD:
+	cmd << "zstd -q";
+	break;
+      case COMP_LZ4:
+	cmd << "lz4 -q";
+	break;
       default:
 	errh->error("%s: unknown compression extension", filename.c_str());
 	errno = EINVAL;